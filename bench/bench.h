@@ -0,0 +1,117 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Common definitions for the benchmark suites.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef MPB_BENCH_H
+#define MPB_BENCH_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <mprompt.h>
+#include <mpeff.h>
+
+#define MPB_UNUSED(x)  (void)(x)
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define mpb_decl_noinline  __declspec(noinline)
+#else
+#define mpb_decl_noinline  __attribute__((noinline))
+#endif
+
+
+/*-----------------------------------------------------------------
+  Options
+-----------------------------------------------------------------*/
+
+typedef struct mpb_options_s {
+  const char* filter;       // only run benchmarks whose name contains this
+  long        samples;      // number of timed samples per benchmark
+  long        sample_ms;    // target duration of a sample (used to calibrate the operation count)
+  const char* config;       // name of the `mp_config_t` variant we run under
+  long        threads;      // maximum number of threads for the `threads`, `sched`, and `sync` suites (0 for the CPU count)
+  const char* counts;       // comma separated counts of suspended prompts for the `memory` suite
+  long        depth;        // recursion depth of each suspended prompt in the `memory` suite
+} mpb_options_t;
+
+extern mpb_options_t mpb_options;
+
+// Is a benchmark selected by the filter?
+bool mpb_selected(const char* suite, const char* name);
+
+
+/*-----------------------------------------------------------------
+  Clock and process statistics
+-----------------------------------------------------------------*/
+
+typedef int64_t mpb_nsecs_t;
+
+mpb_nsecs_t mpb_clock_now(void);   // monotonic clock in nano-seconds
+
+typedef struct mpb_process_info_s {
+  size_t rss;           // current resident set size in bytes (if available)
+  size_t peak_rss;      // peak resident set size in bytes
+  size_t page_faults;   // total minor and major page faults
+  int64_t tlb_misses;  // data TLB load misses in user mode (Linux perf events), or -1 if unavailable
+} mpb_process_info_t;
+
+void mpb_process_info(mpb_process_info_t* info);
+
+typedef struct mpb_maps_info_s {
+  size_t vma_count;     // number of virtual memory areas (if available)
+  size_t committed;     // bytes in private writable mappings (an upper bound of the commit charge as
+                        // `MAP_NORESERVE` mappings (used with `stack_use_overcommit`) are not charged)
+} mpb_maps_info_t;
+
+void mpb_process_maps(mpb_maps_info_t* info);  // reads `/proc/self/maps` on Linux
+
+
+/*-----------------------------------------------------------------
+  Running benchmarks
+-----------------------------------------------------------------*/
+
+// A benchmark function runs `n` operations.
+typedef void (mpb_fun_t)(long n, void* arg);
+
+// Calibrate, run, and report a benchmark `suite/name` with timing percentiles
+// per operation, page faults, commit-on-demand faults, TLB misses, and RSS.
+void mpb_run(const char* suite, const char* name, mpb_fun_t* fun, void* arg);
+
+
+/*-----------------------------------------------------------------
+  Reporting
+  Each benchmark writes one JSON record (object) on a single line to stdout;
+  a human readable summary is written to stderr.
+-----------------------------------------------------------------*/
+
+void mpb_record_begin(const char* suite, const char* name);
+void mpb_record_int(const char* key, int64_t value);
+void mpb_record_num(const char* key, double value);
+void mpb_record_str(const char* key, const char* value);
+void mpb_record_end(void);
+
+#define mpb_printf(...)  fprintf(stderr, __VA_ARGS__)
+
+
+/*-----------------------------------------------------------------
+  Suites
+-----------------------------------------------------------------*/
+
+void mpb_micro_run(void);
+void mpb_baseline_run(void);
+void mpb_threads_run(void);
+void mpb_memory_run(void);
+void mpb_stacks_run(void);
+void mpb_sched_run(void);
+void mpb_chan_run(void);
+void mpb_sync_run(void);
+void mpb_gen_run(void);
+
+#endif
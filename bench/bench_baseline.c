@@ -0,0 +1,460 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Baseline comparison: run the same generator, async worker, and deep
+  recursion workloads on:
+  - `mprompt`:  prompts with in-place growable gstacks,
+  - `ucontext`: `makecontext`/`swapcontext` with fixed size stacks (not on Windows/macOS),
+  - `raw`:      a minimal switch using `mp_setjmp`/`mp_longjmp` with fixed size stacks.
+
+  All three implement the same asymmetric coroutine interface (`bco_impl_t`)
+  so the workloads are identical. The `ucontext` and `raw` stacks come from
+  a free list (as a realistic user would pool them) and have no guard pages.
+  The gap between `mprompt` and `raw` is the cost of the `mp_prompt_resume`
+  path on top of a plain register context switch.
+-----------------------------------------------------------------------------*/
+#include "bench.h"
+#include <errno.h>
+#include "internal/util.h"
+#include "internal/longjmp.h"
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+#define MPB_HAS_UCONTEXT  1
+#include <ucontext.h>
+#else
+#define MPB_HAS_UCONTEXT  0
+#endif
+
+#define SUITE  "baseline"
+
+#define FIXED_STACK_SIZE  (1024*1024L)  // stack size for `ucontext` and `raw` coroutines
+#define ASYNC_ACTIVE      (1000)        // active async workers at a time
+#define ASYNC_USE_KB      (16)          // stack used by an async worker after resuming
+#define DEEP_DEPTH        (1000)        // recursion depth (about 200 bytes per frame)
+#define MEM_COUNT         (10000)       // suspended coroutines to measure memory
+
+
+/*-----------------------------------------------------------------
+  Coroutine interface
+-----------------------------------------------------------------*/
+
+typedef struct bco_s bco_t;
+typedef void* (bco_fun_t)(bco_t* co, void* arg);
+
+typedef struct bco_impl_s {
+  const char* name;
+  bco_t* (*create)(bco_fun_t* fun, void* arg);
+  void*  (*resume)(bco_t* co, void* arg);     // resume until the next yield (or return)
+  void*  (*yield)(bco_t* co, void* value);    // yield from inside the coroutine
+  bool   (*done)(bco_t* co);
+  void   (*free)(bco_t* co);
+} bco_impl_t;
+
+// common header of each implementation
+struct bco_s {
+  bco_fun_t* fun;
+  void*      arg;
+  void*      transfer;
+  bool       done;
+};
+
+static bool bco_done(bco_t* co) {
+  return co->done;
+}
+
+// Free list of fixed size stacks
+typedef struct bco_stack_s {
+  struct bco_stack_s* next;
+} bco_stack_t;
+
+static bco_stack_t* bco_stack_free_list;
+
+static uint8_t* bco_stack_alloc(void) {
+  bco_stack_t* s = bco_stack_free_list;
+  if (s != NULL) {
+    bco_stack_free_list = s->next;
+    return (uint8_t*)s;
+  }
+  return (uint8_t*)malloc(FIXED_STACK_SIZE);
+}
+
+static void bco_stack_free(uint8_t* stk) {
+  bco_stack_t* s = (bco_stack_t*)stk;
+  s->next = bco_stack_free_list;
+  bco_stack_free_list = s;
+}
+
+static void bco_stack_clear(void) {
+  while (bco_stack_free_list != NULL) {
+    bco_stack_t* s = bco_stack_free_list;
+    bco_stack_free_list = s->next;
+    free(s);
+  }
+}
+
+
+/*-----------------------------------------------------------------
+  mprompt
+-----------------------------------------------------------------*/
+
+typedef struct mco_s {
+  bco_t        co;
+  mp_prompt_t* prompt;
+  mp_resume_t* resume;
+} mco_t;
+
+static bco_t* mco_create(bco_fun_t* fun, void* arg) {
+  mco_t* m = (mco_t*)calloc(1, sizeof(mco_t));
+  m->co.fun = fun;
+  m->co.arg = arg;
+  return &m->co;
+}
+
+static void* mco_start(mp_prompt_t* p, void* arg) {
+  mco_t* m = (mco_t*)arg;
+  m->prompt = p;
+  void* result = (m->co.fun)(&m->co, m->co.arg);
+  m->co.done = true;
+  return result;
+}
+
+static void* mco_resume(bco_t* co, void* arg) {
+  mco_t* m = (mco_t*)co;
+  if (m->prompt == NULL) return mp_prompt(&mco_start, m);
+  mp_resume_t* r = m->resume;
+  m->resume = NULL;
+  return mp_resume(r, arg);
+}
+
+static void* mco_suspend(mp_resume_t* r, void* arg) {
+  mco_t* m = (mco_t*)arg;
+  m->resume = r;
+  return m->co.transfer;
+}
+
+static void* mco_yield(bco_t* co, void* value) {
+  mco_t* m = (mco_t*)co;
+  co->transfer = value;
+  return mp_yield(m->prompt, &mco_suspend, m);
+}
+
+static void mco_free(bco_t* co) {
+  mco_t* m = (mco_t*)co;
+  if (m->resume != NULL) mp_resume_drop(m->resume);
+  free(m);
+}
+
+static const bco_impl_t mco_impl = { "mprompt", &mco_create, &mco_resume, &mco_yield, &bco_done, &mco_free };
+
+
+/*-----------------------------------------------------------------
+  ucontext
+-----------------------------------------------------------------*/
+#if MPB_HAS_UCONTEXT
+
+typedef struct uco_s {
+  bco_t      co;
+  ucontext_t ctx;
+  ucontext_t caller;
+  uint8_t*   stack;
+} uco_t;
+
+static void uco_entry(unsigned int hi, unsigned int lo) {
+  uco_t* u = (uco_t*)(((uintptr_t)hi << 16 << 16) | (uintptr_t)lo);
+  u->co.transfer = (u->co.fun)(&u->co, u->co.arg);
+  u->co.done = true;
+  swapcontext(&u->ctx, &u->caller);
+}
+
+static bco_t* uco_create(bco_fun_t* fun, void* arg) {
+  uco_t* u = (uco_t*)calloc(1, sizeof(uco_t));
+  u->co.fun = fun;
+  u->co.arg = arg;
+  u->stack = bco_stack_alloc();
+  getcontext(&u->ctx);
+  u->ctx.uc_stack.ss_sp = u->stack;
+  u->ctx.uc_stack.ss_size = FIXED_STACK_SIZE;
+  u->ctx.uc_link = NULL;
+  uintptr_t p = (uintptr_t)u;
+  makecontext(&u->ctx, (void (*)(void))&uco_entry, 2, (unsigned int)(p >> 16 >> 16), (unsigned int)(p & 0xFFFFFFFFUL));
+  return &u->co;
+}
+
+static void* uco_resume(bco_t* co, void* arg) {
+  uco_t* u = (uco_t*)co;
+  co->transfer = arg;
+  swapcontext(&u->caller, &u->ctx);
+  return co->transfer;
+}
+
+static void* uco_yield(bco_t* co, void* value) {
+  uco_t* u = (uco_t*)co;
+  co->transfer = value;
+  swapcontext(&u->ctx, &u->caller);
+  return co->transfer;
+}
+
+static void uco_free(bco_t* co) {
+  uco_t* u = (uco_t*)co;
+  bco_stack_free(u->stack);
+  free(u);
+}
+
+static const bco_impl_t uco_impl = { "ucontext", &uco_create, &uco_resume, &uco_yield, &bco_done, &uco_free };
+#endif
+
+
+/*-----------------------------------------------------------------
+  raw mp_setjmp/mp_longjmp
+-----------------------------------------------------------------*/
+
+typedef struct rco_s {
+  bco_t        co;
+  mp_jmpbuf_t  ctx;
+  mp_jmpbuf_t  caller;
+  mp_jmpbuf_t* return_jmp;
+  uint8_t*     stack;
+  bool         started;
+} rco_t;
+
+static void rco_entry(void* arg, mp_unwind_frame_t* unwind_frame) {
+  MPB_UNUSED(unwind_frame);
+  rco_t* r = (rco_t*)arg;
+  r->co.transfer = (r->co.fun)(&r->co, r->co.arg);
+  r->co.done = true;
+  mp_longjmp(&r->caller);
+}
+
+static bco_t* rco_create(bco_fun_t* fun, void* arg) {
+  rco_t* r = (rco_t*)calloc(1, sizeof(rco_t));
+  r->co.fun = fun;
+  r->co.arg = arg;
+  r->stack = bco_stack_alloc();
+  r->return_jmp = &r->caller;
+  return &r->co;
+}
+
+static mpb_decl_noinline void* rco_resume(bco_t* co, void* arg) {
+  rco_t* r = (rco_t*)co;
+  co->transfer = arg;
+  if (mp_setjmp(&r->caller) == NULL) {
+    if (!r->started) {
+      r->started = true;
+      mp_stack_enter(r->stack + FIXED_STACK_SIZE, r->stack, r->stack, &r->return_jmp, &rco_entry, r);
+    }
+    mp_longjmp(&r->ctx);
+  }
+  return co->transfer;
+}
+
+static mpb_decl_noinline void* rco_yield(bco_t* co, void* value) {
+  rco_t* r = (rco_t*)co;
+  co->transfer = value;
+  if (mp_setjmp(&r->ctx) == NULL) {
+    mp_longjmp(&r->caller);
+  }
+  return co->transfer;
+}
+
+static void rco_free(bco_t* co) {
+  rco_t* r = (rco_t*)co;
+  bco_stack_free(r->stack);
+  free(r);
+}
+
+static const bco_impl_t rco_impl = { "raw", &rco_create, &rco_resume, &rco_yield, &bco_done, &rco_free };
+
+
+/*-----------------------------------------------------------------
+  Workloads
+-----------------------------------------------------------------*/
+
+static mpb_decl_noinline void* as_stack_address(void* p) {
+  return p;
+}
+
+// touch `kb` KiB of the stack below us
+static mpb_decl_noinline void stack_use(long kb) {
+  void* top = NULL;
+  volatile uint8_t* sp = (volatile uint8_t*)as_stack_address(&top);
+  for (long i = 0; i < (kb*1024) / 4096; i++) {
+    uint8_t b = *(sp - (i * 4096));
+    MPB_UNUSED(b);
+  }
+}
+
+// Generator: yield values until resumed with `NULL`
+static void* generator(bco_t* co, void* arg) {
+  const bco_impl_t* impl = (const bco_impl_t*)arg;
+  void* x = (void*)1;
+  while (x != NULL) {
+    x = (impl->yield)(co, x);
+  }
+  return NULL;
+}
+
+static void bench_generator(long n, void* arg) {
+  const bco_impl_t* impl = (const bco_impl_t*)arg;
+  bco_t* co = (impl->create)(&generator, (void*)impl);
+  for (long i = 0; i < n; i++) {
+    (impl->resume)(co, (void*)1);
+  }
+  (impl->resume)(co, NULL);
+  (impl->free)(co);
+}
+
+// Async worker: await a request, then use stack space to handle it
+static void* async_worker(bco_t* co, void* arg) {
+  const bco_impl_t* impl = (const bco_impl_t*)arg;
+  long kb = (long)(intptr_t)(impl->yield)(co, NULL);
+  stack_use(kb);
+  return (void*)1;
+}
+
+// The active workers persist between runs so we measure the steady state
+typedef struct async_env_s {
+  const bco_impl_t* impl;
+  long              next;
+  bco_t*            workers[ASYNC_ACTIVE];
+} async_env_t;
+
+static void bench_async(long n, void* arg) {
+  async_env_t* env = (async_env_t*)arg;
+  const bco_impl_t* impl = env->impl;
+  for (long i = 0; i < n; i++) {
+    long j = env->next;
+    env->next = (j + 1) % ASYNC_ACTIVE;
+    if (env->workers[j] != NULL) {
+      (impl->resume)(env->workers[j], (void*)(intptr_t)ASYNC_USE_KB);
+      (impl->free)(env->workers[j]);
+    }
+    env->workers[j] = (impl->create)(&async_worker, (void*)impl);
+    (impl->resume)(env->workers[j], NULL);  // run until the first await
+  }
+}
+
+static void bench_async_run(const bco_impl_t* impl) {
+  char name[64];
+  snprintf(name, sizeof(name), "async/%s", impl->name);
+  async_env_t* env = (async_env_t*)calloc(1, sizeof(async_env_t));
+  if (env == NULL) return;
+  env->impl = impl;
+  mpb_run(SUITE, name, &bench_async, env);
+  for (long j = 0; j < ASYNC_ACTIVE; j++) {
+    if (env->workers[j] != NULL) {
+      (impl->resume)(env->workers[j], (void*)(intptr_t)ASYNC_USE_KB);
+      (impl->free)(env->workers[j]);
+    }
+  }
+  free(env);
+}
+
+// Deep recursion: recurse, yield at the bottom, and return after resuming
+static mpb_decl_noinline long recurse(const bco_impl_t* impl, bco_t* co, long depth) {
+  volatile uint8_t frame[160];
+  frame[0] = (uint8_t)depth;
+  if (depth <= 0) {
+    return (long)(intptr_t)(impl->yield)(co, NULL);
+  }
+  return frame[0] + recurse(impl, co, depth - 1) - (long)frame[0];
+}
+
+static void* deep_worker(bco_t* co, void* arg) {
+  const bco_impl_t* impl = (const bco_impl_t*)arg;
+  return (void*)(intptr_t)recurse(impl, co, DEEP_DEPTH);
+}
+
+static void bench_deep(long n, void* arg) {
+  const bco_impl_t* impl = (const bco_impl_t*)arg;
+  for (long i = 0; i < n; i++) {
+    bco_t* co = (impl->create)(&deep_worker, (void*)impl);
+    (impl->resume)(co, NULL);
+    (impl->resume)(co, (void*)1);
+    (impl->free)(co);
+  }
+}
+
+
+/*-----------------------------------------------------------------
+  Memory: suspend many deep coroutines and measure the resident
+  memory per suspended coroutine.
+-----------------------------------------------------------------*/
+
+static void bench_memory(const bco_impl_t* impl) {
+  char name[64];
+  snprintf(name, sizeof(name), "memory/%s", impl->name);
+  if (!mpb_selected(SUITE, name)) return;
+  bco_t** cos = (bco_t**)calloc(MEM_COUNT, sizeof(bco_t*));
+  if (cos == NULL) return;
+  bco_stack_clear();
+  mpb_process_info_t start_info;
+  mpb_process_info(&start_info);
+  mpb_nsecs_t start = mpb_clock_now();
+  for (long i = 0; i < MEM_COUNT; i++) {
+    cos[i] = (impl->create)(&deep_worker, (void*)impl);
+    (impl->resume)(cos[i], NULL);
+  }
+  mpb_nsecs_t setup = mpb_clock_now() - start;
+  mpb_process_info_t info;
+  mpb_process_info(&info);
+  start = mpb_clock_now();
+  for (long i = 0; i < MEM_COUNT; i++) {
+    (impl->resume)(cos[i], (void*)1);
+    (impl->free)(cos[i]);
+  }
+  mpb_nsecs_t teardown = mpb_clock_now() - start;
+  bco_stack_clear();
+  free(cos);
+
+  const int64_t rss_delta = (int64_t)info.rss - (int64_t)start_info.rss;
+  mpb_record_begin(SUITE, name);
+  mpb_record_int("count", MEM_COUNT);
+  mpb_record_int("depth", DEEP_DEPTH);
+  mpb_record_int("rss_delta", rss_delta);
+  mpb_record_int("bytes_per_suspended", rss_delta / MEM_COUNT);
+  mpb_record_num("ns_setup", (double)setup / MEM_COUNT);
+  mpb_record_num("ns_teardown", (double)teardown / MEM_COUNT);
+  mpb_record_int("page_faults", (int64_t)(info.page_faults - start_info.page_faults));
+  mpb_record_int("rss", (int64_t)info.rss);
+  mpb_record_int("peak_rss", (int64_t)info.peak_rss);
+  mpb_record_end();
+  mpb_printf("%-10s %-28s %-10s %10ld bytes/suspended, setup %.1f ns, teardown %.1f ns\n",
+             SUITE, name, mpb_options.config, (long)(rss_delta / MEM_COUNT),
+             (double)setup / MEM_COUNT, (double)teardown / MEM_COUNT);
+}
+
+
+/*-----------------------------------------------------------------
+  Run
+-----------------------------------------------------------------*/
+
+static const bco_impl_t* const impls[] = {
+  &mco_impl,
+  #if MPB_HAS_UCONTEXT
+  &uco_impl,
+  #endif
+  &rco_impl,
+  NULL
+};
+
+void mpb_baseline_run(void) {
+  char name[64];
+  for (const bco_impl_t* const* impl = impls; *impl != NULL; impl++) {
+    bench_memory(*impl);
+  }
+  for (const bco_impl_t* const* impl = impls; *impl != NULL; impl++) {
+    snprintf(name, sizeof(name), "generator/%s", (*impl)->name);
+    mpb_run(SUITE, name, &bench_generator, (void*)*impl);
+  }
+  for (const bco_impl_t* const* impl = impls; *impl != NULL; impl++) {
+    bench_async_run(*impl);
+  }
+  for (const bco_impl_t* const* impl = impls; *impl != NULL; impl++) {
+    snprintf(name, sizeof(name), "deep/%s", (*impl)->name);
+    mpb_run(SUITE, name, &bench_deep, (void*)*impl);
+  }
+  bco_stack_clear();
+}
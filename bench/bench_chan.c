@@ -0,0 +1,175 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Hand-off latency between two tasks; each operation is a round trip:
+
+  - yield_resume  : the raw cost: `mp_yield` to a prompt and `mp_resume` it.
+  - park          : two tasks that `mps_unpark` each other and `mps_park`.
+  - unbuffered    : two tasks that send a value back and forth over two
+                    unbuffered channels.
+  - bounded       : the same over channels with a capacity of one.
+  - select        : the same where the receiver selects over two channels.
+
+  The channel and park benchmarks run on a single worker (so the hand-off
+  is a direct switch), and the unbuffered one also on two workers.
+-----------------------------------------------------------------------------*/
+#include "bench.h"
+#include <mp_sched.h>
+#include <mp_chan.h>
+
+#define SUITE  "chan"
+
+
+/*-----------------------------------------------------------------
+  Raw yield and resume
+-----------------------------------------------------------------*/
+
+static void* pp_yield_fun(mp_resume_t* r, void* arg) {
+  MPB_UNUSED(arg);
+  return r;
+}
+
+static void* pp_prompt_body(mp_prompt_t* p, void* arg) {
+  const long n = (long)(intptr_t)arg;
+  for (long i = 0; i < n; i++) {
+    mp_yield(p, &pp_yield_fun, NULL);
+  }
+  return NULL;
+}
+
+static void bench_yield_resume(long n, void* arg) {
+  MPB_UNUSED(arg);
+  mp_resume_t* r = (mp_resume_t*)mp_prompt(&pp_prompt_body, (void*)(intptr_t)n);
+  while (r != NULL) {
+    r = (mp_resume_t*)mp_resume(r, NULL);
+  }
+}
+
+
+/*-----------------------------------------------------------------
+  Park and unpark
+-----------------------------------------------------------------*/
+
+typedef struct pp_env_s {
+  long        n;
+  mps_task_t* tasks[2];
+  long        turn;         // only accessed by the task whose turn it is (on one worker)
+  mp_chan_t*  chans[2];
+  mp_chan_t*  idle;         // never ready (for `select`)
+} pp_env_t;
+
+static void pp_park_other(void* arg) {
+  pp_env_t* env = (pp_env_t*)arg;
+  env->tasks[1] = mps_current();
+  for (long i = 0; i < env->n; i++) {
+    while (env->turn != 1) mps_park();
+    env->turn = 0;
+    mps_unpark(env->tasks[0]);
+  }
+}
+
+static void pp_park_run(void* arg) {
+  pp_env_t* env = (pp_env_t*)arg;
+  env->tasks[0] = mps_current();
+  mps_spawn(&pp_park_other, env);
+  while (env->tasks[1] == NULL) mps_yield_now();
+  for (long i = 0; i < env->n; i++) {
+    env->turn = 1;
+    mps_unpark(env->tasks[1]);
+    while (env->turn != 0) mps_park();
+  }
+}
+
+static void bench_park(long n, void* arg) {
+  MPB_UNUSED(arg);
+  pp_env_t env;
+  memset(&env, 0, sizeof(env));
+  env.n = n;
+  mps_config_t config = mps_config_default();
+  config.workers = 1;
+  mps_run(&config, &pp_park_run, &env, NULL);
+}
+
+
+/*-----------------------------------------------------------------
+  Channels
+-----------------------------------------------------------------*/
+
+static void pp_chan_echo(void* arg) {
+  pp_env_t* env = (pp_env_t*)arg;
+  void* value;
+  while (mp_chan_recv(env->chans[0], &value)) {
+    mp_chan_send(env->chans[1], value);
+  }
+}
+
+static void pp_chan_run(void* arg) {
+  pp_env_t* env = (pp_env_t*)arg;
+  mps_spawn(&pp_chan_echo, env);
+  void* value;
+  for (long i = 0; i < env->n; i++) {
+    mp_chan_send(env->chans[0], (void*)(intptr_t)i);
+    mp_chan_recv(env->chans[1], &value);
+  }
+  mp_chan_close(env->chans[0]);
+}
+
+static void pp_select_run(void* arg) {
+  pp_env_t* env = (pp_env_t*)arg;
+  mps_spawn(&pp_chan_echo, env);
+  mp_chan_case_t cases[2] = {
+    { env->idle,     MP_CHAN_RECV, NULL, false },
+    { env->chans[1], MP_CHAN_RECV, NULL, false }
+  };
+  for (long i = 0; i < env->n; i++) {
+    mp_chan_send(env->chans[0], (void*)(intptr_t)i);
+    mp_chan_select(cases, 2, true);
+  }
+  mp_chan_close(env->chans[0]);
+}
+
+static void pp_chan_bench(long n, size_t capacity, int workers, mps_fun_t* fun) {
+  pp_env_t env;
+  memset(&env, 0, sizeof(env));
+  env.n = n;
+  env.chans[0] = mp_chan_create(capacity);
+  env.chans[1] = mp_chan_create(capacity);
+  env.idle = mp_chan_create(0);
+  mps_config_t config = mps_config_default();
+  config.workers = workers;
+  mps_run(&config, fun, &env, NULL);
+  mp_chan_free(env.chans[0]);
+  mp_chan_free(env.chans[1]);
+  mp_chan_free(env.idle);
+}
+
+static void bench_unbuffered(long n, void* arg) {
+  pp_chan_bench(n, 0, (int)(intptr_t)arg, &pp_chan_run);
+}
+
+static void bench_bounded(long n, void* arg) {
+  MPB_UNUSED(arg);
+  pp_chan_bench(n, 1, 1, &pp_chan_run);
+}
+
+static void bench_select(long n, void* arg) {
+  MPB_UNUSED(arg);
+  pp_chan_bench(n, 0, 1, &pp_select_run);
+}
+
+
+/*-----------------------------------------------------------------
+  Run
+-----------------------------------------------------------------*/
+
+void mpb_chan_run(void) {
+  mpb_run(SUITE, "pingpong/yield_resume", &bench_yield_resume, NULL);
+  mpb_run(SUITE, "pingpong/park", &bench_park, NULL);
+  mpb_run(SUITE, "pingpong/unbuffered", &bench_unbuffered, (void*)(intptr_t)1);
+  mpb_run(SUITE, "pingpong/unbuffered/2", &bench_unbuffered, (void*)(intptr_t)2);
+  mpb_run(SUITE, "pingpong/bounded", &bench_bounded, NULL);
+  mpb_run(SUITE, "pingpong/select", &bench_select, NULL);
+}
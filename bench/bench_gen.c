@@ -0,0 +1,158 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Generators that produce `n` integers which the consumer sums up:
+
+  - per_element/tail  : yield every element and run the consumer in the yield
+                        handler, ending with `mp_resume_tail` (as in
+                        `test_mp_example_generator.c`).
+  - per_element/resume: yield every element back to the consumer, which
+                        resumes the producer for the next one.
+  - batch/<b>         : a batched generator (`mp_gen.h`) that fills a buffer
+                        of `b` elements per switch.
+  - range_for/<b>     : the same through the typed C++ wrapper (`mp_gen.hpp`)
+                        with a range-for loop (C++ only).
+
+  The time is reported per element (so 1e9 divided by it gives elements per second).
+-----------------------------------------------------------------------------*/
+#include "bench.h"
+#include <mp_gen.h>
+
+#define SUITE  "gen"
+
+static volatile long gen_total;
+
+
+/*-----------------------------------------------------------------
+  Per element
+-----------------------------------------------------------------*/
+
+typedef struct elem_env_s {
+  long n;
+  long current;
+  long sum;
+} elem_env_t;
+
+static void* tail_yield(mp_resume_t* r, void* arg) {
+  elem_env_t* env = (elem_env_t*)arg;
+  env->sum += env->current;     // the consumer body
+  return mp_resume_tail(r, NULL);
+}
+
+static void* tail_action(mp_prompt_t* p, void* arg) {
+  elem_env_t* env = (elem_env_t*)arg;
+  for (long i = 0; i < env->n; i++) {
+    env->current = i;
+    mp_yield(p, &tail_yield, env);
+  }
+  return NULL;
+}
+
+static void bench_per_element_tail(long n, void* arg) {
+  MPB_UNUSED(arg);
+  elem_env_t env = { n, 0, 0 };
+  mp_prompt(&tail_action, &env);
+  gen_total = env.sum;
+}
+
+static void* resume_yield(mp_resume_t* r, void* arg) {
+  MPB_UNUSED(arg);
+  return r;
+}
+
+static void* resume_action(mp_prompt_t* p, void* arg) {
+  elem_env_t* env = (elem_env_t*)arg;
+  for (long i = 0; i < env->n; i++) {
+    env->current = i;
+    mp_yield(p, &resume_yield, NULL);
+  }
+  return NULL;
+}
+
+static void bench_per_element_resume(long n, void* arg) {
+  MPB_UNUSED(arg);
+  elem_env_t env = { n, 0, 0 };
+  mp_resume_t* r = (mp_resume_t*)mp_prompt(&resume_action, &env);
+  while (r != NULL) {
+    env.sum += env.current;
+    r = (mp_resume_t*)mp_resume(r, NULL);
+  }
+  gen_total = env.sum;
+}
+
+
+/*-----------------------------------------------------------------
+  Batched
+-----------------------------------------------------------------*/
+
+static void batch_producer(mp_gen_t* gen, void* arg) {
+  const long n = *((long*)arg);
+  size_t capacity;
+  long*  buf = (long*)mp_gen_buffer(gen, &capacity);
+  size_t count = 0;
+  for (long i = 0; i < n; i++) {
+    buf[count++] = i;
+    if (count == capacity) {
+      if (!mp_gen_yield(gen, count)) return;
+      buf = (long*)mp_gen_buffer(gen, &capacity);
+      count = 0;
+    }
+  }
+  if (count > 0) mp_gen_yield(gen, count);
+}
+
+static void bench_batch(long n, void* arg) {
+  const size_t batch = (size_t)(intptr_t)arg;
+  long* buf = (long*)malloc(batch * sizeof(long));
+  if (buf == NULL) return;
+  mp_gen_t* gen = mp_gen_create(&batch_producer, &n);
+  long   sum = 0;
+  size_t count;
+  while ((count = mp_gen_next(gen, buf, batch)) > 0) {
+    for (size_t i = 0; i < count; i++) sum += buf[i];
+  }
+  mp_gen_free(gen);
+  free(buf);
+  gen_total = sum;
+}
+
+#ifdef __cplusplus
+#include <mp_gen.hpp>
+
+static void bench_range_for(long n, void* arg) {
+  const size_t batch = (size_t)(intptr_t)arg;
+  mp::generator<long> gen([n](mp::gen_sink<long>& out) {
+    for (long i = 0; i < n; i++) {
+      if (!out.emit(i)) return;
+    }
+  }, batch);
+  long sum = 0;
+  for (long x : gen) sum += x;
+  gen_total = sum;
+}
+#endif
+
+
+/*-----------------------------------------------------------------
+  Run
+-----------------------------------------------------------------*/
+
+void mpb_gen_run(void) {
+  static const size_t batches[] = { 1, 8, 64, 512 };
+  char name[64];
+  mpb_run(SUITE, "per_element/tail", &bench_per_element_tail, NULL);
+  mpb_run(SUITE, "per_element/resume", &bench_per_element_resume, NULL);
+  for (size_t i = 0; i < sizeof(batches)/sizeof(batches[0]); i++) {
+    snprintf(name, sizeof(name), "batch/%zu", batches[i]);
+    mpb_run(SUITE, name, &bench_batch, (void*)(intptr_t)batches[i]);
+  }
+  #ifdef __cplusplus
+  for (size_t i = 0; i < sizeof(batches)/sizeof(batches[0]); i++) {
+    snprintf(name, sizeof(name), "range_for/%zu", batches[i]);
+    mpb_run(SUITE, name, &bench_range_for, (void*)(intptr_t)batches[i]);
+  }
+  #endif
+}
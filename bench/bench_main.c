@@ -0,0 +1,227 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Benchmark driver: `mprompt-bench [options]`
+
+  As `mp_init` can only be called once per process, each suite is run
+  for each configuration variant in a separate child process (`--config`)
+  which writes one JSON record per benchmark. The driver collects these
+  into a single JSON document:
+
+    { "library": "libmprompt", "version": ..., "build": ..., "results": [ <record>, ... ] }
+-----------------------------------------------------------------------------*/
+#include "bench.h"
+
+#ifdef _WIN32
+#define popen   _popen
+#define pclose  _pclose
+#endif
+
+#ifndef MPB_VERSION
+#define MPB_VERSION "unknown"
+#endif
+
+/*-----------------------------------------------------------------
+  Suites and configuration variants
+-----------------------------------------------------------------*/
+
+typedef void (mpb_suite_fun_t)(void);
+
+typedef struct mpb_suite_s {
+  const char*      name;
+  mpb_suite_fun_t* run;
+  const char*      configs;     // default configuration variants (comma separated)
+} mpb_suite_t;
+
+static const mpb_suite_t mpb_suites[] = {
+  { "micro", &mpb_micro_run, "default,nogpool" },
+  { "baseline", &mpb_baseline_run, "default" },
+  { "threads", &mpb_threads_run, "default,nocache,nogpool" },
+  { "memory", &mpb_memory_run, "default,nogpool,overcommit,nogrowfast,growpeak,decommit" },
+  { "stacks", &mpb_stacks_run, "default,nogpool,populate,hugepages" },
+  { "sched", &mpb_sched_run, "default" },
+  { "chan", &mpb_chan_run, "default" },
+  { "sync", &mpb_sync_run, "default" },
+  { "gen", &mpb_gen_run, "default" },
+  { NULL, NULL, NULL }
+};
+
+typedef struct mpb_config_variant_s {
+  const char* name;
+  void (*modify)(mp_config_t* config);
+} mpb_config_variant_t;
+
+static void mpb_config_default(mp_config_t* config)    { MPB_UNUSED(config); }
+static void mpb_config_nogpool(mp_config_t* config)    { config->gpool_enable = false; }
+static void mpb_config_gpool(mp_config_t* config)      { config->gpool_enable = true; }
+static void mpb_config_overcommit(mp_config_t* config) { config->stack_use_overcommit = true; }
+static void mpb_config_growfast(mp_config_t* config)   { config->stack_grow_fast = true; }
+static void mpb_config_nogrowfast(mp_config_t* config) { config->stack_grow_fast = false; }
+static void mpb_config_decommit(mp_config_t* config)   { config->stack_reset_decommits = true; }
+static void mpb_config_nocache(mp_config_t* config)    { config->stack_cache_count = -1; }
+static void mpb_config_growpeak(mp_config_t* config)   { config->stack_grow_policy.kind = MP_GROW_PEAK; }
+static void mpb_config_populate(mp_config_t* config)   { config->stack_populate = 1024 * 1024; }
+static void mpb_config_hugepages(mp_config_t* config)  { config->stack_populate = 4 * 1024 * 1024; config->stack_huge_pages = true; }
+
+static const mpb_config_variant_t mpb_config_variants[] = {
+  { "default",    &mpb_config_default },
+  { "nogpool",    &mpb_config_nogpool },
+  { "gpool",      &mpb_config_gpool },
+  { "overcommit", &mpb_config_overcommit },
+  { "growfast",   &mpb_config_growfast },
+  { "nogrowfast", &mpb_config_nogrowfast },
+  { "decommit",   &mpb_config_decommit },
+  { "nocache",    &mpb_config_nocache },
+  { "growpeak",   &mpb_config_growpeak },
+  { "populate",   &mpb_config_populate },
+  { "hugepages",  &mpb_config_hugepages },
+  { NULL, NULL }
+};
+
+static const mpb_config_variant_t* mpb_config_find(const char* name) {
+  for (const mpb_config_variant_t* v = mpb_config_variants; v->name != NULL; v++) {
+    if (strcmp(v->name, name) == 0) return v;
+  }
+  return NULL;
+}
+
+// Is `name` an element of the comma separated `list`?
+static bool mpb_list_contains(const char* list, const char* name) {
+  if (list == NULL) return true;
+  size_t len = strlen(name);
+  for (const char* p = list; p != NULL && *p != 0; ) {
+    const char* end = strchr(p, ',');
+    size_t n = (end == NULL ? strlen(p) : (size_t)(end - p));
+    if (n == len && strncmp(p, name, n) == 0) return true;
+    p = (end == NULL ? NULL : end + 1);
+  }
+  return false;
+}
+
+
+/*-----------------------------------------------------------------
+  Run a suite in a child process and copy its records
+-----------------------------------------------------------------*/
+
+static bool mpb_spawn(const char* self, const mpb_suite_t* suite, const char* config, bool* first, FILE* out) {
+  char cmd[1024];
+  int n = snprintf(cmd, sizeof(cmd), "\"%s\" --suite %s --config %s --samples %ld --sample-ms %ld --threads %ld --depth %ld%s%s%s%s",
+                   self, suite->name, config, mpb_options.samples, mpb_options.sample_ms, mpb_options.threads, mpb_options.depth,
+                   (mpb_options.counts != NULL ? " --counts " : ""),
+                   (mpb_options.counts != NULL ? mpb_options.counts : ""),
+                   (mpb_options.filter != NULL ? " --filter \"" : ""),
+                   (mpb_options.filter != NULL ? mpb_options.filter : ""),
+                   (mpb_options.filter != NULL ? "\"" : ""));
+  if (n <= 0 || n >= (int)sizeof(cmd)) return false;
+  FILE* child = popen(cmd, "r");
+  if (child == NULL) return false;
+  char line[4096];
+  while (fgets(line, sizeof(line), child) != NULL) {
+    if (line[0] != '{') continue;
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = 0;
+    fprintf(out, "%s\n    %s", (*first ? "" : ","), line);
+    *first = false;
+  }
+  return (pclose(child) == 0);
+}
+
+
+/*-----------------------------------------------------------------
+  Main
+-----------------------------------------------------------------*/
+
+static void mpb_usage(void) {
+  mpb_printf("usage: mprompt-bench [options]\n\n"
+             "  --suite <names>      comma separated suites to run (default: all)\n"
+             "  --configs <names>    comma separated configuration variants (default: per suite)\n"
+             "  --config <name>      run directly in this process with a single configuration\n"
+             "  --filter <text>      only run benchmarks whose `suite/name` contains <text>\n"
+             "  --samples <n>        timed samples per benchmark (%ld)\n"
+             "  --sample-ms <n>      target milliseconds per sample (%ld)\n"
+             "  --threads <n>        maximum thread count for the threads, sched, and sync suites (default: CPU count)\n"
+             "  --counts <n,...>     suspended prompt counts for the memory suite (10000,100000,1000000)\n"
+             "  --depth <n>          recursion depth of each suspended prompt in the memory suite (%ld)\n"
+             "  -o <file>            write the JSON results to <file> (default: stdout)\n\n",
+             mpb_options.samples, mpb_options.sample_ms, mpb_options.depth);
+  mpb_printf("suites : ");
+  for (const mpb_suite_t* s = mpb_suites; s->name != NULL; s++) mpb_printf("%s ", s->name);
+  mpb_printf("\nconfigs: ");
+  for (const mpb_config_variant_t* v = mpb_config_variants; v->name != NULL; v++) mpb_printf("%s ", v->name);
+  mpb_printf("\n");
+}
+
+int main(int argc, char** argv) {
+  const char* suites  = NULL;
+  const char* configs = NULL;
+  const char* output  = NULL;
+  bool direct = false;
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* val = (i + 1 < argc ? argv[i + 1] : NULL);
+    if (strcmp(arg, "--suite") == 0 && val != NULL)          { suites = val; i++; }
+    else if (strcmp(arg, "--configs") == 0 && val != NULL)   { configs = val; i++; }
+    else if (strcmp(arg, "--config") == 0 && val != NULL)    { mpb_options.config = val; direct = true; i++; }
+    else if (strcmp(arg, "--filter") == 0 && val != NULL)    { mpb_options.filter = val; i++; }
+    else if (strcmp(arg, "--samples") == 0 && val != NULL)   { mpb_options.samples = atol(val); i++; }
+    else if (strcmp(arg, "--sample-ms") == 0 && val != NULL) { mpb_options.sample_ms = atol(val); i++; }
+    else if (strcmp(arg, "--threads") == 0 && val != NULL)   { mpb_options.threads = atol(val); i++; }
+    else if (strcmp(arg, "--counts") == 0 && val != NULL)    { mpb_options.counts = val; i++; }
+    else if (strcmp(arg, "--depth") == 0 && val != NULL)     { mpb_options.depth = atol(val); i++; }
+    else if (strcmp(arg, "-o") == 0 && val != NULL)          { output = val; i++; }
+    else { mpb_usage(); return (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0 ? 0 : 1); }
+  }
+
+  if (direct) {
+    // run the suites in this process and write records to stdout
+    const mpb_config_variant_t* variant = mpb_config_find(mpb_options.config);
+    if (variant == NULL) {
+      mpb_printf("unknown configuration: %s\n", mpb_options.config);
+      return 1;
+    }
+    mp_config_t config = mp_config_default();
+    (variant->modify)(&config);
+    mp_init(&config);
+    for (const mpb_suite_t* s = mpb_suites; s->name != NULL; s++) {
+      if (mpb_list_contains(suites, s->name)) (s->run)();
+    }
+    return 0;
+  }
+
+  // run each suite and configuration in a child process
+  FILE* out = (output == NULL ? stdout : fopen(output, "w"));
+  if (out == NULL) {
+    mpb_printf("unable to open: %s\n", output);
+    return 1;
+  }
+  fprintf(out, "{\n  \"library\": \"libmprompt\",\n  \"version\": \"%s\",\n", MPB_VERSION);
+  #if defined(__cplusplus)
+  fprintf(out, "  \"language\": \"c++\",\n");
+  #else
+  fprintf(out, "  \"language\": \"c\",\n");
+  #endif
+  #if defined(NDEBUG)
+  fprintf(out, "  \"build\": \"release\",\n");
+  #else
+  fprintf(out, "  \"build\": \"debug\",\n");
+  #endif
+  fprintf(out, "  \"results\": [");
+  bool first = true;
+  int failed = 0;
+  for (const mpb_suite_t* s = mpb_suites; s->name != NULL; s++) {
+    if (!mpb_list_contains(suites, s->name)) continue;
+    for (const mpb_config_variant_t* v = mpb_config_variants; v->name != NULL; v++) {
+      if (!mpb_list_contains(configs != NULL ? configs : s->configs, v->name)) continue;
+      if (!mpb_spawn(argv[0], s, v->name, &first, out)) {
+        mpb_printf("failed to run suite %s with configuration %s\n", s->name, v->name);
+        failed++;
+      }
+    }
+  }
+  fprintf(out, "\n  ]\n}\n");
+  if (out != stdout) fclose(out);
+  return (failed == 0 ? 0 : 1);
+}
@@ -0,0 +1,221 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Memory footprint: create many suspended prompts (10k, 100k, and 1M by
+  default, see `--counts`) that each suspend at a recursion depth of
+  `--depth` frames, and record the RSS, committed bytes, and VMA count
+  while they are suspended together with the setup and teardown time,
+  and the commit-on-demand faults (see `mp_commit_stats`).
+
+  Large counts can exceed the VMA limit (`vm.max_map_count`) or the
+  available memory for some configurations, which would be fatal for
+  `mp_prompt`. We therefore create the prompts in doubling batches and
+  skip a count (with a `skipped` record) as soon as the extrapolated use
+  does not fit (the checks are not included in the setup time). As
+  gstacks from earlier counts are reused (and stay committed) the probe
+  can underestimate, so we extrapolate with the highest use per prompt
+  seen so far.
+-----------------------------------------------------------------------------*/
+#include "bench.h"
+
+#define SUITE  "memory"
+
+#define MEM_PROBE_COUNT  (16)           // prompts created before first extrapolating the resource use
+#define MEM_FRAME_SIZE   (112)          // bytes of locals per recursion frame
+
+
+/*-----------------------------------------------------------------
+  System limits
+-----------------------------------------------------------------*/
+
+#if defined(__linux__)
+static size_t mpb_read_size(const char* fname, const char* key) {
+  FILE* f = fopen(fname, "r");
+  if (f == NULL) return 0;
+  char line[256];
+  size_t result = 0;
+  size_t keylen = (key == NULL ? 0 : strlen(key));
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (key == NULL || strncmp(line, key, keylen) == 0) {
+      unsigned long long n = strtoull(line + keylen, NULL, 10);
+      result = (size_t)n;
+      break;
+    }
+  }
+  fclose(f);
+  return result;
+}
+
+static size_t mpb_max_vma_count(void) {
+  return mpb_read_size("/proc/sys/vm/max_map_count", NULL);
+}
+
+static size_t mpb_available_memory(void) {
+  return 1024 * mpb_read_size("/proc/meminfo", "MemAvailable:");
+}
+#else
+static size_t mpb_max_vma_count(void)    { return 0; }   // unknown
+static size_t mpb_available_memory(void) { return 0; }
+#endif
+
+
+/*-----------------------------------------------------------------
+  Suspended prompts
+-----------------------------------------------------------------*/
+
+static void* suspend(mp_resume_t* r, void* arg) {
+  MPB_UNUSED(arg);
+  return r;
+}
+
+static mpb_decl_noinline long recurse(mp_prompt_t* p, long depth) {
+  volatile uint8_t frame[MEM_FRAME_SIZE];
+  frame[0] = (uint8_t)depth;
+  if (depth <= 0) {
+    mp_yield(p, &suspend, NULL);
+    return frame[0];
+  }
+  return recurse(p, depth - 1) + frame[0];
+}
+
+static void* suspended(mp_prompt_t* p, void* arg) {
+  return (void*)(intptr_t)recurse(p, (long)(intptr_t)arg);
+}
+
+static void resume_all(mp_resume_t** rs, long count) {
+  for (long i = 0; i < count; i++) {
+    mp_resume(rs[i], NULL);
+  }
+}
+
+
+/*-----------------------------------------------------------------
+  Measure `count` suspended prompts
+-----------------------------------------------------------------*/
+
+// highest VMAs and RSS per prompt seen so far
+static double mem_vmas_per_prompt;
+static double mem_rss_per_prompt;
+
+static void mem_update_per_prompt(const mpb_maps_info_t* maps0, const mpb_maps_info_t* maps1,
+                                  const mpb_process_info_t* info0, const mpb_process_info_t* info1, long count) {
+  double vmas = ((double)maps1->vma_count - (double)maps0->vma_count) / (double)count;
+  double rss = ((double)info1->rss - (double)info0->rss) / (double)count;
+  if (vmas > mem_vmas_per_prompt) mem_vmas_per_prompt = vmas;
+  if (rss > mem_rss_per_prompt) mem_rss_per_prompt = rss;
+}
+
+static void bench_memory_skip(const char* name, long count, long depth, const char* reason) {
+  mpb_record_begin(SUITE, name);
+  mpb_record_int("count", count);
+  mpb_record_int("depth", depth);
+  mpb_record_str("skipped", reason);
+  mpb_record_end();
+  mpb_printf("%-10s %-28s %-10s skipped: %s\n", SUITE, name, mpb_options.config, reason);
+}
+
+static void bench_memory(long count, long depth) {
+  char name[64];
+  snprintf(name, sizeof(name), "suspended/%ld", count);
+  if (!mpb_selected(SUITE, name)) return;
+  mp_resume_t** rs = (mp_resume_t**)calloc((size_t)count, sizeof(mp_resume_t*));
+  if (rs == NULL) {
+    bench_memory_skip(name, count, depth, "out of memory");
+    return;
+  }
+  mpb_maps_info_t start_maps;
+  mpb_process_maps(&start_maps);
+  mpb_process_info_t start_info;
+  mpb_process_info(&start_info);
+  mp_commit_stats_reset();
+  mpb_nsecs_t setup = 0;
+  long i = 0;
+  while (i < count) {
+    // create the next batch
+    long n = (i == 0 ? MEM_PROBE_COUNT : 2*i);
+    if (n > count) n = count;
+    mpb_nsecs_t start = mpb_clock_now();
+    for (; i < n; i++) {
+      rs[i] = (mp_resume_t*)mp_prompt(&suspended, (void*)(intptr_t)depth);
+    }
+    setup += mpb_clock_now() - start;
+    if (i >= count) break;
+
+    // check if the full count still fits in the VMA limit and available memory
+    mpb_maps_info_t maps;
+    mpb_process_maps(&maps);
+    mpb_process_info_t info;
+    mpb_process_info(&info);
+    mem_update_per_prompt(&start_maps, &maps, &start_info, &info, i);
+    const double vmas = (double)maps.vma_count + (double)(count - i) * mem_vmas_per_prompt;
+    const double rss = (double)(count - i) * mem_rss_per_prompt;
+    const size_t max_vmas = mpb_max_vma_count();
+    const size_t avail = mpb_available_memory();
+    const char* reason = NULL;
+    if (max_vmas > 0 && vmas > 0.9 * (double)max_vmas) reason = "exceeds vm.max_map_count";
+    else if (avail > 0 && rss > 0.9 * (double)avail) reason = "exceeds the available memory";
+    if (reason != NULL) {
+      resume_all(rs, i);
+      free(rs);
+      bench_memory_skip(name, count, depth, reason);
+      return;
+    }
+  }
+
+  mpb_maps_info_t maps;
+  mpb_process_maps(&maps);
+  mpb_process_info_t info;
+  mpb_process_info(&info);
+  mem_update_per_prompt(&start_maps, &maps, &start_info, &info, count);
+  mpb_nsecs_t start = mpb_clock_now();
+  resume_all(rs, count);
+  mpb_nsecs_t teardown = mpb_clock_now() - start;
+  free(rs);
+  mp_commit_stats_t commit;
+  mp_commit_stats(&commit);
+
+  const int64_t rss_delta = (int64_t)info.rss - (int64_t)start_info.rss;
+  const int64_t committed_delta = (int64_t)maps.committed - (int64_t)start_maps.committed;
+  mpb_record_begin(SUITE, name);
+  mpb_record_int("count", count);
+  mpb_record_int("depth", depth);
+  mpb_record_int("rss_delta", rss_delta);
+  mpb_record_int("rss_per_prompt", rss_delta / count);
+  mpb_record_int("committed_delta", committed_delta);
+  mpb_record_int("committed_per_prompt", committed_delta / count);
+  mpb_record_int("vma_count", (int64_t)maps.vma_count);
+  mpb_record_int("vma_delta", (int64_t)maps.vma_count - (int64_t)start_maps.vma_count);
+  mpb_record_num("ns_setup", (double)setup / (double)count);
+  mpb_record_num("ns_teardown", (double)teardown / (double)count);
+  mpb_record_num("ms_setup", (double)setup / 1e6);
+  mpb_record_num("ms_teardown", (double)teardown / 1e6);
+  mpb_record_int("page_faults", (int64_t)(info.page_faults - start_info.page_faults));
+  mpb_record_int("commit_faults", commit.faults);
+  mpb_record_num("commit_faults_per_prompt", (double)commit.faults / (double)count);
+  mpb_record_num("commit_bytes_per_fault", (commit.faults > 0 ? (double)commit.committed / (double)commit.faults : 0));
+  mpb_record_num("commit_ns_per_fault", (commit.faults > 0 ? (double)commit.nsecs / (double)commit.faults : 0));
+  mpb_record_int("rss", (int64_t)info.rss);
+  mpb_record_int("peak_rss", (int64_t)info.peak_rss);
+  mpb_record_end();
+  mpb_printf("%-10s %-28s %-10s %8ld rss/prompt, %8ld committed/prompt, %7zu vmas, setup %.1f ns, teardown %.1f ns\n",
+             SUITE, name, mpb_options.config, (long)(rss_delta / count), (long)(committed_delta / count),
+             maps.vma_count, (double)setup / (double)count, (double)teardown / (double)count);
+}
+
+
+/*-----------------------------------------------------------------
+  Run
+-----------------------------------------------------------------*/
+
+void mpb_memory_run(void) {
+  const char* counts = (mpb_options.counts != NULL ? mpb_options.counts : "10000,100000,1000000");
+  for (const char* p = counts; p != NULL && *p != 0; ) {
+    long count = atol(p);
+    if (count > 0) bench_memory(count, mpb_options.depth);
+    p = strchr(p, ',');
+    if (p != NULL) p++;
+  }
+}
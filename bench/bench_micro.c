@@ -0,0 +1,266 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Micro benchmarks of the basic operations: prompts, yields and resumes,
+  multi-shot resumptions, gstack allocation, and performing each kind
+  of effect operation.
+-----------------------------------------------------------------------------*/
+#include "bench.h"
+#include <errno.h>
+#include "internal/util.h"
+#include "internal/longjmp.h"
+#include "internal/gstack.h"
+
+#define SUITE  "micro"
+
+/*-----------------------------------------------------------------
+  Prompts
+-----------------------------------------------------------------*/
+
+static void* return_fun(mp_prompt_t* p, void* arg) {
+  MPB_UNUSED(p);
+  return arg;
+}
+
+static void bench_prompt(long n, void* arg) {
+  MPB_UNUSED(arg);
+  for (long i = 0; i < n; i++) {
+    mp_prompt(&return_fun, NULL);
+  }
+}
+
+// A generator yields its resumption on every iteration until it is resumed with `NULL`
+static void* yield_resumption(mp_resume_t* r, void* arg) {
+  MPB_UNUSED(arg);
+  return r;
+}
+
+static void* generator_fun(mp_prompt_t* p, void* arg) {
+  while (arg != NULL) {
+    arg = mp_yield(p, &yield_resumption, NULL);
+  }
+  return NULL;
+}
+
+static void bench_yield_resume(long n, void* arg) {
+  MPB_UNUSED(arg);
+  mp_resume_t* r = (mp_resume_t*)mp_prompt(&generator_fun, (void*)1);
+  for (long i = 0; i < n; i++) {
+    r = (mp_resume_t*)mp_resume(r, (void*)1);
+  }
+  mp_resume(r, NULL);
+}
+
+// Restart a short generator (that yields once) under a fresh prompt, or under a retained one
+static void bench_restart(long n, void* arg) {
+  MPB_UNUSED(arg);
+  for (long i = 0; i < n; i++) {
+    mp_resume_t* r = (mp_resume_t*)mp_prompt(&generator_fun, (void*)1);
+    mp_resume(r, NULL);
+  }
+}
+
+static void bench_restart_reuse(long n, void* arg) {
+  MPB_UNUSED(arg);
+  mp_prompt_t* p = mp_prompt_retain(mp_prompt_create());
+  for (long i = 0; i < n; i++) {
+    mp_resume_t* r = (mp_resume_t*)mp_prompt_enter(p, &generator_fun, (void*)1);
+    mp_resume(r, NULL);
+  }
+  mp_prompt_release(p);
+}
+
+static void bench_prompt_reuse(long n, void* arg) {
+  MPB_UNUSED(arg);
+  mp_prompt_t* p = mp_prompt_retain(mp_prompt_create());
+  for (long i = 0; i < n; i++) {
+    mp_prompt_enter(p, &return_fun, NULL);
+  }
+  mp_prompt_release(p);
+}
+
+static void* resume_tail(mp_resume_t* r, void* arg) {
+  return mp_resume_tail(r, arg);
+}
+
+static void* resume_tail_fun(mp_prompt_t* p, void* arg) {
+  long n = (long)(intptr_t)arg;
+  for (long i = 0; i < n; i++) {
+    mp_yield(p, &resume_tail, NULL);
+  }
+  return NULL;
+}
+
+static void bench_resume_tail(long n, void* arg) {
+  MPB_UNUSED(arg);
+  mp_prompt(&resume_tail_fun, (void*)(intptr_t)n);
+}
+
+// Resume a multi-shot resumption `n` times (each time copying the saved stack)
+static void* resume_multi(mp_resume_t* r, void* arg) {
+  long n = (long)(intptr_t)arg;
+  mp_resume_t* m = mp_resume_multi(r);
+  for (long i = 1; i < n; i++) {
+    mp_resume(mp_resume_dup(m), NULL);
+  }
+  return mp_resume(m, NULL);
+}
+
+static void* multi_fun(mp_prompt_t* p, void* arg) {
+  mp_yield(p, &resume_multi, arg);
+  return NULL;
+}
+
+static void bench_multi(long n, void* arg) {
+  MPB_UNUSED(arg);
+  mp_prompt(&multi_fun, (void*)(intptr_t)n);
+}
+
+
+/*-----------------------------------------------------------------
+  Gstacks
+-----------------------------------------------------------------*/
+
+// Allocate and free a single gstack (which is usually served from the thread local cache)
+static void bench_gstack(long n, void* arg) {
+  MPB_UNUSED(arg);
+  for (long i = 0; i < n; i++) {
+    mp_gstack_t* g = mp_gstack_alloc(0, NULL);
+    mp_gstack_free(g, false);
+  }
+}
+
+// Allocate and free many gstacks at a time (exceeding the thread local cache)
+#define GSTACK_MANY  (64)
+
+static void bench_gstack_many(long n, void* arg) {
+  MPB_UNUSED(arg);
+  mp_gstack_t* gs[GSTACK_MANY];
+  for (long i = 0; i < n; i += GSTACK_MANY) {
+    long m = (n - i < GSTACK_MANY ? n - i : GSTACK_MANY);
+    for (long j = 0; j < m; j++) gs[j] = mp_gstack_alloc(0, NULL);
+    for (long j = 0; j < m; j++) mp_gstack_free(gs[j], false);
+  }
+}
+
+
+/*-----------------------------------------------------------------
+  Effect operations
+  The `bench` effect has an operation for each operation kind.
+-----------------------------------------------------------------*/
+
+MPE_DEFINE_EFFECT10(bench, tail_noop, tail, scoped_once, scoped, once, multi, forward, abort, never, never_finally)
+
+static void* op_resume_tail(mpe_resume_t* r, void* local, void* arg) {
+  return mpe_resume_tail(r, local, arg);
+}
+
+static void* op_resume_final(mpe_resume_t* r, void* local, void* arg) {
+  return mpe_resume_final(r, local, arg);
+}
+
+static void* op_return(mpe_resume_t* r, void* local, void* arg) {
+  MPB_UNUSED(r); MPB_UNUSED(local);
+  return arg;
+}
+
+static const mpe_operation_t bench_ops[] = {
+  { MPE_OP_TAIL_NOOP,     MPE_OPTAG(bench,tail_noop),     &op_resume_tail },
+  { MPE_OP_TAIL,          MPE_OPTAG(bench,tail),          &op_resume_tail },
+  { MPE_OP_SCOPED_ONCE,   MPE_OPTAG(bench,scoped_once),   &op_resume_tail },
+  { MPE_OP_SCOPED,        MPE_OPTAG(bench,scoped),        &op_resume_final },
+  { MPE_OP_ONCE,          MPE_OPTAG(bench,once),          &op_resume_tail },
+  { MPE_OP_MULTI,         MPE_OPTAG(bench,multi),         &op_resume_final },
+  { MPE_OP_FORWARD,       MPE_OPTAG(bench,forward),       NULL },
+  { MPE_OP_ABORT,         MPE_OPTAG(bench,abort),         &op_return },
+  { MPE_OP_NEVER,         MPE_OPTAG(bench,never),         &op_return },
+  { MPE_OP_NEVER_FINALLY, MPE_OPTAG(bench,never_finally), &op_return },
+  { MPE_OP_NULL, mpe_op_null, NULL }
+};
+static const mpe_handlerdef_t bench_hdef = { MPE_EFFECT(bench), NULL, bench_ops };
+
+// the outer handler handles forwarded operations
+static const mpe_operation_t bench_outer_ops[] = {
+  { MPE_OP_TAIL_NOOP,     MPE_OPTAG(bench,tail_noop),     &op_resume_tail },
+  { MPE_OP_TAIL_NOOP,     MPE_OPTAG(bench,tail),          &op_resume_tail },
+  { MPE_OP_TAIL_NOOP,     MPE_OPTAG(bench,scoped_once),   &op_resume_tail },
+  { MPE_OP_TAIL_NOOP,     MPE_OPTAG(bench,scoped),        &op_resume_tail },
+  { MPE_OP_TAIL_NOOP,     MPE_OPTAG(bench,once),          &op_resume_tail },
+  { MPE_OP_TAIL_NOOP,     MPE_OPTAG(bench,multi),         &op_resume_tail },
+  { MPE_OP_TAIL_NOOP,     MPE_OPTAG(bench,forward),       &op_resume_tail },
+  { MPE_OP_TAIL_NOOP,     MPE_OPTAG(bench,abort),         &op_resume_tail },
+  { MPE_OP_TAIL_NOOP,     MPE_OPTAG(bench,never),         &op_resume_tail },
+  { MPE_OP_TAIL_NOOP,     MPE_OPTAG(bench,never_finally), &op_resume_tail },
+  { MPE_OP_NULL, mpe_op_null, NULL }
+};
+static const mpe_handlerdef_t bench_outer_hdef = { MPE_EFFECT(bench), NULL, bench_outer_ops };
+
+typedef struct perform_env_s {
+  mpe_optag_t optag;
+  long        n;
+} perform_env_t;
+
+static void* perform_loop(void* arg) {
+  perform_env_t* env = (perform_env_t*)arg;
+  for (long i = 0; i < env->n; i++) {
+    mpe_perform(env->optag, NULL);
+  }
+  return NULL;
+}
+
+static void* perform_handle(void* arg) {
+  return mpe_handle(&bench_hdef, NULL, &perform_loop, arg);
+}
+
+// Perform `n` operations under a handler, in chunks of at most `PERFORM_CHUNK` operations per handler
+// as scoped and multi-shot operations resume in a nested frame (and would overflow the stack eventually)
+#define PERFORM_CHUNK  (1000)
+
+static void bench_perform(long n, void* arg) {
+  while (n > 0) {
+    perform_env_t env = { (mpe_optag_t)arg, (n > PERFORM_CHUNK ? PERFORM_CHUNK : n) };
+    mpe_handle(&bench_outer_hdef, NULL, &perform_handle, &env);
+    n -= env.n;
+  }
+}
+
+static void* perform_once(void* arg) {
+  return mpe_perform((mpe_optag_t)arg, NULL);
+}
+
+// Operations that never resume exit their handler so we handle every operation
+static void bench_perform_handle(long n, void* arg) {
+  for (long i = 0; i < n; i++) {
+    mpe_handle(&bench_hdef, NULL, &perform_once, arg);
+  }
+}
+
+
+/*-----------------------------------------------------------------
+  Run
+-----------------------------------------------------------------*/
+
+void mpb_micro_run(void) {
+  mpb_run(SUITE, "prompt/enter_return", &bench_prompt, NULL);
+  mpb_run(SUITE, "prompt/enter_return_reuse", &bench_prompt_reuse, NULL);
+  mpb_run(SUITE, "prompt/yield_resume", &bench_yield_resume, NULL);
+  mpb_run(SUITE, "prompt/restart", &bench_restart, NULL);
+  mpb_run(SUITE, "prompt/restart_reuse", &bench_restart_reuse, NULL);
+  mpb_run(SUITE, "prompt/resume_tail", &bench_resume_tail, NULL);
+  mpb_run(SUITE, "prompt/multi_dup_resume", &bench_multi, NULL);
+  mpb_run(SUITE, "gstack/alloc_free", &bench_gstack, NULL);
+  mpb_run(SUITE, "gstack/alloc_free_64", &bench_gstack_many, NULL);
+  mpb_run(SUITE, "perform/tail_noop", &bench_perform, (void*)MPE_OPTAG(bench,tail_noop));
+  mpb_run(SUITE, "perform/tail", &bench_perform, (void*)MPE_OPTAG(bench,tail));
+  mpb_run(SUITE, "perform/scoped_once", &bench_perform, (void*)MPE_OPTAG(bench,scoped_once));
+  mpb_run(SUITE, "perform/scoped", &bench_perform, (void*)MPE_OPTAG(bench,scoped));
+  mpb_run(SUITE, "perform/once", &bench_perform, (void*)MPE_OPTAG(bench,once));
+  mpb_run(SUITE, "perform/multi", &bench_perform, (void*)MPE_OPTAG(bench,multi));
+  mpb_run(SUITE, "perform/forward", &bench_perform, (void*)MPE_OPTAG(bench,forward));
+  mpb_run(SUITE, "handle_perform/abort", &bench_perform_handle, (void*)MPE_OPTAG(bench,abort));
+  mpb_run(SUITE, "handle_perform/never", &bench_perform_handle, (void*)MPE_OPTAG(bench,never));
+  mpb_run(SUITE, "handle_perform/never_finally", &bench_perform_handle, (void*)MPE_OPTAG(bench,never_finally));
+}
@@ -0,0 +1,178 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Scheduler throughput on 1, 2, 4, ... up to `--threads` workers:
+
+  - spawn/<w>: spawn and run empty tasks (spawned from one task per worker).
+  - yield/<w>: `mps_yield_now` in 8 tasks per worker.
+  - park/<w> : pass a token between pairs of tasks with `mps_park`/`mps_unpark`.
+
+  Each sample is a full `mps_run` (including starting the worker threads),
+  and the time is reported per operation over all workers.
+-----------------------------------------------------------------------------*/
+#include "bench.h"
+#include <mp_sched.h>
+#include "internal/atomic.h"
+
+#define SUITE  "sched"
+
+#define YIELD_TASKS   (8)    // yielding tasks per worker
+#define PARK_PAIRS    (4)    // pairs of ping-pong tasks per worker
+
+typedef struct pair_s     pair_t;
+typedef struct pair_arg_s pair_arg_t;
+
+typedef struct sched_env_s {
+  int         workers;
+  long        n;            // total operations
+  long        pair_count;   // for `park`
+  pair_t*     pairs;
+  pair_arg_t* pair_args;
+} sched_env_t;
+
+static void sched_run(int workers, mps_fun_t* fun, long n) {
+  mps_config_t config = mps_config_default();
+  config.workers = workers;
+  sched_env_t env = { workers, n, 0, NULL, NULL };
+  mps_run(&config, fun, &env, NULL);
+}
+
+
+/*-----------------------------------------------------------------
+  Spawn
+-----------------------------------------------------------------*/
+
+static void spawn_empty(void* arg) {
+  MPB_UNUSED(arg);
+}
+
+static void spawn_spread(void* arg) {
+  const long n = (long)(intptr_t)arg;
+  for (long i = 0; i < n; i++) mps_spawn(&spawn_empty, NULL);
+}
+
+static void spawn_main(void* arg) {
+  const sched_env_t* env = (const sched_env_t*)arg;
+  for (int i = 0; i < env->workers; i++) {
+    mps_spawn(&spawn_spread, (void*)(intptr_t)(env->n / env->workers + 1));
+  }
+}
+
+static void bench_spawn(long n, void* arg) {
+  sched_run((int)(intptr_t)arg, &spawn_main, n);
+}
+
+
+/*-----------------------------------------------------------------
+  Yield
+-----------------------------------------------------------------*/
+
+static void yield_task(void* arg) {
+  const long n = (long)(intptr_t)arg;
+  for (long i = 0; i < n; i++) mps_yield_now();
+}
+
+static void yield_main(void* arg) {
+  const sched_env_t* env = (const sched_env_t*)arg;
+  const long tasks = (long)env->workers * YIELD_TASKS;
+  for (long i = 0; i < tasks; i++) {
+    mps_spawn(&yield_task, (void*)(intptr_t)(env->n / tasks + 1));
+  }
+}
+
+static void bench_yield(long n, void* arg) {
+  sched_run((int)(intptr_t)arg, &yield_main, n);
+}
+
+
+/*-----------------------------------------------------------------
+  Park and unpark
+-----------------------------------------------------------------*/
+
+struct pair_s {
+  _Atomic(intptr_t) turn;
+  _Atomic(intptr_t) tasks[2];    // `mps_task_t*`
+  long              rounds;
+};
+
+struct pair_arg_s {
+  pair_t* pair;
+  long    side;
+};
+
+static mps_task_t* pair_other(pair_t* pair, long side) {
+  intptr_t t;
+  while ((t = mp_atomic_load(&pair->tasks[1 - side])) == 0) { mps_yield_now(); }
+  return (mps_task_t*)t;
+}
+
+static void pair_task(void* arg) {
+  pair_arg_t* pa = (pair_arg_t*)arg;
+  pair_t* pair = pa->pair;
+  const long side = pa->side;
+  mp_atomic_store(&pair->tasks[side], (intptr_t)mps_current());
+  mps_task_t* other = pair_other(pair, side);
+  for (long i = 0; i < pair->rounds; i++) {
+    while (mp_atomic_load(&pair->turn) != side) { mps_park(); }
+    mp_atomic_store(&pair->turn, (intptr_t)(1 - side));
+    mps_unpark(other);
+  }
+}
+
+static void park_main(void* arg) {
+  const sched_env_t* env = (const sched_env_t*)arg;
+  for (long i = 0; i < env->pair_count; i++) {
+    env->pairs[i].rounds = env->n / (2 * env->pair_count) + 1;
+    for (long side = 0; side < 2; side++) {
+      env->pair_args[2*i + side].pair = &env->pairs[i];
+      env->pair_args[2*i + side].side = side;
+      mps_spawn(&pair_task, &env->pair_args[2*i + side]);
+    }
+  }
+}
+
+static void bench_park(long n, void* arg) {
+  const int workers = (int)(intptr_t)arg;
+  sched_env_t env = { workers, n, (long)workers * PARK_PAIRS, NULL, NULL };
+  env.pairs = (pair_t*)calloc((size_t)env.pair_count, sizeof(pair_t));
+  env.pair_args = (pair_arg_t*)calloc((size_t)env.pair_count * 2, sizeof(pair_arg_t));
+  if (env.pairs != NULL && env.pair_args != NULL) {
+    mps_config_t config = mps_config_default();
+    config.workers = workers;
+    mps_run(&config, &park_main, &env, NULL);
+  }
+  free(env.pairs);
+  free(env.pair_args);
+}
+
+
+/*-----------------------------------------------------------------
+  Run
+-----------------------------------------------------------------*/
+
+static void sched_count(void* arg) {
+  *((int*)arg) = mps_worker_count();
+}
+
+static void bench_sched(int workers) {
+  char name[64];
+  snprintf(name, sizeof(name), "spawn/%d", workers);
+  mpb_run(SUITE, name, &bench_spawn, (void*)(intptr_t)workers);
+  snprintf(name, sizeof(name), "yield/%d", workers);
+  mpb_run(SUITE, name, &bench_yield, (void*)(intptr_t)workers);
+  snprintf(name, sizeof(name), "park/%d", workers);
+  mpb_run(SUITE, name, &bench_park, (void*)(intptr_t)workers);
+}
+
+void mpb_sched_run(void) {
+  int max_workers = (int)mpb_options.threads;
+  if (max_workers <= 0) mps_run(NULL, &sched_count, &max_workers, NULL);  // the CPU count
+  int n = 1;
+  for (; n < max_workers; n *= 2) {
+    bench_sched(n);
+  }
+  bench_sched(max_workers);
+}
@@ -0,0 +1,63 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Deep recursion on fresh stacks: each operation starts a prompt that
+  recurses 64 KiB or 1 MiB deep and suspends. We keep a batch of suspended
+  prompts that exceeds the thread-local gstack cache so most prompts get
+  a fresh gstack. Run under the `populate` and `hugepages` configurations
+  to compare the page faults, commit-on-demand faults, and TLB misses
+  (recorded when perf events are available) against commit-on-demand.
+-----------------------------------------------------------------------------*/
+#include "bench.h"
+
+#define SUITE  "stacks"
+
+#define RECURSE_FRAME  (1024)   // bytes of locals per recursion frame
+#define RECURSE_BATCH  (16)     // suspended prompts at a time
+
+
+/*-----------------------------------------------------------------
+  Deep recursion
+-----------------------------------------------------------------*/
+
+static void* recurse_suspend(mp_resume_t* r, void* arg) {
+  MPB_UNUSED(arg);
+  return r;
+}
+
+static mpb_decl_noinline long recurse(mp_prompt_t* p, long depth) {
+  volatile uint8_t frame[RECURSE_FRAME];
+  frame[0] = (uint8_t)depth;
+  if (depth <= 0) {
+    mp_yield(p, &recurse_suspend, NULL);
+    return frame[0];
+  }
+  return recurse(p, depth - 1) + frame[0];
+}
+
+static void* recurse_start(mp_prompt_t* p, void* arg) {
+  return (void*)(intptr_t)recurse(p, (long)(intptr_t)arg);
+}
+
+static void bench_recurse(long n, void* arg) {
+  const long depth = (long)(intptr_t)arg;
+  mp_resume_t* rs[RECURSE_BATCH];
+  for (long i = 0; i < n; i += RECURSE_BATCH) {
+    long m = (n - i < RECURSE_BATCH ? n - i : RECURSE_BATCH);
+    for (long j = 0; j < m; j++) rs[j] = (mp_resume_t*)mp_prompt(&recurse_start, (void*)(intptr_t)depth);
+    for (long j = 0; j < m; j++) mp_resume(rs[j], NULL);
+  }
+}
+
+
+/*-----------------------------------------------------------------
+  Run
+-----------------------------------------------------------------*/
+
+void mpb_stacks_run(void) {
+  mpb_run(SUITE, "recurse/64k", &bench_recurse, (void*)(intptr_t)((64 * 1024) / RECURSE_FRAME));
+  mpb_run(SUITE, "recurse/1m", &bench_recurse, (void*)(intptr_t)((1024 * 1024) / RECURSE_FRAME));
+}
@@ -0,0 +1,193 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Contention on synchronization primitives between scheduled tasks
+  (8 tasks per worker, on 1, 2, 4, ... up to `--threads` workers):
+
+  - mutex/<w>        : lock, increment a counter, and unlock an `mp_mutex_t`.
+  - mutex_lifo/<w>   : the same with LIFO wake up order.
+  - pthread_mutex/<w>: the same with a `pthread_mutex_t` (which blocks the worker
+                       thread when contended instead of parking the task).
+  - sema/<w>         : acquire and release an `mp_sema_t` with one unit per worker.
+  - cond/<w>         : pass a token around the tasks with an `mp_cond_t` broadcast.
+  - pthread_cond/<w> : the same with a `pthread_cond_t` (with a single task per
+                       worker, as a blocking wait would stall the other tasks of a worker).
+
+  The time is reported per operation over all tasks.
+-----------------------------------------------------------------------------*/
+#include "bench.h"
+#include <mp_sched.h>
+#include <mp_sync.h>
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#define MPB_HAS_PTHREAD  (1)
+#else
+#define MPB_HAS_PTHREAD  (0)
+#endif
+
+#define SUITE  "sync"
+
+#define TASKS_PER_WORKER  (8)
+
+typedef enum sync_kind_e {
+  SYNC_MUTEX,
+  SYNC_MUTEX_LIFO,
+  SYNC_PTHREAD_MUTEX,
+  SYNC_SEMA,
+  SYNC_COND,
+  SYNC_PTHREAD_COND
+} sync_kind_t;
+
+typedef struct sync_env_s {
+  sync_kind_t     kind;
+  int             tasks;
+  long            n;           // operations per task
+  long            counter;
+  long            turn;        // for `cond`: the task whose turn it is
+  mp_mutex_t*     mutex;
+  mp_sema_t*      sema;
+  mp_cond_t*      cond;
+  #if MPB_HAS_PTHREAD
+  pthread_mutex_t pmutex;
+  pthread_cond_t  pcond;
+  #endif
+} sync_env_t;
+
+typedef struct sync_arg_s {
+  sync_env_t* env;
+  long        id;
+} sync_arg_t;
+
+
+/*-----------------------------------------------------------------
+  Tasks
+-----------------------------------------------------------------*/
+
+static void sync_task(void* arg) {
+  sync_arg_t* sa = (sync_arg_t*)arg;
+  sync_env_t* env = sa->env;
+  for (long i = 0; i < env->n; i++) {
+    switch (env->kind) {
+      case SYNC_MUTEX:
+      case SYNC_MUTEX_LIFO:
+        mp_mutex_lock(env->mutex);
+        env->counter++;
+        mp_mutex_unlock(env->mutex);
+        break;
+      case SYNC_SEMA:
+        mp_sema_acquire(env->sema);
+        mp_sema_release(env->sema);
+        break;
+      case SYNC_COND:
+        mp_mutex_lock(env->mutex);
+        while (env->turn != sa->id) mp_cond_wait(env->cond, env->mutex);
+        env->turn = (env->turn + 1) % env->tasks;
+        mp_cond_broadcast(env->cond);
+        mp_mutex_unlock(env->mutex);
+        break;
+      #if MPB_HAS_PTHREAD
+      case SYNC_PTHREAD_MUTEX:
+        pthread_mutex_lock(&env->pmutex);
+        env->counter++;
+        pthread_mutex_unlock(&env->pmutex);
+        break;
+      case SYNC_PTHREAD_COND:
+        pthread_mutex_lock(&env->pmutex);
+        while (env->turn != sa->id) pthread_cond_wait(&env->pcond, &env->pmutex);
+        env->turn = (env->turn + 1) % env->tasks;
+        pthread_cond_broadcast(&env->pcond);
+        pthread_mutex_unlock(&env->pmutex);
+        break;
+      #endif
+      default: break;
+    }
+  }
+}
+
+static void sync_main(void* arg) {
+  sync_arg_t* args = (sync_arg_t*)arg;
+  for (long i = 0; i < args[0].env->tasks; i++) mps_spawn(&sync_task, &args[i]);
+}
+
+static void bench_sync(sync_kind_t kind, int workers, long n) {
+  sync_env_t env;
+  memset(&env, 0, sizeof(env));
+  env.kind = kind;
+  env.tasks = workers * (kind == SYNC_PTHREAD_COND ? 1 : TASKS_PER_WORKER);
+  env.n = n / env.tasks + 1;
+  env.mutex = mp_mutex_create(kind == SYNC_MUTEX_LIFO ? MP_SYNC_LIFO : MP_SYNC_FIFO);
+  env.sema = mp_sema_create((size_t)workers, MP_SYNC_FIFO);
+  env.cond = mp_cond_create(MP_SYNC_FIFO);
+  #if MPB_HAS_PTHREAD
+  pthread_mutex_init(&env.pmutex, NULL);
+  pthread_cond_init(&env.pcond, NULL);
+  #endif
+  sync_arg_t* args = (sync_arg_t*)calloc((size_t)env.tasks, sizeof(sync_arg_t));
+  if (args != NULL) {
+    for (long i = 0; i < env.tasks; i++) {
+      args[i].env = &env;
+      args[i].id = i;
+    }
+    mps_config_t config = mps_config_default();
+    config.workers = workers;
+    mps_run(&config, &sync_main, args, NULL);
+    free(args);
+  }
+  #if MPB_HAS_PTHREAD
+  pthread_cond_destroy(&env.pcond);
+  pthread_mutex_destroy(&env.pmutex);
+  #endif
+  mp_cond_free(env.cond);
+  mp_sema_free(env.sema);
+  mp_mutex_free(env.mutex);
+}
+
+static int bench_workers;
+
+static void bench_kind(long n, void* arg) {
+  bench_sync((sync_kind_t)(intptr_t)arg, bench_workers, n);
+}
+
+
+/*-----------------------------------------------------------------
+  Run
+-----------------------------------------------------------------*/
+
+static void sync_count(void* arg) {
+  *((int*)arg) = mps_worker_count();
+}
+
+static void bench_sync_workers(int workers) {
+  static const struct { const char* name; sync_kind_t kind; } kinds[] = {
+    { "mutex", SYNC_MUTEX },
+    { "mutex_lifo", SYNC_MUTEX_LIFO },
+    #if MPB_HAS_PTHREAD
+    { "pthread_mutex", SYNC_PTHREAD_MUTEX },
+    #endif
+    { "sema", SYNC_SEMA },
+    { "cond", SYNC_COND },
+    #if MPB_HAS_PTHREAD
+    { "pthread_cond", SYNC_PTHREAD_COND },
+    #endif
+  };
+  bench_workers = workers;
+  for (size_t i = 0; i < sizeof(kinds)/sizeof(kinds[0]); i++) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s/%d", kinds[i].name, workers);
+    mpb_run(SUITE, name, &bench_kind, (void*)(intptr_t)kinds[i].kind);
+  }
+}
+
+void mpb_sync_run(void) {
+  int max_workers = (int)mpb_options.threads;
+  if (max_workers <= 0) mps_run(NULL, &sync_count, &max_workers, NULL);  // the CPU count
+  int n = 1;
+  for (; n < max_workers; n *= 2) {
+    bench_sync_workers(n);
+  }
+  bench_sync_workers(max_workers);
+}
@@ -0,0 +1,290 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Multi-threaded scaling: run the async worker pattern (as in `test_mp_async`)
+  on 1, 2, 4, ... up to `--threads` threads at the same time. Each thread
+  keeps a ring of suspended workers; an operation completes the oldest
+  worker (using some stack) and starts a new one in its place.
+
+  For each thread count we report the throughput per thread, the contention
+  on the gpool spin locks, the cache hits of the thread-local gstack caches,
+  the page fault rate, and the RSS.
+-----------------------------------------------------------------------------*/
+#include "bench.h"
+#include <errno.h>
+#include "internal/util.h"
+#include "internal/atomic.h"
+#include "internal/longjmp.h"
+#include "internal/gstack.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define SUITE  "threads"
+
+#define ASYNC_ACTIVE  (256)   // active workers per thread
+#define ASYNC_USE_KB  (16)    // stack used by a worker after resuming
+#define ASYNC_BATCH   (64)    // operations between checking for the stop signal
+
+
+/*-----------------------------------------------------------------
+  Threads
+-----------------------------------------------------------------*/
+
+#if defined(_WIN32)
+typedef HANDLE mpb_thread_t;
+
+static DWORD WINAPI mpb_thread_start(LPVOID arg);
+
+static bool mpb_thread_create(mpb_thread_t* t, void* arg) {
+  *t = CreateThread(NULL, 0, &mpb_thread_start, arg, 0, NULL);
+  return (*t != NULL);
+}
+
+static void mpb_thread_join(mpb_thread_t t) {
+  WaitForSingleObject(t, INFINITE);
+  CloseHandle(t);
+}
+
+static void mpb_sleep_ms(long ms) {
+  Sleep((DWORD)ms);
+}
+
+static long mpb_cpu_count(void) {
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  return (long)si.dwNumberOfProcessors;
+}
+#else
+typedef pthread_t mpb_thread_t;
+
+static void* mpb_thread_start(void* arg);
+
+static bool mpb_thread_create(mpb_thread_t* t, void* arg) {
+  return (pthread_create(t, NULL, &mpb_thread_start, arg) == 0);
+}
+
+static void mpb_thread_join(mpb_thread_t t) {
+  pthread_join(t, NULL);
+}
+
+static void mpb_sleep_ms(long ms) {
+  struct timespec t;
+  t.tv_sec = ms / 1000;
+  t.tv_nsec = (ms % 1000) * 1000000L;
+  while (nanosleep(&t, &t) != 0 && errno == EINTR) { };
+}
+
+static long mpb_cpu_count(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n > 0 ? n : 1);
+}
+#endif
+
+
+/*-----------------------------------------------------------------
+  Async workers
+-----------------------------------------------------------------*/
+
+static mpb_decl_noinline void* as_stack_address(void* p) {
+  return p;
+}
+
+// touch `kb` KiB of the stack below us
+static mpb_decl_noinline void stack_use(long kb) {
+  void* top = NULL;
+  volatile uint8_t* sp = (volatile uint8_t*)as_stack_address(&top);
+  for (long i = 0; i < (kb*1024) / 4096; i++) {
+    uint8_t b = *(sp - (i * 4096));
+    MPB_UNUSED(b);
+  }
+}
+
+static void* worker_await(mp_resume_t* r, void* arg) {
+  MPB_UNUSED(arg);
+  return r;
+}
+
+static void* worker(mp_prompt_t* p, void* arg) {
+  MPB_UNUSED(arg);
+  long kb = (long)(intptr_t)mp_yield(p, &worker_await, NULL);
+  stack_use(kb);
+  return NULL;
+}
+
+// The state of each thread
+typedef struct thread_env_s {
+  long              ops;
+  mpb_nsecs_t       elapsed;
+  mp_gstack_stats_t stats;
+  mp_resume_t*      workers[ASYNC_ACTIVE];
+} thread_env_t;
+
+static _Atomic(intptr_t) threads_ready;
+static _Atomic(intptr_t) threads_go;
+static _Atomic(intptr_t) threads_stop;
+
+static void thread_run(thread_env_t* env) {
+  // start the initial workers
+  for (long j = 0; j < ASYNC_ACTIVE; j++) {
+    env->workers[j] = (mp_resume_t*)mp_prompt(&worker, NULL);
+  }
+  mp_gstack_stats_t start_stats;
+  mp_gstack_stats(&start_stats);
+  mp_atomic_add(&threads_ready, (intptr_t)1);
+  while (mp_atomic_load(&threads_go) == 0) { mp_atomic_yield(); }
+
+  // complete the oldest worker and start a new one, until stopped
+  mpb_nsecs_t start = mpb_clock_now();
+  long next = 0;
+  long ops = 0;
+  while (mp_atomic_load(&threads_stop) == 0) {
+    for (long i = 0; i < ASYNC_BATCH; i++) {
+      mp_resume(env->workers[next], (void*)(intptr_t)ASYNC_USE_KB);
+      env->workers[next] = (mp_resume_t*)mp_prompt(&worker, NULL);
+      next = (next + 1) % ASYNC_ACTIVE;
+    }
+    ops += ASYNC_BATCH;
+  }
+  env->elapsed = mpb_clock_now() - start;
+  env->ops = ops;
+  mp_gstack_stats(&env->stats);
+  env->stats.cache_hits -= start_stats.cache_hits;
+  env->stats.cache_misses -= start_stats.cache_misses;
+
+  // and complete the remaining workers
+  for (long j = 0; j < ASYNC_ACTIVE; j++) {
+    mp_resume(env->workers[j], (void*)(intptr_t)ASYNC_USE_KB);
+  }
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI mpb_thread_start(LPVOID arg) {
+  thread_run((thread_env_t*)arg);
+  return 0;
+}
+#else
+static void* mpb_thread_start(void* arg) {
+  thread_run((thread_env_t*)arg);
+  return NULL;
+}
+#endif
+
+
+/*-----------------------------------------------------------------
+  Run on `nthreads` threads for a fixed duration
+-----------------------------------------------------------------*/
+
+static void bench_threads(long nthreads, long duration_ms) {
+  char name[64];
+  snprintf(name, sizeof(name), "async/%ld", nthreads);
+  if (!mpb_selected(SUITE, name)) return;
+
+  thread_env_t* envs = (thread_env_t*)calloc((size_t)nthreads, sizeof(thread_env_t));
+  mpb_thread_t* threads = (mpb_thread_t*)calloc((size_t)nthreads, sizeof(mpb_thread_t));
+  if (envs == NULL || threads == NULL) {
+    free(envs); free(threads);
+    return;
+  }
+  mp_atomic_store(&threads_ready, (intptr_t)0);
+  mp_atomic_store(&threads_go, (intptr_t)0);
+  mp_atomic_store(&threads_stop, (intptr_t)0);
+
+  long started = 0;
+  for (; started < nthreads; started++) {
+    if (!mpb_thread_create(&threads[started], &envs[started])) break;
+  }
+  while (mp_atomic_load(&threads_ready) < (intptr_t)started) { mpb_sleep_ms(1); }
+
+  // measure while all threads run
+  mp_gstack_stats_t start_stats;
+  mp_gstack_stats(&start_stats);
+  mpb_process_info_t start_info;
+  mpb_process_info(&start_info);
+  mpb_nsecs_t start = mpb_clock_now();
+  mp_atomic_store(&threads_go, (intptr_t)1);
+  mpb_sleep_ms(duration_ms);
+  mp_atomic_store(&threads_stop, (intptr_t)1);
+  for (long i = 0; i < started; i++) {
+    mpb_thread_join(threads[i]);
+  }
+  const double secs = (double)(mpb_clock_now() - start) / 1e9;
+  mpb_process_info_t info;
+  mpb_process_info(&info);
+  mp_gstack_stats_t stats;
+  mp_gstack_stats(&stats);
+
+  // per thread throughput
+  long ops = 0;
+  double tput_min = 0;
+  double tput_max = 0;
+  double tput_total = 0;
+  ssize_t cache_hits = 0;
+  ssize_t cache_misses = 0;
+  for (long i = 0; i < started; i++) {
+    const thread_env_t* env = &envs[i];
+    double tput = (env->elapsed > 0 ? (double)env->ops * 1e9 / (double)env->elapsed : 0);
+    if (i == 0 || tput < tput_min) tput_min = tput;
+    if (i == 0 || tput > tput_max) tput_max = tput;
+    tput_total += tput;
+    ops += env->ops;
+    cache_hits += env->stats.cache_hits;
+    cache_misses += env->stats.cache_misses;
+  }
+  const double tput_mean = (started > 0 ? tput_total / (double)started : 0);
+  const ssize_t locks = stats.gpool_lock_count - start_stats.gpool_lock_count;
+  const ssize_t contended = stats.gpool_lock_contended - start_stats.gpool_lock_contended;
+  const ssize_t spins = stats.gpool_lock_spins - start_stats.gpool_lock_spins;
+  const size_t faults = info.page_faults - start_info.page_faults;
+
+  mpb_record_begin(SUITE, name);
+  mpb_record_int("threads", started);
+  mpb_record_int("duration_ms", duration_ms);
+  mpb_record_int("ops", ops);
+  mpb_record_num("ops_per_sec", tput_total);
+  mpb_record_num("ops_per_sec_thread", tput_mean);
+  mpb_record_num("ops_per_sec_thread_min", tput_min);
+  mpb_record_num("ops_per_sec_thread_max", tput_max);
+  mpb_record_num("ns_per_op_thread", (tput_mean > 0 ? 1e9 / tput_mean : 0));
+  mpb_record_int("gpool_count", stats.gpool_count);
+  mpb_record_int("gpool_lock_count", locks);
+  mpb_record_int("gpool_lock_contended", contended);
+  mpb_record_int("gpool_lock_spins", spins);
+  mpb_record_num("gpool_contention_pct", (locks > 0 ? 100.0 * (double)contended / (double)locks : 0));
+  mpb_record_int("cache_hits", cache_hits);
+  mpb_record_int("cache_misses", cache_misses);
+  mpb_record_int("page_faults", (int64_t)faults);
+  mpb_record_num("page_faults_per_sec", (secs > 0 ? (double)faults / secs : 0));
+  mpb_record_int("rss", (int64_t)info.rss);
+  mpb_record_int("peak_rss", (int64_t)info.peak_rss);
+  mpb_record_end();
+  mpb_printf("%-10s %-28s %-10s %10.1f ns/op per thread (min %.0f, max %.0f ops/s), gpool contention: %.2f%%, faults/s: %.0f, rss: %zukb\n",
+             SUITE, name, mpb_options.config, (tput_mean > 0 ? 1e9 / tput_mean : 0), tput_min, tput_max,
+             (locks > 0 ? 100.0 * (double)contended / (double)locks : 0), (secs > 0 ? (double)faults / secs : 0), info.rss / 1024);
+  free(envs);
+  free(threads);
+}
+
+
+/*-----------------------------------------------------------------
+  Run
+-----------------------------------------------------------------*/
+
+void mpb_threads_run(void) {
+  const long max_threads = (mpb_options.threads > 0 ? mpb_options.threads : mpb_cpu_count());
+  const long duration_ms = (mpb_options.samples > 0 ? mpb_options.samples : 1) * mpb_options.sample_ms;
+  long n = 1;
+  for (; n < max_threads; n *= 2) {
+    bench_threads(n, duration_ms);
+  }
+  bench_threads(max_threads, duration_ms);
+}
@@ -0,0 +1,297 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Timing, statistics, process information, and JSON records.
+-----------------------------------------------------------------------------*/
+#include "bench.h"
+
+mpb_options_t mpb_options = { NULL, 25, 2, "default", 0, NULL, 8 };
+
+bool mpb_selected(const char* suite, const char* name) {
+  if (mpb_options.filter == NULL) return true;
+  char full[256];
+  snprintf(full, sizeof(full), "%s/%s", suite, name);
+  return (strstr(full, mpb_options.filter) != NULL);
+}
+
+
+// ----------------------------------------------------------------
+// Monotonic clock in nano-seconds
+// ----------------------------------------------------------------
+#ifdef _WIN32
+#include <windows.h>
+mpb_nsecs_t mpb_clock_now(void) {
+  static LARGE_INTEGER mfreq; // = 0
+  if (mfreq.QuadPart == 0) {
+    QueryPerformanceFrequency(&mfreq);
+    if (mfreq.QuadPart == 0) mfreq.QuadPart = 1000;
+  }
+  LARGE_INTEGER t;
+  QueryPerformanceCounter(&t);
+  // calculate in parts to avoid overflow
+  int64_t secs = t.QuadPart / mfreq.QuadPart;
+  int64_t frac = t.QuadPart % mfreq.QuadPart;
+  return (secs*1000000000LL + ((frac*1000000000LL)/mfreq.QuadPart));
+}
+#else
+#include <time.h>
+mpb_nsecs_t mpb_clock_now(void) {
+  struct timespec t;
+  #ifdef CLOCK_MONOTONIC
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  #else
+  clock_gettime(CLOCK_REALTIME, &t);
+  #endif
+  return ((mpb_nsecs_t)t.tv_sec * 1000000000LL) + (mpb_nsecs_t)t.tv_nsec;
+}
+#endif
+
+
+// --------------------------------------------------------
+// Process statistics
+// --------------------------------------------------------
+#if defined(_WIN32)
+#include <psapi.h>
+#pragma comment(lib,"psapi.lib")
+
+void mpb_process_info(mpb_process_info_t* info) {
+  PROCESS_MEMORY_COUNTERS pmc;
+  GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+  info->rss = (size_t)pmc.WorkingSetSize;
+  info->peak_rss = (size_t)pmc.PeakWorkingSetSize;
+  info->page_faults = (size_t)pmc.PageFaultCount;
+  info->tlb_misses = -1;
+}
+
+#elif defined(__unix__) || defined(__unix) || defined(unix) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#include <sys/resource.h>
+#if defined(__APPLE__) && defined(__MACH__)
+#include <mach/mach.h>
+#endif
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+static size_t mpb_current_rss(void) {
+  #if defined(__APPLE__) && defined(__MACH__)
+  struct mach_task_basic_info tinfo;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&tinfo, &count) != KERN_SUCCESS) return 0;
+  return (size_t)tinfo.resident_size;
+  #else
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f == NULL) return 0;
+  long size = 0;
+  long resident = 0;
+  int n = fscanf(f, "%ld %ld", &size, &resident);
+  fclose(f);
+  return (n == 2 ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0);
+  #endif
+}
+
+// Count data TLB load misses of this thread in user mode with a perf event.
+// This is often unavailable (in virtual machines, or due to `perf_event_paranoid`).
+static int64_t mpb_tlb_misses(void) {
+  #if defined(__linux__) && defined(SYS_perf_event_open)
+  static int fd = -2;
+  if (fd == -2) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = (int)syscall(SYS_perf_event_open, &attr, 0 /* this thread */, -1 /* any cpu */, -1, 0);
+    if (fd < 0) fd = -1;
+  }
+  uint64_t count = 0;
+  if (fd < 0 || read(fd, &count, sizeof(count)) != (ssize_t)sizeof(count)) return -1;
+  return (int64_t)count;
+  #else
+  return -1;
+  #endif
+}
+
+void mpb_process_info(mpb_process_info_t* info) {
+  struct rusage rusage;
+  getrusage(RUSAGE_SELF, &rusage);
+  #if defined(__APPLE__) && defined(__MACH__)
+  info->peak_rss = (size_t)rusage.ru_maxrss;  // apple reports in bytes
+  #else
+  info->peak_rss = (size_t)rusage.ru_maxrss * 1024;
+  #endif
+  info->page_faults = (size_t)(rusage.ru_minflt + rusage.ru_majflt);
+  info->rss = mpb_current_rss();
+  info->tlb_misses = mpb_tlb_misses();
+}
+
+#else
+void mpb_process_info(mpb_process_info_t* info) {
+  info->rss = 0;
+  info->peak_rss = 0;
+  info->page_faults = 0;
+  info->tlb_misses = -1;
+}
+#endif
+
+#if defined(__linux__)
+void mpb_process_maps(mpb_maps_info_t* info) {
+  info->vma_count = 0;
+  info->committed = 0;
+  FILE* f = fopen("/proc/self/maps", "r");
+  if (f == NULL) return;
+  char line[1024];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    unsigned long long start = 0;
+    unsigned long long end = 0;
+    char perms[8] = { 0 };
+    if (sscanf(line, "%llx-%llx %7s", &start, &end, perms) != 3) continue;
+    info->vma_count++;
+    if (perms[1] == 'w' && perms[3] == 'p') {
+      info->committed += (size_t)(end - start);
+    }
+  }
+  fclose(f);
+}
+#else
+void mpb_process_maps(mpb_maps_info_t* info) {
+  info->vma_count = 0;
+  info->committed = 0;
+}
+#endif
+
+
+// --------------------------------------------------------
+// JSON records
+// --------------------------------------------------------
+
+static bool mpb_record_first;
+
+static void mpb_record_key(const char* key) {
+  if (!mpb_record_first) printf(",");
+  mpb_record_first = false;
+  printf(" \"%s\": ", key);
+}
+
+void mpb_record_begin(const char* suite, const char* name) {
+  printf("{");
+  mpb_record_first = true;
+  mpb_record_str("suite", suite);
+  mpb_record_str("name", name);
+  mpb_record_str("config", mpb_options.config);
+}
+
+void mpb_record_int(const char* key, int64_t value) {
+  mpb_record_key(key);
+  printf("%lld", (long long)value);
+}
+
+void mpb_record_num(const char* key, double value) {
+  mpb_record_key(key);
+  printf("%.3f", value);
+}
+
+void mpb_record_str(const char* key, const char* value) {
+  mpb_record_key(key);
+  printf("\"");
+  for (const char* p = value; *p != 0; p++) {
+    if (*p == '"' || *p == '\\') printf("\\");
+    printf("%c", *p);
+  }
+  printf("\"");
+}
+
+void mpb_record_end(void) {
+  printf(" }\n");
+  fflush(stdout);
+}
+
+
+// --------------------------------------------------------
+// Run a benchmark
+// --------------------------------------------------------
+
+static int mpb_compare_double(const void* p, const void* q) {
+  double x = *((const double*)p);
+  double y = *((const double*)q);
+  return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+// nearest rank percentile of sorted samples
+static double mpb_percentile(const double* xs, long n, double pct) {
+  long i = (long)((pct / 100.0) * (double)n + 0.5);
+  if (i < 1) i = 1;
+  if (i > n) i = n;
+  return xs[i - 1];
+}
+
+// Double the operation count until a sample takes at least `sample_ms`
+static long mpb_calibrate(mpb_fun_t* fun, void* arg) {
+  const mpb_nsecs_t target = (mpb_nsecs_t)mpb_options.sample_ms * 1000000;
+  long n = 1;
+  while (n < (1L << 28)) {
+    mpb_nsecs_t start = mpb_clock_now();
+    fun(n, arg);
+    mpb_nsecs_t elapsed = mpb_clock_now() - start;
+    if (elapsed >= target) break;
+    n = (elapsed <= target/64 ? n*8 : n*2);
+  }
+  return n;
+}
+
+void mpb_run(const char* suite, const char* name, mpb_fun_t* fun, void* arg) {
+  if (!mpb_selected(suite, name)) return;
+  long ops = mpb_calibrate(fun, arg);   // also warms up
+  long samples = (mpb_options.samples > 0 ? mpb_options.samples : 1);
+  double* xs = (double*)malloc((size_t)samples * sizeof(double));
+  if (xs == NULL) return;
+  mp_commit_stats_reset();
+  mpb_process_info_t start_info;
+  mpb_process_info(&start_info);
+  double total = 0;
+  for (long i = 0; i < samples; i++) {
+    mpb_nsecs_t start = mpb_clock_now();
+    fun(ops, arg);
+    mpb_nsecs_t elapsed = mpb_clock_now() - start;
+    xs[i] = (double)elapsed / (double)ops;
+    total += xs[i];
+  }
+  mpb_process_info_t info;
+  mpb_process_info(&info);
+  mp_commit_stats_t commit;
+  mp_commit_stats(&commit);
+  qsort(xs, (size_t)samples, sizeof(double), &mpb_compare_double);
+
+  const double mean = total / (double)samples;
+  const double p50  = mpb_percentile(xs, samples, 50.0);
+  const double p99  = mpb_percentile(xs, samples, 99.0);
+  const size_t faults = info.page_faults - start_info.page_faults;
+  mpb_record_begin(suite, name);
+  mpb_record_int("ops", ops);
+  mpb_record_int("samples", samples);
+  mpb_record_num("ns_mean", mean);
+  mpb_record_num("ns_min", xs[0]);
+  mpb_record_num("ns_p50", p50);
+  mpb_record_num("ns_p90", mpb_percentile(xs, samples, 90.0));
+  mpb_record_num("ns_p99", p99);
+  mpb_record_num("ns_max", xs[samples - 1]);
+  mpb_record_int("page_faults", (int64_t)faults);
+  mpb_record_int("commit_faults", commit.faults);
+  if (info.tlb_misses >= 0 && start_info.tlb_misses >= 0) {
+    const int64_t tlb_misses = info.tlb_misses - start_info.tlb_misses;
+    mpb_record_int("tlb_misses", tlb_misses);
+    mpb_record_num("tlb_misses_per_op", (double)tlb_misses / ((double)ops * (double)samples));
+  }
+  mpb_record_int("rss", (int64_t)info.rss);
+  mpb_record_int("peak_rss", (int64_t)info.peak_rss);
+  mpb_record_end();
+  mpb_printf("%-10s %-28s %-10s %10.1f ns/op (p50 %.1f, p99 %.1f), faults: %zu, commit faults: %ld, rss: %zukb\n",
+             suite, name, mpb_options.config, mean, p50, p99, faults, (long)commit.faults, info.rss / 1024);
+  free(xs);
+}
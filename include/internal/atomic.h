@@ -36,6 +36,7 @@
 #define mp_atomic_load(p)                        mp_atomic(load)(p)
 #define mp_atomic_store(p,x)                     mp_atomic(store)(p,x)
 #define mp_atomic_add(p,x)                       mp_atomic(fetch_add)(p,x)
+#define mp_atomic_exchange(p,x)                  mp_atomic(exchange)(p,x)
 
 static inline void mp_atomic_yield(void);
 
@@ -184,6 +185,11 @@ typedef _Atomic(intptr_t) mp_spin_lock_t;
 
 #define mp_spin_lock_create()  ((intptr_t)0)
 
+static inline bool mp_spin_lock_try_acquire(mp_spin_lock_t* l) {
+  intptr_t expected = 0;
+  return mp_atomic_cas(l, &expected, (intptr_t)1);
+}
+
 static inline void mp_spin_lock_acquire(mp_spin_lock_t* l) {
   intptr_t expected = 0;
   while (!mp_atomic_cas(l, &expected, (intptr_t)1)) { 
@@ -25,7 +25,27 @@ mp_gsave_t*  mp_gstack_save(mp_gstack_t* gstack, uint8_t* sp);    // save up to
 void         mp_gsave_restore(mp_gsave_t* gsave);
 void         mp_gsave_free(mp_gsave_t* gsave);
 
+void         mp_gstack_set_grow_policy(mp_gstack_t* g, const mp_grow_policy_t* policy);  // NULL for the default
+void         mp_gstack_set_peak_key(mp_gstack_t* g, const void* key);                   // usually the start function
+void         mp_gstack_end_lifetime(mp_gstack_t* g);                                    // record statistics and the peak use when a gstack is reused (as by `mp_gstack_free`)
+
 mp_gstack_t* mp_gstack_current(void);             // implemented in <mprompt.c>
+void         mp_gstack_readable(const mp_gstack_t* g, uint8_t** lo, uint8_t** hi);  // committed extent (used by `mp_backtrace_signal`)
+
+
+/*------------------------------------------------------------------------------
+   Statistics (used for benchmarking)
+------------------------------------------------------------------------------*/
+typedef struct mp_gstack_stats_s {
+  ssize_t gpool_count;           // number of gpools
+  ssize_t gpool_lock_count;      // total acquisitions of the gpool locks
+  ssize_t gpool_lock_contended;  // acquisitions that had to spin
+  ssize_t gpool_lock_spins;      // total spin iterations
+  ssize_t cache_hits;            // gstacks allocated from the thread-local cache (of the current thread)
+  ssize_t cache_misses;          // gstacks allocated fresh (of the current thread)
+} mp_gstack_stats_t;
+
+void         mp_gstack_stats(mp_gstack_stats_t* stats);
 
 
 
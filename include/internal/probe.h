@@ -0,0 +1,99 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef MP_PROBE_H
+#define MP_PROBE_H
+
+/*------------------------------------------------------------------------------
+  Static (USDT) probes in the `libmprompt` provider
+
+  Enabled by building with `MP_USE_USDT=1` (cmake `-DMP_USE_USDT=ON`). Each
+  probe is a single `nop` with an ELF `.note.stapsdt` note describing the
+  location of its arguments, so `perf`, `bpftrace`, `systemtap` etc. can attach
+  to a running process. When disabled, the probes (and their arguments) are
+  compiled away completely. For example:
+
+    > bpftrace -e 'usdt:./myprogram:libmprompt:gstack_alloc { @hit[arg1] = count(); }'
+
+  Probes (all arguments are passed as 64-bit integers):
+    prompt_create(p, gstack)
+    prompt_free(p)
+    yield(p)
+    resume(p, initial)          -- `initial` is 1 for the first entry of a prompt
+    resume_multi(p, mresume)
+    gstack_alloc(gstack, hit)   -- `hit` is 1 if allocated from the thread-local cache
+    gstack_free(gstack, to)     -- `to` is 0 (to the OS or gpool), 1 (to the cache), or 2 (delayed)
+    gstack_budget(committed, needed)  -- a fresh gstack would exceed the `stack_budget`
+    commit_on_demand(addr, size)
+
+  We use <sys/sdt.h> when available and otherwise emit compatible notes
+  ourselves (on ELF platforms for x64 and arm64).
+------------------------------------------------------------------------------*/
+
+#if !defined(MP_USE_USDT)
+#define MP_USE_USDT 0
+#endif
+
+#if MP_USE_USDT && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define MP_HAS_SYS_SDT 1
+#endif
+#endif
+
+#if MP_USE_USDT && defined(MP_HAS_SYS_SDT)
+
+#include <sys/sdt.h>
+#define MP_PROBE1(name,a)    DTRACE_PROBE1(libmprompt, name, (int64_t)(intptr_t)(a))
+#define MP_PROBE2(name,a,b)  DTRACE_PROBE2(libmprompt, name, (int64_t)(intptr_t)(a), (int64_t)(intptr_t)(b))
+
+#elif MP_USE_USDT && defined(__ELF__) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__aarch64__))
+
+// The note layout follows <sys/sdt.h>: the address of the probe, the address
+// of the `.stapsdt.base` section (to adjust for prelinking), the address of the
+// semaphore (none), the provider and probe name, and the argument format.
+#define MP_PROBE_ASM_(name,args) \
+  "990: nop\n" \
+  ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+  ".balign 4\n" \
+  ".4byte 992f-991f, 994f-993f, 3\n" \
+  "991: .asciz \"stapsdt\"\n" \
+  "992: .balign 4\n" \
+  "993: .8byte 990b\n" \
+  ".8byte _.stapsdt.base\n" \
+  ".8byte 0\n" \
+  ".asciz \"libmprompt\"\n" \
+  ".asciz \"" #name "\"\n" \
+  ".asciz \"" args "\"\n" \
+  "994: .balign 4\n" \
+  ".popsection\n" \
+  ".ifndef _.stapsdt.base\n" \
+  ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+  ".weak _.stapsdt.base\n" \
+  ".hidden _.stapsdt.base\n" \
+  "_.stapsdt.base: .space 1\n" \
+  ".size _.stapsdt.base, 1\n" \
+  ".popsection\n" \
+  ".endif\n"
+
+#define MP_PROBE1(name,a) \
+  __asm__ __volatile__(MP_PROBE_ASM_(name, "-8@%0") \
+                       :: "nor"((int64_t)(intptr_t)(a)))
+#define MP_PROBE2(name,a,b) \
+  __asm__ __volatile__(MP_PROBE_ASM_(name, "-8@%0 -8@%1") \
+                       :: "nor"((int64_t)(intptr_t)(a)), "nor"((int64_t)(intptr_t)(b)))
+
+#else
+
+#if MP_USE_USDT && !defined(_MSC_VER)
+#warning "static probes (MP_USE_USDT) are not supported on this platform"
+#endif
+#define MP_PROBE1(name,a)    ((void)0)
+#define MP_PROBE2(name,a,b)  ((void)0)
+
+#endif
+
+#endif // MP_PROBE_H
@@ -42,6 +42,14 @@ typedef ptrdiff_t  ssize_t;
 #define mp_decl_returns_twice   
 #endif
 
+// Prevent specialized copies of a function (like gcc's `.constprop` clones) 
+// so the return address of a `mp_setjmp` inside it is a unique code location.
+#if defined(__GNUC__) && !defined(__clang__) && !defined(__INTEL_COMPILER)
+#define mp_decl_noclone         __attribute__((noclone))
+#else
+#define mp_decl_noclone
+#endif
+
 
 #if defined(__GNUC__) || defined(__clang__)
 #define mp_unlikely(x)          __builtin_expect((x),0)
@@ -0,0 +1,68 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef MP_CHAN_H
+#define MP_CHAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mprompt.h"
+
+//---------------------------------------------------------------------------
+// Channels for the tasks of the M:N scheduler (see `mp_sched.h`)
+//
+// Go-style channels of `void*` values. An unbuffered channel (capacity 0)
+// makes every send wait for a receiver; a bounded channel buffers up to its
+// capacity; and the sends on an unbounded channel never wait. A send or
+// receive that cannot complete parks the current task. When the other side
+// is already waiting, the value is handed over directly (without going
+// through the buffer) and the waiting task runs next on the current worker.
+//
+// Operations that wait can only be used from a scheduled task; the others
+// can be used from any thread.
+//---------------------------------------------------------------------------
+
+typedef struct mp_chan_s mp_chan_t;
+
+#define MP_CHAN_UNBOUNDED  (SIZE_MAX)
+
+mp_decl_export mp_chan_t* mp_chan_create(size_t capacity);   // 0 for an unbuffered channel, or `MP_CHAN_UNBOUNDED`
+mp_decl_export void       mp_chan_free(mp_chan_t* chan);     // there should be no tasks waiting on it
+mp_decl_export void       mp_chan_close(mp_chan_t* chan);    // wakes up all waiting tasks
+mp_decl_export size_t     mp_chan_count(mp_chan_t* chan);    // the number of buffered values
+
+// Send a value; returns false if the channel is closed.
+mp_decl_export bool mp_chan_send(mp_chan_t* chan, void* value);
+
+// Receive a value; after the channel is closed the buffered values can still be received,
+// and then this returns false (with `*value` set to NULL).
+mp_decl_export bool mp_chan_recv(mp_chan_t* chan, void** value);
+
+// These never wait: they return false if the operation would wait (or the channel is closed).
+mp_decl_export bool mp_chan_try_send(mp_chan_t* chan, void* value);
+mp_decl_export bool mp_chan_try_recv(mp_chan_t* chan, void** value);
+
+
+// Select: wait for the first of several operations that can complete.
+typedef enum mp_chan_dir_e {
+  MP_CHAN_SEND,
+  MP_CHAN_RECV
+} mp_chan_dir_t;
+
+typedef struct mp_chan_case_s {
+  mp_chan_t*    chan;     // a NULL channel is never ready
+  mp_chan_dir_t dir;
+  void*         value;    // the value to send, or the received value
+  bool          ok;       // set to false if the channel was closed
+} mp_chan_case_t;
+
+// Perform one of the `cases` that can complete (picking a random one if several can);
+// returns its index. If none can complete and `block` is false, this returns -1 right away.
+mp_decl_export int mp_chan_select(mp_chan_case_t* cases, size_t count, bool block);
+
+#endif
@@ -0,0 +1,64 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef MP_GEN_H
+#define MP_GEN_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "mprompt.h"
+
+//---------------------------------------------------------------------------
+// Batched generators
+//
+// A generator that yields every element costs a full `mp_yield`/`mp_resume`
+// round trip per element. Here the producer runs under its own prompt and
+// fills a buffer that the consumer provides to `mp_gen_next`, and it only
+// switches back when that buffer is full (or when it is finished). The
+// elements are never copied by the library: the producer writes them
+// directly into the consumer's buffer (see `mp_gen.hpp` for a typed C++
+// interface that supports range-for loops).
+//
+//   static void count(mp_gen_t* gen, void* arg) {
+//     size_t capacity;
+//     long*  buf = (long*)mp_gen_buffer(gen, &capacity);
+//     size_t n = 0;
+//     for (long i = 0; i < 1000; i++) {
+//       buf[n++] = i;
+//       if (n == capacity) {
+//         if (!mp_gen_yield(gen, n)) return;     // stopped by the consumer
+//         buf = (long*)mp_gen_buffer(gen, &capacity);
+//         n = 0;
+//       }
+//     }
+//     if (n > 0) mp_gen_yield(gen, n);
+//   }
+//
+//   long buf[64];
+//   mp_gen_t* gen = mp_gen_create(&count, NULL);
+//   size_t n;
+//   while ((n = mp_gen_next(gen, buf, 64)) > 0) { ... use buf[0..n) ... }
+//   mp_gen_free(gen);
+//---------------------------------------------------------------------------
+
+typedef struct mp_gen_s mp_gen_t;
+
+// The producer; it runs under a fresh prompt from the first call to `mp_gen_next`.
+typedef void (mp_gen_fun_t)(mp_gen_t* gen, void* arg);
+
+// Consumer
+mp_decl_export mp_gen_t* mp_gen_create(mp_gen_fun_t* fun, void* arg);
+mp_decl_export size_t    mp_gen_next(mp_gen_t* gen, void* buffer, size_t capacity);  // let the producer fill up to `capacity` elements; returns the count (or 0 when it is finished)
+mp_decl_export bool      mp_gen_is_done(mp_gen_t* gen);
+mp_decl_export void      mp_gen_free(mp_gen_t* gen);    // stops an unfinished producer (`mp_gen_yield` returns `false`) and waits until it returns
+
+// Producer
+mp_decl_export void*     mp_gen_buffer(mp_gen_t* gen, size_t* capacity);  // the buffer to fill (changes after each `mp_gen_yield`)
+mp_decl_export bool      mp_gen_yield(mp_gen_t* gen, size_t count);       // pass `count` elements to the consumer; returns `false` if the generator is stopped
+                                                                            // (an empty batch does not reach the consumer and the producer is resumed right away)
+
+#endif
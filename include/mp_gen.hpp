@@ -0,0 +1,152 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef MP_GEN_HPP
+#define MP_GEN_HPP
+
+/*-----------------------------------------------------------------
+  Header-only typed C++ interface over the batched generators of
+  `mp_gen.h`. The producer emits values into a sink, and the consumer
+  iterates over the generator with a range-for loop:
+
+    mp::generator<long> gen([](mp::gen_sink<long>& out) {
+      for (long i = 0; i < 1000; i++) {
+        if (!out.emit(i)) return;    // the consumer stopped early
+      }
+    }, 64);
+    for (long x : gen) { ... }
+
+  Emitting and iterating only touch the buffer; the producer and
+  consumer switch once per batch (of 64 elements here). The elements
+  must be default constructible and copy (or move) assignable. A
+  generator can be iterated only once.
+-----------------------------------------------------------------*/
+
+#if !defined(__cplusplus)
+#error "mp_gen.hpp requires C++"
+#endif
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+#include "mp_gen.h"
+
+namespace mp {
+
+// The producer side of a generator
+template<typename T>
+class gen_sink {
+public:
+  explicit gen_sink(mp_gen_t* gen) : gen_(gen), buf_(nullptr), capacity_(0), count_(0) {
+    refresh();
+  }
+
+  // Emit a value; returns `false` if the generator was stopped (in which case the producer should return)
+  bool emit(const T& value) {
+    if (count_ == capacity_ && !flush()) return false;
+    buf_[count_++] = value;
+    return true;
+  }
+
+  bool emit(T&& value) {
+    if (count_ == capacity_ && !flush()) return false;
+    buf_[count_++] = std::move(value);
+    return true;
+  }
+
+  // Pass the emitted values to the consumer right away (a no-op if nothing was emitted)
+  bool flush() {
+    if (count_ == 0 && capacity_ > 0) return true;   // (but still yield if stopped to return `false`)
+    const bool more = mp_gen_yield(gen_, count_);
+    count_ = 0;
+    refresh();
+    return more;
+  }
+
+private:
+  void refresh() {
+    buf_ = static_cast<T*>(mp_gen_buffer(gen_, &capacity_));
+  }
+
+  mp_gen_t* gen_;
+  T*        buf_;
+  size_t    capacity_;
+  size_t    count_;
+
+  template<typename U> friend class generator;
+};
+
+
+// The consumer side of a generator
+template<typename T>
+class generator {
+public:
+  using producer_t = std::function<void(gen_sink<T>&)>;
+
+  explicit generator(producer_t producer, size_t batch = 64)
+    : producer_(std::move(producer)), batch_(batch == 0 ? 1 : batch), buf_(new T[batch == 0 ? 1 : batch]), count_(0)
+  {
+    gen_ = mp_gen_create(&start, this);
+  }
+
+  ~generator() {
+    mp_gen_free(gen_);
+  }
+
+  generator(const generator&) = delete;             // the producer refers to `this`
+  generator& operator=(const generator&) = delete;
+
+  class iterator {
+  public:
+    T& operator*() const  { return g_->buf_[i_]; }
+    T* operator->() const { return &g_->buf_[i_]; }
+    iterator& operator++() {
+      if (++i_ == g_->count_) {
+        i_ = 0;
+        if (!g_->fill()) g_ = nullptr;
+      }
+      return *this;
+    }
+    bool operator==(const iterator& other) const { return (g_ == other.g_ && i_ == other.i_); }
+    bool operator!=(const iterator& other) const { return !(*this == other); }
+  private:
+    explicit iterator(generator* g) : g_(g), i_(0) { }
+    generator* g_;
+    size_t     i_;
+    friend class generator;
+  };
+
+  iterator begin() { return iterator(fill() ? this : nullptr); }
+  iterator end()   { return iterator(nullptr); }
+
+  // Fill the buffer with the next batch of at most `batch` elements; returns false when the producer is done
+  bool fill() {
+    count_ = mp_gen_next(gen_, buf_.get(), batch_);
+    return (count_ > 0);
+  }
+  const T* data() const { return buf_.get(); }
+  size_t   size() const { return count_; }
+
+private:
+  static void start(mp_gen_t* gen, void* arg) {
+    generator* self = static_cast<generator*>(arg);
+    gen_sink<T> sink(gen);
+    (self->producer_)(sink);
+    if (sink.count_ > 0) mp_gen_yield(gen, sink.count_);   // the last (partial) batch
+  }
+
+  producer_t           producer_;
+  size_t               batch_;
+  std::unique_ptr<T[]> buf_;
+  size_t               count_;
+  mp_gen_t*            gen_;
+};
+
+}  // namespace mp
+
+#endif
@@ -0,0 +1,135 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef MP_IO_H
+#define MP_IO_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "mprompt.h"
+
+//---------------------------------------------------------------------------
+// Asynchronous I/O (Linux only; enabled with the `MP_USE_IO` cmake option)
+//
+// A per-thread reactor runs tasks under their own prompt. When an I/O
+// operation cannot complete right away, the task yields its prompt to the
+// reactor which resumes it once the operation completes. The reactor uses
+// io_uring where available (submitting all operations of a round in one
+// batch), and epoll otherwise. With the epoll backend, sockets and pipes
+// should be in non-blocking mode (`O_NONBLOCK`) or the operations block the
+// thread; regular files are always read and written directly.
+//
+// Outside a reactor task, the operations are just the blocking system calls.
+//---------------------------------------------------------------------------
+
+typedef void (mp_io_fun_t)(void* arg);
+typedef struct mp_io_task_s mp_io_task_t;   // a task of a reactor
+
+typedef enum mp_io_backend_e {
+  MP_IO_AUTO,       // io_uring if available, epoll otherwise
+  MP_IO_EPOLL,
+  MP_IO_URING
+} mp_io_backend_t;
+
+typedef struct mp_io_config_s {
+  mp_io_backend_t backend;
+  int             queue_depth;   // io_uring submission queue entries, or maximum epoll events per wait (256)
+} mp_io_config_t;
+
+// Run `fun(arg)` as the first task of a reactor on the current thread; returns when all its tasks
+// have finished. Returns 0 on success, or an error code if the backend could not be initialized
+// (`ENOSYS` if the requested backend is not available).
+mp_decl_export int            mp_io_run(const mp_io_config_t* config, mp_io_fun_t* fun, void* arg);
+mp_decl_export mp_io_config_t mp_io_config_default(void);
+mp_decl_export void           mp_io_spawn(mp_io_fun_t* fun, void* arg);   // start a task on the reactor of the current thread
+mp_decl_export mp_io_backend_t mp_io_backend(void);                      // the backend of the current reactor (or `MP_IO_AUTO` if there is none)
+mp_decl_export mp_io_task_t*  mp_io_current(void);                       // the current task (or NULL)
+
+// Operations; these return -1 and set `errno` on an error (just like the system calls)
+mp_decl_export ssize_t mp_io_read(int fd, void* buf, size_t count);
+mp_decl_export ssize_t mp_io_write(int fd, const void* buf, size_t count);
+mp_decl_export int     mp_io_accept(int fd, struct sockaddr* addr, socklen_t* addrlen, int flags);  // as `accept4`
+mp_decl_export int     mp_io_close(int fd);   // use this to close descriptors used with the reactor
+
+
+//---------------------------------------------------------------------------
+// Timers
+//
+// Each reactor has a hierarchical timer wheel with a resolution of a
+// millisecond that is advanced at every reactor tick. Timers are intrusive
+// (so they need no allocation); starting and stopping a timer is O(1).
+// Timer functions run on the reactor (not in a task); they can for example
+// cancel a task. Timers can only be used on a reactor thread, and a timer
+// must be started, or zero initialized, before it is stopped or tested.
+// Timers that are still pending when the reactor finishes are discarded.
+//---------------------------------------------------------------------------
+
+typedef int64_t mp_msecs_t;
+
+typedef void (mp_timer_fun_t)(void* arg);
+
+typedef struct mp_timer_s {   // the fields are private
+  struct mp_timer_s* next;
+  struct mp_timer_s* prev;
+  mp_msecs_t         expire;
+  mp_timer_fun_t*    fun;
+  void*              arg;
+} mp_timer_t;
+
+mp_decl_export mp_msecs_t mp_io_now(void);    // monotonic clock in milli-seconds
+
+mp_decl_export void mp_timer_start(mp_timer_t* timer, mp_msecs_t deadline, mp_timer_fun_t* fun, void* arg);  // call `fun(arg)` at the `deadline` (the timer must not be pending)
+mp_decl_export void mp_timer_stop(mp_timer_t* timer);                  // does nothing if the timer is not pending
+mp_decl_export bool mp_timer_is_pending(const mp_timer_t* timer);
+
+// Suspend the current task; these return 0, or -1 with `errno` set to `ECANCELED` if the task was cancelled.
+// (Outside a reactor task these block the thread.)
+mp_decl_export int mp_sleep_until(mp_msecs_t deadline);
+mp_decl_export int mp_sleep(mp_msecs_t timeout);
+
+
+//---------------------------------------------------------------------------
+// Cancellation
+//---------------------------------------------------------------------------
+
+// Cancel the wait of a task (that has not finished): its pending operation (or sleep) returns -1 with `errno` set to `ECANCELED`.
+// If the task is not waiting, its next wait is cancelled. (An operation that already completed
+// in the meantime returns its result and the cancellation applies to the next wait.)
+mp_decl_export void mp_io_cancel(mp_io_task_t* task);
+mp_decl_export bool mp_io_uncancel(void);    // clear a pending cancellation of the current task (returns true if there was one)
+
+// Set a function that is called in the current task when one of its waits is cancelled (before
+// returning `ECANCELED`); the function can unwind the task (see `mpe_with_timeout` in `mpeff.h`).
+// The previous function is returned in `prev_fun` and `prev_arg` (if not NULL).
+typedef void (mp_io_cancel_fun_t)(void* arg);
+mp_decl_export void mp_io_on_cancel(mp_io_cancel_fun_t* fun, void* arg, mp_io_cancel_fun_t** prev_fun, void** prev_arg);
+
+
+//---------------------------------------------------------------------------
+// Offloading blocking calls
+//
+// `mp_offload` runs a call that would block the thread (a synchronous file
+// API, `getaddrinfo`, compression) on a pool of helper threads shared by all
+// reactors, while the other tasks of the reactor keep running. The task is
+// resumed on its own reactor thread when the call finishes.
+//---------------------------------------------------------------------------
+
+typedef void* (mp_offload_fun_t)(void* arg);
+
+// Run `fun(arg)` on a helper thread and return its result, with `errno` as set by the call.
+// In C++, an exception raised by `fun` is rethrown in the task. The call cannot be interrupted: 
+// cancelling the task while it waits applies to its next wait. (Outside a reactor task, `fun` is called directly.)
+mp_decl_export void* mp_offload(mp_offload_fun_t* fun, void* arg);
+
+// Set the maximum number of helper threads (4 by default). Helper threads are started on demand
+// and are kept for later calls.
+mp_decl_export void  mp_offload_set_max_threads(int n);
+
+#endif
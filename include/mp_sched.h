@@ -0,0 +1,67 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef MP_SCHED_H
+#define MP_SCHED_H
+
+#include <stdint.h>
+#include "mprompt.h"
+
+//---------------------------------------------------------------------------
+// M:N scheduler
+//
+// Runs many tasks on a few worker threads. Each task runs under its own
+// prompt (and thus on its own in-place growable gstack); a task that yields
+// or parks is suspended as a resumption in a run queue. Each worker has its
+// own run queue and steals work from the other workers when it runs out.
+// Tasks can migrate between workers at every suspension point (see the
+// `mp_resume` notes on thread-local state).
+//
+// The scheduler has no timers: sleeping and timeouts (`mp_sleep`, `mp_io_cancel`,
+// and `mpe_with_timeout` in libmpeff) are only available for the tasks of an I/O 
+// reactor (see `mp_io.h`).
+//---------------------------------------------------------------------------
+
+typedef struct mps_task_s  mps_task_t;        // a scheduled task
+
+typedef void (mps_fun_t)(void* arg);
+
+typedef struct mps_config_s {
+  int   workers;          // number of worker threads (including the thread calling `mps_run`); 0 for the CPU count
+} mps_config_t;
+
+typedef struct mps_stats_s {
+  int64_t spawns;         // tasks spawned
+  int64_t switches;       // tasks started or resumed by a worker
+  int64_t steals;         // successful steals from another worker
+  int64_t sleeps;         // times a worker went to sleep for lack of work
+} mps_stats_t;
+
+// Run `fun(arg)` as the first task on a fresh scheduler with `config->workers` worker threads;
+// returns when all tasks have finished. The calling thread is one of the workers.
+// If `stats` is not NULL it receives the totals over all workers.
+mp_decl_export void         mps_run(const mps_config_t* config, mps_fun_t* fun, void* arg, mps_stats_t* stats);
+mp_decl_export mps_config_t mps_config_default(void);
+
+// The following can only be called from within a task.
+mp_decl_export void         mps_spawn(mps_fun_t* fun, void* arg);  // schedule `fun(arg)` as a new task
+mp_decl_export void         mps_yield_now(void);                   // suspend and let other tasks run first
+mp_decl_export mps_task_t*  mps_current(void);                     // the currently running task
+mp_decl_export int          mps_worker_id(void);                   // the current worker (0 is the thread that called `mps_run`), or -1 outside a scheduler
+mp_decl_export int          mps_worker_count(void);                // the number of workers of the current scheduler
+
+// Suspend the current task until `mps_unpark` is called on it. If the task was already unparked
+// since it last parked, this returns right away. As an unpark can come in early, `mps_park` can
+// return without the condition the task is waiting for to hold, so always park in a loop.
+mp_decl_export void         mps_park(void);
+
+// Make a parked task runnable again (or let its next `mps_park` return right away).
+// Can be called from any thread (including threads outside the scheduler) as long as
+// the task has not finished.
+mp_decl_export void         mps_unpark(mps_task_t* task);
+
+#endif
@@ -0,0 +1,67 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef MP_SYNC_H
+#define MP_SYNC_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "mprompt.h"
+
+//---------------------------------------------------------------------------
+// Synchronization for the tasks of the M:N scheduler (see `mp_sched.h`)
+//
+// An OS mutex (or condition variable) that blocks inside a task blocks the
+// whole worker thread, and with it all tasks that the worker could run (and
+// if the owner of the mutex is suspended on the same worker, it deadlocks).
+// These primitives instead park the waiting task: each waiter is a node on
+// the stack of its task in an intrusive wait queue (so waiting does not
+// allocate) and waiters are woken up in FIFO or LIFO order. Ownership (or
+// a semaphore unit) is handed over to a woken waiter directly.
+//
+// Operations that wait can only be used from a scheduled task; the others
+// can be used from any thread.
+//---------------------------------------------------------------------------
+
+typedef enum mp_sync_order_e {
+  MP_SYNC_FIFO,     // wake up the longest waiting task first (fair)
+  MP_SYNC_LIFO      // wake up the most recently waiting task first (its stack is likely still in the cache)
+} mp_sync_order_t;
+
+typedef struct mp_mutex_s    mp_mutex_t;
+typedef struct mp_sema_s     mp_sema_t;
+typedef struct mp_cond_s     mp_cond_t;
+typedef struct mp_barrier_s  mp_barrier_t;
+
+// Mutex (not recursive)
+mp_decl_export mp_mutex_t* mp_mutex_create(mp_sync_order_t order);
+mp_decl_export void        mp_mutex_free(mp_mutex_t* mutex);
+mp_decl_export void        mp_mutex_lock(mp_mutex_t* mutex);
+mp_decl_export bool        mp_mutex_try_lock(mp_mutex_t* mutex);
+mp_decl_export void        mp_mutex_unlock(mp_mutex_t* mutex);
+
+// Counting semaphore
+mp_decl_export mp_sema_t*  mp_sema_create(size_t count, mp_sync_order_t order);
+mp_decl_export void        mp_sema_free(mp_sema_t* sema);
+mp_decl_export void        mp_sema_acquire(mp_sema_t* sema);
+mp_decl_export bool        mp_sema_try_acquire(mp_sema_t* sema);
+mp_decl_export void        mp_sema_release(mp_sema_t* sema);
+
+// Condition variable (used with an `mp_mutex_t`); as with any condition variable, wait in a loop.
+mp_decl_export mp_cond_t*  mp_cond_create(mp_sync_order_t order);
+mp_decl_export void        mp_cond_free(mp_cond_t* cond);
+mp_decl_export void        mp_cond_wait(mp_cond_t* cond, mp_mutex_t* mutex);
+mp_decl_export void        mp_cond_signal(mp_cond_t* cond);
+mp_decl_export void        mp_cond_broadcast(mp_cond_t* cond);
+
+// Barrier for `count` tasks; `mp_barrier_wait` returns true in the last task to arrive.
+// The barrier can be reused once all tasks have passed it.
+mp_decl_export mp_barrier_t* mp_barrier_create(size_t count);
+mp_decl_export void          mp_barrier_free(mp_barrier_t* barrier);
+mp_decl_export bool          mp_barrier_wait(mp_barrier_t* barrier);
+
+#endif
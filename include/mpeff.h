@@ -86,7 +86,8 @@ typedef enum mpe_opkind_e {
   MPE_OP_SCOPED_ONCE, ///< resume at most once within the scope of an operation function.
   MPE_OP_SCOPED,      ///< resume never or multiple times within the scope of an operation function.
   MPE_OP_ONCE,        ///< resume at most once.
-  MPE_OP_MULTI        ///< resume never or multiple times.
+  MPE_OP_MULTI,       ///< resume never or multiple times.
+  MPE_OP_NEVER_FINALLY ///< never resume -- and run only `mpe_finally` finalizers (but not C++ destructors) before running the operation function; this does not raise an exception and is much faster than #MPE_OP_NEVER in C++.
 } mpe_opkind_t;
 
 /// Operation defintion.
@@ -98,19 +99,33 @@ typedef struct mpe_operation_s {
 } mpe_operation_t; 
 
 /// Handler definition.
+/// The operations are a separate (static) array so effects can have any number of operations:
+/// `static const mpe_operation_t ops[] = { ..., { MPE_OP_NULL, mpe_op_null, NULL } };`
 typedef struct mpe_handlerdef_s {
-  mpe_effect_t      effect;         ///< The Effect being handled.
-  mpe_resultfun_t*  resultfun;      ///< Invoked when the handled action is done; can be NULL in which case the action result is passed unchanged.
-  mpe_operation_t   operations[8];  ///< Definitions of all handled operations ending with an operation with `lh_opkind` `LH_OP_NULL`. Can be NULL to handle no operations;
-                                    ///< Note: all operations must be in the same order here as in the effect definition! (since each operation has a fixed index).
+  mpe_effect_t           effect;      ///< The Effect being handled.
+  mpe_resultfun_t*       resultfun;   ///< Invoked when the handled action is done; can be NULL in which case the action result is passed unchanged.
+  const mpe_operation_t* operations;  ///< Definitions of all handled operations ending with an operation with `opkind` #MPE_OP_NULL. 
+                                      ///< Note: all operations must be in the same order here as in the effect definition! (since each operation 
+                                      ///< has a fixed index, the array is used directly as a dispatch table indexed by `opidx`).
 } mpe_handlerdef_t;
 
+/// Define a static handler definition `name` with an inline (brace-initialized) operations array.
+/// This keeps the initializer of the original layout (where the operations were embedded in the 
+/// handler definition) working: `static const mpe_handlerdef_t hdef = { effect, resultfun, { ops } };`
+/// becomes `MPE_HANDLERDEF(hdef, effect, resultfun, { ops });` 
+#define MPE_HANDLERDEF(name,effect,resultfun,...) \
+  static const mpe_operation_t name##_operations[] = __VA_ARGS__; \
+  static const mpe_handlerdef_t name = { effect, resultfun, name##_operations }
+
 
 
 /*-----------------------------------------------------------------
   Handlers
 -----------------------------------------------------------------*/
 
+/// Handle `body(arg)` with the handler definition `hdef` and initial local state `local`.
+/// Handlers whose operations are all #MPE_OP_TAIL_NOOP, #MPE_OP_TAIL, or #MPE_OP_FORWARD never 
+/// yield and are installed in-place on the current stack (without allocating a prompt).
 mpe_decl_export void* mpe_handle(const mpe_handlerdef_t* hdef, void* local, mpe_actionfun_t* body, void* arg);
 mpe_decl_export void* mpe_perform(mpe_optag_t optag, void* arg);
 
@@ -118,11 +133,46 @@ mpe_decl_export void* mpe_resume(mpe_resume_t* resume, void* local, void* arg);
 mpe_decl_export void* mpe_resume_final(mpe_resume_t* resume, void* local, void* arg);  // final resumption
 mpe_decl_export void* mpe_resume_tail(mpe_resume_t* resume, void* local, void* arg);   // final resumption in tail position
 mpe_decl_export void  mpe_resume_release(mpe_resume_t* resume);                        // final resumption causing unwinding (raise unwind exception on resume)
+mpe_decl_export void  mpe_resume_drop(mpe_resume_t* resume);                           // final resumption that only runs `mpe_finally` finalizers (no exception is raised)
 
 
 mpe_decl_export void* mpe_mask(mpe_effect_t eff, size_t from, mpe_actionfun_t* fun, void* arg);
 mpe_decl_export void* mpe_finally(void* local, mpe_releasefun_t* finally_fun, mpe_actionfun_t* fun, void* arg);
 
+/// Run `fun(arg)` in an I/O task (see `mp_io.h`) and unwind it (running finalizers and destructors) if it is
+/// still running after `timeout` milli-seconds; the task is cancelled and the unwinding starts at its next wait.
+/// Returns the result of `fun`, or NULL if it timed out (and sets `*timed_out`). Outside an I/O task `fun` just
+/// runs without a timeout. (Only available on Linux with the I/O module.)
+mpe_decl_export void* mpe_with_timeout(int64_t timeout, mpe_actionfun_t* fun, void* arg, bool* timed_out);
+
+
+/*-----------------------------------------------------------------
+  Task groups
+-----------------------------------------------------------------*/
+
+/// A task group (or nursery) runs child computations, each under its own prompt, that take turns on the
+/// current thread when they call mpe_group_yield(). mpe_group_join() runs all children to completion;
+/// if a child fails, or the group is cancelled, or the join itself is unwound (by mpe_with_timeout() for
+/// example), all remaining children are cancelled before the join returns (or continues unwinding).
+typedef struct mpe_group_s mpe_group_t;
+
+/// How the suspended children of a cancelled group are released.
+typedef enum mpe_group_cancel_e {
+  MPE_GROUP_UNWIND,   ///< resume each child to unwind it with mpe_resume_release() (running C++ destructors and `mpe_finally` finalizers).
+  MPE_GROUP_DROP      ///< drop each child without resuming it: only its `mpe_finally` finalizers are run (on the stack of the canceller, under the
+                      ///< handlers of the child) and then its prompts are dropped (with mp_resume_drop()); this is faster for many children as no child
+                      ///< is resumed, but (like #MPE_OP_NEVER_FINALLY) skips C++ destructors.
+} mpe_group_cancel_t;
+
+mpe_decl_export mpe_group_t* mpe_group_create(mpe_group_cancel_t cancel);
+mpe_decl_export void  mpe_group_free(mpe_group_t* group);                                      // cancels any remaining children
+mpe_decl_export void  mpe_group_spawn(mpe_group_t* group, mpe_actionfun_t* fun, void* arg);   // add a child that starts at its first turn (ignored if the group is cancelled)
+mpe_decl_export void* mpe_group_join(mpe_group_t* group);                                      // run all children; returns the error of the first failed child (or NULL)
+mpe_decl_export void  mpe_group_cancel(mpe_group_t* group);                                    // cancel the remaining children at the next turn
+mpe_decl_export bool  mpe_group_is_cancelled(mpe_group_t* group);
+mpe_decl_export void  mpe_group_yield(void);                                                   // in a child: give the other children a turn
+mpe_decl_export void  mpe_group_fail(void* error);                                             // in a child: unwind it and cancel its group with `error` (non-NULL)
+
 
 /*-----------------------------------------------------------------
   Operation tags
@@ -154,6 +204,9 @@ mpe_decl_export const char* mpe_effect_name(mpe_effect_t effect);
 #define MPE_OPTAG_DEF(effect,op)   mpe_op_##effect##_##op
 #define MPE_OPTAG(effect,op)       &MPE_OPTAG_DEF(effect,op)
 
+#define MPE_DECLARE_EFFECT(effect)  \
+extern const char* MPE_EFFECT(effect)[];
+
 #define MPE_DECLARE_EFFECT0(effect)  \
 extern const char* MPE_EFFECT(effect)[2];
 
@@ -183,57 +236,198 @@ MPE_DECLARE_OP(effect,op) \
 void effect##_##op(argtype arg);
 
 
+/// Define an operation tag at index `idx`; together with an explicit name array
+/// (`const char* MPE_EFFECT(effect)[] = { "effect", "effect/op1", ..., NULL };`)
+/// this can be used to define effects with any number of operations.
+#define MPE_DEFINE_OPTAG(effect,op,idx) \
+const struct mpe_optag_s MPE_OPTAG_DEF(effect,op) = { MPE_EFFECT(effect), idx }; 
+
 #define MPE_DEFINE_EFFECT0(effect) \
 const char* MPE_EFFECT(effect)[2] = { #effect, NULL }; 
 
 #define MPE_DEFINE_EFFECT1(effect,op1) \
 const char* MPE_EFFECT(effect)[3] = { #effect, #effect "/" #op1, NULL }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op1) = { MPE_EFFECT(effect), 0 }; 
+MPE_DEFINE_OPTAG(effect,op1,0)
 
 #define MPE_DEFINE_EFFECT2(effect,op1,op2) \
-const char* MPE_EFFECT(effect)[4] = {  #effect, #effect "/" #op1, #effect "/" #op2, NULL }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op1) = { MPE_EFFECT(effect), 0 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op2) = { MPE_EFFECT(effect), 1 }; 
+const char* MPE_EFFECT(effect)[4] = { #effect, #effect "/" #op1, #effect "/" #op2, NULL }; \
+MPE_DEFINE_OPTAG(effect,op1,0) \
+MPE_DEFINE_OPTAG(effect,op2,1)
 
 #define MPE_DEFINE_EFFECT3(effect,op1,op2,op3) \
-const char* MPE_EFFECT(effect)[5] = {  #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, NULL }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op1) = { MPE_EFFECT(effect), 0 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op2) = { MPE_EFFECT(effect), 1 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op3) = { MPE_EFFECT(effect), 2 }; 
+const char* MPE_EFFECT(effect)[5] = { #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, NULL }; \
+MPE_DEFINE_OPTAG(effect,op1,0) \
+MPE_DEFINE_OPTAG(effect,op2,1) \
+MPE_DEFINE_OPTAG(effect,op3,2)
 
 #define MPE_DEFINE_EFFECT4(effect,op1,op2,op3,op4) \
-const char* MPE_EFFECT(effect)[6] = {  #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, NULL }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op1) = { MPE_EFFECT(effect), 0 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op2) = { MPE_EFFECT(effect), 1 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op3) = { MPE_EFFECT(effect), 2 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op4) = { MPE_EFFECT(effect), 3 }; 
+const char* MPE_EFFECT(effect)[6] = { #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, NULL }; \
+MPE_DEFINE_OPTAG(effect,op1,0) \
+MPE_DEFINE_OPTAG(effect,op2,1) \
+MPE_DEFINE_OPTAG(effect,op3,2) \
+MPE_DEFINE_OPTAG(effect,op4,3)
 
 #define MPE_DEFINE_EFFECT5(effect,op1,op2,op3,op4,op5) \
-const char* MPE_EFFECT(effect)[7] = {  #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, #effect "/" #op5, NULL }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op1) = { MPE_EFFECT(effect), 0 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op2) = { MPE_EFFECT(effect), 1 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op3) = { MPE_EFFECT(effect), 2 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op4) = { MPE_EFFECT(effect), 3 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op5) = { MPE_EFFECT(effect), 4 }; 
+const char* MPE_EFFECT(effect)[7] = { #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, #effect "/" #op5, NULL }; \
+MPE_DEFINE_OPTAG(effect,op1,0) \
+MPE_DEFINE_OPTAG(effect,op2,1) \
+MPE_DEFINE_OPTAG(effect,op3,2) \
+MPE_DEFINE_OPTAG(effect,op4,3) \
+MPE_DEFINE_OPTAG(effect,op5,4)
 
 #define MPE_DEFINE_EFFECT6(effect,op1,op2,op3,op4,op5,op6) \
-const char* MPE_EFFECT(effect)[8] = {  #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, #effect "/" #op5, #effect "/" #op6, NULL }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op1) = { MPE_EFFECT(effect), 0 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op2) = { MPE_EFFECT(effect), 1 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op3) = { MPE_EFFECT(effect), 2 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op4) = { MPE_EFFECT(effect), 3 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op5) = { MPE_EFFECT(effect), 4 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op6) = { MPE_EFFECT(effect), 5 }; 
+const char* MPE_EFFECT(effect)[8] = { #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, #effect "/" #op5, #effect "/" #op6, NULL }; \
+MPE_DEFINE_OPTAG(effect,op1,0) \
+MPE_DEFINE_OPTAG(effect,op2,1) \
+MPE_DEFINE_OPTAG(effect,op3,2) \
+MPE_DEFINE_OPTAG(effect,op4,3) \
+MPE_DEFINE_OPTAG(effect,op5,4) \
+MPE_DEFINE_OPTAG(effect,op6,5)
 
 #define MPE_DEFINE_EFFECT7(effect,op1,op2,op3,op4,op5,op6,op7) \
-const char* MPE_EFFECT(effect)[9] = {  #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, #effect "/" #op5, #effect "/" #op6, #effect "/" #op7, NULL }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op1) = { MPE_EFFECT(effect), 0 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op2) = { MPE_EFFECT(effect), 1 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op3) = { MPE_EFFECT(effect), 2 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op4) = { MPE_EFFECT(effect), 3 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op5) = { MPE_EFFECT(effect), 4 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op6) = { MPE_EFFECT(effect), 5 }; \
-const struct mpe_optag_s MPE_OPTAG_DEF(effect,op7) = { MPE_EFFECT(effect), 6 }; 
+const char* MPE_EFFECT(effect)[9] = { #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, #effect "/" #op5, #effect "/" #op6, #effect "/" #op7, NULL }; \
+MPE_DEFINE_OPTAG(effect,op1,0) \
+MPE_DEFINE_OPTAG(effect,op2,1) \
+MPE_DEFINE_OPTAG(effect,op3,2) \
+MPE_DEFINE_OPTAG(effect,op4,3) \
+MPE_DEFINE_OPTAG(effect,op5,4) \
+MPE_DEFINE_OPTAG(effect,op6,5) \
+MPE_DEFINE_OPTAG(effect,op7,6)
+
+#define MPE_DEFINE_EFFECT8(effect,op1,op2,op3,op4,op5,op6,op7,op8) \
+const char* MPE_EFFECT(effect)[10] = { #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, #effect "/" #op5, #effect "/" #op6, #effect "/" #op7, #effect "/" #op8, NULL }; \
+MPE_DEFINE_OPTAG(effect,op1,0) \
+MPE_DEFINE_OPTAG(effect,op2,1) \
+MPE_DEFINE_OPTAG(effect,op3,2) \
+MPE_DEFINE_OPTAG(effect,op4,3) \
+MPE_DEFINE_OPTAG(effect,op5,4) \
+MPE_DEFINE_OPTAG(effect,op6,5) \
+MPE_DEFINE_OPTAG(effect,op7,6) \
+MPE_DEFINE_OPTAG(effect,op8,7)
+
+#define MPE_DEFINE_EFFECT9(effect,op1,op2,op3,op4,op5,op6,op7,op8,op9) \
+const char* MPE_EFFECT(effect)[11] = { #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, #effect "/" #op5, #effect "/" #op6, #effect "/" #op7, #effect "/" #op8, #effect "/" #op9, NULL }; \
+MPE_DEFINE_OPTAG(effect,op1,0) \
+MPE_DEFINE_OPTAG(effect,op2,1) \
+MPE_DEFINE_OPTAG(effect,op3,2) \
+MPE_DEFINE_OPTAG(effect,op4,3) \
+MPE_DEFINE_OPTAG(effect,op5,4) \
+MPE_DEFINE_OPTAG(effect,op6,5) \
+MPE_DEFINE_OPTAG(effect,op7,6) \
+MPE_DEFINE_OPTAG(effect,op8,7) \
+MPE_DEFINE_OPTAG(effect,op9,8)
+
+#define MPE_DEFINE_EFFECT10(effect,op1,op2,op3,op4,op5,op6,op7,op8,op9,op10) \
+const char* MPE_EFFECT(effect)[12] = { #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, #effect "/" #op5, #effect "/" #op6, #effect "/" #op7, #effect "/" #op8, #effect "/" #op9, #effect "/" #op10, NULL }; \
+MPE_DEFINE_OPTAG(effect,op1,0) \
+MPE_DEFINE_OPTAG(effect,op2,1) \
+MPE_DEFINE_OPTAG(effect,op3,2) \
+MPE_DEFINE_OPTAG(effect,op4,3) \
+MPE_DEFINE_OPTAG(effect,op5,4) \
+MPE_DEFINE_OPTAG(effect,op6,5) \
+MPE_DEFINE_OPTAG(effect,op7,6) \
+MPE_DEFINE_OPTAG(effect,op8,7) \
+MPE_DEFINE_OPTAG(effect,op9,8) \
+MPE_DEFINE_OPTAG(effect,op10,9)
+
+#define MPE_DEFINE_EFFECT11(effect,op1,op2,op3,op4,op5,op6,op7,op8,op9,op10,op11) \
+const char* MPE_EFFECT(effect)[13] = { #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, #effect "/" #op5, #effect "/" #op6, #effect "/" #op7, #effect "/" #op8, #effect "/" #op9, #effect "/" #op10, #effect "/" #op11, NULL }; \
+MPE_DEFINE_OPTAG(effect,op1,0) \
+MPE_DEFINE_OPTAG(effect,op2,1) \
+MPE_DEFINE_OPTAG(effect,op3,2) \
+MPE_DEFINE_OPTAG(effect,op4,3) \
+MPE_DEFINE_OPTAG(effect,op5,4) \
+MPE_DEFINE_OPTAG(effect,op6,5) \
+MPE_DEFINE_OPTAG(effect,op7,6) \
+MPE_DEFINE_OPTAG(effect,op8,7) \
+MPE_DEFINE_OPTAG(effect,op9,8) \
+MPE_DEFINE_OPTAG(effect,op10,9) \
+MPE_DEFINE_OPTAG(effect,op11,10)
+
+#define MPE_DEFINE_EFFECT12(effect,op1,op2,op3,op4,op5,op6,op7,op8,op9,op10,op11,op12) \
+const char* MPE_EFFECT(effect)[14] = { #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, #effect "/" #op5, #effect "/" #op6, #effect "/" #op7, #effect "/" #op8, #effect "/" #op9, #effect "/" #op10, #effect "/" #op11, #effect "/" #op12, NULL }; \
+MPE_DEFINE_OPTAG(effect,op1,0) \
+MPE_DEFINE_OPTAG(effect,op2,1) \
+MPE_DEFINE_OPTAG(effect,op3,2) \
+MPE_DEFINE_OPTAG(effect,op4,3) \
+MPE_DEFINE_OPTAG(effect,op5,4) \
+MPE_DEFINE_OPTAG(effect,op6,5) \
+MPE_DEFINE_OPTAG(effect,op7,6) \
+MPE_DEFINE_OPTAG(effect,op8,7) \
+MPE_DEFINE_OPTAG(effect,op9,8) \
+MPE_DEFINE_OPTAG(effect,op10,9) \
+MPE_DEFINE_OPTAG(effect,op11,10) \
+MPE_DEFINE_OPTAG(effect,op12,11)
+
+#define MPE_DEFINE_EFFECT13(effect,op1,op2,op3,op4,op5,op6,op7,op8,op9,op10,op11,op12,op13) \
+const char* MPE_EFFECT(effect)[15] = { #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, #effect "/" #op5, #effect "/" #op6, #effect "/" #op7, #effect "/" #op8, #effect "/" #op9, #effect "/" #op10, #effect "/" #op11, #effect "/" #op12, #effect "/" #op13, NULL }; \
+MPE_DEFINE_OPTAG(effect,op1,0) \
+MPE_DEFINE_OPTAG(effect,op2,1) \
+MPE_DEFINE_OPTAG(effect,op3,2) \
+MPE_DEFINE_OPTAG(effect,op4,3) \
+MPE_DEFINE_OPTAG(effect,op5,4) \
+MPE_DEFINE_OPTAG(effect,op6,5) \
+MPE_DEFINE_OPTAG(effect,op7,6) \
+MPE_DEFINE_OPTAG(effect,op8,7) \
+MPE_DEFINE_OPTAG(effect,op9,8) \
+MPE_DEFINE_OPTAG(effect,op10,9) \
+MPE_DEFINE_OPTAG(effect,op11,10) \
+MPE_DEFINE_OPTAG(effect,op12,11) \
+MPE_DEFINE_OPTAG(effect,op13,12)
+
+#define MPE_DEFINE_EFFECT14(effect,op1,op2,op3,op4,op5,op6,op7,op8,op9,op10,op11,op12,op13,op14) \
+const char* MPE_EFFECT(effect)[16] = { #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, #effect "/" #op5, #effect "/" #op6, #effect "/" #op7, #effect "/" #op8, #effect "/" #op9, #effect "/" #op10, #effect "/" #op11, #effect "/" #op12, #effect "/" #op13, #effect "/" #op14, NULL }; \
+MPE_DEFINE_OPTAG(effect,op1,0) \
+MPE_DEFINE_OPTAG(effect,op2,1) \
+MPE_DEFINE_OPTAG(effect,op3,2) \
+MPE_DEFINE_OPTAG(effect,op4,3) \
+MPE_DEFINE_OPTAG(effect,op5,4) \
+MPE_DEFINE_OPTAG(effect,op6,5) \
+MPE_DEFINE_OPTAG(effect,op7,6) \
+MPE_DEFINE_OPTAG(effect,op8,7) \
+MPE_DEFINE_OPTAG(effect,op9,8) \
+MPE_DEFINE_OPTAG(effect,op10,9) \
+MPE_DEFINE_OPTAG(effect,op11,10) \
+MPE_DEFINE_OPTAG(effect,op12,11) \
+MPE_DEFINE_OPTAG(effect,op13,12) \
+MPE_DEFINE_OPTAG(effect,op14,13)
+
+#define MPE_DEFINE_EFFECT15(effect,op1,op2,op3,op4,op5,op6,op7,op8,op9,op10,op11,op12,op13,op14,op15) \
+const char* MPE_EFFECT(effect)[17] = { #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, #effect "/" #op5, #effect "/" #op6, #effect "/" #op7, #effect "/" #op8, #effect "/" #op9, #effect "/" #op10, #effect "/" #op11, #effect "/" #op12, #effect "/" #op13, #effect "/" #op14, #effect "/" #op15, NULL }; \
+MPE_DEFINE_OPTAG(effect,op1,0) \
+MPE_DEFINE_OPTAG(effect,op2,1) \
+MPE_DEFINE_OPTAG(effect,op3,2) \
+MPE_DEFINE_OPTAG(effect,op4,3) \
+MPE_DEFINE_OPTAG(effect,op5,4) \
+MPE_DEFINE_OPTAG(effect,op6,5) \
+MPE_DEFINE_OPTAG(effect,op7,6) \
+MPE_DEFINE_OPTAG(effect,op8,7) \
+MPE_DEFINE_OPTAG(effect,op9,8) \
+MPE_DEFINE_OPTAG(effect,op10,9) \
+MPE_DEFINE_OPTAG(effect,op11,10) \
+MPE_DEFINE_OPTAG(effect,op12,11) \
+MPE_DEFINE_OPTAG(effect,op13,12) \
+MPE_DEFINE_OPTAG(effect,op14,13) \
+MPE_DEFINE_OPTAG(effect,op15,14)
+
+#define MPE_DEFINE_EFFECT16(effect,op1,op2,op3,op4,op5,op6,op7,op8,op9,op10,op11,op12,op13,op14,op15,op16) \
+const char* MPE_EFFECT(effect)[18] = { #effect, #effect "/" #op1, #effect "/" #op2, #effect "/" #op3, #effect "/" #op4, #effect "/" #op5, #effect "/" #op6, #effect "/" #op7, #effect "/" #op8, #effect "/" #op9, #effect "/" #op10, #effect "/" #op11, #effect "/" #op12, #effect "/" #op13, #effect "/" #op14, #effect "/" #op15, #effect "/" #op16, NULL }; \
+MPE_DEFINE_OPTAG(effect,op1,0) \
+MPE_DEFINE_OPTAG(effect,op2,1) \
+MPE_DEFINE_OPTAG(effect,op3,2) \
+MPE_DEFINE_OPTAG(effect,op4,3) \
+MPE_DEFINE_OPTAG(effect,op5,4) \
+MPE_DEFINE_OPTAG(effect,op6,5) \
+MPE_DEFINE_OPTAG(effect,op7,6) \
+MPE_DEFINE_OPTAG(effect,op8,7) \
+MPE_DEFINE_OPTAG(effect,op9,8) \
+MPE_DEFINE_OPTAG(effect,op10,9) \
+MPE_DEFINE_OPTAG(effect,op11,10) \
+MPE_DEFINE_OPTAG(effect,op12,11) \
+MPE_DEFINE_OPTAG(effect,op13,12) \
+MPE_DEFINE_OPTAG(effect,op14,13) \
+MPE_DEFINE_OPTAG(effect,op15,14) \
+MPE_DEFINE_OPTAG(effect,op16,15)
 
 
 #define MPE_DEFINE_OP0(effect,op,restype) \
@@ -0,0 +1,359 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef MPE_EFFECT_HPP
+#define MPE_EFFECT_HPP
+
+/*-----------------------------------------------------------------
+  Header-only typed C++17 interface over `mpeff.h`.
+
+  Effects are types with a static name array, and operations are
+  types that carry their index and signature:
+
+    struct state {
+      static constexpr const char* names[] = { "state", "state/get", "state/set", nullptr };
+      using get = mpe::operation<state, 0, long()>;
+      using set = mpe::operation<state, 1, void(long)>;
+    };
+
+  Handlers are plain classes; a handler definition binds each operation
+  (in index order) to a member function with a particular operation kind:
+
+    struct state_handler {
+      long value;
+      long get()       { return value; }
+      void set(long x) { value = x; }
+    };
+    using state_def = mpe::handler_def<state,
+                        mpe::tail_noop<state::get, &state_handler::get>,
+                        mpe::tail_noop<state::set, &state_handler::set>>;
+
+    state_handler h{ 42 };
+    long x = mpe::handle<state_def>(h, [](){ return state::get::perform(); });
+
+  Arguments and results of operations are passed by reference through
+  the performing frame without boxing, and tail resumptive members are
+  inlined into their (statically generated) operation function. Only values that
+  cross a context switch (results of a handler or of a yielding resumption)
+  are converted to a `void*` and these are only heap allocated if they
+  do not fit in a pointer.
+-----------------------------------------------------------------*/
+
+#if !defined(__cplusplus) || (__cplusplus < 201703L && !(defined(_MSVC_LANG) && _MSVC_LANG >= 201703L))
+#error "mpeff.hpp requires C++17"
+#endif
+
+#include <cstring>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "mpeff.h"
+
+namespace mpe {
+
+namespace detail {
+
+  // Convert values to and from `void*`; only allocates if the value does not fit in a pointer.
+  template<class T>
+  struct box {
+    static constexpr bool inplace = (std::is_trivially_copyable<T>::value && sizeof(T) <= sizeof(void*));
+    static void* to(T&& x) {
+      if constexpr (inplace) {
+        void* p = nullptr;
+        std::memcpy(&p, &x, sizeof(T));
+        return p;
+      }
+      else {
+        return new T(std::move(x));
+      }
+    }
+    static T from(void* p) {
+      if constexpr (inplace) {
+        // copy into raw storage (so `T` need not be default constructible)
+        alignas(T) unsigned char buf[sizeof(T)];
+        std::memcpy(buf, &p, sizeof(T));
+        return *std::launder(reinterpret_cast<T*>(buf));
+      }
+      else {
+        T* q = static_cast<T*>(p);
+        T x(std::move(*q));
+        delete q;
+        return x;
+      }
+    }
+  };
+
+  template<>
+  struct box<void> {
+    static void from(void*) { }
+  };
+
+  // Uninitialized storage for an operation result that is set in-place by tail resumptive operations.
+  template<class R>
+  struct slot {
+    alignas(R) unsigned char buf[sizeof(R)];
+    bool is_set = false;
+    template<class... Xs>
+    void set(Xs&&... xs) {
+      new (static_cast<void*>(buf)) R(std::forward<Xs>(xs)...);
+      is_set = true;
+    }
+    R take() {
+      R* p = std::launder(reinterpret_cast<R*>(buf));
+      R x(std::move(*p));
+      p->~R();
+      is_set = false;
+      return x;
+    }
+  };
+
+  template<>
+  struct slot<void> { };
+
+  // The environment of a perform lives in the frame of the performer.
+  template<class R, class... Args>
+  struct perform_env {
+    std::tuple<Args&&...> args;
+    slot<R> result;
+  };
+
+  // Deconstruct member function types
+  template<class M> struct member_traits;
+  template<class H, class R, class... Args>
+  struct member_traits<R (H::*)(Args...)> {
+    using handler_type = H;
+    using result_type  = R;
+  };
+
+  // Invoke a handler member with the arguments of a perform
+  template<auto M, class H, class Env, class... Pre>
+  inline decltype(auto) invoke(H* h, Env* env, Pre&&... pre) {
+    return std::apply([&](auto&&... args) -> decltype(auto) {
+      return (h->*M)(std::forward<Pre>(pre)..., std::forward<decltype(args)>(args)...);
+    }, env->args);
+  }
+
+} // namespace detail
+
+
+
+//------------------------------------------------------
+// Operations
+//------------------------------------------------------
+
+template<class E, long Idx, class Sig>
+struct operation;
+
+/// An operation of effect `E` at index `Idx` taking `Args` and returning `R`.
+template<class E, long Idx, class R, class... Args>
+struct operation<E, Idx, R(Args...)> {
+  using effect      = E;
+  using result_type = R;
+  using env_type    = detail::perform_env<R, Args...>;
+  static constexpr long index = Idx;
+  static constexpr struct mpe_optag_s tag = { E::names, Idx };
+
+  /// Perform this operation under the innermost handler for `E`.
+  static R perform(Args... args) {
+    env_type env{ std::forward_as_tuple(std::forward<Args>(args)...), {} };
+    void* res = mpe_perform(&tag, &env);
+    if constexpr (std::is_void<R>::value) {
+      (void)(res);
+    }
+    else {
+      if (env.result.is_set) return env.result.take();  // tail resumed in-place
+      return detail::box<R>::from(res);                              // resumed from a yield
+    }
+  }
+};
+
+/// Perform an operation.
+template<class Op, class... Xs>
+inline typename Op::result_type perform(Xs&&... xs) {
+  return Op::perform(std::forward<Xs>(xs)...);
+}
+
+
+//------------------------------------------------------
+// Resumptions
+//------------------------------------------------------
+
+/// A typed resumption for an operation `Op` under a handler with result type `T`.
+/// A resumption is owned by its operation function: if it is not resumed for the last time
+/// (or released) when the operation function returns, it is released at that point.
+/// A `once` or `multi` resumption can be moved out to resume it later.
+template<class Op, class T>
+class resumption {
+  using R = typename Op::result_type;
+  mpe_resume_t* r;
+  void*         local;
+  bool          once;   // can be resumed at most once
+
+  mpe_resume_t* take() {
+    mpe_resume_t* x = r;
+    r = nullptr;
+    return x;
+  }
+
+  template<class... Xs>
+  static void* arg(Xs&&... xs) {
+    if constexpr (std::is_void<R>::value) { return nullptr; }
+                                     else { return detail::box<R>::to(R(std::forward<Xs>(xs)...)); }
+  }
+public:
+  resumption(mpe_resume_t* r, void* local, bool once = false) : r(r), local(local), once(once) { }
+  resumption(resumption&& other) noexcept : r(other.take()), local(other.local), once(other.once) { }
+  resumption& operator=(resumption&& other) noexcept {
+    if (this != &other) { release(); local = other.local; once = other.once; r = other.take(); }
+    return *this;
+  }
+  resumption(const resumption&) = delete;
+  resumption& operator=(const resumption&) = delete;
+  ~resumption() { release(); }
+
+  /// Resume (used for `scoped`, `multi` operations that may resume more than once; this is the last resume for the other kinds).
+  template<class... Xs>
+  T resume(Xs&&... xs) {
+    if (once) return resume_final(std::forward<Xs>(xs)...);
+    return detail::box<T>::from(mpe_resume(r, local, arg(std::forward<Xs>(xs)...)));
+  }
+
+  /// Resume for the last time.
+  template<class... Xs>
+  T resume_final(Xs&&... xs) { return detail::box<T>::from(mpe_resume_final(take(), local, arg(std::forward<Xs>(xs)...))); }
+
+  /// Resume for the last time in tail position.
+  template<class... Xs>
+  T resume_tail(Xs&&... xs)  { return detail::box<T>::from(mpe_resume_tail(take(), local, arg(std::forward<Xs>(xs)...))); }
+
+  /// Drop the resumption without resuming (which unwinds the suspended computation).
+  void release()             { if (r != nullptr) mpe_resume_release(take()); }
+
+  /// Drop the resumption without resuming; only runs `mpe_finally` finalizers and no C++ destructors (but is faster than `release`).
+  void drop()                { if (r != nullptr) mpe_resume_drop(take()); }
+};
+
+
+//------------------------------------------------------
+// Operation functions
+//------------------------------------------------------
+
+namespace detail {
+
+  // Tail resumptive: `R H::m(Args...)`
+  // The member is inlined and the result is set in-place in the performer's frame.
+  // (we do not call `mpe_resume_tail` as the resumption is always in-place and the local state is unchanged)
+  template<class Op, auto M>
+  void* tail_opfun(mpe_resume_t* r, void* local, void* arg) {
+    (void)(r);
+    using H = typename member_traits<decltype(M)>::handler_type;
+    H* h = static_cast<H*>(local);
+    auto* env = static_cast<typename Op::env_type*>(arg);
+    if constexpr (std::is_void<typename Op::result_type>::value) {
+      invoke<M>(h, env);
+    }
+    else {
+      env->result.set(invoke<M>(h, env));
+    }
+    return nullptr;
+  }
+
+  // General: `T H::m(resumption<Op,T>& r, Args...)`
+  template<class Op, auto M, mpe_opkind_t Kind>
+  void* general_opfun(mpe_resume_t* r, void* local, void* arg) {
+    using H = typename member_traits<decltype(M)>::handler_type;
+    using T = typename member_traits<decltype(M)>::result_type;
+    H* h = static_cast<H*>(local);
+    auto* env = static_cast<typename Op::env_type*>(arg);
+    resumption<Op, T> resume(r, local, Kind == MPE_OP_SCOPED_ONCE || Kind == MPE_OP_ONCE);
+    return box<T>::to(invoke<M>(h, env, resume));
+  }
+
+  // Never resume: `T H::m(Args...)`
+  // Arguments are copied and the performer is unwound (running destructors) before calling the member.
+  // This is a `MPE_OP_ONCE` clause that releases its resumption instead of a `MPE_OP_NEVER(_FINALLY)` one:
+  // those call the operation function only after the performer is unwound (while the arguments are
+  // references into its frame), and `MPE_OP_NEVER_FINALLY` would not run the destructors of the performer.
+  template<class Op, auto M>
+  void* never_opfun(mpe_resume_t* r, void* local, void* arg) {
+    using H = typename member_traits<decltype(M)>::handler_type;
+    using T = typename member_traits<decltype(M)>::result_type;
+    H* h = static_cast<H*>(local);
+    auto* env = static_cast<typename Op::env_type*>(arg);
+    auto args = std::apply([](auto&&... xs) { return std::make_tuple(std::decay_t<decltype(xs)>(xs)...); }, env->args);
+    mpe_resume_release(r);
+    return box<T>::to(std::apply([h](auto&&... xs) -> T { return (h->*M)(std::move(xs)...); }, std::move(args)));
+  }
+
+  template<class Op, mpe_opkind_t Kind, mpe_opfun_t* Fun>
+  struct clause {
+    using op = Op;
+    static constexpr mpe_operation_t operation = { Kind, &Op::tag, Fun };
+  };
+
+} // namespace detail
+
+
+/// Tail resumptive operation that performs no operations itself: `R H::m(Args...)`.
+template<class Op, auto M> struct tail_noop   : detail::clause<Op, MPE_OP_TAIL_NOOP,   &detail::tail_opfun<Op, M>> { };
+/// Tail resumptive operation: `R H::m(Args...)`.
+template<class Op, auto M> struct tail        : detail::clause<Op, MPE_OP_TAIL,        &detail::tail_opfun<Op, M>> { };
+/// Never resumes; the performer is unwound before calling `T H::m(Args...)`.
+template<class Op, auto M> struct never       : detail::clause<Op, MPE_OP_ONCE,        &detail::never_opfun<Op, M>> { };
+/// Resumes at most once within the scope of `T H::m(resumption<Op,T>&, Args...)`.
+template<class Op, auto M> struct scoped_once : detail::clause<Op, MPE_OP_SCOPED_ONCE, &detail::general_opfun<Op, M, MPE_OP_SCOPED_ONCE>> { };
+/// Resumes any number of times within the scope of `T H::m(resumption<Op,T>&, Args...)`.
+template<class Op, auto M> struct scoped      : detail::clause<Op, MPE_OP_SCOPED,      &detail::general_opfun<Op, M, MPE_OP_SCOPED>> { };
+/// Resumes at most once (possibly outside the scope of `T H::m(resumption<Op,T>&, Args...)`).
+template<class Op, auto M> struct once        : detail::clause<Op, MPE_OP_ONCE,        &detail::general_opfun<Op, M, MPE_OP_ONCE>> { };
+/// Resumes any number of times.
+template<class Op, auto M> struct multi       : detail::clause<Op, MPE_OP_MULTI,       &detail::general_opfun<Op, M, MPE_OP_MULTI>> { };
+
+
+//------------------------------------------------------
+// Handlers
+//------------------------------------------------------
+
+namespace detail {
+  template<long I>
+  constexpr bool in_order() { return true; }
+
+  template<long I, class C, class... Cs>
+  constexpr bool in_order() { return (C::op::index == I && in_order<I + 1, Cs...>()); }
+}
+
+/// A handler definition for effect `E` with a clause for every operation (in index order).
+template<class E, class... Clauses>
+struct handler_def {
+  static_assert(detail::in_order<0, Clauses...>(), "handler clauses must be given in operation index order");
+  static constexpr mpe_operation_t operations[] = { Clauses::operation..., { MPE_OP_NULL, nullptr, nullptr } };
+  static constexpr mpe_handlerdef_t hdef = { E::names, nullptr, operations };
+};
+
+namespace detail {
+  template<class F, class T>
+  void* handle_action(void* arg) {
+    F* f = static_cast<F*>(arg);
+    if constexpr (std::is_void<T>::value) { (*f)(); return nullptr; }
+                                     else { return box<T>::to((*f)()); }
+  }
+}
+
+/// Handle `body()` with handler `h` using definition `Def`.
+/// Handlers with only tail resumptive operations are installed in-place without a prompt.
+template<class Def, class H, class F>
+inline auto handle(H& h, F&& body) -> decltype(body()) {
+  using T  = decltype(body());
+  using FT = std::remove_reference_t<F>;
+  void* res = mpe_handle(&Def::hdef, &h, &detail::handle_action<FT, T>, const_cast<std::remove_const_t<FT>*>(&body));
+  return detail::box<T>::from(res);
+}
+
+} // namespace mpe
+
+#endif
@@ -45,6 +45,9 @@ mp_decl_export void* mp_prompt(mp_start_fun_t* fun, void* arg);
 mp_decl_export void* mp_yield(mp_prompt_t* p, mp_yield_fun_t* fun, void* arg);
 
 // Resume back to the yield point with a result; can be used at most once.
+// A resumption can be resumed on any thread (but by one thread at a time) so suspended prompts 
+// can migrate between threads. Code in a migrating prompt should not keep pointers to thread-local
+// state across a yield, nor yield inside a C++ `catch` block (as exception state is per thread).
 mp_decl_export void* mp_resume(mp_resume_t* resume, void* arg);      // resume 
 mp_decl_export void* mp_resume_tail(mp_resume_t* resume, void* arg); // resume as the last action in a `mp_yield_fun_t`
 mp_decl_export void  mp_resume_drop(mp_resume_t* resume);            // drop the resume object without resuming
@@ -65,18 +68,50 @@ mp_decl_export mp_resume_t* mp_resume_dup(mp_resume_t* r);    // only multi-resu
 #include <stddef.h>
 #include <stdbool.h>
 
+// Stack growth policies: how much to commit when a gstack grows into uncommitted memory
+typedef enum mp_grow_kind_e {
+  MP_GROW_DEFAULT,                // geometric if `stack_grow_fast` is set, and otherwise per page
+  MP_GROW_FIXED,                  // commit `step` bytes per fault (OS page size)
+  MP_GROW_GEOMETRIC,              // commit `factor*used` extra bytes per fault (2), but at most `max` extra (1 MiB)
+  MP_GROW_PEAK,                   // commit up to the learned peak stack use of the start function at once, and beyond that grow geometrically
+  MP_GROW_CUSTOM                  // commit `fun(used,available,arg)` extra bytes per fault
+} mp_grow_kind_t;
+
+// Custom growth: called from the page fault handler so it must be async-signal-safe.
+typedef ptrdiff_t (mp_grow_fun_t)(ptrdiff_t used, ptrdiff_t available, void* arg);
+
+typedef struct mp_grow_policy_s {
+  mp_grow_kind_t kind;
+  ptrdiff_t      step;            // MP_GROW_FIXED
+  ptrdiff_t      factor;          // MP_GROW_GEOMETRIC and MP_GROW_PEAK
+  ptrdiff_t      max;             // MP_GROW_GEOMETRIC and MP_GROW_PEAK
+  mp_grow_fun_t* fun;             // MP_GROW_CUSTOM
+  void*          arg;             // MP_GROW_CUSTOM
+} mp_grow_policy_t;
+
+// Stack budget: called when a fresh gstack would exceed the `stack_budget`, where `committed` is the
+// total committed gstack memory and `needed` the bytes to commit. Return `true` to try again (after 
+// waiting for other prompts to finish for example), or `false` to fail the allocation.
+typedef bool (mp_budget_fun_t)(ptrdiff_t committed, ptrdiff_t needed, void* arg);
+
 // Configuration settings
 typedef struct mp_config_s {
   bool      gpool_enable;         // enable gpools for in-process reuse of stack memory (besides the thread-local cache)
   bool      stack_grow_fast;      // grow stacks by doubling (to up to 1MiB at a time) instead of per-page
   bool      stack_use_overcommit; // use overcommit on systems that support this (Linux only) -- disables gpools and fast stack growing.
   bool      stack_reset_decommits;// instead of resetting memory in a gpool, use a full decommit in instead.
+  bool      stack_huge_pages;     // advise transparent huge pages for gpools and populated stack memory (Linux only)
   ptrdiff_t gpool_max_size;       // maximum virtual size per gpool (256 GiB)
   ptrdiff_t stack_max_size;       // maximum virtual size of a gstack (8 MiB)
   ptrdiff_t stack_exn_guaranteed; // guaranteed extra stack space available during exception unwinding (Windows only) (16 KiB)
   ptrdiff_t stack_initial_commit; // initial commit size of a gstack (OS page size, 4 KiB)
+  ptrdiff_t stack_populate;       // commit and prefault this much of each fresh gstack upfront (0)
   ptrdiff_t stack_gap_size;       // virtual no-access gap between stacks for security (64 KiB)
   ptrdiff_t stack_cache_count;    // count of gstacks to keep in a thread-local cache (4)  
+  mp_grow_policy_t stack_grow_policy; // default growth policy of gstacks (MP_GROW_DEFAULT)
+  ptrdiff_t stack_budget;         // maximum committed memory of all gstacks in the process (0 for unlimited)
+  mp_budget_fun_t* stack_budget_fun; // called when the budget is exhausted (NULL to fail right away)
+  void*     stack_budget_arg;     // argument passed to `stack_budget_fun`
 } mp_config_t;
 
 // Initialize with `config`; use NULL for default settings.
@@ -85,6 +120,36 @@ typedef struct mp_config_s {
 mp_decl_export void        mp_init(const mp_config_t* config);
 mp_decl_export mp_config_t mp_config_default(void);  // default configuration for this platform
 
+// Total committed memory of all gstacks in the process (as counted against the `stack_budget`).
+// This includes the gstacks in the thread-local caches, but not memory committed by the OS itself 
+// (as with `stack_use_overcommit`). Growing gstacks may exceed the budget by a page per fault.
+mp_decl_export ptrdiff_t   mp_stack_committed(void);
+
+
+//---------------------------------------------------------------------------
+// Commit-on-demand statistics (of the current thread)
+// Histogram bucket 0 counts zero values, and bucket `i > 0` counts values in `[2^(i-1), 2^i)`
+// (where the last bucket also counts all larger values). 
+// Use these to tune `stack_grow_fast` and `stack_initial_commit`.
+// (Faults handled by the OS, as with `stack_use_overcommit`, are not counted)
+//---------------------------------------------------------------------------
+
+#define MP_COMMIT_HIST_SIZE  (32)
+
+typedef struct mp_commit_stats_s {
+  ptrdiff_t faults;                               // total commit-on-demand page faults
+  ptrdiff_t committed;                            // total bytes committed on demand
+  ptrdiff_t nsecs;                                // total nanoseconds spent in the fault handler
+  ptrdiff_t gstacks;                              // completed gstack lifetimes (usually one prompt each)
+  ptrdiff_t committed_hist[MP_COMMIT_HIST_SIZE];  // bytes committed per fault
+  ptrdiff_t nsecs_hist[MP_COMMIT_HIST_SIZE];      // nanoseconds in the handler per fault
+  ptrdiff_t faults_hist[MP_COMMIT_HIST_SIZE];     // faults per gstack lifetime
+} mp_commit_stats_t;
+
+mp_decl_export void mp_commit_stats(mp_commit_stats_t* stats);  // get the statistics of the current thread
+mp_decl_export void mp_commit_stats_reset(void);                // and reset them
+mp_decl_export int  mp_commit_hist_bucket(ptrdiff_t value);     // the histogram bucket of a value
+
 
 
 //---------------------------------------------------------------------------
@@ -95,17 +160,47 @@ mp_decl_export mp_config_t mp_config_default(void);  // default configuration fo
 // Get a portable backtrace
 mp_decl_export int          mp_backtrace(void** backtrace, int len);
 
+// Async-signal-safe backtrace across prompts by walking frame pointers, starting at the 
+// interrupted context `ucontext` (as passed to a `SA_SIGINFO` signal handler), or at the caller if `NULL`.
+// Requires code compiled with frame pointers (`-fno-omit-frame-pointer`); returns 0 if unsupported.
+// Install the handler with `SA_ONSTACK` as signals cannot be delivered on gstack pages that are not yet committed.
+mp_decl_export int          mp_backtrace_signal(void* ucontext, void** backtrace, int len);
+
 // How often is this resumption resumed?
 mp_decl_export long         mp_resume_resume_count(mp_resume_t* r);
 mp_decl_export int          mp_resume_should_unwind(mp_resume_t* r);  // refcount==1 && resume_count==0
 
 // Separate prompt creation
 mp_decl_export mp_prompt_t* mp_prompt_create(void);
+mp_decl_export mp_prompt_t* mp_prompt_try_create(void);  // returns NULL with `errno` set to `EAGAIN` if the stack budget is exhausted (or `ENOMEM`)
 mp_decl_export void* mp_prompt_enter(mp_prompt_t* p, mp_start_fun_t* fun, void* arg) ;
 
+// Reusable prompts: a retained prompt keeps its gstack (and its committed memory) when its start
+// function returns, or when its suspended resumption is dropped, and becomes idle again so it can
+// be re-entered with `mp_prompt_enter` (with any start function) without allocating.
+// `mp_prompt_release` frees an idle prompt, or lets a running or suspended prompt be freed as usual once it finishes.
+mp_decl_export mp_prompt_t* mp_prompt_retain(mp_prompt_t* p);
+mp_decl_export bool         mp_prompt_is_idle(mp_prompt_t* p);    // can it be entered?
+mp_decl_export void         mp_prompt_release(mp_prompt_t* p);
+
+// Set the stack growth policy of a prompt; call before entering it or at the start of its function.
+// (Zero fields in the policy are set to their defaults)
+mp_decl_export void mp_prompt_set_grow_policy(mp_prompt_t* p, const mp_grow_policy_t* policy);
+
 // Walk the chain of prompts.
 mp_decl_export mp_prompt_t* mp_prompt_top(void);
 mp_decl_export mp_prompt_t* mp_prompt_parent(mp_prompt_t* p);
 
+// Task context: a library with thread-local state that should follow the tasks of the scheduler and 
+// the I/O reactor (as the handler frames of `libmpeff`) registers a hook to get and set that state. 
+// The context of a task is saved when it suspends and restored when it resumes (possibly on another thread).
+// The state must be NULL on every thread until the hook is registered.
+typedef struct mp_task_context_hook_s {
+  void* (*get)(void);
+  void  (*set)(void* context);
+} mp_task_context_hook_t;
+
+mp_decl_export void mp_task_context_hook(const mp_task_context_hook_t* hook);
+
 
 #endif
\ No newline at end of file
@@ -8,4 +8,5 @@
 -----------------------------------------------------------------------------*/
 
 #include "mpeff.c"
+#include "timeout.c"
 #include "../mprompt/main.c"
@@ -74,16 +74,24 @@ static inline void mpe_free(void* p) {
 typedef struct mpe_frame_s {
   mpe_effect_t        effect;     // every frame has an effect (to speed up tests)
   struct mpe_frame_s* parent;
+  bool                masked;     // is there an under or mask frame in the chain from this frame? (see `mpe_find_cached`)
 } mpe_frame_t;
 
 
+// An entry in the handler lookup table (see `mpe_find_cached`)
+typedef struct mpe_find_entry_s {
+  mpe_effect_t                effect;
+  struct mpe_frame_handle_s*  handler;
+} mpe_find_entry_t;
+
+
 // A handler frame
 typedef struct mpe_frame_handle_s {
   mpe_frame_t             frame;
   mp_prompt_t*            prompt;
   const mpe_handlerdef_t* hdef;
   void*                   local;
-  mpe_frame_t*            resume_top;
+  mpe_find_entry_t        prev;       // the lookup table entry replaced by this handler (restored when popped)
 } mpe_frame_handle_t;
 
 
@@ -142,32 +150,173 @@ struct mpe_resume_s {
 // Top of the frames in the current execution stack
 mpe_decl_thread mpe_frame_t* mpe_frame_top;
 
+// Set the top frame
+static inline void mpe_frame_pop_to(mpe_frame_t* f) {
+  mpe_frame_top = f;
+}
+
+// Handler lookup table.
+// Maps an effect (direct mapped on its address) to its innermost handler in the current
+// chain, ignoring under and mask frames. A handler replaces the entry of its effect when it
+// is pushed and restores the previous entry when it is popped (or unlinked); an entry of 
+// another effect is a miss that falls back to `mpe_find` (see `mpe_find_cached`).
+#define MPE_FIND_CACHE_SHIFT  (5)
+#define MPE_FIND_CACHE_SIZE   (1 << MPE_FIND_CACHE_SHIFT)
+
+static mpe_decl_thread mpe_find_entry_t mpe_find_cache[MPE_FIND_CACHE_SIZE];
+
+static inline mpe_find_entry_t* mpe_find_entry(mpe_effect_t effect) {
+  const uint32_t h = (uint32_t)((uintptr_t)effect >> 3) * UINT32_C(0x9E3779B1);  // Fibonacci hashing
+  return &mpe_find_cache[h >> (32 - MPE_FIND_CACHE_SHIFT)];
+}
+
+static inline bool mpe_frame_is_barrier(const mpe_frame_t* f) {
+  return (f->effect == MPE_EFFECT(mpe_frame_under) || f->effect == MPE_EFFECT(mpe_frame_mask));
+}
+
+static inline bool mpe_frame_is_handler(const mpe_frame_t* f) {
+  return (!mpe_frame_is_barrier(f) && f->effect != MPE_EFFECT(mpe_frame_finally));
+}
+
+// Switch to another chain of frames (or NULL): the lookup table is cleared
+static void mpe_frame_switch(mpe_frame_t* top) {
+  memset(mpe_find_cache, 0, sizeof(mpe_find_cache));
+  mpe_frame_pop_to(top);
+}
+
+// Each task of the scheduler and I/O reactor in libmprompt has its own handler frames:
+// the task context is the top frame. The hook is registered by each thread when it first 
+// pushes a frame (until then the frames of all threads are empty as the hook requires).
+static void* mpe_task_context_get(void) {
+  return mpe_frame_top;
+}
+
+static void mpe_task_context_set(void* top) {
+  mpe_frame_switch((mpe_frame_t*)top);
+}
+
+static const mp_task_context_hook_t mpe_task_context_hook = { &mpe_task_context_get, &mpe_task_context_set };
+
+static mpe_decl_thread bool mpe_task_context_registered;
+
+static mpe_decl_noinline void mpe_task_context_register(void) {
+  if (mpe_task_context_registered) return;
+  mpe_task_context_registered = true;
+  mp_task_context_hook(&mpe_task_context_hook);
+}
+
+// Push a frame on top
+static inline void mpe_frame_push(mpe_frame_t* f) {
+  mpe_frame_t* top = mpe_frame_top;
+  mpe_assert_internal(top != f);
+  if (mpe_unlikely(top == NULL)) mpe_task_context_register();
+  f->parent = top;
+  f->masked = ((top != NULL && top->masked) || mpe_frame_is_barrier(f));
+  mpe_frame_top = f;
+}
+
+// Push a handler frame on top and make it the innermost handler of its effect
+static inline void mpe_handler_push(mpe_frame_handle_t* h) {
+  mpe_find_entry_t* e = mpe_find_entry(h->frame.effect);
+  h->prev = *e;
+  e->effect = h->frame.effect;
+  e->handler = h;
+  mpe_frame_push(&h->frame);
+}
+
+// Pop a handler frame (that is not necessarily on top)
+static inline void mpe_handler_pop_entry(mpe_frame_handle_t* h) {
+  *mpe_find_entry(h->frame.effect) = h->prev;
+}
+
+// Unlink the frames from the top up to `target` (which must be in the current chain)
+static void mpe_frame_unlink_to(mpe_frame_t* target) {
+  for (mpe_frame_t* f = mpe_frame_top; f != target; f = f->parent) {
+    mpe_assert_internal(f != NULL);
+    if (mpe_frame_is_handler(f)) mpe_handler_pop_entry((mpe_frame_handle_t*)f);
+  }
+  mpe_frame_pop_to(target);
+}
 
-// use as: `{mpe_with_frame(f){ <body> }}`
+// Link the frames of a resumption, from `resume_top` up to its handler `h`, on top of the current frames
+// (which may be a different chain than where they were unlinked from, possibly on another thread).
+// This is not inlined as it runs after the prompt was resumed (possibly on another thread) and the compiler 
+// may otherwise reuse the address of the thread-local `mpe_frame_top` (and lookup table) from before.
+static mpe_decl_noinline void mpe_frame_relink(mpe_frame_handle_t* h, mpe_frame_t* resume_top) {
+  mpe_frame_t* top = mpe_frame_top;
+  mpe_assert_internal(top != &h->frame);
+  h->frame.parent = top;
+  // the relinked handlers shadow the current ones and their previous entries are no longer valid;
+  // invalidate both so these are looked up again. Also recompute if the frames are masked.
+  size_t barriers = 0;
+  for (mpe_frame_t* f = resume_top; f != top; f = f->parent) {
+    if (mpe_frame_is_barrier(f)) barriers++;
+  }
+  const bool masked = (top != NULL && top->masked);
+  for (mpe_frame_t* f = resume_top; f != top; f = f->parent) {
+    f->masked = (masked || barriers > 0);
+    if (mpe_frame_is_barrier(f)) {
+      barriers--;
+    }
+    else if (mpe_frame_is_handler(f)) {
+      mpe_frame_handle_t* g = (mpe_frame_handle_t*)f;
+      g->prev.effect = NULL;
+      mpe_find_entry(f->effect)->effect = NULL;
+    }
+  }
+  mpe_frame_pop_to(resume_top);
+}
+
+// Pop a frame (that is on top)
+static inline void mpe_frame_pop(mpe_frame_t* f) {
+  mpe_assert_internal(mpe_frame_top == f);
+  mpe_frame_pop_to(f->parent);
+}
+
+static inline void mpe_handler_pop(mpe_frame_handle_t* h) {
+  mpe_handler_pop_entry(h);
+  mpe_frame_pop(&h->frame);
+}
+
+// use as: `{mpe_with_frame(f){ <body> }}` (or `{mpe_with_handler(h){ <body> }}` for a handler frame)
 #if MPE_HAS_TRY
-#define mpe_with_frame(f)   mpe_raii_with_frame_t _with_frame(f); 
-// This class ensures a handler-stack will be properly unwound even when exceptions are raised.
+#define mpe_with_frame(f)     mpe_raii_with_frame_t _with_frame(f); 
+#define mpe_with_handler(h)   mpe_raii_with_handler_t _with_handler(h); 
+// These classes ensure a handler-stack will be properly unwound even when exceptions are raised.
 class mpe_raii_with_frame_t {
 private:
   mpe_frame_t* f;
 public:
   mpe_raii_with_frame_t(mpe_frame_t* f) {
     this->f = f;
-    f->parent = mpe_frame_top;
-    mpe_assert_internal(f->parent != f);
-    mpe_frame_top = f;
+    mpe_frame_push(f);
   }
   ~mpe_raii_with_frame_t() {
-    mpe_assert_internal(mpe_frame_top == f);
-    mpe_frame_top = f->parent;
+    mpe_frame_pop(f);
+  }
+};
+class mpe_raii_with_handler_t {
+private:
+  mpe_frame_handle_t* h;
+public:
+  mpe_raii_with_handler_t(mpe_frame_handle_t* h) {
+    this->h = h;
+    mpe_handler_push(h);
+  }
+  ~mpe_raii_with_handler_t() {
+    mpe_handler_pop(h);
   }
 };
 #else
 // C version
 #define mpe_with_frame(f) \
-  for( bool _once = ((f)->parent = mpe_frame_top, mpe_frame_top = (f), true); \
+  for( bool _once = (mpe_frame_push(f), true); \
+       _once; \
+       _once = (mpe_frame_pop(f), false) ) 
+#define mpe_with_handler(h) \
+  for( bool _once = (mpe_handler_push(h), true); \
        _once; \
-       _once = (mpe_frame_top = (f)->parent, false) ) 
+       _once = (mpe_handler_pop(h), false) ) 
 #endif
 
 
@@ -192,16 +341,41 @@ public:
     return "libmpeff: unwinding the stack -- do not catch this exception!";
   }
 };
+#endif
+
+
+// Run (and pop) the finally frames up to the `target` frame.
+static mpe_decl_noinline void mpe_unwind_finally_to(mpe_frame_t* target) {
+  mpe_frame_t* f = mpe_frame_top;
+  while (f != NULL && f != target) {
+    mpe_frame_t* parent = f->parent;
+    if (f->effect == MPE_EFFECT(mpe_frame_finally)) {
+      mpe_frame_finally_t* ff = (mpe_frame_finally_t*)f;
+      mpe_frame_unlink_to(parent);   // run the finalizer outside its own frame
+      (ff->fun)(ff->local);
+    }
+    f = parent;
+  }
+  mpe_assert_internal(f == target);
+  mpe_frame_unlink_to(target);
+}
+
+// Unwind to a handler without raising an exception: run the finally frames explicitly 
+// and yield to the handler prompt, dropping the intermediate stack (so C++ destructors are not run).
+static void* mpe_perform_yield_to_abort(mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg);
+static void mpe_unwind_finally(mpe_frame_handle_t* target, const mpe_operation_t* op, void* arg) {
+  mpe_unwind_finally_to(&target->frame);
+  mpe_perform_yield_to_abort(target, op, arg);
+}
 
+#if MPE_HAS_TRY
 static void mpe_unwind_to(mpe_frame_handle_t* target, const mpe_operation_t* op, void* arg) {
   //fprintf(stderr, "throw unwind..\n");
   throw mpe_unwind_exception(target, op, arg);
 }
 #else
-static void* mpe_perform_yield_to_abort(mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg);
 static void mpe_unwind_to(mpe_frame_handle_t* target, const mpe_operation_t* op, void* arg) {
-  // TODO: walk the handlers and invoke finally frames
-  mpe_perform_yield_to_abort(target, op, arg);
+  mpe_unwind_finally(target, op, arg);
 }
 #endif
 
@@ -248,10 +422,17 @@ typedef struct mpe_perform_env_s {
   void* oparg;
 } mpe_perform_env_t;
 
+// Resuming can unwind the resumed computation instead
+typedef enum mpe_unwind_kind_e {
+  MPE_UNWIND_NONE,
+  MPE_UNWIND,           // run destructors and finalizers (using an exception in C++)
+  MPE_UNWIND_FINALLY    // only run finalizers
+} mpe_unwind_kind_t;
+
 typedef struct mpe_resume_env_s {
   void* local;
   void* result;
-  bool  unwind;
+  mpe_unwind_kind_t unwind;
 } mpe_resume_env_t;
 
 
@@ -273,18 +454,22 @@ static void* mpe_perform_op_clause(mp_resume_t* mpr, void* earg) {
 
 // Yield 
 static void* mpe_perform_yield_to(mpe_resumption_kind_t rkind, mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg) {
+  mpe_assert_internal(h->prompt != NULL);    // tail handlers are installed without a prompt and never yield
   mpe_frame_t* resume_top = mpe_frame_top; // save current top
-  mpe_frame_top = h->frame.parent;           // and unlink handlers
+  mpe_frame_unlink_to(h->frame.parent);      // and unlink handlers
   mpe_perform_env_t penv = { rkind, op->opfun, h->local, arg };
   // yield up
   mpe_resume_env_t* renv = (mpe_resume_env_t*)mp_yield(h->prompt, &mpe_perform_op_clause, &penv);
   // resumed!                     
   h->local = renv->local;           // set new state
-  mpe_assert_internal(mpe_frame_top != &h->frame);
-  h->frame.parent = mpe_frame_top;  // relink handlers
-  mpe_frame_top = resume_top;
-  if (renv->unwind) {
-    mpe_unwind_to(h, &mpe_op_unwind, renv->result);
+  mpe_frame_relink(h, resume_top);  // relink handlers (which may be under a different chain now)
+  if (mpe_unlikely(renv->unwind != MPE_UNWIND_NONE)) {
+    if (renv->unwind == MPE_UNWIND_FINALLY) {
+      mpe_unwind_finally(h, &mpe_op_unwind, renv->result);
+    }
+    else {
+      mpe_unwind_to(h, &mpe_op_unwind, renv->result);
+    }
   }
   return renv->result;
 }
@@ -297,12 +482,15 @@ static void* mpe_perform_op_clause_abort(mp_resume_t* mpr, void* earg) {
 }
 
 static void* mpe_perform_yield_to_abort(mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg) {
-  mpe_frame_top = h->frame.parent;           // unlink handlers
+  mpe_assert_internal(h->prompt != NULL);
+  mpe_frame_unlink_to(h->frame.parent);      // unlink handlers
   mpe_perform_env_t env = { MPE_RESUMPTION_SCOPED_ONCE /* unused */, op->opfun, h->local, arg };
   return mp_yield(h->prompt, &mpe_perform_op_clause_abort, &env);
 }
 
 
+void* mpe_perform(mpe_optag_t optag, void* arg);
+
 // Tail resumptive under an "under" frame
 static void* mpe_perform_under(mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg) {
   mpe_frame_under_t f;
@@ -316,38 +504,84 @@ static void* mpe_perform_under(mpe_frame_handle_t* h, const mpe_operation_t* op,
   return result;
 }
 
+// Forward an operation to the next enclosing handler (under an "under" frame)
+static void* mpe_perform_forward(mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg) {
+  mpe_frame_under_t f;
+  f.frame.effect = MPE_EFFECT(mpe_frame_under);
+  f.under = h->frame.effect;
+  void* result = NULL;
+  {mpe_with_frame(&f.frame) {
+    result = mpe_perform(op->optag, arg);
+  }}
+  return result;
+}
+
 // ------------------------------------------------------------------------------
 // Perform
 // ------------------------------------------------------------------------------
 
-static void* mpe_perform_at(mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg) {
+// Each operation kind has a direct perform function. The operations array of a handler 
+// definition is indexed by `opidx` and together with this table (indexed by `opkind`) 
+// an operation is dispatched with a single indirect call.
+typedef void* (mpe_perform_fun_t)(mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg);
+
+static void* mpe_perform_tail_noop(mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg) {
+  // tail resumptive, calls no operations, execute in place
+  mpe_resume_t resume = { MPE_RESUMPTION_INPLACE, { &h->local } };
+  return (op->opfun)(&resume, h->local, arg);
+}
+
+static void* mpe_perform_null(mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg) {
+  (void)(h); (void)(arg);
+  fprintf(stderr, "invalid operation: %s\n", mpe_optag_name(op->optag));
+  return NULL;
+}
+
+static void* mpe_perform_never(mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg) {
+  mpe_unwind_to(h, op, arg);
+  return NULL; // never reached
+}
+
+static void* mpe_perform_never_finally(mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg) {
+  mpe_unwind_finally(h, op, arg);
+  return NULL; // never reached
+}
+
+static void* mpe_perform_scoped_once(mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg) {
+  return mpe_perform_yield_to(MPE_RESUMPTION_SCOPED_ONCE, h, op, arg);
+}
+
+static void* mpe_perform_once(mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg) {
+  return mpe_perform_yield_to(MPE_RESUMPTION_ONCE, h, op, arg);
+}
+
+static void* mpe_perform_multi(mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg) {
+  return mpe_perform_yield_to(MPE_RESUMPTION_MULTI, h, op, arg);
+}
+
+static mpe_perform_fun_t* const mpe_perform_funs[MPE_OP_NEVER_FINALLY + 1] = {
+  &mpe_perform_null,            // MPE_OP_NULL
+  &mpe_perform_forward,         // MPE_OP_FORWARD
+  &mpe_perform_yield_to_abort,  // MPE_OP_ABORT
+  &mpe_perform_never,           // MPE_OP_NEVER
+  &mpe_perform_tail_noop,       // MPE_OP_TAIL_NOOP
+  &mpe_perform_under,           // MPE_OP_TAIL
+  &mpe_perform_scoped_once,     // MPE_OP_SCOPED_ONCE
+  &mpe_perform_multi,           // MPE_OP_SCOPED
+  &mpe_perform_once,            // MPE_OP_ONCE
+  &mpe_perform_multi,           // MPE_OP_MULTI
+  &mpe_perform_never_finally    // MPE_OP_NEVER_FINALLY
+};
+
+static inline void* mpe_perform_at(mpe_frame_handle_t* h, const mpe_operation_t* op, void* arg) {
   mpe_opkind_t opkind = op->opkind;
-  mpe_assert_internal(opkind == op->opkind);
+  mpe_assert_internal(opkind >= MPE_OP_NULL && opkind <= MPE_OP_NEVER_FINALLY);
   if (mpe_likely(opkind == MPE_OP_TAIL_NOOP)) {
-    // tail resumptive, calls no operations, execute in place
+    // inline the most common case
     mpe_resume_t resume = { MPE_RESUMPTION_INPLACE, { &h->local } };
     return (op->opfun)(&resume, h->local, arg);
   }
-  else if (mpe_likely(opkind == MPE_OP_TAIL)) {
-    // tail resumptive; execute in place under an "under" frame
-    return mpe_perform_under(h, op, arg);
-  }
-  else if (opkind == MPE_OP_SCOPED_ONCE) {
-    return mpe_perform_yield_to(MPE_RESUMPTION_SCOPED_ONCE, h, op, arg);
-  }
-  else if (opkind == MPE_OP_ONCE) {
-    return mpe_perform_yield_to(MPE_RESUMPTION_ONCE, h, op, arg);
-  }
-  else if (opkind == MPE_OP_NEVER) {
-    mpe_unwind_to(h, op, arg);
-    return NULL; // never reached
-  }
-  else if (opkind == MPE_OP_ABORT) {
-    return mpe_perform_yield_to_abort(h, op, arg);
-  }
-  else {
-    return mpe_perform_yield_to(MPE_RESUMPTION_MULTI, h, op, arg);    
-  }
+  return (mpe_perform_funs[opkind])(h, op, arg);
 }
 
 static mpe_decl_noinline void* mpe_unhandled_operation(mpe_optag_t optag) {
@@ -393,8 +627,28 @@ static mpe_frame_handle_t* mpe_find(mpe_optag_t optag) {
   return NULL;
 }
 
-void* mpe_perform(mpe_optag_t optag, void* arg) {
+// Find the innermost handler using the lookup table (which makes repeated performs 
+// constant time independent of the handler nesting depth). The table ignores under and 
+// mask frames so we use `mpe_find` when any is active. 
+static inline mpe_frame_handle_t* mpe_find_cached(mpe_optag_t optag) {
+  mpe_frame_t* top = mpe_frame_top;
+  if (mpe_unlikely(top == NULL || top->masked)) return mpe_find(optag);
+  mpe_effect_t opeff = optag->effect;
+  mpe_find_entry_t* e = mpe_find_entry(opeff);
+  if (mpe_likely(e->effect == opeff)) {
+    mpe_assert_internal(e->handler == mpe_find(optag));
+    return e->handler;
+  }
   mpe_frame_handle_t* h = mpe_find(optag);
+  if (mpe_likely(h != NULL)) {
+    e->effect = opeff;
+    e->handler = h;
+  }
+  return h;
+}
+
+void* mpe_perform(mpe_optag_t optag, void* arg) {
+  mpe_frame_handle_t* h = mpe_find_cached(optag);
   if (mpe_unlikely(h == NULL)) return mpe_unhandled_operation(optag);
   const mpe_operation_t* op = &h->hdef->operations[optag->opidx];
   return mpe_perform_at(h, op, arg);
@@ -428,7 +682,7 @@ static mpe_decl_noinline void* mpe_handle_start(mp_prompt_t* prompt, void* earg)
   try {  // catch unwind exceptions
   #endif
     // push frame on top
-    {mpe_with_frame(&h.frame) {
+    {mpe_with_handler(&h) {
       // and call the action
       result = (env->body)(env->arg);
     }}
@@ -450,9 +704,41 @@ static mpe_decl_noinline void* mpe_handle_start(mp_prompt_t* prompt, void* earg)
   return result;
 }
 
+// Are all operations tail resumptive? In that case the handler never yields 
+// and can be installed in-place without a prompt. (This scans the few operations of
+// the definition on every handle which is cheaper than caching the result per definition.)
+static bool mpe_handlerdef_is_tail(const mpe_handlerdef_t* hdef) {
+  if (hdef->operations == NULL) return true;
+  for (const mpe_operation_t* op = hdef->operations; op->opkind != MPE_OP_NULL; op++) {
+    mpe_opkind_t opkind = op->opkind;
+    if (opkind != MPE_OP_TAIL_NOOP && opkind != MPE_OP_TAIL && opkind != MPE_OP_FORWARD) return false;
+  }
+  return true;
+}
+
+// Start a tail handler in-place on the current stack
+static void* mpe_handle_tail(const mpe_handlerdef_t* hdef, void* local, mpe_actionfun_t* body, void* arg) {
+  mpe_frame_handle_t h;
+  h.prompt = NULL;
+  h.hdef = hdef;
+  h.local = local;
+  h.frame.effect = hdef->effect;
+  void* result = NULL;
+  {mpe_with_handler(&h) {
+    result = body(arg);
+  }}
+  if (hdef->resultfun != NULL) {
+    result = hdef->resultfun(h.local, result);
+  }
+  return result;
+}
+
 /// Handle a particular effect.
 /// Handles operations yielded in `body(arg)` with the given handler definition `def`.
 void* mpe_handle(const mpe_handlerdef_t* hdef, void* local, mpe_actionfun_t* body, void* arg) {
+  if (mpe_handlerdef_is_tail(hdef)) {
+    return mpe_handle_tail(hdef, local, body, arg);
+  }
   struct mpe_handle_start_env env = { hdef, local, body, arg };
   return mp_prompt(&mpe_handle_start, &env);
 }
@@ -462,7 +748,7 @@ void* mpe_handle(const mpe_handlerdef_t* hdef, void* local, mpe_actionfun_t* bod
   Resume
 -----------------------------------------------------------------*/
 
-static void* mpe_resume_internal(bool final, mpe_resume_t* resume, void* local, void* arg, bool unwind) {
+static void* mpe_resume_internal(bool final, mpe_resume_t* resume, void* local, void* arg, mpe_unwind_kind_t unwind) {
   mpe_assert(resume->kind >= MPE_RESUMPTION_SCOPED_ONCE);
   mpe_resume_env_t renv = { local, arg, unwind };
   // and resume
@@ -491,18 +777,18 @@ static void* mpe_resume_internal(bool final, mpe_resume_t* resume, void* local,
 }
 
 // Resume to unwind (e.g. run destructors and finally clauses)
-static void mpe_resume_unwind(mpe_resume_t* r) {
-  mpe_resume_internal(true, r, NULL, NULL, true);
+static void mpe_resume_unwind(mpe_resume_t* r, mpe_unwind_kind_t unwind) {
+  mpe_resume_internal(true, r, NULL, NULL, unwind);
 }
 
 // Last use of a resumption
 void* mpe_resume_final(mpe_resume_t* resume, void* local, void* arg) {
-  return mpe_resume_internal(true, resume, local, arg, false);
+  return mpe_resume_internal(true, resume, local, arg, MPE_UNWIND_NONE);
 }
 
 // Regular resume
 void* mpe_resume(mpe_resume_t* resume, void* local, void* arg) {
-  return mpe_resume_internal(false, resume, local, arg, false);
+  return mpe_resume_internal(false, resume, local, arg, MPE_UNWIND_NONE);
 }
 
 // Last resume in tail-position
@@ -511,7 +797,7 @@ void* mpe_resume_tail(mpe_resume_t* resume, void* local, void* arg) {
     *resume->mp.plocal = local;
     return arg;
   }
-  mpe_resume_env_t renv = { local, arg, false };
+  mpe_resume_env_t renv = { local, arg, MPE_UNWIND_NONE };
   // and tail resume
   if (resume->kind == MPE_RESUMPTION_SCOPED_ONCE) {
     mp_resume_t* mpr = resume->mp.resume;
@@ -525,17 +811,16 @@ void* mpe_resume_tail(mpe_resume_t* resume, void* local, void* arg) {
 }
 
 
-// Release without resuming 
-void mpe_resume_release(mpe_resume_t* resume) {
+static void mpe_resume_release_ex(mpe_resume_t* resume, mpe_unwind_kind_t unwind) {
   if (resume == NULL) return; // in case someone tries to release a NULL (OP_NEVER or OP_ABORT) resumption
-  if (resume->kind == MPE_RESUMPTION_ONCE) {
-    mpe_resume_unwind(resume);    
+  if (resume->kind == MPE_RESUMPTION_ONCE || resume->kind == MPE_RESUMPTION_SCOPED_ONCE) {
+    mpe_resume_unwind(resume, unwind);
   }
   else {
     mpe_assert_internal(resume->kind == MPE_RESUMPTION_MULTI);
     mp_resume_t* mpr = resume->mp.resume;
     if (mp_resume_should_unwind(mpr)) {
-      mpe_resume_unwind(resume);
+      mpe_resume_unwind(resume, unwind);
     }
     else {
       mpe_free(resume);
@@ -544,6 +829,16 @@ void mpe_resume_release(mpe_resume_t* resume) {
   }
 }
 
+// Release without resuming 
+void mpe_resume_release(mpe_resume_t* resume) {
+  mpe_resume_release_ex(resume, MPE_UNWIND);
+}
+
+// Release without resuming and without raising an exception: only finally frames are run
+void mpe_resume_drop(mpe_resume_t* resume) {
+  mpe_resume_release_ex(resume, MPE_UNWIND_FINALLY);
+}
+
 /*-----------------------------------------------------------------
   Mask
 -----------------------------------------------------------------*/
@@ -588,3 +883,213 @@ void* mpe_finally(void* local, mpe_releasefun_t* finally_fun, mpe_actionfun_t* f
   #endif
   return result;
 }
+
+
+
+/*-----------------------------------------------------------------
+  Task groups
+-----------------------------------------------------------------*/
+
+// Each child runs under its own `mpe_group` handler with the child as its local state:
+// `yield` suspends the child and returns to the join loop, while `fail` unwinds the child
+// and cancels the group. The result of running a child for a turn tells which happened.
+MPE_DEFINE_EFFECT2(mpe_group, yield, fail)
+
+typedef struct mpe_group_child_s {
+  struct mpe_group_child_s* next;
+  mpe_group_t*      group;
+  mpe_actionfun_t*  fun;
+  void*             arg;
+  mpe_resume_t*     resume;     // the resumption of a suspended child (NULL if it has not started yet)
+  mpe_frame_t*      top;        // the frames of a suspended child from its top ..
+  mpe_frame_t*      handler;    // .. up to its handler (used to run its finalizers when it is dropped)
+} mpe_group_child_t;
+
+struct mpe_group_s {
+  mpe_group_cancel_t cancel;
+  bool               cancelled;
+  bool               joining;
+  void*              error;      // the error of the first failed child
+  mpe_group_child_t* head;       // children waiting for their turn (in FIFO order)
+  mpe_group_child_t* tail;
+  mpe_group_child_t* running;    // the child that has the turn
+};
+
+static char mpe_group_done;
+static char mpe_group_suspended;
+static char mpe_group_failed;
+
+static void* mpe_group_op_yield(mpe_resume_t* r, void* local, void* arg) {
+  (void)(arg);
+  ((mpe_group_child_t*)local)->resume = r;
+  return &mpe_group_suspended;
+}
+
+static void* mpe_group_op_fail(mpe_resume_t* r, void* local, void* arg) {
+  (void)(r);
+  mpe_group_t* g = ((mpe_group_child_t*)local)->group;
+  if (g->error == NULL) g->error = arg;
+  g->cancelled = true;
+  return &mpe_group_failed;
+}
+
+static const mpe_operation_t mpe_group_ops[] = {
+  { MPE_OP_ONCE,  MPE_OPTAG(mpe_group, yield), &mpe_group_op_yield },
+  { MPE_OP_NEVER, MPE_OPTAG(mpe_group, fail),  &mpe_group_op_fail },
+  { MPE_OP_NULL, mpe_op_null, NULL }
+};
+static const mpe_handlerdef_t mpe_group_hdef = { MPE_EFFECT(mpe_group), NULL, mpe_group_ops };
+
+static void mpe_group_push(mpe_group_t* g, mpe_group_child_t* c) {
+  c->next = NULL;
+  if (g->tail == NULL) { g->head = c; }
+                  else { g->tail->next = c; }
+  g->tail = c;
+}
+
+static mpe_group_child_t* mpe_group_pop(mpe_group_t* g) {
+  mpe_group_child_t* c = g->head;
+  if (c != NULL) {
+    g->head = c->next;
+    if (g->head == NULL) g->tail = NULL;
+  }
+  return c;
+}
+
+static void* mpe_group_child_start(void* arg) {
+  mpe_group_child_t* c = (mpe_group_child_t*)arg;
+  (c->fun)(c->arg);
+  return &mpe_group_done;
+}
+
+void mpe_group_yield(void) {
+  mpe_optag_t optag = MPE_OPTAG(mpe_group, yield);
+  mpe_frame_handle_t* h = mpe_find_cached(optag);
+  if (mpe_unlikely(h == NULL)) { mpe_unhandled_operation(optag); return; }
+  mpe_group_child_t* c = (mpe_group_child_t*)h->local;
+  c->top = mpe_frame_top;
+  c->handler = &h->frame;
+  mpe_perform_at(h, &h->hdef->operations[optag->opidx], NULL);
+}
+
+void mpe_group_fail(void* error) {
+  mpe_perform(MPE_OPTAG(mpe_group, fail), error);
+}
+
+// Release a suspended child
+static void mpe_group_release_child(mpe_group_t* g, mpe_group_child_t* c) {
+  mpe_resume_t* r = c->resume;
+  if (r == NULL) return;   // never started
+  c->resume = NULL;
+  if (g->cancel == MPE_GROUP_UNWIND) {
+    mpe_resume_release(r);
+    return;
+  }
+  // Drop: instead of resuming the child to unwind its frames, run its finalizers 
+  // (innermost first) right here as its suspended frames stay valid until its prompts are dropped.
+  // As in `mpe_unwind_finally_to`, each finalizer runs outside its own frame (in the chain of the child).
+  mpe_frame_t* top = mpe_frame_top;
+  for (mpe_frame_t* f = c->top; f != NULL && f != c->handler; f = f->parent) {
+    if (f->effect == MPE_EFFECT(mpe_frame_finally)) {
+      mpe_frame_finally_t* ff = (mpe_frame_finally_t*)f;
+      mpe_frame_switch(ff->frame.parent);
+      (ff->fun)(ff->local);
+      mpe_frame_switch(top);
+    }
+  }
+  // and drop its prompt chain (each child is dropped separately with `mp_resume_drop`)
+  mpe_assert_internal(r->kind == MPE_RESUMPTION_ONCE);
+  mp_resume_t* mpr = r->mp.resume;
+  mpe_free(r);
+  mp_resume_drop(mpr);
+}
+
+// Called when the join loop ends (or is unwound): cancel all remaining children if needed
+static void mpe_group_release(void* local) {
+  mpe_group_t* g = (mpe_group_t*)local;
+  g->joining = false;
+  if (g->running != NULL) {
+    // unwound while a child had its turn; its prompt is dropped by the unwinding itself
+    mpe_free(g->running);
+    g->running = NULL;
+    g->cancelled = true;
+  }
+  if (!g->cancelled) return;
+  mpe_group_child_t* c;
+  while ((c = mpe_group_pop(g)) != NULL) {
+    mpe_group_release_child(g, c);
+    mpe_free(c);
+  }
+}
+
+// Give each child a turn until all are done or the group is cancelled
+static void* mpe_group_run(void* arg) {
+  mpe_group_t* g = (mpe_group_t*)arg;
+  mpe_group_child_t* c;
+  while (!g->cancelled && (c = mpe_group_pop(g)) != NULL) {
+    g->running = c;
+    void* status;
+    if (c->resume == NULL) {
+      status = mpe_handle(&mpe_group_hdef, c, &mpe_group_child_start, c);
+    }
+    else {
+      mpe_resume_t* r = c->resume;
+      c->resume = NULL;
+      status = mpe_resume_final(r, c, NULL);
+    }
+    g->running = NULL;
+    if (status == &mpe_group_suspended) {
+      mpe_group_push(g, c);
+    }
+    else {
+      mpe_assert_internal(status == &mpe_group_done || status == &mpe_group_failed);
+      mpe_free(c);
+    }
+  }
+  return NULL;
+}
+
+mpe_group_t* mpe_group_create(mpe_group_cancel_t cancel) {
+  mpe_group_t* g = mpe_malloc_tp(mpe_group_t);
+  g->cancel = cancel;
+  g->cancelled = false;
+  g->joining = false;
+  g->error = NULL;
+  g->head = g->tail = NULL;
+  g->running = NULL;
+  return g;
+}
+
+void mpe_group_free(mpe_group_t* g) {
+  if (g == NULL) return;
+  mpe_assert(!g->joining);
+  g->cancelled = true;
+  mpe_group_release(g);
+  mpe_free(g);
+}
+
+void mpe_group_spawn(mpe_group_t* g, mpe_actionfun_t* fun, void* arg) {
+  if (g->cancelled) return;
+  mpe_group_child_t* c = mpe_malloc_tp(mpe_group_child_t);
+  c->group = g;
+  c->fun = fun;
+  c->arg = arg;
+  c->resume = NULL;
+  c->top = c->handler = NULL;
+  mpe_group_push(g, c);
+}
+
+void* mpe_group_join(mpe_group_t* g) {
+  mpe_assert(!g->joining);  // a child cannot join its own group
+  g->joining = true;
+  mpe_finally(g, &mpe_group_release, &mpe_group_run, g);
+  return g->error;
+}
+
+void mpe_group_cancel(mpe_group_t* g) {
+  g->cancelled = true;
+}
+
+bool mpe_group_is_cancelled(mpe_group_t* g) {
+  return g->cancelled;
+}
@@ -0,0 +1,112 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Timeouts for I/O tasks: glue between the effect handlers and the 
+  timers and cancellation of the I/O reactor of libmprompt (`mp_io.h`).
+  This only uses the public interfaces of both libraries.
+-----------------------------------------------------------------------------*/
+#if defined(MP_USE_IO) && defined(__linux__)
+#include <stdbool.h>
+#include <stdint.h>
+#include <mprompt.h>
+#include <mp_io.h>
+#include "mpeff.h"
+
+// When the timer expires, the I/O task is cancelled; the cancel function of the
+// task then performs `mpe_timeout_expired` which unwinds to the innermost
+// timeout handler. If an outer timeout expired, the unwinding continues from there.
+MPE_DEFINE_EFFECT1(mpe_timeout, expired);
+
+typedef struct mpe_timeout_s {
+  bool                expired;
+  mp_io_task_t*       task;
+  mp_timer_t          timer;
+  mpe_actionfun_t*    fun;
+  void*               arg;
+  void*               result;
+  mp_io_cancel_fun_t* prev_fun;    // the previous cancel function of the task
+  void*               prev_arg;
+} mpe_timeout_t;
+
+static void mpe_timeout_cancel(void* arg);
+
+// The enclosing timeout of the same task (or NULL)
+static mpe_timeout_t* mpe_timeout_outer(mpe_timeout_t* to) {
+  return (to->prev_fun == &mpe_timeout_cancel ? (mpe_timeout_t*)to->prev_arg : NULL);
+}
+
+static void mpe_timeout_fire(void* arg) {
+  mpe_timeout_t* to = (mpe_timeout_t*)arg;
+  to->expired = true;
+  mp_io_cancel(to->task);
+}
+
+static void mpe_timeout_cancel(void* arg) {
+  mpe_timeout_t* to = (mpe_timeout_t*)arg;
+  if (to->expired) {
+    mpe_perform(MPE_OPTAG(mpe_timeout, expired), to);   // does not return
+  }
+  else if (to->prev_fun != NULL) {
+    (to->prev_fun)(to->prev_arg);
+  }
+}
+
+static void* mpe_timeout_op_expired(mpe_resume_t* r, void* local, void* arg) {
+  (void)(r); (void)(local);
+  return arg;   // the expired timeout
+}
+
+static void* mpe_timeout_body(void* arg) {
+  mpe_timeout_t* to = (mpe_timeout_t*)arg;
+  to->result = (to->fun)(to->arg);
+  return NULL;
+}
+
+static void* mpe_timeout_handle(void* arg) {
+  static const mpe_operation_t timeout_ops[] = {
+    { MPE_OP_NEVER, MPE_OPTAG(mpe_timeout, expired), &mpe_timeout_op_expired },
+    { MPE_OP_NULL, mpe_op_null, NULL }
+  };
+  static const mpe_handlerdef_t timeout_hdef = { MPE_EFFECT(mpe_timeout), NULL, timeout_ops };
+  return mpe_handle(&timeout_hdef, arg, &mpe_timeout_body, arg);
+}
+
+static void mpe_timeout_release(void* local) {
+  mpe_timeout_t* to = (mpe_timeout_t*)local;
+  mp_timer_stop(&to->timer);
+  mp_io_on_cancel(to->prev_fun, to->prev_arg, NULL, NULL);
+}
+
+void* mpe_with_timeout(int64_t timeout, mpe_actionfun_t* fun, void* arg, bool* timed_out) {
+  if (timed_out != NULL) *timed_out = false;
+  mp_io_task_t* task = mp_io_current();
+  if (task == NULL) return fun(arg);
+  mpe_timeout_t to;
+  to.expired = false;
+  to.task = task;
+  to.fun = fun;
+  to.arg = arg;
+  to.result = NULL;
+  mp_io_on_cancel(&mpe_timeout_cancel, &to, &to.prev_fun, &to.prev_arg);
+  mp_timer_start(&to.timer, mp_io_now() + (timeout > 0 ? timeout : 0), &mpe_timeout_fire, &to);
+  mpe_timeout_t* target = (mpe_timeout_t*)mpe_finally(&to, &mpe_timeout_release, &mpe_timeout_handle, &to);
+  if (target == NULL) {
+    // finished before the cancellation took effect; clear it unless an enclosing timeout expired as well
+    if (to.expired) {
+      mpe_timeout_t* outer = mpe_timeout_outer(&to);
+      while (outer != NULL && !outer->expired) outer = mpe_timeout_outer(outer);
+      if (outer == NULL) mp_io_uncancel();
+    }
+    return to.result;
+  }
+  if (target != &to) {
+    mpe_perform(MPE_OPTAG(mpe_timeout, expired), target);   // continue unwinding to the enclosing timeout
+  }
+  if (timed_out != NULL) *timed_out = true;
+  return NULL;
+}
+
+#endif
@@ -0,0 +1,374 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Channels for scheduled tasks.
+
+  Each channel has a lock, a ring buffer, and queues of waiting senders and
+  receivers. A waiter lives on the stack of its parked task and points to
+  the (select) operation it belongs to; a task that finds a waiter on the
+  other side claims the operation with a CAS (as a select can wait on many
+  channels at once), performs the case directly on the waiter, and unparks
+  its task. As in Go, a select locks all its channels (in address order)
+  while it checks the cases and enqueues its waiters, so no one can complete
+  one of its cases in the meantime.
+
+  A claimer unparks the task while still holding the channel lock; the
+  woken task locks all its channels again to dequeue its other waiters, so
+  it cannot return (and pop its waiters off the stack) before the claimer
+  is done with it.
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "mprompt.h"
+#include "mp_sched.h"
+#include "mp_chan.h"
+#include "internal/util.h"
+#include "internal/atomic.h"
+
+#define MP_CHAN_INITIAL_SIZE  (16)     // initial buffer of an unbounded channel
+#define MP_CHAN_SELECT_LOCAL  (8)      // cases of a select without allocation
+
+//-----------------------------------------------------------------------
+// Types
+//-----------------------------------------------------------------------
+
+// An operation (with one or more cases) that waits
+typedef struct mp_chan_sel_s {
+  _Atomic(intptr_t)  state;     // -1 while waiting, or the index of the completed case
+  _Atomic(intptr_t)  done;      // set once the case is completed
+  mps_task_t*        task;
+} mp_chan_sel_t;
+
+typedef struct mp_chan_waiter_s {
+  mp_chan_sel_t*           sel;
+  mp_chan_case_t*          kase;
+  intptr_t                 index;    // of `kase` in the select
+  bool                     queued;
+  struct mp_chan_waiter_s* next;
+  struct mp_chan_waiter_s* prev;
+} mp_chan_waiter_t;
+
+typedef struct mp_chan_waitq_s {
+  mp_chan_waiter_t* head;
+  mp_chan_waiter_t* tail;
+} mp_chan_waitq_t;
+
+struct mp_chan_s {
+  mps_mutex_t       lock;
+  size_t            capacity;
+  bool              closed;
+  void**            buf;        // ring buffer
+  size_t            buf_size;
+  size_t            head;
+  size_t            count;
+  mp_chan_waitq_t   senders;
+  mp_chan_waitq_t   receivers;
+};
+
+
+//-----------------------------------------------------------------------
+// Wait queues
+//-----------------------------------------------------------------------
+
+static void mp_chan_waitq_push(mp_chan_waitq_t* q, mp_chan_waiter_t* w) {
+  w->next = NULL;
+  w->prev = q->tail;
+  if (q->tail == NULL) { q->head = w; }
+                  else { q->tail->next = w; }
+  q->tail = w;
+  w->queued = true;
+}
+
+static void mp_chan_waitq_remove(mp_chan_waitq_t* q, mp_chan_waiter_t* w) {
+  if (w->prev == NULL) { q->head = w->next; }
+                  else { w->prev->next = w->next; }
+  if (w->next == NULL) { q->tail = w->prev; }
+                  else { w->next->prev = w->prev; }
+  w->next = w->prev = NULL;
+  w->queued = false;
+}
+
+// Dequeue the first waiter whose operation we can claim (skipping those completed by others)
+static mp_chan_waiter_t* mp_chan_waitq_claim(mp_chan_waitq_t* q) {
+  mp_chan_waiter_t* w;
+  while ((w = q->head) != NULL) {
+    mp_chan_waitq_remove(q, w);
+    intptr_t expected = -1;
+    if (mp_atomic_cas(&w->sel->state, &expected, w->index)) return w;
+  }
+  return NULL;
+}
+
+// Wake up the task of a claimed waiter (with the channel still locked)
+static void mp_chan_waiter_wakeup(mp_chan_waiter_t* w, bool ok) {
+  mp_chan_sel_t* sel = w->sel;
+  mps_task_t* task = sel->task;
+  w->kase->ok = ok;
+  mp_atomic_store(&sel->done, (intptr_t)1);
+  mps_unpark(task);
+}
+
+
+//-----------------------------------------------------------------------
+// Buffer
+//-----------------------------------------------------------------------
+
+static bool mp_chan_buf_push(mp_chan_t* c, void* value) {
+  if (c->count >= c->capacity) return false;
+  if (c->count == c->buf_size) {
+    // grow an unbounded channel
+    const size_t size = (c->buf_size == 0 ? MP_CHAN_INITIAL_SIZE : 2 * c->buf_size);
+    void** buf = (void**)mp_malloc_safe(size * sizeof(void*));
+    for (size_t i = 0; i < c->count; i++) {
+      buf[i] = c->buf[(c->head + i) % c->buf_size];
+    }
+    mp_free(c->buf);
+    c->buf = buf;
+    c->buf_size = size;
+    c->head = 0;
+  }
+  c->buf[(c->head + c->count) % c->buf_size] = value;
+  c->count++;
+  return true;
+}
+
+static void* mp_chan_buf_pop(mp_chan_t* c) {
+  mp_assert_internal(c->count > 0);
+  void* value = c->buf[c->head];
+  c->head = (c->head + 1) % c->buf_size;
+  c->count--;
+  return value;
+}
+
+
+//-----------------------------------------------------------------------
+// Cases (with the channel locked)
+//-----------------------------------------------------------------------
+
+static bool mp_chan_try_send_locked(mp_chan_t* c, mp_chan_case_t* kase) {
+  if (c->closed) {
+    kase->ok = false;
+    return true;
+  }
+  mp_chan_waiter_t* w = mp_chan_waitq_claim(&c->receivers);
+  if (w != NULL) {
+    // hand over directly
+    w->kase->value = kase->value;
+    mp_chan_waiter_wakeup(w, true);
+  }
+  else if (!mp_chan_buf_push(c, kase->value)) {
+    return false;
+  }
+  kase->ok = true;
+  return true;
+}
+
+static bool mp_chan_try_recv_locked(mp_chan_t* c, mp_chan_case_t* kase) {
+  if (c->count > 0) {
+    kase->value = mp_chan_buf_pop(c);
+    // a waiting sender can now fill the buffer
+    mp_chan_waiter_t* w = mp_chan_waitq_claim(&c->senders);
+    if (w != NULL) {
+      mp_chan_buf_push(c, w->kase->value);
+      mp_chan_waiter_wakeup(w, true);
+    }
+    kase->ok = true;
+    return true;
+  }
+  mp_chan_waiter_t* w = mp_chan_waitq_claim(&c->senders);
+  if (w != NULL) {
+    kase->value = w->kase->value;
+    mp_chan_waiter_wakeup(w, true);
+    kase->ok = true;
+    return true;
+  }
+  if (c->closed) {
+    kase->value = NULL;
+    kase->ok = false;
+    return true;
+  }
+  return false;
+}
+
+static bool mp_chan_try_case_locked(mp_chan_case_t* kase) {
+  return (kase->dir == MP_CHAN_SEND ? mp_chan_try_send_locked(kase->chan, kase) : mp_chan_try_recv_locked(kase->chan, kase));
+}
+
+
+//-----------------------------------------------------------------------
+// Select
+//-----------------------------------------------------------------------
+
+static mp_decl_thread uint32_t mp_chan_random = 0x9E3779B9;
+
+static size_t mp_chan_random_index(size_t count) {
+  uint32_t x = mp_chan_random;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  mp_chan_random = x;
+  return (size_t)x % count;
+}
+
+// Lock the distinct channels of the cases in address order (to avoid deadlock); `chans` receives the locked channels
+static size_t mp_chan_lock_all(mp_chan_case_t* cases, size_t count, mp_chan_t** chans) {
+  size_t n = 0;
+  for (size_t i = 0; i < count; i++) {
+    mp_chan_t* c = cases[i].chan;
+    if (c == NULL) continue;
+    size_t j = n;
+    while (j > 0 && (uintptr_t)chans[j-1] > (uintptr_t)c) j--;
+    if (j > 0 && chans[j-1] == c) continue;   // duplicate
+    memmove(&chans[j+1], &chans[j], (n - j) * sizeof(mp_chan_t*));
+    chans[j] = c;
+    n++;
+  }
+  for (size_t i = 0; i < n; i++) mps_mutex_lock(&chans[i]->lock);
+  return n;
+}
+
+static void mp_chan_unlock_all(mp_chan_t** chans, size_t n) {
+  for (size_t i = n; i > 0; i--) mps_mutex_unlock(&chans[i-1]->lock);
+}
+
+int mp_chan_select(mp_chan_case_t* cases, size_t count, bool block) {
+  if (count == 0 && !block) return -1;
+  mp_chan_t*       local_chans[MP_CHAN_SELECT_LOCAL];
+  mp_chan_waiter_t local_waiters[MP_CHAN_SELECT_LOCAL];
+  mp_chan_t**       chans   = local_chans;
+  mp_chan_waiter_t* waiters = local_waiters;
+  if (count > MP_CHAN_SELECT_LOCAL) {
+    chans = (mp_chan_t**)mp_malloc_safe(count * sizeof(mp_chan_t*));
+    waiters = (mp_chan_waiter_t*)mp_malloc_safe(count * sizeof(mp_chan_waiter_t));
+  }
+
+  // check the cases in a random order
+  int result = -1;
+  const size_t nchans = mp_chan_lock_all(cases, count, chans);
+  const size_t start = (count > 1 ? mp_chan_random_index(count) : 0);
+  for (size_t i = 0; i < count && result < 0; i++) {
+    const size_t k = (start + i) % count;
+    if (cases[k].chan != NULL && mp_chan_try_case_locked(&cases[k])) result = (int)k;
+  }
+  if (result >= 0 || !block) {
+    mp_chan_unlock_all(chans, nchans);
+  }
+  else {
+    // enqueue a waiter on every channel and park until one of the cases is completed
+    mps_task_t* task = mps_current();
+    if (task == NULL) mp_fatal_message(EINVAL, "channel operations can only wait in a scheduled task\n");
+    mp_chan_sel_t sel;
+    mp_atomic_store(&sel.state, (intptr_t)-1);
+    mp_atomic_store(&sel.done, (intptr_t)0);
+    sel.task = task;
+    for (size_t i = 0; i < count; i++) {
+      mp_chan_waiter_t* w = &waiters[i];
+      w->sel = &sel;
+      w->kase = &cases[i];
+      w->index = (intptr_t)i;
+      w->queued = false;
+      mp_chan_t* c = cases[i].chan;
+      if (c != NULL) mp_chan_waitq_push(cases[i].dir == MP_CHAN_SEND ? &c->senders : &c->receivers, w);
+    }
+    mp_chan_unlock_all(chans, nchans);
+    while (mp_atomic_load(&sel.done) == 0) {
+      mps_park();
+    }
+    result = (int)mp_atomic_load(&sel.state);
+    // dequeue the other waiters
+    mp_chan_lock_all(cases, count, chans);
+    for (size_t i = 0; i < count; i++) {
+      mp_chan_waiter_t* w = &waiters[i];
+      if (w->queued) {
+        mp_chan_t* c = cases[i].chan;
+        mp_chan_waitq_remove(cases[i].dir == MP_CHAN_SEND ? &c->senders : &c->receivers, w);
+      }
+    }
+    mp_chan_unlock_all(chans, nchans);
+  }
+
+  if (chans != local_chans) {
+    mp_free(chans);
+    mp_free(waiters);
+  }
+  return result;
+}
+
+
+//-----------------------------------------------------------------------
+// Interface
+//-----------------------------------------------------------------------
+
+mp_chan_t* mp_chan_create(size_t capacity) {
+  mp_chan_t* c = mp_zalloc_safe_tp(mp_chan_t);
+  mps_mutex_init(&c->lock);
+  c->capacity = capacity;
+  if (capacity > 0 && capacity != MP_CHAN_UNBOUNDED) {
+    c->buf = (void**)mp_malloc_safe(capacity * sizeof(void*));
+    c->buf_size = capacity;
+  }
+  return c;
+}
+
+void mp_chan_free(mp_chan_t* c) {
+  if (c == NULL) return;
+  mp_assert(c->senders.head == NULL && c->receivers.head == NULL);
+  mps_mutex_done(&c->lock);
+  mp_free(c->buf);
+  mp_free(c);
+}
+
+void mp_chan_close(mp_chan_t* c) {
+  mps_mutex_lock(&c->lock);
+  c->closed = true;
+  mp_chan_waiter_t* w;
+  while ((w = mp_chan_waitq_claim(&c->receivers)) != NULL) {
+    w->kase->value = NULL;
+    mp_chan_waiter_wakeup(w, false);
+  }
+  while ((w = mp_chan_waitq_claim(&c->senders)) != NULL) {
+    mp_chan_waiter_wakeup(w, false);
+  }
+  mps_mutex_unlock(&c->lock);
+}
+
+size_t mp_chan_count(mp_chan_t* c) {
+  mps_mutex_lock(&c->lock);
+  const size_t count = c->count;
+  mps_mutex_unlock(&c->lock);
+  return count;
+}
+
+static bool mp_chan_op(mp_chan_t* c, mp_chan_dir_t dir, void** value, bool block) {
+  mp_chan_case_t kase;
+  kase.chan = c;
+  kase.dir = dir;
+  kase.value = *value;
+  kase.ok = false;
+  if (mp_chan_select(&kase, 1, block) < 0) return false;
+  *value = kase.value;
+  return kase.ok;
+}
+
+bool mp_chan_send(mp_chan_t* c, void* value) {
+  return mp_chan_op(c, MP_CHAN_SEND, &value, true);
+}
+
+bool mp_chan_recv(mp_chan_t* c, void** value) {
+  *value = NULL;
+  return mp_chan_op(c, MP_CHAN_RECV, value, true);
+}
+
+bool mp_chan_try_send(mp_chan_t* c, void* value) {
+  return mp_chan_op(c, MP_CHAN_SEND, &value, false);
+}
+
+bool mp_chan_try_recv(mp_chan_t* c, void** value) {
+  *value = NULL;
+  return mp_chan_op(c, MP_CHAN_RECV, value, false);
+}
@@ -0,0 +1,123 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Batched generators: the producer runs under its own prompt and fills
+  the buffer of the consumer, switching back once per batch.
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <errno.h>
+
+#include "mprompt.h"
+#include "mp_gen.h"
+#include "internal/util.h"
+
+struct mp_gen_s {
+  mp_gen_fun_t* fun;
+  void*         arg;
+  mp_prompt_t*  prompt;     // the prompt of the producer (NULL if not yet started)
+  mp_resume_t*  resume;     // the producer while it is suspended
+  void*         buffer;     // the buffer of the consumer ..
+  size_t        capacity;   // .. with room for `capacity` elements
+  size_t        count;      // elements passed by the last `mp_gen_yield`
+  bool          stopped;
+  bool          done;
+};
+
+mp_gen_t* mp_gen_create(mp_gen_fun_t* fun, void* arg) {
+  mp_gen_t* g = mp_zalloc_safe_tp(mp_gen_t);
+  g->fun = fun;
+  g->arg = arg;
+  return g;
+}
+
+bool mp_gen_is_done(mp_gen_t* g) {
+  return g->done;
+}
+
+
+//-----------------------------------------------------------------------
+// Producer
+//-----------------------------------------------------------------------
+
+static void* mp_gen_start(mp_prompt_t* p, void* arg) {
+  mp_gen_t* g = (mp_gen_t*)arg;
+  g->prompt = p;
+  (g->fun)(g, g->arg);
+  return NULL;
+}
+
+static void* mp_gen_suspend(mp_resume_t* r, void* arg) {
+  mp_gen_t* g = (mp_gen_t*)arg;
+  g->resume = r;
+  return g;
+}
+
+void* mp_gen_buffer(mp_gen_t* g, size_t* capacity) {
+  if (capacity != NULL) *capacity = g->capacity;
+  return g->buffer;
+}
+
+bool mp_gen_yield(mp_gen_t* g, size_t count) {
+  if (mp_unlikely(g->stopped)) return false;
+  mp_assert(count <= g->capacity);
+  g->count = count;
+  mp_yield(g->prompt, &mp_gen_suspend, g);
+  return !g->stopped;
+}
+
+
+//-----------------------------------------------------------------------
+// Consumer
+//-----------------------------------------------------------------------
+
+// Run the producer until it yields a batch (returns true) or returns (false)
+static bool mp_gen_run(mp_gen_t* g) {
+  g->count = 0;
+  g->done = true;    // until the producer yields again (as it may also raise an exception)
+  void* res;
+  if (g->prompt == NULL) {
+    res = mp_prompt(&mp_gen_start, g);
+  }
+  else {
+    mp_resume_t* r = g->resume;
+    g->resume = NULL;
+    res = mp_resume(r, NULL);
+  }
+  if (res != g) {
+    g->buffer = NULL;
+    g->capacity = 0;
+    return false;
+  }
+  g->done = false;
+  return true;
+}
+
+size_t mp_gen_next(mp_gen_t* g, void* buffer, size_t capacity) {
+  if (g->done) return 0;
+  if (buffer == NULL || capacity == 0) {
+    mp_error_message(EINVAL, "mp_gen_next needs a buffer with room for at least one element\n");
+    return 0;
+  }
+  g->buffer = buffer;
+  g->capacity = capacity;
+  // keep running the producer while it yields empty batches (as a count of 0 signifies the end)
+  while (mp_gen_run(g)) {
+    if (g->count > 0) return g->count;
+  }
+  return 0;
+}
+
+void mp_gen_free(mp_gen_t* g) {
+  if (g == NULL) return;
+  if (g->prompt != NULL) {
+    // let the producer return (and release its resources)
+    g->stopped = true;
+    g->buffer = NULL;
+    g->capacity = 0;
+    while (!g->done) mp_gen_run(g);
+  }
+  mp_free(g);
+}
@@ -16,6 +16,8 @@
 #include "internal/util.h"
 #include "internal/longjmp.h"       // mp_stack_enter
 #include "internal/gstack.h"
+#include "internal/probe.h"
+#include "internal/atomic.h"       // budget of committed memory
 
 #ifdef __cplusplus
 #include <exception>
@@ -38,6 +40,10 @@ struct mp_gstack_s {
   ssize_t       stack_size;         // actual available total stack size (includes reserved space) (depends on platform, but usually `os_gstack_size - 2*mp_gstack_gap`)
   ssize_t       initial_commit;     // initial committed memory (usually `os_page_size`)  
   ssize_t       committed;          // current committed estimate
+  ssize_t       faults;             // commit-on-demand faults since allocation
+  mp_grow_policy_t grow;            // growth policy (normalized)
+  const void*   peak_key;           // key (start function) to learn the peak stack use for `MP_GROW_PEAK`
+  ssize_t       used_peak;          // peak stack use seen by the fault handler
   ssize_t       extra_size;         // size of extra allocated bytes.         
   uint8_t       extra[1];           // extra allocated (holds the mp_prompt_t structure)
 };
@@ -56,12 +62,18 @@ static bool    os_stack_grows_down        = true;          // on almost all syst
 static ssize_t os_page_size               = 0;             // initialized at startup
 
 static ssize_t os_gstack_initial_commit   = 0;             // initial commit size (initialized to be at least `os_page_size`)
+static ssize_t os_gstack_populate         = 0;             // prefault size of a fresh gstack (at most `os_gstack_initial_commit`)
+static bool    os_gstack_huge_pages       = false;         // advise transparent huge pages?
 static ssize_t os_gstack_size             = 8 * MP_MIB;    // reserved memory for a stack (including the gaps)
 static ssize_t os_gstack_gap              = 64 * MP_KIB;   // noaccess gap between stacks; `os_gstack_gap > min(64*1024, os_page_size, os_gstack_size/2`.
 static bool    os_gstack_reset_decommits  = false;         // force full decommit when resetting a stack?
 static bool    os_gstack_grow_fast        = true;          // use doubling to grow gstacks (up to 1MiB)
+static mp_grow_policy_t os_gstack_grow;                    // default growth policy (normalized at initialization)
 static ssize_t os_gstack_cache_max_count  = 4;             // number of prompts to keep in the thread local cache
 static ssize_t os_gstack_exn_guaranteed   = 32 * MP_KIB;   // guaranteed stack size available during an exception unwind (only used on Windows)
+static ssize_t os_gstack_budget           = 0;             // maximum committed memory of all gstacks (0 for unlimited)
+static mp_budget_fun_t* os_gstack_budget_fun = NULL;       // called when the budget is exhausted
+static void*   os_gstack_budget_arg       = NULL;
 
 #if defined(_MSC_VER) && !defined(NDEBUG)  // gpool a tad smaller in msvc so debug traces work (as the gpool can be placed lower than the system stack)
 static ssize_t os_gpool_max_size          = 16 * MP_GIB;   // virtual size of one gstack pooled area (holds about 2^15 gstacks)
@@ -99,11 +111,14 @@ static void     mp_gstack_os_free(uint8_t* full, uint8_t* stack, ssize_t stack_s
 static bool     mp_gstack_os_init(void);
 static void     mp_gstack_os_thread_init(void);
 static void     mp_gstack_thread_done(void);  // called by hook installed in os specific include
+static int64_t  mp_os_clock_ns(void);         // monotonic clock (async-signal-safe)
 
 // Used by the gpool implementation
 static uint8_t* mp_os_mem_reserve(ssize_t size);
 static void     mp_os_mem_free(uint8_t* p, ssize_t size);
 static bool     mp_os_mem_commit(uint8_t* start, ssize_t size);
+static void     mp_os_mem_populate(uint8_t* start, ssize_t size);  // prefault committed memory
+static void     mp_os_mem_advise_huge(uint8_t* start, ssize_t size);
 
 // Used by signal handler to check access
 typedef enum mp_access_e {
@@ -114,11 +129,14 @@ typedef enum mp_access_e {
 } mp_access_t;
 
 static mp_access_t  mp_gstack_check_access(mp_gstack_t* g, void* address, ssize_t* stack_size, ssize_t* available, ssize_t* commit_available);
+static void         mp_gstack_commit_record(mp_gstack_t* g, ssize_t committed, ssize_t size, int64_t start_ns);
+static ssize_t      mp_gstack_grow_extra(mp_gstack_t* g, ssize_t used, ssize_t available);
 
 // The gpool interface
 typedef struct mp_gpool_s mp_gpool_t;
 static uint8_t*     mp_gpool_alloc(uint8_t** stk, ssize_t* stk_size);
 static void         mp_gpool_free(uint8_t* stk);
+static void         mp_gpools_stats(mp_gstack_stats_t* stats);
 static mp_access_t  mp_gpools_check_access(void* address, ssize_t* available, ssize_t* stack_size, const mp_gpool_t** gp);
 
 
@@ -165,6 +183,177 @@ static uint8_t* mp_gstack_base(const mp_gstack_t* g) {
 // We have a small cache per thread of stacks to avoid going to the OS too often.
 static mp_decl_thread mp_gstack_t* _mp_gstack_cache;
 static mp_decl_thread ssize_t      _mp_gstack_cache_count;
+static mp_decl_thread ssize_t      _mp_gstack_cache_hits;
+static mp_decl_thread ssize_t      _mp_gstack_cache_misses;
+
+// Commit-on-demand statistics of this thread (updated by the fault handler running on this thread)
+static mp_decl_thread mp_commit_stats_t _mp_commit_stats;
+
+int mp_commit_hist_bucket(ptrdiff_t v) {
+  int b = 0;
+  while (v > 0 && b < MP_COMMIT_HIST_SIZE - 1) { v >>= 1; b++; }
+  return b;
+}
+
+// Budget of committed memory of all gstacks in the process.
+// Counts the initial commit of fresh gstacks and the commit-on-demand growth, until a gstack is freed
+// to the OS or gpool (so it includes the gstacks in the thread-local caches).
+static _Atomic(ssize_t) mp_gstack_budget_committed;
+
+// Try to count `size` more bytes against the budget
+static bool mp_gstack_budget_try_reserve(ssize_t size) {
+  ssize_t committed = mp_atomic_load(&mp_gstack_budget_committed);
+  do {
+    if (os_gstack_budget > 0 && committed + size > os_gstack_budget) return false;
+  } while (!mp_atomic_cas(&mp_gstack_budget_committed, &committed, committed + size));
+  return true;
+}
+
+// Reserve `size` bytes for a fresh gstack. When the budget is exhausted we first free the gstacks 
+// in our thread-local cache, and then call the budget function (which may block) until it gives up.
+static bool mp_gstack_budget_reserve(ssize_t size) {
+  if (mp_gstack_budget_try_reserve(size)) return true;
+  mp_gstack_clear_cache();
+  while (!mp_gstack_budget_try_reserve(size)) {
+    const ssize_t committed = mp_atomic_load(&mp_gstack_budget_committed);
+    MP_PROBE2(gstack_budget, committed, size);
+    if (os_gstack_budget_fun == NULL || !os_gstack_budget_fun(committed, size, os_gstack_budget_arg)) {
+      errno = EAGAIN;
+      return false;
+    }
+  }
+  return true;
+}
+
+static void mp_gstack_budget_release(ssize_t size) {
+  mp_atomic_add(&mp_gstack_budget_committed, -size);
+}
+
+ptrdiff_t mp_stack_committed(void) {
+  return mp_atomic_load(&mp_gstack_budget_committed);
+}
+
+// Called from the fault handler after committing `size` bytes in `g` (up to `committed` bytes in total);
+// this must be async-signal-safe.
+static void mp_gstack_commit_record(mp_gstack_t* g, ssize_t committed, ssize_t size, int64_t start_ns) {
+  const int64_t nsecs = mp_os_clock_ns() - start_ns;
+  mp_atomic_add(&mp_gstack_budget_committed, committed - g->committed);
+  g->committed = committed;
+  g->faults++;
+  _mp_commit_stats.faults++;
+  _mp_commit_stats.committed += size;
+  _mp_commit_stats.nsecs += (ptrdiff_t)nsecs;
+  _mp_commit_stats.committed_hist[mp_commit_hist_bucket(size)]++;
+  _mp_commit_stats.nsecs_hist[mp_commit_hist_bucket((ptrdiff_t)nsecs)]++;
+}
+
+// Called when a gstack is released
+static void mp_gstack_commit_record_lifetime(mp_gstack_t* g) {
+  _mp_commit_stats.gstacks++;
+  _mp_commit_stats.faults_hist[mp_commit_hist_bucket(g->faults)]++;
+  g->faults = 0;
+}
+
+void mp_commit_stats(mp_commit_stats_t* stats) {
+  *stats = _mp_commit_stats;
+}
+
+void mp_commit_stats_reset(void) {
+  memset(&_mp_commit_stats, 0, sizeof(_mp_commit_stats));
+}
+
+
+// Growth policies.
+// The peak stack use per start function is learned in a small direct-mapped thread-local table.
+#define MP_GSTACK_PEAKS  (64)
+
+typedef struct mp_gstack_peak_s {
+  const void* key;
+  ssize_t     peak;
+} mp_gstack_peak_t;
+
+static mp_decl_thread mp_gstack_peak_t _mp_gstack_peaks[MP_GSTACK_PEAKS];
+
+static mp_gstack_peak_t* mp_gstack_peak_slot(const void* key) {
+  return &_mp_gstack_peaks[((uintptr_t)key >> 4) % MP_GSTACK_PEAKS];
+}
+
+static ssize_t mp_gstack_peak_lookup(const void* key) {
+  const mp_gstack_peak_t* slot = mp_gstack_peak_slot(key);
+  return (key != NULL && slot->key == key ? slot->peak : 0);
+}
+
+// Called when a gstack is released
+static void mp_gstack_peak_update(mp_gstack_t* g) {
+  if (g->peak_key == NULL || g->used_peak == 0) return;
+  mp_gstack_peak_t* slot = mp_gstack_peak_slot(g->peak_key);
+  if (slot->key != g->peak_key) {
+    slot->key = g->peak_key;
+    slot->peak = g->used_peak;
+  }
+  else if (g->used_peak > slot->peak) {
+    slot->peak = g->used_peak;
+  }
+}
+
+// Fill in the defaults of a growth policy
+static mp_grow_policy_t mp_grow_policy_normalize(const mp_grow_policy_t* policy) {
+  mp_grow_policy_t grow = *policy;
+  if (grow.kind == MP_GROW_DEFAULT) { grow.kind = (os_gstack_grow_fast ? MP_GROW_GEOMETRIC : MP_GROW_FIXED); }
+  if (grow.kind == MP_GROW_CUSTOM && grow.fun == NULL) { grow.kind = MP_GROW_FIXED; }
+  grow.step = (grow.step <= 0 ? os_page_size : mp_align_up(grow.step, os_page_size));
+  if (grow.factor <= 0) { grow.factor = 2; }
+  if (grow.max <= 0) { grow.max = 1 * MP_MIB; }
+  return grow;
+}
+
+// Called from the fault handler when `g` (or the unknown gstack if `NULL`) faults at `used` bytes 
+// with `available` bytes left: return the extra bytes to commit beyond the faulting page. 
+// This must be async-signal-safe.
+static ssize_t mp_gstack_grow_extra(mp_gstack_t* g, ssize_t used, ssize_t available) {
+  const mp_grow_policy_t* policy = (g != NULL ? &g->grow : &os_gstack_grow);
+  if (g != NULL && used + os_page_size > g->used_peak) { g->used_peak = used + os_page_size; }
+  ssize_t extra = 0;
+  if (policy->kind == MP_GROW_FIXED) {
+    extra = policy->step - os_page_size;
+  }
+  else if (policy->kind == MP_GROW_CUSTOM) {
+    extra = policy->fun(used, available, policy->arg);
+  }
+  else {
+    // geometric, and for peak at least up to the learned peak
+    if (used > 0) { extra = mp_min(policy->factor * used, policy->max); }
+    if (policy->kind == MP_GROW_PEAK && g != NULL) {
+      extra = mp_max(extra, mp_gstack_peak_lookup(g->peak_key) - used - os_page_size);
+    }
+  }
+  if (os_gstack_budget > 0) {
+    // do not grow beyond the budget (but the faulting page itself is always committed)
+    const ssize_t left = os_gstack_budget - mp_atomic_load(&mp_gstack_budget_committed) - os_page_size;
+    if (extra > left) { extra = left; }
+  }
+  return mp_max(0, extra);
+}
+
+void mp_gstack_set_grow_policy(mp_gstack_t* g, const mp_grow_policy_t* policy) {
+  g->grow = (policy == NULL ? os_gstack_grow : mp_grow_policy_normalize(policy));
+}
+
+void mp_gstack_set_peak_key(mp_gstack_t* g, const void* key) {
+  g->peak_key = key;
+}
+
+// The lifetime of a gstack ends when it is freed, or when it is kept for reuse (by a retained prompt):
+// record its faults and learn the peak stack use of its start function (and start afresh).
+// A lifetime starts when the gstack is entered (and sets the peak key), so a gstack that was not 
+// entered again since the end of its last lifetime is not recorded twice.
+void mp_gstack_end_lifetime(mp_gstack_t* g) {
+  if (g->peak_key == NULL) return;
+  mp_gstack_commit_record_lifetime(g);
+  mp_gstack_peak_update(g);
+  g->peak_key = NULL;
+  g->used_peak = 0;
+}
 
 
 // We also have a delayed free list to keep gstacks alive during exception unwinding
@@ -213,7 +402,9 @@ mp_gstack_t* mp_gstack_alloc(ssize_t extra_size, void** extra)
       if (prev == NULL) { _mp_gstack_cache = g->next; }
                    else { prev->next = g->next; }
       _mp_gstack_cache_count--;
+      _mp_gstack_cache_hits++;
       g->next = NULL;
+      MP_PROBE2(gstack_alloc, g, 1);
       break;
     }
     else {
@@ -224,10 +415,17 @@ mp_gstack_t* mp_gstack_alloc(ssize_t extra_size, void** extra)
 
   // otherwise allocate fresh
   if (g == NULL) {
+    _mp_gstack_cache_misses++;
+    // count the initial commit against the budget
+    if (!mp_gstack_budget_reserve(os_gstack_initial_commit)) {
+      return NULL;
+    }
+
     // allocate separately for security
     extra_size = mp_align_up(extra_size, sizeof(void*));    
     g = (mp_gstack_t*)mp_malloc(sizeof(mp_gstack_t) - 1 + extra_size); 
     if (g == NULL) {
+      mp_gstack_budget_release(os_gstack_initial_commit);
       return NULL;
     }
 
@@ -237,14 +435,25 @@ mp_gstack_t* mp_gstack_alloc(ssize_t extra_size, void** extra)
     ssize_t  initial_commit;
     uint8_t* full = mp_gstack_os_alloc(&stk, &stk_size, &initial_commit);
     if (full == NULL) { 
+      mp_gstack_budget_release(os_gstack_initial_commit);
       mp_free(g);
       errno = ENOMEM;
       return NULL;
     }    
+    if (initial_commit != os_gstack_initial_commit) {
+      mp_gstack_budget_release(os_gstack_initial_commit - initial_commit);
+    }
     
     uint8_t* base = mp_base(stk, stk_size);
     mp_assert_internal((intptr_t)base % 32 == 0);
 
+    // prefault the hot part of the stack
+    if (os_gstack_populate > 0 && initial_commit >= os_gstack_populate) {
+      uint8_t* populate_start;
+      mp_push(base, os_gstack_populate, &populate_start);
+      mp_os_mem_populate(populate_start, os_gstack_populate);
+    }
+
     // initialize with debug 0xFD
     #ifndef NDEBUG
     uint8_t* commit_start;
@@ -259,9 +468,16 @@ mp_gstack_t* mp_gstack_alloc(ssize_t extra_size, void** extra)
     g->stack = stk;
     g->stack_size = stk_size;
     g->initial_commit = g->committed = initial_commit;
+    g->faults = 0;
     g->extra_size = extra_size;
+    MP_PROBE2(gstack_alloc, g, 0);
   }
 
+  // reset the growth policy (as a cached gstack may have used another one)
+  g->grow = os_gstack_grow;
+  g->peak_key = NULL;
+  g->used_peak = 0;
+
   if (extra != NULL && extra_size > 0) {
     *extra = &g->extra[0];
   }
@@ -298,15 +514,20 @@ void mp_gstack_free(mp_gstack_t* g, bool delay) {
 
   // if delayed, always push it on the delayed list
   if (delay) {
+    MP_PROBE2(gstack_free, g, 2);
     g->next = _mp_gstack_delayed_free;
     _mp_gstack_delayed_free = g;
     return;
   }
 
+  // the prompt lifetime ends here
+  mp_gstack_end_lifetime(g);
+
   // otherwise try to put it in our thread local cache...
   if (_mp_gstack_cache_count < os_gstack_cache_max_count) {
     // allowed to cache.
     // we keep it as-is    
+    MP_PROBE2(gstack_free, g, 1);
     g->next = _mp_gstack_cache;
     _mp_gstack_cache = g;
     _mp_gstack_cache_count++;
@@ -314,11 +535,33 @@ void mp_gstack_free(mp_gstack_t* g, bool delay) {
   }
 
   // otherwise free it to the OS
+  MP_PROBE2(gstack_free, g, 0);
   mp_gstack_os_free(g->full, g->stack, g->stack_size, g->committed);
+  mp_gstack_budget_release(g->committed);
   mp_free(g);
 }
 
 
+// The extent `[*lo,*hi)` of the gstack that can be read without a page fault;
+// used for async-signal-safe backtraces.
+void mp_gstack_readable(const mp_gstack_t* g, uint8_t** lo, uint8_t** hi) {
+  const ssize_t size = (os_use_overcommit ? g->stack_size : mp_min(g->committed, g->stack_size));
+  uint8_t* base = mp_gstack_base(g);
+  uint8_t* limit = mp_push(base, size, NULL);
+  *lo = (os_stack_grows_down ? limit : base);
+  *hi = (os_stack_grows_down ? base : limit);
+}
+
+
+// Statistics of the gpools and the thread-local cache of the current thread
+void mp_gstack_stats(mp_gstack_stats_t* stats) {
+  memset(stats, 0, sizeof(*stats));
+  mp_gpools_stats(stats);
+  stats->cache_hits = _mp_gstack_cache_hits;
+  stats->cache_misses = _mp_gstack_cache_misses;
+}
+
+
 // Clear all (thread local) cached gstacks.
 void mp_gstack_clear_cache(void) {
   mp_gstack_clear_delayed();
@@ -327,6 +570,7 @@ void mp_gstack_clear_cache(void) {
     mp_gstack_t* next = _mp_gstack_cache = g->next;
     _mp_gstack_cache_count--;
     mp_gstack_os_free(g->full, g->stack, g->stack_size, g->committed);
+    mp_gstack_budget_release(g->committed);
     mp_free(g);
     g = next;
   }
@@ -429,7 +673,9 @@ bool mp_gstack_init(const mp_config_t* config) {
     // user settings
     if (config != NULL) {      
       os_gstack_reset_decommits = config->stack_reset_decommits;
+      os_gstack_huge_pages = config->stack_huge_pages;
       os_use_overcommit = config->stack_use_overcommit;      
+      os_gstack_grow = config->stack_grow_policy;
       if (os_use_overcommit) {
         os_use_gpools = false;
         os_gstack_grow_fast = false;
@@ -450,9 +696,17 @@ bool mp_gstack_init(const mp_config_t* config) {
       if (config->stack_initial_commit > 0) {
         os_gstack_initial_commit = mp_align_up(config->stack_initial_commit, 4 * MP_KIB);
       }
+      if (config->stack_populate > 0) {
+        os_gstack_populate = config->stack_populate;
+      }
       if (config->stack_gap_size > 0) {
         os_gstack_gap = mp_align_up(config->stack_gap_size, 4 * MP_KIB);
       }
+      if (config->stack_budget > 0) {
+        os_gstack_budget = config->stack_budget;
+        os_gstack_budget_fun = config->stack_budget_fun;
+        os_gstack_budget_arg = config->stack_budget_arg;
+      }
       if (config->stack_cache_count >= 0) {
         os_gstack_cache_max_count = config->stack_cache_count;
       }
@@ -471,7 +725,11 @@ bool mp_gstack_init(const mp_config_t* config) {
     os_gstack_gap = mp_align_up(os_gstack_gap, os_page_size);
     os_gpool_max_size = mp_align_up(os_gpool_max_size, os_page_size);
     os_gstack_initial_commit = (os_gstack_initial_commit == 0 ? os_page_size : mp_align_up(os_gstack_initial_commit, os_page_size));
+    os_gstack_populate = mp_align_up(os_gstack_populate, os_page_size);
+    if (os_gstack_populate > os_gstack_initial_commit) os_gstack_initial_commit = os_gstack_populate;  // populated memory is committed
     if (os_gstack_initial_commit > os_gstack_size) os_gstack_initial_commit = os_gstack_size;
+    if (os_gstack_populate > os_gstack_initial_commit) os_gstack_populate = os_gstack_initial_commit;
+    os_gstack_grow = mp_grow_policy_normalize(&os_gstack_grow);
 
     // register exit routine
     atexit(&mp_gstack_done);
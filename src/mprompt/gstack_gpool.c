@@ -62,6 +62,9 @@ typedef struct mp_gpool_s {
   bool     zeroed;          // is the free area surely zero'd?
   // protected by a lock:
   mp_spin_lock_t free_lock;
+  ssize_t  lock_count;      // statistics
+  ssize_t  lock_contended;
+  ssize_t  lock_spins;
   ssize_t  free_sp;
   int16_t  free[MP_GPOOL_MAX_COUNT];
 } mp_gpool_t;
@@ -80,6 +83,25 @@ static mp_gpool_t* mp_gpool_next(const mp_gpool_t* gp) {
 }
 
 
+// Acquire the lock of the free stack and keep track of contention
+static void mp_gpool_lock_acquire(mp_gpool_t* gp) {
+  ssize_t spins = 0;
+  while (!mp_spin_lock_try_acquire(&gp->free_lock)) {
+    spins++;
+    mp_atomic_yield();
+  }
+  gp->lock_count++;
+  if (spins > 0) {
+    gp->lock_contended++;
+    gp->lock_spins += spins;
+  }
+}
+
+static void mp_gpool_lock_release(mp_gpool_t* gp) {
+  mp_spin_lock_release(&gp->free_lock);
+}
+
+
 // Create a new pool in a given reserved virtual memory area.
 static mp_gpool_t* mp_gpool_create(void* p, ssize_t size, ssize_t stack_size, ssize_t gap_size, bool zeroed) {
   // check parameters  
@@ -124,14 +146,14 @@ static uint8_t* mp_gpool_alloc_stack(uint8_t** stk, ssize_t* stk_size) {
     ssize_t sp;
     volatile int16_t _access = 0;
     _access += gp->free[gp->free_sp + 64]; // ensure no page fault happens inside the spin lock
-    mp_spin_lock(&gp->free_lock) {
-      // pop from free stack
-      sp = gp->free_sp;
-      if (sp < gp->block_count) {
-        gp->free_sp = sp + 1;
-        block_idx = gp->free[sp] + sp;
-      }
-    }    
+    mp_gpool_lock_acquire(gp);
+    // pop from free stack
+    sp = gp->free_sp;
+    if (sp < gp->block_count) {
+      gp->free_sp = sp + 1;
+      block_idx = gp->free[sp] + sp;
+    }
+    mp_gpool_lock_release(gp);
     mp_assert_internal(block_idx >= 0 && block_idx < gp->block_count);
     if (block_idx > 0) {
       if (mp_gpool_grows_down()) {
@@ -157,6 +179,7 @@ static uint8_t* mp_gpool_alloc(uint8_t** stk, ssize_t* stk_size) {
   size_t poolsize = os_gpool_max_size;
   uint8_t* pool = mp_os_mem_reserve(poolsize);
   if (pool == NULL) return NULL;
+  if (os_gstack_huge_pages) { mp_os_mem_advise_huge(pool, poolsize); }
 
   // commit on demand in the regular fault handler
   ssize_t init_size = mp_align_up(sizeof(mp_gpool_t), os_page_size);
@@ -192,14 +215,14 @@ static void mp_gpool_free(uint8_t* stk) {
       else {
         idx = block_idx;
       }
-      mp_spin_lock(&gp->free_lock) {
-        // push on free stack
-        gp->free_sp--;
-        sp = gp->free_sp;
-        //idx = gp->block_count - block_idx - sp;
-        idx = idx - sp;        
-        gp->free[sp] = (int16_t)idx;
-      }
+      mp_gpool_lock_acquire(gp);
+      // push on free stack
+      gp->free_sp--;
+      sp = gp->free_sp;
+      //idx = gp->block_count - block_idx - sp;
+      idx = idx - sp;        
+      gp->free[sp] = (int16_t)idx;
+      mp_gpool_lock_release(gp);
       mp_assert(idx >= INT16_MIN && idx <= INT16_MAX);
       mp_assert(sp > 0);
       return; // done
@@ -207,6 +230,18 @@ static void mp_gpool_free(uint8_t* stk) {
   }
 }
 
+// Add the lock statistics of all pools
+static void mp_gpools_stats(mp_gstack_stats_t* stats) {
+  for (mp_gpool_t* gp = mp_gpool_first(); gp != NULL; gp = mp_gpool_next(gp)) {
+    mp_spin_lock_acquire(&gp->free_lock);
+    stats->gpool_count++;
+    stats->gpool_lock_count += gp->lock_count;
+    stats->gpool_lock_contended += gp->lock_contended;
+    stats->gpool_lock_spins += gp->lock_spins;
+    mp_spin_lock_release(&gp->free_lock);
+  }
+}
+
 // Is a pointer located in a stack page and thus can be made accessible?
 // This routine is called from exception handler thread while debugging on macOS to verify
 // if the address is in one of our stacks and is allowed to be committed.
@@ -14,6 +14,7 @@
 #include <signal.h>    // sigaction
 #include <fcntl.h>     // file read
 #include <pthread.h>   // use pthread local storage keys to detect thread ending
+#include <time.h>      // clock_gettime
 
 // We need atomic operations for the `gpool` on systems that do not have overcommit.
 #include "internal/atomic.h"
@@ -108,6 +109,35 @@ static bool mp_os_mem_commit(uint8_t* start, ssize_t size) {
   return true;
 }
 
+// Prefault committed memory. `MAP_POPULATE` only applies to fresh mappings while
+// our stacks are already reserved, so we use `MADV_POPULATE_WRITE` (Linux 5.14+)
+// and otherwise touch each page.
+static void mp_os_mem_populate(uint8_t* start, ssize_t size) {
+  if (os_gstack_huge_pages) { mp_os_mem_advise_huge(start, size); }
+  #if defined(MADV_POPULATE_WRITE)
+  if (madvise(start, size, MADV_POPULATE_WRITE) == 0) return;
+  #endif
+  for (ssize_t i = 0; i < size; i += os_page_size) {
+    ((volatile uint8_t*)start)[i] = 0;
+  }
+}
+
+// Advise transparent huge pages; only 2MiB aligned parts can use them.
+static void mp_os_mem_advise_huge(uint8_t* start, ssize_t size) {
+  #if defined(MADV_HUGEPAGE)
+  madvise(start, size, MADV_HUGEPAGE);  // ignore errors as THP may be disabled
+  #else
+  MP_UNUSED(start); MP_UNUSED(size);
+  #endif
+}
+
+// Monotonic clock in nano seconds (async-signal-safe)
+static int64_t mp_os_clock_ns(void) {
+  struct timespec t;
+  if (clock_gettime(CLOCK_MONOTONIC, &t) != 0) return 0;
+  return ((int64_t)t.tv_sec * 1000000000LL) + t.tv_nsec;
+}
+
 // Reset the memory of a gstack
 static bool mp_os_mem_reset(uint8_t* p, ssize_t size) {
   // we can only decommit if MAP_FIXED is defined
@@ -295,6 +325,7 @@ static mp_decl_thread stack_t* mp_sig_stack;  // every thread needs a signal sta
 
 static bool mp_mmap_commit_on_demand(void* addr, bool addr_in_other_thread) {
   // demand allocate?
+  const int64_t start_ns = mp_os_clock_ns();
   uint8_t* page = mp_align_down_ptr((uint8_t*)addr, os_page_size);
   ssize_t available = 0;
   ssize_t stack_size = 0;
@@ -313,18 +344,20 @@ static bool mp_mmap_commit_on_demand(void* addr, bool addr_in_other_thread) {
   if (access == MP_ACCESS) {
     // a pointer to a valid gstack in our gpool, make the page read-write
     // mp_trace_message("  segv: unprotect page\n");
-    // use quadratic growth; quite important for performance
-    ssize_t extra = 0;
+    // use the growth policy; geometric growth by default which is quite important for performance
     ssize_t used = stack_size - available;
-    if (os_gstack_grow_fast && used > 0) { extra = 2*used; }   // doubling..
-    if (extra > 1 * MP_MIB) { extra = 1 * MP_MIB; }            // up to 1MiB growh
+    ssize_t extra = mp_gstack_grow_extra(g, used, available);
     if (extra > available) { extra = available; }              // but not more than available
     extra = mp_align_down(extra,os_page_size);
     //mp_trace_message("expand stack: extra: %zd, avail: %zd, used: %d\n", extra, available, used);
     uint8_t* commit_start;
     mp_push(page, extra, &commit_start);
     if (mprotect(commit_start, extra + os_page_size, PROT_READ | PROT_WRITE) == 0) {
-      if (g != NULL) { g->committed = mp_unpush(commit_start, g->stack, g->stack_size ); }
+      MP_PROBE2(commit_on_demand, commit_start, extra + os_page_size);
+      if (g != NULL) { 
+        // (not recorded for the mach exception thread)
+        mp_gstack_commit_record(g, mp_unpush(commit_start, g->stack, g->stack_size), extra + os_page_size, start_ns);
+      }
     };
     return true; 
   }
@@ -73,6 +73,28 @@ static bool mp_os_mem_commit(uint8_t* start, ssize_t size) {
 }
 
 
+// Prefault committed memory by touching each page
+static void mp_os_mem_populate(uint8_t* start, ssize_t size) {
+  for (ssize_t i = 0; i < size; i += os_page_size) {
+    ((volatile uint8_t*)start)[i] = 0;
+  }
+}
+
+// Transparent huge pages are not supported
+static void mp_os_mem_advise_huge(uint8_t* start, ssize_t size) {
+  MP_UNUSED(start); MP_UNUSED(size);
+}
+
+// Monotonic clock in nano seconds
+static int64_t mp_os_clock_ns(void) {
+  static LARGE_INTEGER freq;  // = 0
+  if (freq.QuadPart == 0) { QueryPerformanceFrequency(&freq); }
+  LARGE_INTEGER t;
+  QueryPerformanceCounter(&t);
+  return (int64_t)((double)t.QuadPart * (1.0e9 / (double)freq.QuadPart));
+}
+
+
 // Allocate a gstack
 static uint8_t* mp_gstack_os_alloc(uint8_t** stk, ssize_t* stk_size, ssize_t* initial_commit) {
   if (!os_use_gpools) {
@@ -302,6 +324,7 @@ static LONG WINAPI mp_gstack_win_page_fault(PEXCEPTION_POINTERS ep)
   }
 
   // find the page start
+  const int64_t start_ns = mp_os_clock_ns();
   MP_TIB* tib = mp_win_tib();
   uint8_t* const addr = (exncode != MP_CPP_EXN ? (uint8_t*)ep->ExceptionRecord->ExceptionInformation[1] : tib->StackLimit - 8);
   uint8_t* const page = mp_align_down_ptr(addr, os_page_size);
@@ -330,11 +353,8 @@ static LONG WINAPI mp_gstack_win_page_fault(PEXCEPTION_POINTERS ep)
     ssize_t extra = (exncode != MP_CPP_EXN ? 0 : os_gstack_exn_guaranteed - os_page_size);
     ssize_t used = stack_size - available;
     mp_assert_internal(used >= 0);
-    if (os_gstack_grow_fast && exncode != MP_CPP_EXN && used > 0) {
-      extra = 2 * used;                   // doubling.. 
-    }
-    if (extra > 1 * MP_MIB) {
-      extra = 1 * MP_MIB;                 // up to 1MiB growh
+    if (exncode != MP_CPP_EXN) {
+      extra = mp_gstack_grow_extra(g, used, available);  // use the growth policy
     }
     if (extra > available - guard_size) {
       extra = available - guard_size;     // up to stack limit 
@@ -350,7 +370,9 @@ static LONG WINAPI mp_gstack_win_page_fault(PEXCEPTION_POINTERS ep)
         if (VirtualAlloc(gpage, guard_size, MEM_COMMIT, PAGE_GUARD | PAGE_READWRITE) != NULL) {
           tib->StackLimit = extend;
           tib->StackRealLimit = gpage; 
-          if (g != NULL) { g->committed = mp_unpush(extend, g->stack, g->stack_size); }
+          if (g != NULL) { 
+            mp_gstack_commit_record(g, mp_unpush(extend, g->stack, g->stack_size), commit_size, start_ns);
+          }
           //mp_trace_message("expanded stack: extra: %zdk, available: %zdk, stack_size: %zdk, used: %zdk\n", extra/1024, available/1024, g->stack_size/1024, used/1024);
           //mp_win_trace_stack_layout(tib->StackBase, tib->StackBase - g->stack_size);
           return (exncode!=MP_CPP_EXN ? EXCEPTION_CONTINUE_EXECUTION : EXCEPTION_CONTINUE_SEARCH);
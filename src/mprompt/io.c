@@ -0,0 +1,1019 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Asynchronous I/O with a per-thread reactor.
+
+  Each task runs under its own prompt. An operation that has to wait yields
+  the prompt of the task to the reactor (see `mp_io_task_wait`) which
+  keeps the resumption in the task until the operation completes.
+
+  - epoll: operations are tried first; on `EAGAIN` the task registers its
+    interest with `EPOLLONESHOT` and waits for readiness before retrying.
+  - io_uring: operations are queued as submission entries while tasks run;
+    when no task is ready anymore, the reactor submits the whole batch and
+    waits for completions in a single `io_uring_enter`, and then reaps all
+    available completions at once. Operations on non-blocking descriptors
+    that complete with `EAGAIN` are retried after a poll request.
+
+  The timer wheel (`timer.c`) is advanced at every reactor tick and the
+  backend waits at most until the next timer is due. A cancelled wait
+  completes right away (or, with io_uring, once the kernel has cancelled
+  the operation) and returns `ECANCELED`.
+
+  Blocking calls passed to `mp_offload` run on a pool of helper threads
+  that hand the finished calls back to the reactor of the task over a
+  lock-free stack, and wake up the reactor with an eventfd.
+-----------------------------------------------------------------------------*/
+#if defined(MP_USE_IO) && defined(__linux__)
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "mprompt.h"
+#include "mp_io.h"
+#include "internal/util.h"
+#include "internal/atomic.h"
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define MP_IO_HAS_URING  (1)
+#endif
+#endif
+#ifndef MP_IO_HAS_URING
+#define MP_IO_HAS_URING  (0)
+#endif
+
+#ifdef __cplusplus
+#include <exception>
+#endif
+
+#if !defined(_GNU_SOURCE)
+// glibc only declares `accept4` with `_GNU_SOURCE` (which g++ defines by default)
+extern int accept4(int fd, struct sockaddr* addr, socklen_t* addrlen, int flags);
+#endif
+
+
+//-----------------------------------------------------------------------
+// Types
+//-----------------------------------------------------------------------
+
+// What a suspended task waits for
+typedef enum mp_io_wait_e {
+  MP_IO_WAIT_NONE,
+  MP_IO_WAIT_FD,        // epoll readiness of `wait_fd`
+  MP_IO_WAIT_URING,     // an io_uring completion
+  MP_IO_WAIT_TIMER,     // the `wait_timer` (in `mp_sleep_until`)
+  MP_IO_WAIT_OFFLOAD    // a call on an offload thread (in `mp_offload`)
+} mp_io_wait_t;
+
+struct mp_io_task_s {
+  mp_io_fun_t*         fun;
+  void*                arg;
+  mp_prompt_t*         prompt;    // the prompt the task runs under (once started)
+  mp_resume_t*         resume;    // the resumption while suspended (NULL if not yet started)
+  void*                context;   // the task context while suspended (see `mp_task_context_get`)
+  bool                 done;
+  int                  result;    // io_uring completion result
+  mp_io_wait_t         wait;
+  int                  wait_fd;
+  bool                 wait_write;
+  mp_timer_t*          wait_timer;
+  bool                 cancelled;       // the current wait is cancelled
+  bool                 cancel_pending;  // cancel the next wait
+  mp_io_cancel_fun_t*  cancel_fun;
+  void*                cancel_arg;
+  struct mp_io_task_s* next;      // in the ready queue
+};
+
+// epoll: the tasks waiting on a descriptor
+typedef struct mp_io_fd_s {
+  mp_io_task_t* reader;
+  mp_io_task_t* writer;
+  bool          registered;
+} mp_io_fd_t;
+
+typedef struct mp_io_reactor_s {
+  mp_io_backend_t     backend;
+  int                 queue_depth;
+  mp_io_task_t*       current;
+  mp_io_task_t*       ready_head;
+  mp_io_task_t*       ready_tail;
+  long                live;          // tasks that have not finished
+  long                waiting;       // tasks waiting for an operation (or sleeping)
+  void*               context;       // the initial context of tasks
+  mp_wheel_t          wheel;
+
+  // offloaded calls
+  int                 offload_fd;      // eventfd written by the helper threads (or -1 if not yet created)
+  long                offloading;      // tasks waiting for an offloaded call
+  bool                offload_armed;   // io_uring: a poll on the eventfd is queued
+  _Atomic(intptr_t)   offload_done;    // finished calls: a lock-free stack of `mp_offload_job_t*`
+  _Atomic(intptr_t)   offload_pending; // calls whose helper thread may still access the reactor
+
+  // epoll
+  int                 epfd;
+  mp_io_fd_t*         fds;
+  int                 fd_count;
+  struct epoll_event* events;
+
+  #if MP_IO_HAS_URING
+  // io_uring
+  int                 ring_fd;
+  void*               sq_ring;
+  size_t              sq_ring_size;
+  void*               cq_ring;
+  size_t              cq_ring_size;
+  struct io_uring_sqe* sqes;
+  size_t              sqes_size;
+  unsigned*           sq_head;
+  unsigned*           sq_tail;
+  unsigned*           sq_array;
+  unsigned            sq_mask;
+  unsigned            sq_entries;
+  unsigned*           cq_head;
+  unsigned*           cq_tail;
+  unsigned            cq_mask;
+  struct io_uring_cqe* cqes;
+  unsigned            to_submit;     // queued submissions
+  bool                ext_arg;       // `IORING_FEAT_EXT_ARG`: wait with a timeout
+  struct __kernel_timespec timeout;  // otherwise we submit a timeout operation
+  #endif
+} mp_io_reactor_t;
+
+static mp_decl_thread mp_io_reactor_t* _mp_io_reactor;
+
+
+//-----------------------------------------------------------------------
+// Tasks
+//-----------------------------------------------------------------------
+
+static void mp_io_ready_push(mp_io_reactor_t* r, mp_io_task_t* t) {
+  t->next = NULL;
+  if (r->ready_tail == NULL) { r->ready_head = t; }
+                        else { r->ready_tail->next = t; }
+  r->ready_tail = t;
+}
+
+static mp_io_task_t* mp_io_ready_pop(mp_io_reactor_t* r) {
+  mp_io_task_t* t = r->ready_head;
+  if (t != NULL) {
+    r->ready_head = t->next;
+    if (r->ready_head == NULL) r->ready_tail = NULL;
+  }
+  return t;
+}
+
+static void mp_io_task_create(mp_io_reactor_t* r, mp_io_fun_t* fun, void* arg) {
+  mp_io_task_t* t = mp_zalloc_safe_tp(mp_io_task_t);
+  t->fun = fun;
+  t->arg = arg;
+  t->context = r->context;
+  r->live++;
+  mp_io_ready_push(r, t);
+}
+
+static void* mp_io_task_start(mp_prompt_t* p, void* arg) {
+  mp_io_task_t* t = (mp_io_task_t*)arg;
+  t->prompt = p;
+  #ifdef __cplusplus
+  try {
+    (t->fun)(t->arg);
+  }
+  catch (...) {
+    mp_fatal_message(EINVAL, "unhandled exception in an I/O task\n");
+  }
+  #else
+  (t->fun)(t->arg);
+  #endif
+  t->done = true;
+  return NULL;
+}
+
+static void* mp_io_task_suspended(mp_resume_t* resume, void* arg) {
+  mp_io_task_t* t = (mp_io_task_t*)arg;
+  t->resume = resume;
+  return NULL;
+}
+
+// Wait until the reactor makes the task ready again (check `t->cancelled` afterwards)
+static void mp_io_task_wait(mp_io_reactor_t* r, mp_io_task_t* t, mp_io_wait_t wait) {
+  t->wait = wait;
+  r->waiting++;
+  mp_yield(t->prompt, &mp_io_task_suspended, t);
+}
+
+static void mp_io_task_wakeup(mp_io_reactor_t* r, mp_io_task_t* t) {
+  mp_assert_internal(t->wait != MP_IO_WAIT_NONE);
+  t->wait = MP_IO_WAIT_NONE;
+  r->waiting--;
+  mp_io_ready_push(r, t);
+}
+
+// Consume a pending cancellation before starting a wait
+static bool mp_io_task_cancel_pending(mp_io_task_t* t) {
+  if (!t->cancel_pending) return false;
+  t->cancel_pending = false;
+  return true;
+}
+
+// A wait of the current task was cancelled: call the cancel function (which may unwind) and fail with `ECANCELED`
+static int mp_io_task_cancelled(mp_io_task_t* t) {
+  if (t->cancel_fun != NULL) (t->cancel_fun)(t->cancel_arg);
+  errno = ECANCELED;
+  return -1;
+}
+
+static void mp_io_task_run(mp_io_reactor_t* r, mp_io_task_t* t) {
+  void* context = mp_task_context_get();
+  mp_task_context_set(t->context);
+  r->current = t;
+  if (t->resume == NULL) {
+    mp_prompt(&mp_io_task_start, t);
+  }
+  else {
+    mp_resume_t* resume = t->resume;
+    t->resume = NULL;
+    mp_resume(resume, NULL);
+  }
+  r->current = NULL;
+  t->context = mp_task_context_get();
+  mp_task_context_set(context);
+  if (t->done) {
+    r->live--;
+    mp_free(t);
+  }
+}
+
+// The reactor of the current task (or NULL when not running in a reactor task)
+static mp_io_reactor_t* mp_io_reactor_in_task(void) {
+  mp_io_reactor_t* r = _mp_io_reactor;
+  return (r != NULL && r->current != NULL ? r : NULL);
+}
+
+
+//-----------------------------------------------------------------------
+// Offloading blocking calls
+//
+// The helper threads are shared by all reactors and take the calls from a
+// queue under a lock. A helper pushes a finished call on the lock-free
+// `offload_done` stack of the reactor of the task, and writes the eventfd
+// of the reactor if the stack was empty. The reactor takes the whole stack
+// at once (when the eventfd is readable, or before it blocks).
+//-----------------------------------------------------------------------
+
+#define MP_OFFLOAD_THREADS   (4)   // default maximum number of helper threads
+#define MP_IO_OFFLOAD_EVENT  (1)   // io_uring user data of the poll on the eventfd
+
+typedef struct mp_offload_job_s {
+  mp_offload_fun_t*        fun;
+  void*                    arg;
+  void*                    result;
+  int                      err;       // `errno` after the call
+  mp_io_reactor_t*         reactor;
+  mp_io_task_t*            task;
+  #ifdef __cplusplus
+  std::exception_ptr       exn;       // raised by the call
+  #endif
+  struct mp_offload_job_s* next;      // in the pool queue, or in the `offload_done` stack of the reactor
+} mp_offload_job_t;
+
+typedef struct mp_offload_pool_s {
+  pthread_mutex_t   lock;
+  pthread_cond_t    work;        // signaled when a call is queued
+  mp_offload_job_t* head;
+  mp_offload_job_t* tail;
+  int               queued;      // calls in the queue
+  int               threads;     // helper threads started
+  int               idle;        // helper threads waiting for a call
+  int               max_threads;
+} mp_offload_pool_t;
+
+static mp_offload_pool_t mp_offload_pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, 0, 0, MP_OFFLOAD_THREADS };
+
+static void mp_offload_exec(mp_offload_job_t* job) {
+  #ifdef __cplusplus
+  try {
+    job->result = (job->fun)(job->arg);
+  }
+  catch (...) {
+    job->exn = std::current_exception();
+  }
+  #else
+  job->result = (job->fun)(job->arg);
+  #endif
+  job->err = errno;
+}
+
+// Pass a finished call back to its reactor (after which the job can be gone as the task may resume)
+static void mp_offload_complete(mp_offload_job_t* job) {
+  mp_io_reactor_t* r = job->reactor;
+  intptr_t head = mp_atomic_load(&r->offload_done);
+  do {
+    job->next = (mp_offload_job_t*)head;
+  } while (!mp_atomic_cas(&r->offload_done, &head, (intptr_t)job));
+  if (head == 0) {
+    const uint64_t one = 1;
+    while (write(r->offload_fd, &one, sizeof(one)) < 0 && errno == EINTR) { }
+  }
+  mp_atomic_add(&r->offload_pending, (intptr_t)-1);   // the reactor may be freed from now on
+}
+
+static void* mp_offload_thread(void* arg) {
+  MP_UNUSED(arg);
+  mp_offload_pool_t* pool = &mp_offload_pool;
+  pthread_mutex_lock(&pool->lock);
+  while (true) {
+    mp_offload_job_t* job = pool->head;
+    if (job == NULL) {
+      pool->idle++;
+      pthread_cond_wait(&pool->work, &pool->lock);
+      pool->idle--;
+      continue;
+    }
+    pool->head = job->next;
+    if (pool->head == NULL) pool->tail = NULL;
+    pool->queued--;
+    pthread_mutex_unlock(&pool->lock);
+    mp_offload_exec(job);
+    mp_offload_complete(job);
+    pthread_mutex_lock(&pool->lock);
+  }
+  return NULL;
+}
+
+// Queue a call, and start a helper thread if there are more calls than idle helpers (up to `max_threads`)
+static void mp_offload_submit(mp_offload_job_t* job) {
+  mp_offload_pool_t* pool = &mp_offload_pool;
+  pthread_mutex_lock(&pool->lock);
+  job->next = NULL;
+  if (pool->tail == NULL) { pool->head = job; }
+                     else { pool->tail->next = job; }
+  pool->tail = job;
+  pool->queued++;
+  const bool start = (pool->queued > pool->idle && pool->threads < pool->max_threads);
+  if (start) pool->threads++;
+  if (pool->idle > 0) pthread_cond_signal(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  if (start) {
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    const int err = pthread_create(&thread, &attr, &mp_offload_thread, NULL);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+      // the other helper threads take the call
+      pthread_mutex_lock(&pool->lock);
+      const int threads = --pool->threads;
+      pthread_mutex_unlock(&pool->lock);
+      if (threads == 0) mp_fatal_message(err, "unable to create an offload thread\n");
+    }
+  }
+}
+
+void mp_offload_set_max_threads(int n) {
+  mp_offload_pool_t* pool = &mp_offload_pool;
+  pthread_mutex_lock(&pool->lock);
+  pool->max_threads = (n > 0 ? n : MP_OFFLOAD_THREADS);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+// Create the eventfd of a reactor on its first offloaded call
+static void mp_io_offload_init(mp_io_reactor_t* r) {
+  r->offload_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (r->offload_fd < 0) mp_fatal_message(errno, "unable to create the offload eventfd\n");
+  if (r->backend == MP_IO_EPOLL) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;   // level triggered: stays registered
+    ev.data.fd = r->offload_fd;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->offload_fd, &ev) != 0) mp_fatal_message(errno, "unable to register the offload eventfd\n");
+  }
+}
+
+// Wake up the tasks of all finished calls (in the order they finished)
+static void mp_io_offload_reap(mp_io_reactor_t* r) {
+  uint64_t count;
+  const ssize_t n = read(r->offload_fd, &count, sizeof(count));   // reset the eventfd (or `EAGAIN`)
+  MP_UNUSED(n);
+  mp_offload_job_t* job = (mp_offload_job_t*)mp_atomic_exchange(&r->offload_done, (intptr_t)0);
+  mp_offload_job_t* done = NULL;
+  while (job != NULL) {
+    mp_offload_job_t* next = job->next;
+    job->next = done;
+    done = job;
+    job = next;
+  }
+  while (done != NULL) {
+    mp_offload_job_t* next = done->next;
+    r->offloading--;
+    mp_io_task_wakeup(r, done->task);
+    done = next;
+  }
+}
+
+static void mp_io_offload_done(mp_io_reactor_t* r) {
+  if (r->offload_fd < 0) return;
+  // all calls finished, but their helper threads may still be writing the eventfd
+  while (mp_atomic_load(&r->offload_pending) > 0) mp_atomic_yield();
+  close(r->offload_fd);
+}
+
+void* mp_offload(mp_offload_fun_t* fun, void* arg) {
+  mp_io_reactor_t* r = mp_io_reactor_in_task();
+  if (r == NULL) return (fun)(arg);
+  if (r->offload_fd < 0) mp_io_offload_init(r);
+  mp_io_task_t* t = r->current;
+  mp_offload_job_t job;
+  job.fun = fun;
+  job.arg = arg;
+  job.result = NULL;
+  job.err = 0;
+  job.reactor = r;
+  job.task = t;
+  job.next = NULL;
+  r->offloading++;
+  mp_atomic_add(&r->offload_pending, (intptr_t)1);
+  mp_offload_submit(&job);
+  mp_io_task_wait(r, t, MP_IO_WAIT_OFFLOAD);
+  #ifdef __cplusplus
+  if (job.exn) std::rethrow_exception(job.exn);
+  #endif
+  errno = job.err;
+  return job.result;
+}
+
+
+//-----------------------------------------------------------------------
+// epoll
+//-----------------------------------------------------------------------
+
+static mp_io_fd_t* mp_io_epoll_fd(mp_io_reactor_t* r, int fd) {
+  if (fd >= r->fd_count) {
+    int count = (r->fd_count == 0 ? 64 : r->fd_count);
+    while (count <= fd) count *= 2;
+    mp_io_fd_t* fds = (mp_io_fd_t*)realloc(r->fds, (size_t)count * sizeof(mp_io_fd_t));
+    if (fds == NULL) mp_fatal_message(ENOMEM, "unable to allocate the reactor descriptor table\n");
+    memset(fds + r->fd_count, 0, (size_t)(count - r->fd_count) * sizeof(mp_io_fd_t));
+    r->fds = fds;
+    r->fd_count = count;
+  }
+  return &r->fds[fd];
+}
+
+// (Re)arm the one-shot interest of the waiting tasks on a descriptor
+static int mp_io_epoll_arm(mp_io_reactor_t* r, int fd, mp_io_fd_t* rec) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLONESHOT | (rec->reader != NULL ? EPOLLIN : 0) | (rec->writer != NULL ? EPOLLOUT : 0);
+  ev.data.fd = fd;
+  if (rec->registered && epoll_ctl(r->epfd, EPOLL_CTL_MOD, fd, &ev) == 0) return 0;
+  if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) == 0 ||
+      (errno == EEXIST && epoll_ctl(r->epfd, EPOLL_CTL_MOD, fd, &ev) == 0)) {
+    rec->registered = true;
+    return 0;
+  }
+  return -1;
+}
+
+// Wait until `fd` is readable (or writable); returns -1 with `errno` set if the descriptor cannot be waited on
+// (or if the wait was cancelled).
+static int mp_io_epoll_wait_fd(mp_io_reactor_t* r, int fd, bool write) {
+  mp_io_task_t* t = r->current;
+  if (mp_io_task_cancel_pending(t)) return mp_io_task_cancelled(t);
+  mp_io_fd_t* rec = mp_io_epoll_fd(r, fd);
+  mp_io_task_t** waiter = (write ? &rec->writer : &rec->reader);
+  if (*waiter != NULL) {
+    errno = EBUSY;   // another task already waits in the same direction
+    return -1;
+  }
+  *waiter = t;
+  if (mp_io_epoll_arm(r, fd, rec) != 0) {
+    *waiter = NULL;
+    return -1;
+  }
+  t->wait_fd = fd;
+  t->wait_write = write;
+  mp_io_task_wait(r, t, MP_IO_WAIT_FD);
+  if (t->cancelled) {
+    t->cancelled = false;
+    return mp_io_task_cancelled(t);
+  }
+  return 0;
+}
+
+// Stop waiting on a descriptor; the one-shot interest stays armed (and an event without waiters is ignored)
+static void mp_io_epoll_cancel(mp_io_reactor_t* r, mp_io_task_t* t) {
+  mp_io_fd_t* rec = mp_io_epoll_fd(r, t->wait_fd);
+  if (t->wait_write) { rec->writer = NULL; }
+                else { rec->reader = NULL; }
+}
+
+static void mp_io_epoll_poll(mp_io_reactor_t* r, int timeout) {
+  int n;
+  do {
+    n = epoll_wait(r->epfd, r->events, r->queue_depth, timeout);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) mp_fatal_message(errno, "epoll_wait failed\n");
+  for (int i = 0; i < n; i++) {
+    const int fd = r->events[i].data.fd;
+    const uint32_t events = r->events[i].events;
+    if (fd == r->offload_fd) {
+      mp_io_offload_reap(r);
+      continue;
+    }
+    mp_io_fd_t* rec = mp_io_epoll_fd(r, fd);
+    if (rec->reader != NULL && (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0) {
+      mp_io_task_wakeup(r, rec->reader);
+      rec->reader = NULL;
+    }
+    if (rec->writer != NULL && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) != 0) {
+      mp_io_task_wakeup(r, rec->writer);
+      rec->writer = NULL;
+    }
+    if ((rec->reader != NULL || rec->writer != NULL) && mp_io_epoll_arm(r, fd, rec) != 0) {
+      mp_fatal_message(errno, "unable to re-arm descriptor %d\n", fd);
+    }
+  }
+}
+
+static int mp_io_epoll_init(mp_io_reactor_t* r) {
+  r->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (r->epfd < 0) return errno;
+  r->events = (struct epoll_event*)mp_malloc_safe((size_t)r->queue_depth * sizeof(struct epoll_event));
+  r->backend = MP_IO_EPOLL;
+  return 0;
+}
+
+static void mp_io_epoll_done(mp_io_reactor_t* r) {
+  close(r->epfd);
+  mp_free(r->events);
+  mp_free(r->fds);
+}
+
+
+//-----------------------------------------------------------------------
+// io_uring
+//-----------------------------------------------------------------------
+#if MP_IO_HAS_URING
+
+#define mp_io_load_acquire(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define mp_io_store_release(p,x)  __atomic_store_n(p, x, __ATOMIC_RELEASE)
+
+static void mp_io_uring_enter(mp_io_reactor_t* r, unsigned wait, int timeout);
+
+// Queue a submission entry
+static void mp_io_uring_push(mp_io_reactor_t* r, uint8_t opcode, int fd, const void* addr, unsigned len, uint64_t off, uint32_t flags, uint64_t user_data) {
+  if (*r->sq_tail - mp_io_load_acquire(r->sq_head) >= r->sq_entries) {
+    mp_io_uring_enter(r, 0, -1);   // full: submit what we have so far
+  }
+  const unsigned tail = *r->sq_tail;
+  const unsigned index = tail & r->sq_mask;
+  struct io_uring_sqe* sqe = &r->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)addr;
+  sqe->len = len;
+  sqe->off = off;
+  sqe->rw_flags = (__kernel_rwf_t)flags;   // shares the union with `accept_flags` and `poll32_events`
+  sqe->user_data = user_data;
+  r->sq_array[index] = index;
+  mp_io_store_release(r->sq_tail, tail + 1);
+  r->to_submit++;
+}
+
+// Submit the queued entries and wait for at least `wait` completions (or at most `timeout` milli-seconds if it is not negative)
+static void mp_io_uring_enter(mp_io_reactor_t* r, unsigned wait, int timeout) {
+  unsigned flags = (wait > 0 ? IORING_ENTER_GETEVENTS : 0);
+  void* arg = NULL;
+  size_t arg_size = 0;
+  #ifdef IORING_FEAT_EXT_ARG
+  struct io_uring_getevents_arg getevents;
+  #endif
+  if (wait > 0 && timeout >= 0) {
+    r->timeout.tv_sec = timeout / 1000;
+    r->timeout.tv_nsec = (long long)(timeout % 1000) * 1000000;
+    #ifdef IORING_FEAT_EXT_ARG
+    if (r->ext_arg) {
+      memset(&getevents, 0, sizeof(getevents));
+      getevents.ts = (uint64_t)(uintptr_t)&r->timeout;
+      arg = &getevents;
+      arg_size = sizeof(getevents);
+      flags |= IORING_ENTER_EXT_ARG;
+    }
+    else
+    #endif
+    {
+      mp_io_uring_push(r, IORING_OP_TIMEOUT, -1, &r->timeout, 1, 1, 0, 0);
+    }
+  }
+  while (true) {
+    long n = syscall(__NR_io_uring_enter, r->ring_fd, r->to_submit, wait, flags, arg, arg_size);
+    r->to_submit = *r->sq_tail - mp_io_load_acquire(r->sq_head);   // the kernel consumed the submitted entries
+    if (n >= 0 || errno == ETIME) {
+      if (r->to_submit == 0 || wait > 0) return;
+    }
+    else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      mp_fatal_message(errno, "io_uring_enter failed\n");
+    }
+  }
+}
+
+static void mp_io_uring_reap(mp_io_reactor_t* r) {
+  unsigned head = *r->cq_head;
+  const unsigned tail = mp_io_load_acquire(r->cq_tail);
+  for (; head != tail; head++) {
+    const struct io_uring_cqe* cqe = &r->cqes[head & r->cq_mask];
+    if (cqe->user_data == MP_IO_OFFLOAD_EVENT) {
+      r->offload_armed = false;
+      mp_io_offload_reap(r);
+      continue;
+    }
+    mp_io_task_t* t = (mp_io_task_t*)(uintptr_t)cqe->user_data;
+    if (t == NULL) continue;   // a timeout or cancel request
+    t->result = cqe->res;
+    mp_io_task_wakeup(r, t);
+  }
+  mp_io_store_release(r->cq_head, head);
+}
+
+// The `poll32_events` of a poll request
+static uint32_t mp_io_uring_poll_events(short pollev) {
+  uint32_t events = (uint32_t)pollev;
+  #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  events = (events << 16) | (events >> 16);
+  #endif
+  return events;
+}
+
+static void mp_io_uring_poll(mp_io_reactor_t* r, int timeout) {
+  if (r->offloading > 0 && !r->offload_armed) {
+    // also complete when an offloaded call finishes
+    mp_io_uring_push(r, IORING_OP_POLL_ADD, r->offload_fd, NULL, 0, 0, mp_io_uring_poll_events(POLLIN), MP_IO_OFFLOAD_EVENT);
+    r->offload_armed = true;
+  }
+  mp_io_uring_enter(r, 1, timeout);
+  mp_io_uring_reap(r);
+}
+
+// Ask the kernel to cancel the operation of a task; the task is woken up by the completion of its operation
+static void mp_io_uring_cancel(mp_io_reactor_t* r, mp_io_task_t* t) {
+  if (t->cancelled) return;
+  t->cancelled = true;
+  mp_io_uring_push(r, IORING_OP_ASYNC_CANCEL, -1, t, 0, 0, 0, 0);
+}
+
+// Queue an operation of the current task and wait for its completion; returns the result (`-errno` on failure)
+static int mp_io_uring_op(mp_io_reactor_t* r, uint8_t opcode, int fd, const void* addr, unsigned len, uint64_t off, uint32_t flags) {
+  mp_io_task_t* t = r->current;
+  if (mp_io_task_cancel_pending(t)) return -ECANCELED;
+  mp_io_uring_push(r, opcode, fd, addr, len, off, flags, (uint64_t)(uintptr_t)t);
+  mp_io_task_wait(r, t, MP_IO_WAIT_URING);
+  if (t->cancelled) {
+    t->cancelled = false;
+    if (t->result == -ECANCELED || t->result == -EINTR) return -ECANCELED;
+    t->cancel_pending = true;   // the operation completed anyway
+  }
+  return t->result;
+}
+
+// io_uring takes a 32-bit length (and returns an `int`): clamp larger counts like the kernel
+// does for `read` and `write`, which results in a short read or write (as with epoll).
+static unsigned mp_io_uring_len(size_t count) {
+  return (count > INT_MAX ? (unsigned)INT_MAX : (unsigned)count);
+}
+
+// Perform an operation; on `EAGAIN` (for non-blocking descriptors) wait for readiness and retry.
+static ssize_t mp_io_uring_op_retry(mp_io_reactor_t* r, uint8_t opcode, int fd, const void* addr, unsigned len, uint64_t off, uint32_t flags, short pollev) {
+  while (true) {
+    int res = mp_io_uring_op(r, opcode, fd, addr, len, off, flags);
+    if (res == -EAGAIN) {
+      res = mp_io_uring_op(r, IORING_OP_POLL_ADD, fd, NULL, 0, 0, mp_io_uring_poll_events(pollev));
+      if (res >= 0) continue;
+    }
+    if (res == -ECANCELED) return mp_io_task_cancelled(r->current);
+    if (res < 0) {
+      errno = -res;
+      return -1;
+    }
+    return res;
+  }
+}
+
+static int mp_io_uring_init(mp_io_reactor_t* r) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  long fd = syscall(__NR_io_uring_setup, (unsigned)r->queue_depth, &params);
+  if (fd < 0) return errno;
+  r->ring_fd = (int)fd;
+  r->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  r->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  const bool single = ((params.features & IORING_FEAT_SINGLE_MMAP) != 0);
+  if (single) {
+    r->sq_ring_size = r->cq_ring_size = (r->sq_ring_size > r->cq_ring_size ? r->sq_ring_size : r->cq_ring_size);
+  }
+  r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->ring_fd, IORING_OFF_SQ_RING);
+  r->cq_ring = (single ? r->sq_ring : mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->ring_fd, IORING_OFF_CQ_RING));
+  r->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes = (struct io_uring_sqe*)mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->ring_fd, IORING_OFF_SQES);
+  if (r->sq_ring == MAP_FAILED || r->cq_ring == MAP_FAILED || r->sqes == MAP_FAILED) {
+    const int err = errno;
+    if (r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_size);
+    if (!single && r->cq_ring != MAP_FAILED) munmap(r->cq_ring, r->cq_ring_size);
+    if (r->sq_ring != MAP_FAILED) munmap(r->sq_ring, r->sq_ring_size);
+    close(r->ring_fd);
+    return err;
+  }
+  uint8_t* sq = (uint8_t*)r->sq_ring;
+  uint8_t* cq = (uint8_t*)r->cq_ring;
+  r->sq_head    = (unsigned*)(sq + params.sq_off.head);
+  r->sq_tail    = (unsigned*)(sq + params.sq_off.tail);
+  r->sq_mask    = *(unsigned*)(sq + params.sq_off.ring_mask);
+  r->sq_entries = *(unsigned*)(sq + params.sq_off.ring_entries);
+  r->sq_array   = (unsigned*)(sq + params.sq_off.array);
+  r->cq_head    = (unsigned*)(cq + params.cq_off.head);
+  r->cq_tail    = (unsigned*)(cq + params.cq_off.tail);
+  r->cq_mask    = *(unsigned*)(cq + params.cq_off.ring_mask);
+  r->cqes       = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+  r->to_submit  = 0;
+  #ifdef IORING_FEAT_EXT_ARG
+  r->ext_arg    = ((params.features & IORING_FEAT_EXT_ARG) != 0);
+  #endif
+  r->backend    = MP_IO_URING;
+  return 0;
+}
+
+static void mp_io_uring_done(mp_io_reactor_t* r) {
+  munmap(r->sqes, r->sqes_size);
+  if (r->cq_ring != r->sq_ring) munmap(r->cq_ring, r->cq_ring_size);
+  munmap(r->sq_ring, r->sq_ring_size);
+  close(r->ring_fd);
+}
+
+#else
+static int  mp_io_uring_init(mp_io_reactor_t* r) { MP_UNUSED(r); return ENOSYS; }
+static void mp_io_uring_done(mp_io_reactor_t* r) { MP_UNUSED(r); }
+static void mp_io_uring_poll(mp_io_reactor_t* r, int timeout) { MP_UNUSED(r); MP_UNUSED(timeout); }
+static void mp_io_uring_cancel(mp_io_reactor_t* r, mp_io_task_t* t) { MP_UNUSED(r); MP_UNUSED(t); }
+#endif
+
+
+//-----------------------------------------------------------------------
+// Reactor
+//-----------------------------------------------------------------------
+
+// Milli-seconds until the next timer is due (or -1 if there are no timers)
+static int mp_io_poll_timeout(mp_io_reactor_t* r) {
+  const mp_msecs_t next = mp_wheel_next(&r->wheel);
+  if (next < 0) return -1;
+  const mp_msecs_t now = mp_io_now();
+  if (next <= now) return 0;
+  return (next - now > INT_MAX ? INT_MAX : (int)(next - now));
+}
+
+mp_io_config_t mp_io_config_default(void) {
+  mp_io_config_t config;
+  config.backend = MP_IO_AUTO;
+  config.queue_depth = 256;
+  return config;
+}
+
+int mp_io_run(const mp_io_config_t* config, mp_io_fun_t* fun, void* arg) {
+  mp_io_config_t cfg = (config != NULL ? *config : mp_io_config_default());
+  mp_io_reactor_t* r = mp_zalloc_safe_tp(mp_io_reactor_t);
+  r->offload_fd = -1;
+  r->queue_depth = (cfg.queue_depth > 0 ? cfg.queue_depth : 256);
+  int err = ENOSYS;
+  if (cfg.backend == MP_IO_URING || cfg.backend == MP_IO_AUTO) err = mp_io_uring_init(r);
+  if (err != 0 && (cfg.backend == MP_IO_EPOLL || cfg.backend == MP_IO_AUTO)) err = mp_io_epoll_init(r);
+  if (err != 0) {
+    mp_free(r);
+    return err;
+  }
+
+  mp_io_reactor_t* prev = _mp_io_reactor;   // when `mp_io_run` is called from a task
+  _mp_io_reactor = r;
+  r->context = mp_task_context_get();
+  mp_wheel_init(&r->wheel, mp_io_now());
+  mp_io_task_create(r, fun, arg);
+  while (true) {
+    mp_io_task_t* t;
+    while ((t = mp_io_ready_pop(r)) != NULL) {
+      mp_io_task_run(r, t);
+    }
+    if (r->live == 0) break;
+    mp_wheel_advance(&r->wheel, mp_io_now());
+    if (r->offloading > 0 && mp_atomic_load(&r->offload_done) != 0) mp_io_offload_reap(r);
+    if (r->ready_head != NULL) continue;
+    mp_assert_internal(r->waiting > 0);
+    const int timeout = mp_io_poll_timeout(r);
+    if (r->backend == MP_IO_URING) { mp_io_uring_poll(r, timeout); }
+                              else { mp_io_epoll_poll(r, timeout); }
+    mp_wheel_advance(&r->wheel, mp_io_now());
+  }
+  mp_wheel_clear(&r->wheel);
+  mp_io_offload_done(r);
+  _mp_io_reactor = prev;
+
+  if (r->backend == MP_IO_URING) { mp_io_uring_done(r); }
+                            else { mp_io_epoll_done(r); }
+  mp_free(r);
+  return 0;
+}
+
+void mp_io_spawn(mp_io_fun_t* fun, void* arg) {
+  mp_io_reactor_t* r = mp_io_reactor_in_task();
+  if (r == NULL) mp_fatal_message(EINVAL, "mp_io_spawn can only be called from an I/O task\n");
+  mp_io_task_create(r, fun, arg);
+}
+
+mp_io_backend_t mp_io_backend(void) {
+  mp_io_reactor_t* r = _mp_io_reactor;
+  return (r == NULL ? MP_IO_AUTO : r->backend);
+}
+
+mp_io_task_t* mp_io_current(void) {
+  mp_io_reactor_t* r = mp_io_reactor_in_task();
+  return (r == NULL ? NULL : r->current);
+}
+
+
+//-----------------------------------------------------------------------
+// Timers
+//-----------------------------------------------------------------------
+
+mp_msecs_t mp_io_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((mp_msecs_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+static mp_io_reactor_t* mp_io_reactor_for_timer(void) {
+  mp_io_reactor_t* r = _mp_io_reactor;
+  if (r == NULL) mp_fatal_message(EINVAL, "timers can only be used on a reactor thread\n");
+  return r;
+}
+
+void mp_timer_start(mp_timer_t* timer, mp_msecs_t deadline, mp_timer_fun_t* fun, void* arg) {
+  mp_io_reactor_t* r = mp_io_reactor_for_timer();
+  timer->expire = deadline;
+  timer->fun = fun;
+  timer->arg = arg;
+  mp_wheel_insert(&r->wheel, timer);
+}
+
+void mp_timer_stop(mp_timer_t* timer) {
+  if (!mp_timer_is_pending(timer)) return;
+  mp_wheel_remove(&mp_io_reactor_for_timer()->wheel, timer);
+}
+
+bool mp_timer_is_pending(const mp_timer_t* timer) {
+  return (timer->next != NULL);
+}
+
+static void mp_io_sleep_expired(void* arg) {
+  mp_io_task_wakeup(_mp_io_reactor, (mp_io_task_t*)arg);
+}
+
+int mp_sleep_until(mp_msecs_t deadline) {
+  mp_io_reactor_t* r = mp_io_reactor_in_task();
+  if (r == NULL) {
+    // block the thread
+    struct timespec ts;
+    ts.tv_sec = (time_t)(deadline / 1000);
+    ts.tv_nsec = (long)(deadline % 1000) * 1000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) { }
+    return 0;
+  }
+  mp_io_task_t* t = r->current;
+  if (mp_io_task_cancel_pending(t)) return mp_io_task_cancelled(t);
+  mp_timer_t timer;
+  mp_timer_start(&timer, deadline, &mp_io_sleep_expired, t);
+  t->wait_timer = &timer;
+  mp_io_task_wait(r, t, MP_IO_WAIT_TIMER);
+  t->wait_timer = NULL;
+  if (t->cancelled) {
+    t->cancelled = false;
+    return mp_io_task_cancelled(t);
+  }
+  return 0;
+}
+
+int mp_sleep(mp_msecs_t timeout) {
+  return mp_sleep_until(mp_io_now() + (timeout > 0 ? timeout : 0));
+}
+
+
+//-----------------------------------------------------------------------
+// Cancellation
+//-----------------------------------------------------------------------
+
+void mp_io_cancel(mp_io_task_t* t) {
+  mp_io_reactor_t* r = _mp_io_reactor;
+  if (r == NULL) mp_fatal_message(EINVAL, "mp_io_cancel can only be called on a reactor thread\n");
+  switch (t->wait) {
+    case MP_IO_WAIT_NONE:
+      t->cancel_pending = true;
+      break;
+    case MP_IO_WAIT_FD:
+      mp_io_epoll_cancel(r, t);
+      t->cancelled = true;
+      mp_io_task_wakeup(r, t);
+      break;
+    case MP_IO_WAIT_TIMER:
+      mp_wheel_remove(&r->wheel, t->wait_timer);
+      t->cancelled = true;
+      mp_io_task_wakeup(r, t);
+      break;
+    case MP_IO_WAIT_URING:
+      mp_io_uring_cancel(r, t);
+      break;
+    case MP_IO_WAIT_OFFLOAD:
+      t->cancel_pending = true;   // an offloaded call cannot be interrupted
+      break;
+  }
+}
+
+bool mp_io_uncancel(void) {
+  mp_io_reactor_t* r = mp_io_reactor_in_task();
+  return (r != NULL && mp_io_task_cancel_pending(r->current));
+}
+
+void mp_io_on_cancel(mp_io_cancel_fun_t* fun, void* arg, mp_io_cancel_fun_t** prev_fun, void** prev_arg) {
+  mp_io_reactor_t* r = mp_io_reactor_in_task();
+  if (r == NULL) mp_fatal_message(EINVAL, "mp_io_on_cancel can only be called from an I/O task\n");
+  mp_io_task_t* t = r->current;
+  if (prev_fun != NULL) *prev_fun = t->cancel_fun;
+  if (prev_arg != NULL) *prev_arg = t->cancel_arg;
+  t->cancel_fun = fun;
+  t->cancel_arg = arg;
+}
+
+
+//-----------------------------------------------------------------------
+// Operations
+//-----------------------------------------------------------------------
+
+ssize_t mp_io_read(int fd, void* buf, size_t count) {
+  mp_io_reactor_t* r = mp_io_reactor_in_task();
+  if (r == NULL) return read(fd, buf, count);
+  #if MP_IO_HAS_URING
+  if (r->backend == MP_IO_URING) return mp_io_uring_op_retry(r, IORING_OP_READ, fd, buf, mp_io_uring_len(count), (uint64_t)-1, 0, POLLIN);
+  #endif
+  while (true) {
+    ssize_t n = read(fd, buf, count);
+    if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) return n;
+    if (mp_io_epoll_wait_fd(r, fd, false) != 0) return -1;
+  }
+}
+
+ssize_t mp_io_write(int fd, const void* buf, size_t count) {
+  mp_io_reactor_t* r = mp_io_reactor_in_task();
+  if (r == NULL) return write(fd, buf, count);
+  #if MP_IO_HAS_URING
+  if (r->backend == MP_IO_URING) return mp_io_uring_op_retry(r, IORING_OP_WRITE, fd, buf, mp_io_uring_len(count), (uint64_t)-1, 0, POLLOUT);
+  #endif
+  while (true) {
+    ssize_t n = write(fd, buf, count);
+    if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) return n;
+    if (mp_io_epoll_wait_fd(r, fd, true) != 0) return -1;
+  }
+}
+
+int mp_io_accept(int fd, struct sockaddr* addr, socklen_t* addrlen, int flags) {
+  mp_io_reactor_t* r = mp_io_reactor_in_task();
+  if (r == NULL) return accept4(fd, addr, addrlen, flags);
+  #if MP_IO_HAS_URING
+  if (r->backend == MP_IO_URING) return (int)mp_io_uring_op_retry(r, IORING_OP_ACCEPT, fd, addr, 0, (uint64_t)(uintptr_t)addrlen, (uint32_t)flags, POLLIN);
+  #endif
+  while (true) {
+    int afd = accept4(fd, addr, addrlen, flags);
+    if (afd >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) return afd;
+    if (mp_io_epoll_wait_fd(r, fd, false) != 0) return -1;
+  }
+}
+
+int mp_io_close(int fd) {
+  mp_io_reactor_t* r = _mp_io_reactor;
+  if (r != NULL && r->backend == MP_IO_EPOLL && fd >= 0 && fd < r->fd_count && r->fds[fd].registered) {
+    epoll_ctl(r->epfd, EPOLL_CTL_DEL, fd, NULL);
+    memset(&r->fds[fd], 0, sizeof(mp_io_fd_t));
+  }
+  return close(fd);
+}
+
+#endif
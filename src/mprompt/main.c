@@ -11,3 +11,9 @@
 #include "mprompt.c"
 #include "gstack.c"
 #include "util.c"
+#include "gen.c"
+#include "sched.c"
+#include "chan.c"
+#include "sync.c"
+#include "timer.c"
+#include "io.c"
@@ -14,6 +14,7 @@
 #include "internal/util.h"
 #include "internal/longjmp.h"
 #include "internal/gstack.h"
+#include "internal/probe.h"
 
 #ifdef __cplusplus
 #include <exception>
@@ -70,6 +71,7 @@ struct mp_prompt_s {
 
   void*              sp;            // security: contains the (guarded) expected stack pointer for a return (if active) or resume (if suspended)
   mp_unwind_frame_t* unwind_frame;  // used to aid with unwinding on some platforms (windows only for now)
+  bool               retained;      // keep the prompt and its gstack for reuse when its refcount drops to zero (see `mp_prompt_retain`)
 };
 
 
@@ -179,12 +181,12 @@ static bool mp_prompt_is_ancestor(mp_prompt_t* p) {
 }
 #endif
 
-// Allocate a fresh (suspended) prompt
-mp_prompt_t* mp_prompt_create(void) {
+// Allocate a fresh (suspended) prompt, or return NULL if the stack budget is exhausted (`EAGAIN`) or out of memory
+mp_prompt_t* mp_prompt_try_create(void) {
   // allocate a fresh growable stack
   mp_prompt_t* p;
   mp_gstack_t* gstack = mp_gstack_alloc(sizeof(mp_prompt_t), (void**)&p);
-  if (gstack == NULL) { mp_fatal_message(ENOMEM, "unable to allocate a stack\n"); }
+  if (gstack == NULL) return NULL;
   // allocate the prompt structure at the base of the new stack
   p->parent = NULL;
   p->top = p;
@@ -193,30 +195,60 @@ mp_prompt_t* mp_prompt_create(void) {
   p->resume_point = NULL;
   p->return_point = NULL;
   p->unwind_frame = NULL;
+  p->retained = false;
+  MP_PROBE2(prompt_create, p, gstack);
   return p;
 }
 
-// Free a prompt and drop its children
-static void mp_prompt_free(mp_prompt_t* p, bool delay) {
-  mp_assert_internal(!mp_prompt_is_active(p));
-  p = p->top;
-  while (p != NULL) {
-    mp_assert_internal(p->refcount == 0);
+// Allocate a fresh (suspended) prompt
+mp_prompt_t* mp_prompt_create(void) {
+  mp_prompt_t* p = mp_prompt_try_create();
+  if (p == NULL) {
+    if (errno == EAGAIN) { mp_fatal_message(EAGAIN, "unable to allocate a stack: the stack budget is exhausted\n"); }
+                    else { mp_fatal_message(ENOMEM, "unable to allocate a stack\n"); }
+  }
+  return p;
+}
+
+// Free the prompts of a suspended chain from its `top` down to (but not including) `base`
+// (the prompts suspended above the base prompt are owned by its chain and still have a refcount of 1)
+static void mp_prompt_free_chain(mp_prompt_t* top, mp_prompt_t* base, bool delay) {
+  mp_prompt_t* p = top;
+  while (p != base) {
     mp_prompt_t* parent = p->parent;    
+    mp_assert_internal(parent == NULL || p->refcount == 1);
+    MP_PROBE1(prompt_free, p);
     mp_gstack_free(p->gstack, delay);
-    if (parent != NULL) {
-      mp_assert_internal(parent->refcount == 1);
-      parent->refcount--;
-    }
     p = parent;
   }
 }
 
-// Decrement the refcount (and free when it becomes zero).
+// Free a prompt and drop its children
+static void mp_prompt_free(mp_prompt_t* p, bool delay) {
+  mp_assert_internal(!mp_prompt_is_active(p));
+  mp_assert_internal(p->refcount == 0);
+  mp_prompt_free_chain(p->top, NULL, delay);
+}
+
+// Reset a retained prompt so it can be entered again: drop its children but keep its own gstack
+// (with the memory that is committed already)
+static void mp_prompt_reset(mp_prompt_t* p, bool delay) {
+  mp_assert_internal(!mp_prompt_is_active(p));
+  mp_assert_internal(p->refcount == 0 && p->retained);
+  mp_prompt_free_chain(p->top, p, delay);
+  mp_gstack_end_lifetime(p->gstack);     // as if it was freed (for the commit statistics and the learned peak)
+  p->top = p;
+  p->refcount = 1;
+  p->resume_point = NULL;
+  p->return_point = NULL;
+}
+
+// Decrement the refcount (and free or reset when it becomes zero).
 static void mp_prompt_drop_internal(mp_prompt_t* p, bool delay) {
   int64_t i = p->refcount--;
   if (i <= 1) {
-    mp_prompt_free(p, delay);
+    if (p->retained) { mp_prompt_reset(p, delay); }
+                else { mp_prompt_free(p, delay); }
   }
 }
 
@@ -272,6 +304,26 @@ static inline mp_return_point_t* mp_prompt_unlink(mp_prompt_t* p, mp_resume_poin
   return p->return_point;
 }
 
+// Unlink when returning from the start function. A prompt can be resumed on another thread
+// so we never inline this: the compiler may otherwise reuse the address of the thread-local
+// `_mp_prompt_top` computed before the start function was called (on another thread).
+static mp_decl_noinline mp_return_point_t* mp_prompt_unlink_return(mp_prompt_t* p, void** sp) {
+  return mp_prompt_unlink(p, NULL, sp);
+}
+
+
+// A suspended prompt can be resumed on any thread, even one that never allocated 
+// a gstack itself; in that case we need to initialize it first (for example, to 
+// set up the alternate signal stack used to commit gstack pages on demand).
+static mp_decl_thread bool _mp_thread_init;
+
+static inline void mp_thread_init(void) {
+  if (mp_unlikely(!_mp_thread_init)) {
+    _mp_thread_init = true;
+    mp_gstack_init(NULL);
+  }
+}
+
 
 //-----------------------------------------------------------------------
 // Checked longjmp
@@ -323,8 +375,8 @@ static  void mp_prompt_stack_entry(void* penv, mp_unwind_frame_t* unwind_frame)
   try {
   #endif
     void* result = (env->fun)(p, env->arg);
-    // RET: return from a prompt
-    ret = mp_prompt_unlink(p, NULL, &sp);
+    // RET: return from a prompt (possibly on another thread than where we started)
+    ret = mp_prompt_unlink_return(p, &sp);
     ret->arg = result;
     ret->fun = NULL;
     ret->kind = MP_RETURN;    
@@ -332,7 +384,7 @@ static  void mp_prompt_stack_entry(void* penv, mp_unwind_frame_t* unwind_frame)
   }
   catch (...) {
     mp_trace_message("catch exception to propagate across the prompt %p..\n", p);
-    ret = mp_prompt_unlink(p, NULL, &sp);
+    ret = mp_prompt_unlink_return(p, &sp);
     ret->exn = std::current_exception();
     ret->arg = NULL;
     ret->fun = NULL;
@@ -369,7 +421,8 @@ static mp_decl_noinline void* mp_prompt_exec_yield_fun(mp_return_point_t* ret, m
 
 
 // Resume a prompt: used for the initial entry as well as for resuming in a suspended prompt.
-static mp_decl_noinline void* mp_prompt_resume(mp_prompt_t * p, void* arg) {
+static mp_decl_noinline mp_decl_noclone void* mp_prompt_resume(mp_prompt_t * p, void* arg) {
+  MP_PROBE2(resume, p, p->resume_point == NULL);
   mp_return_point_t ret;    
   // save our return location for yields and regular return  
   if (mp_setjmp(&ret.jmp)) {
@@ -386,6 +439,7 @@ static mp_decl_noinline void* mp_prompt_resume(mp_prompt_t * p, void* arg) {
     }
 
     mp_assert(p->parent == NULL);
+    mp_thread_init();
     void* sp;
     mp_resume_point_t* res = mp_prompt_link(p,&ret,&sp);  // make active
     if (res != NULL) {
@@ -402,14 +456,20 @@ static mp_decl_noinline void* mp_prompt_resume(mp_prompt_t * p, void* arg) {
 }
 
 void* mp_prompt_enter(mp_prompt_t* p, mp_start_fun_t* fun, void* arg) {
-  mp_assert_internal(!mp_prompt_is_active(p) && p->resume_point == NULL);
+  mp_assert_internal(mp_prompt_is_idle(p));
   mp_entry_env_t env;
   env.prompt = p;
   env.fun = fun;
   env.arg = arg;
+  mp_gstack_set_peak_key(p->gstack, (const void*)fun);   // learn the peak stack use per start function
   return mp_prompt_resume(p, &env);
 }
 
+// Set the growth policy of the gstack of `p`.
+void mp_prompt_set_grow_policy(mp_prompt_t* p, const mp_grow_policy_t* policy) {
+  mp_gstack_set_grow_policy(p->gstack, policy);
+}
+
 // Install a fresh prompt `p` with a growable stack and start running `fun(p,arg)` on it.
 void* mp_prompt(mp_start_fun_t* fun, void* arg) {
   mp_prompt_t* p = mp_prompt_create();
@@ -417,6 +477,33 @@ void* mp_prompt(mp_start_fun_t* fun, void* arg) {
 }
 
 
+//-----------------------------------------------------------------------
+// Reusable prompts
+//-----------------------------------------------------------------------
+
+// Keep `p` and its gstack when its start function returns (or when its resumption is dropped)
+// so it can be entered again without allocating.
+mp_prompt_t* mp_prompt_retain(mp_prompt_t* p) {
+  p->retained = true;
+  return p;
+}
+
+// Can `p` be entered? (a fresh prompt, or a retained prompt that finished)
+bool mp_prompt_is_idle(mp_prompt_t* p) {
+  return (p->top == p && p->resume_point == NULL && p->parent == NULL);
+}
+
+// Free a retained prompt if it is idle; otherwise it is freed as usual once it finishes.
+void mp_prompt_release(mp_prompt_t* p) {
+  if (p == NULL) return;
+  p->retained = false;
+  if (mp_prompt_is_idle(p)) {
+    mp_assert_internal(p->refcount == 1);
+    mp_prompt_drop(p);
+  }
+}
+
+
 
 //-----------------------------------------------------------------------
 // Resume from a yield (once)
@@ -496,9 +583,11 @@ int mp_resume_should_unwind(mp_resume_t* resume) {
 
 
 // Yield back to a prompt with a `mp_resume_once_t` resumption and run `fun(arg)` at the yield point
-void* mp_yield(mp_prompt_t* p, mp_yield_fun_t* fun, void* arg) {
+// (never inline or clone as the resume label must be a unique code location)
+mp_decl_noinline mp_decl_noclone void* mp_yield(mp_prompt_t* p, mp_yield_fun_t* fun, void* arg) {
   mp_assert(mp_prompt_is_ancestor(p));           // can only yield up to an ancestor
   mp_assert_internal(mp_prompt_is_active(p));    // can only yield to an active prompt
+  MP_PROBE1(yield, p);
   // set our resume point (Y)
   mp_resume_point_t res;
   if (mp_setjmp(&res.jmp)) {
@@ -540,6 +629,7 @@ mp_resume_t* mp_resume_multi(mp_resume_t* once) {
   r->resume_count = 0;
   r->save = NULL;
   r->tail_return_point = p->return_point;
+  MP_PROBE2(resume_multi, p, r);
   return mp_resume_as_multi(r);
 }
 
@@ -758,6 +848,135 @@ int mp_backtrace(void** bt, int len) {
 
 #endif
 
+
+//-----------------------------------------------------------------------
+// Async-signal-safe backtrace
+//
+// Walk the frame pointers from the interrupted context and continue at the
+// return point of each prompt in its parent stack. We only read memory
+// in the committed part of each gstack and do not allocate or lock,
+// so this can be used from a sampling profiler (`SIGPROF`) signal handler.
+// (assumes stacks grow down which holds for all supported platforms)
+//-----------------------------------------------------------------------
+
+#if !defined(_WIN32) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__aarch64__))
+#include <signal.h>
+#include <ucontext.h>
+
+#define MP_BT_MAX_FRAME_SIZE     (256 * MP_KIB)   // on the system stack: maximal distance between frames
+#define MP_BT_MAX_SYSTEM_STACK   (8 * MP_MIB)     // on the system stack: maximal extent from the stack pointer
+
+#if defined(__x86_64__)
+#define mp_jmpbuf_fp(jmp)  ((void**)(jmp)->reg_rbp)
+#else
+#define mp_jmpbuf_fp(jmp)  ((void**)(jmp)->reg_fp)
+#endif
+
+// Get the instruction, frame, and stack pointer of an interrupted context
+static bool mp_signal_context(void* ucontext, void** ip, void*** fp, uint8_t** sp) {
+  ucontext_t* uc = (ucontext_t*)ucontext;
+  #if defined(__linux__) && defined(__x86_64__)
+  *ip = (void*)uc->uc_mcontext.gregs[16];            // REG_RIP
+  *fp = (void**)uc->uc_mcontext.gregs[10];           // REG_RBP
+  *sp = (uint8_t*)uc->uc_mcontext.gregs[15];         // REG_RSP
+  #elif defined(__linux__) && defined(__aarch64__)
+  *ip = (void*)uc->uc_mcontext.pc;
+  *fp = (void**)uc->uc_mcontext.regs[29];
+  *sp = (uint8_t*)uc->uc_mcontext.sp;
+  #elif defined(__APPLE__) && defined(__x86_64__)
+  *ip = (void*)uc->uc_mcontext->__ss.__rip;
+  *fp = (void**)uc->uc_mcontext->__ss.__rbp;
+  *sp = (uint8_t*)uc->uc_mcontext->__ss.__rsp;
+  #elif defined(__FreeBSD__) && defined(__x86_64__)
+  *ip = (void*)uc->uc_mcontext.mc_rip;
+  *fp = (void**)uc->uc_mcontext.mc_rbp;
+  *sp = (uint8_t*)uc->uc_mcontext.mc_rsp;
+  #else
+  MP_UNUSED(uc); MP_UNUSED(ip); MP_UNUSED(fp); MP_UNUSED(sp);
+  return false;
+  #endif
+  return true;
+}
+
+// Walk frame pointers in `[lo,hi)`; each frame is `fp[0]` = parent frame, `fp[1]` = return address.
+static int mp_backtrace_frames(void** fp, uint8_t* lo, uint8_t* hi, bool system_stack, void** bt, int len) {
+  int n = 0;
+  while (n < len && ((uintptr_t)fp % sizeof(void*)) == 0 && (uint8_t*)fp >= lo && (uint8_t*)(fp + 2) <= hi) {
+    void* ip = fp[1];
+    if (ip == NULL) break;
+    bt[n++] = ip;
+    void** next = (void**)fp[0];
+    if (next <= fp) break;  // frames must go toward the base
+    if (system_stack && ((uint8_t*)next - (uint8_t*)fp) > MP_BT_MAX_FRAME_SIZE) break;
+    fp = next;
+  }
+  return n;
+}
+
+static mp_decl_noinline int mp_backtrace_signal_from(void* ucontext, void** bt, int len) {
+  void*    ip = NULL;
+  void**   fp;
+  uint8_t* sp;
+  if (ucontext != NULL) {
+    if (!mp_signal_context(ucontext, &ip, &fp, &sp)) return 0;
+  }
+  else {
+    fp = (void**)__builtin_frame_address(0);  // start at the current frame
+    sp = (uint8_t*)fp;
+  }
+  int n = 0;
+  if (ip != NULL && n < len) bt[n++] = ip;
+
+  // find the prompt whose gstack we are executing on (we may be interrupted during a switch)
+  mp_prompt_t* p = _mp_prompt_top;
+  uint8_t* lo = NULL;
+  uint8_t* hi = NULL;
+  while (p != NULL) {
+    mp_gstack_readable(p->gstack, &lo, &hi);
+    if (sp >= lo && sp < hi) break;
+    p = p->parent;
+  }
+
+  // and walk each gstack up to the system stack
+  while (n < len) {
+    if (p == NULL) {
+      lo = sp;
+      hi = sp + MP_BT_MAX_SYSTEM_STACK;
+    }
+    else {
+      mp_gstack_readable(p->gstack, &lo, &hi);
+    }
+    n += mp_backtrace_frames(fp, lo, hi, p == NULL, bt + n, len - n);
+    if (p == NULL) break;
+    // continue in the parent at the return point
+    mp_return_point_t* ret = p->return_point;
+    p = p->parent;
+    if (ret == NULL) break;
+    if (p != NULL) {
+      mp_gstack_readable(p->gstack, &lo, &hi);
+      if ((uint8_t*)ret < lo || (uint8_t*)(ret + 1) > hi) break;
+    }
+    fp = mp_jmpbuf_fp(&ret->jmp);
+    sp = (uint8_t*)ret->jmp.reg_sp;
+    if (n < len) bt[n++] = ret->jmp.reg_ip;
+  }
+  return n;
+}
+
+int mp_backtrace_signal(void* ucontext, void** bt, int len) {
+  if (bt == NULL || len <= 0) return 0;
+  return mp_backtrace_signal_from(ucontext, bt, len);
+}
+
+#else
+
+int mp_backtrace_signal(void* ucontext, void** bt, int len) {
+  MP_UNUSED(ucontext); MP_UNUSED(bt); MP_UNUSED(len);
+  return 0;
+}
+
+#endif
+
 /*
 void mp_gstack_win_test(mp_gstack_t* g);
 void* win_test(mp_prompt_t* p, void* arg) {
@@ -0,0 +1,679 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  M:N scheduler on top of prompts.
+
+  Each task runs under its own prompt; to yield or park, it yields up to
+  that prompt with `mp_yield` which returns the resumption to the worker
+  that ran it. The worker then stores the resumption in the task and puts
+  the task back in a run queue (or leaves it parked).
+
+  Each worker owns a bounded run queue (a ring as in the Go runtime): only
+  the owner pushes at the tail, while the owner and thieves take from the
+  head with a CAS. A worker that runs out of tasks steals half of the tasks
+  of another worker. Tasks that are made runnable from outside the workers,
+  or that overflow a run queue, go into a global queue that is checked
+  regularly for fairness. Idle workers go to sleep on a condition variable.
+
+  A task that is unparked by another task on the same worker goes into the
+  `runnext` slot of that worker (as in Go) so it runs as soon as the current
+  task suspends: this makes a hand-off between two tasks (as in a channel)
+  a direct switch. The `runnext` task is not stolen by other workers.
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "mprompt.h"
+#include "mp_sched.h"
+#include "internal/util.h"
+#include "internal/atomic.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#ifdef __cplusplus
+#include <exception>
+#endif
+
+#define MPS_RUNQ_SIZE     (256)   // tasks in a local run queue (must be a power of 2)
+#define MPS_GLOBAL_TICK   (61)    // check the global queue first every so many ticks
+#define MPS_SPIN_ROUNDS   (32)    // rounds of stealing before going to sleep
+
+
+//-----------------------------------------------------------------------
+// Task context: the scheduler and the I/O reactor save the context of a 
+// task when it suspends and restore it when it resumes (possibly on another 
+// thread) through the registered hook (see `mp_task_context_hook`).
+//-----------------------------------------------------------------------
+
+static _Atomic(const mp_task_context_hook_t*) mp_task_context;
+
+void mp_task_context_hook(const mp_task_context_hook_t* hook) {
+  mp_atomic_store_ptr(const mp_task_context_hook_t, &mp_task_context, hook);
+}
+
+static inline void* mp_task_context_get(void) {
+  const mp_task_context_hook_t* hook = mp_atomic_load_ptr(const mp_task_context_hook_t, &mp_task_context);
+  return (hook == NULL ? NULL : (hook->get)());
+}
+
+static inline void mp_task_context_set(void* context) {
+  const mp_task_context_hook_t* hook = mp_atomic_load_ptr(const mp_task_context_hook_t, &mp_task_context);
+  if (hook != NULL) (hook->set)(context);
+}
+
+
+//-----------------------------------------------------------------------
+// Threads, locks, and condition variables
+//-----------------------------------------------------------------------
+
+#if defined(_WIN32)
+typedef HANDLE              mps_thread_t;
+typedef SRWLOCK             mps_mutex_t;
+typedef CONDITION_VARIABLE  mps_cond_t;
+
+static DWORD WINAPI mps_thread_start(LPVOID arg);
+
+static bool mps_thread_create(mps_thread_t* t, void* arg) {
+  *t = CreateThread(NULL, 0, &mps_thread_start, arg, 0, NULL);
+  return (*t != NULL);
+}
+
+static void mps_thread_join(mps_thread_t t) {
+  WaitForSingleObject(t, INFINITE);
+  CloseHandle(t);
+}
+
+static void mps_mutex_init(mps_mutex_t* m)      { InitializeSRWLock(m); }
+static void mps_mutex_done(mps_mutex_t* m)      { MP_UNUSED(m); }
+static void mps_mutex_lock(mps_mutex_t* m)      { AcquireSRWLockExclusive(m); }
+static void mps_mutex_unlock(mps_mutex_t* m)    { ReleaseSRWLockExclusive(m); }
+static void mps_cond_init(mps_cond_t* c)        { InitializeConditionVariable(c); }
+static void mps_cond_done(mps_cond_t* c)        { MP_UNUSED(c); }
+static void mps_cond_wait(mps_cond_t* c, mps_mutex_t* m) { SleepConditionVariableSRW(c, m, INFINITE, 0); }
+static void mps_cond_signal(mps_cond_t* c)      { WakeConditionVariable(c); }
+static void mps_cond_broadcast(mps_cond_t* c)   { WakeAllConditionVariable(c); }
+
+static int mps_cpu_count(void) {
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  return (int)si.dwNumberOfProcessors;
+}
+#else
+typedef pthread_t           mps_thread_t;
+typedef pthread_mutex_t     mps_mutex_t;
+typedef pthread_cond_t      mps_cond_t;
+
+static void* mps_thread_start(void* arg);
+
+static bool mps_thread_create(mps_thread_t* t, void* arg) {
+  return (pthread_create(t, NULL, &mps_thread_start, arg) == 0);
+}
+
+static void mps_thread_join(mps_thread_t t) {
+  pthread_join(t, NULL);
+}
+
+static void mps_mutex_init(mps_mutex_t* m)      { pthread_mutex_init(m, NULL); }
+static void mps_mutex_done(mps_mutex_t* m)      { pthread_mutex_destroy(m); }
+static void mps_mutex_lock(mps_mutex_t* m)      { pthread_mutex_lock(m); }
+static void mps_mutex_unlock(mps_mutex_t* m)    { pthread_mutex_unlock(m); }
+static void mps_cond_init(mps_cond_t* c)        { pthread_cond_init(c, NULL); }
+static void mps_cond_done(mps_cond_t* c)        { pthread_cond_destroy(c); }
+static void mps_cond_wait(mps_cond_t* c, mps_mutex_t* m) { pthread_cond_wait(c, m); }
+static void mps_cond_signal(mps_cond_t* c)      { pthread_cond_signal(c); }
+static void mps_cond_broadcast(mps_cond_t* c)   { pthread_cond_broadcast(c); }
+
+static int mps_cpu_count(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n > 0 ? (int)n : 1);
+}
+#endif
+
+
+//-----------------------------------------------------------------------
+// Types
+//-----------------------------------------------------------------------
+
+typedef struct mps_sched_s   mps_sched_t;
+typedef struct mps_worker_s  mps_worker_t;
+
+// Why a task yielded to its worker
+typedef enum mps_action_e {
+  MPS_DONE = 1,     // the task function returned
+  MPS_YIELD,        // `mps_yield_now`: reschedule at the end of the run queue
+  MPS_PARK          // `mps_park`: wait for an unpark
+} mps_action_t;
+
+// Park state of a task
+typedef enum mps_park_e {
+  MPS_RUNNING,      // running or runnable
+  MPS_NOTIFIED,     // running or runnable, and the next park returns right away
+  MPS_PARKED        // suspended until an unpark
+} mps_park_t;
+
+struct mps_task_s {
+  mps_sched_t*      sched;
+  mps_fun_t*        fun;
+  void*             arg;
+  mp_prompt_t*      prompt;     // the prompt the task runs under (once started)
+  mp_resume_t*      resume;     // the resumption while suspended (NULL if not yet started)
+  void*             context;    // the task context while suspended (see `mp_task_context_get`)
+  mps_action_t      action;     // set by the task before it yields to the worker
+  _Atomic(intptr_t) park;       // `mps_park_t`
+  mps_task_t*       next;       // in the global queue
+};
+
+// A run queue of a worker: only the owner pushes, but anyone can take
+typedef struct mps_runq_s {
+  _Atomic(intptr_t) head;
+  _Atomic(intptr_t) tail;
+  _Atomic(intptr_t) slots[MPS_RUNQ_SIZE];   // `mps_task_t*`
+} mps_runq_t;
+
+struct mps_worker_s {
+  mps_sched_t*      sched;
+  int               id;
+  mps_task_t*       current;    // the task that is running
+  mps_task_t*       runnext;    // runs next (only accessed by the owner)
+  mp_prompt_t*      idle;       // a retained prompt of a finished task, reused by the next fresh task
+  uintptr_t         tick;       // number of tasks run
+  uint64_t          random;     // to pick a victim to steal from
+  mps_stats_t       stats;
+  mps_thread_t      thread;
+  mps_runq_t        runq;
+  uint8_t           padding[64];   // keep run queues on separate cache lines
+};
+
+struct mps_sched_s {
+  int               worker_count;
+  mps_worker_t*     workers;
+  _Atomic(intptr_t) live;         // tasks that have not finished yet
+  _Atomic(intptr_t) done;         // set when all tasks have finished
+  _Atomic(intptr_t) sleepers;     // workers that are (about to go) sleeping
+  _Atomic(intptr_t) global_count; // tasks in the global queue
+  mps_mutex_t       lock;         // protects the global queue and the `epoch`
+  mps_cond_t        wakeup;       // signaled when the `epoch` is incremented
+  intptr_t          epoch;
+  void*             context;      // the initial context of tasks
+  mps_task_t*       global_head;
+  mps_task_t*       global_tail;
+};
+
+// The worker of the current thread
+static mp_decl_thread mps_worker_t* _mps_worker;
+
+// Tasks can migrate between threads so this must not be inlined (or the thread-local
+// address may be reused across a suspension).
+static mp_decl_noinline mps_worker_t* mps_worker(void) {
+  return _mps_worker;
+}
+
+
+//-----------------------------------------------------------------------
+// Tasks
+//-----------------------------------------------------------------------
+
+static mps_task_t* mps_task_create(mps_sched_t* s, mps_fun_t* fun, void* arg) {
+  mps_task_t* t = mp_malloc_safe_tp(mps_task_t);
+  t->sched = s;
+  t->fun = fun;
+  t->arg = arg;
+  t->prompt = NULL;
+  t->resume = NULL;
+  t->context = s->context;
+  t->action = MPS_DONE;
+  mp_atomic_store(&t->park, (intptr_t)MPS_RUNNING);
+  t->next = NULL;
+  return t;
+}
+
+static void* mps_task_start(mp_prompt_t* p, void* arg) {
+  mps_task_t* t = (mps_task_t*)arg;
+  t->prompt = p;
+  #ifdef __cplusplus
+  try {
+    (t->fun)(t->arg);
+  }
+  catch (...) {
+    mp_fatal_message(EINVAL, "unhandled exception in a scheduled task\n");
+  }
+  #else
+  (t->fun)(t->arg);
+  #endif
+  return (void*)(intptr_t)MPS_DONE;
+}
+
+// Runs on the worker that resumed the task
+static void* mps_task_suspended(mp_resume_t* r, void* arg) {
+  mps_task_t* t = (mps_task_t*)arg;
+  t->resume = r;
+  return (void*)(intptr_t)t->action;
+}
+
+static void mps_task_suspend(mps_task_t* t, mps_action_t action) {
+  t->action = action;
+  mp_yield(t->prompt, &mps_task_suspended, t);
+}
+
+
+//-----------------------------------------------------------------------
+// Local run queues
+//-----------------------------------------------------------------------
+
+static mps_task_t* mps_runq_slot(mps_runq_t* q, intptr_t i) {
+  return (mps_task_t*)mp_atomic_load(&q->slots[i & (MPS_RUNQ_SIZE - 1)]);
+}
+
+static void mps_runq_set_slot(mps_runq_t* q, intptr_t i, mps_task_t* t) {
+  mp_atomic_store(&q->slots[i & (MPS_RUNQ_SIZE - 1)], (intptr_t)t);
+}
+
+static bool mps_runq_is_empty(mps_runq_t* q) {
+  const intptr_t h = mp_atomic_load(&q->head);
+  return (h == mp_atomic_load(&q->tail));
+}
+
+// Take from the head (by the owner or a thief)
+static mps_task_t* mps_runq_pop(mps_runq_t* q) {
+  while (true) {
+    intptr_t h = mp_atomic_load(&q->head);
+    const intptr_t t = mp_atomic_load(&q->tail);
+    if (h == t) return NULL;
+    mps_task_t* task = mps_runq_slot(q, h);
+    if (mp_atomic_cas(&q->head, &h, h + 1)) return task;
+  }
+}
+
+// Push at the tail (by the owner only); returns false if the queue is full
+static bool mps_runq_try_push(mps_runq_t* q, mps_task_t* task) {
+  const intptr_t h = mp_atomic_load(&q->head);
+  const intptr_t t = mp_atomic_load(&q->tail);
+  if (t - h >= MPS_RUNQ_SIZE) return false;
+  mps_runq_set_slot(q, t, task);
+  mp_atomic_store(&q->tail, t + 1);
+  return true;
+}
+
+// Steal half of the tasks of `victim` into the (empty) run queue `q` of the thief;
+// returns one of the stolen tasks to run right away.
+static mps_task_t* mps_runq_steal(mps_runq_t* q, mps_runq_t* victim) {
+  const intptr_t qt = mp_atomic_load(&q->tail);
+  intptr_t n;
+  while (true) {
+    intptr_t h = mp_atomic_load(&victim->head);
+    const intptr_t t = mp_atomic_load(&victim->tail);
+    n = t - h;
+    n = n - n/2;
+    if (n <= 0) return NULL;
+    // copy into our slots beyond our tail (not visible to others until we update the tail)
+    for (intptr_t i = 0; i < n; i++) {
+      mps_runq_set_slot(q, qt + i, mps_runq_slot(victim, h + i));
+    }
+    if (mp_atomic_cas(&victim->head, &h, h + n)) break;
+  }
+  n--;
+  mps_task_t* task = mps_runq_slot(q, qt + n);
+  if (n > 0) mp_atomic_store(&q->tail, qt + n);
+  return task;
+}
+
+
+//-----------------------------------------------------------------------
+// Global queue and sleeping workers
+//-----------------------------------------------------------------------
+
+static void mps_global_push(mps_sched_t* s, mps_task_t* first, mps_task_t* last, intptr_t count) {
+  last->next = NULL;
+  mps_mutex_lock(&s->lock);
+  if (s->global_tail == NULL) { s->global_head = first; }
+                         else { s->global_tail->next = first; }
+  s->global_tail = last;
+  mp_atomic_add(&s->global_count, count);
+  mps_mutex_unlock(&s->lock);
+}
+
+// Take a task from the global queue, and move a fair share of the rest to our run queue.
+static mps_task_t* mps_global_pop(mps_worker_t* w) {
+  mps_sched_t* s = w->sched;
+  if (mp_atomic_load(&s->global_count) == 0) return NULL;
+  mps_mutex_lock(&s->lock);
+  mps_task_t* task = s->global_head;
+  if (task != NULL) {
+    intptr_t taken = 1;
+    intptr_t share = mp_min(mp_atomic_load(&s->global_count) / s->worker_count, MPS_RUNQ_SIZE/2);
+    mps_task_t* t = task->next;
+    while (t != NULL && share-- > 0 && mps_runq_try_push(&w->runq, t)) {
+      t = t->next;
+      taken++;
+    }
+    s->global_head = t;
+    if (t == NULL) s->global_tail = NULL;
+    mp_atomic_add(&s->global_count, -taken);
+  }
+  mps_mutex_unlock(&s->lock);
+  return task;
+}
+
+// Wake up a sleeping worker (if any)
+static void mps_wake(mps_sched_t* s) {
+  if (mp_atomic_load(&s->sleepers) == 0) return;
+  mps_mutex_lock(&s->lock);
+  s->epoch++;
+  mps_cond_signal(&s->wakeup);
+  mps_mutex_unlock(&s->lock);
+}
+
+static bool mps_has_work(mps_sched_t* s) {
+  if (mp_atomic_load(&s->global_count) > 0) return true;
+  for (int i = 0; i < s->worker_count; i++) {
+    if (!mps_runq_is_empty(&s->workers[i].runq)) return true;
+  }
+  return false;
+}
+
+// Sleep until woken up; returns false if the scheduler is done.
+static bool mps_sleep(mps_worker_t* w) {
+  mps_sched_t* s = w->sched;
+  mps_mutex_lock(&s->lock);
+  const intptr_t epoch = s->epoch;
+  mp_atomic_add(&s->sleepers, 1);
+  mps_mutex_unlock(&s->lock);
+  // a task pushed from now on sees us as a sleeper and increments the epoch,
+  // so checking for work once more avoids missing a wakeup
+  const bool work = mps_has_work(s);
+  mps_mutex_lock(&s->lock);
+  if (!work) {
+    w->stats.sleeps++;
+    while (s->epoch == epoch && mp_atomic_load(&s->done) == 0) {
+      mps_cond_wait(&s->wakeup, &s->lock);
+    }
+  }
+  mp_atomic_add(&s->sleepers, -1);
+  mps_mutex_unlock(&s->lock);
+  return (mp_atomic_load(&s->done) == 0);
+}
+
+static void mps_finish(mps_sched_t* s) {
+  mps_mutex_lock(&s->lock);
+  mp_atomic_store(&s->done, (intptr_t)1);
+  mps_cond_broadcast(&s->wakeup);
+  mps_mutex_unlock(&s->lock);
+}
+
+// Make a task runnable
+static void mps_enqueue(mps_sched_t* s, mps_task_t* task) {
+  mps_worker_t* w = mps_worker();
+  if (w == NULL || w->sched != s || !mps_runq_try_push(&w->runq, task)) {
+    mps_global_push(s, task, task, 1);
+  }
+  mps_wake(s);
+}
+
+// Make a task runnable; from a task on the same scheduler it runs next on this worker
+// (and a previous `runnext` task moves to the run queue).
+static void mps_enqueue_next(mps_sched_t* s, mps_task_t* task) {
+  mps_worker_t* w = mps_worker();
+  if (w != NULL && w->sched == s && w->current != NULL) {
+    mps_task_t* prev = w->runnext;
+    w->runnext = task;
+    if (prev == NULL) return;
+    task = prev;
+  }
+  mps_enqueue(s, task);
+}
+
+
+//-----------------------------------------------------------------------
+// Workers
+//-----------------------------------------------------------------------
+
+static mps_task_t* mps_steal(mps_worker_t* w) {
+  mps_sched_t* s = w->sched;
+  const int n = s->worker_count;
+  if (n <= 1) return NULL;
+  // xorshift to pick a random starting victim
+  w->random ^= w->random << 13;
+  w->random ^= w->random >> 7;
+  w->random ^= w->random << 17;
+  const int start = (int)(w->random % (uint64_t)n);
+  for (int i = 0; i < n; i++) {
+    mps_worker_t* victim = &s->workers[(start + i) % n];
+    if (victim == w) continue;
+    mps_task_t* task = mps_runq_steal(&w->runq, &victim->runq);
+    if (task != NULL) {
+      w->stats.steals++;
+      if (!mps_runq_is_empty(&w->runq)) mps_wake(s);  // let others steal from us
+      return task;
+    }
+  }
+  return NULL;
+}
+
+// Find a task to run; returns NULL when the scheduler is done.
+static mps_task_t* mps_find_task(mps_worker_t* w) {
+  mps_sched_t* s = w->sched;
+  mps_task_t* task;
+  while (mp_atomic_load(&s->done) == 0) {
+    // check the global queue now and then so its tasks are not starved by local ones
+    if ((w->tick % MPS_GLOBAL_TICK) == 0 && (task = mps_global_pop(w)) != NULL) return task;
+    if ((task = w->runnext) != NULL) {
+      w->runnext = NULL;
+      return task;
+    }
+    if ((task = mps_runq_pop(&w->runq)) != NULL) return task;
+    if ((task = mps_global_pop(w)) != NULL) return task;
+    for (int i = 0; i < MPS_SPIN_ROUNDS && mp_atomic_load(&s->done) == 0; i++) {
+      if ((task = mps_steal(w)) != NULL) return task;
+      if ((task = mps_global_pop(w)) != NULL) return task;
+      mp_atomic_yield();
+    }
+    if (!mps_sleep(w)) break;
+  }
+  return NULL;
+}
+
+// Run a task until it suspends or finishes
+static void mps_task_run(mps_worker_t* w, mps_task_t* t) {
+  w->current = t;
+  w->tick++;
+  w->stats.switches++;
+  void* context = mp_task_context_get();
+  mp_task_context_set(t->context);
+  mps_action_t action;
+  if (t->resume == NULL) {
+    // start on a warm stack if we have one
+    mp_prompt_t* p = w->idle;
+    if (p != NULL) { w->idle = NULL; }
+              else { p = mp_prompt_retain(mp_prompt_create()); }
+    action = (mps_action_t)(intptr_t)mp_prompt_enter(p, &mps_task_start, t);
+  }
+  else {
+    mp_resume_t* r = t->resume;
+    t->resume = NULL;
+    action = (mps_action_t)(intptr_t)mp_resume(r, NULL);
+  }
+  t->context = mp_task_context_get();   // before a parked task can be resumed elsewhere
+  mp_task_context_set(context);
+  w->current = NULL;
+  switch (action) {
+    case MPS_DONE: {
+      // keep the (now idle) prompt of the task for the next one
+      if (w->idle == NULL) { w->idle = t->prompt; }
+                      else { mp_prompt_release(t->prompt); }
+      mps_sched_t* s = t->sched;
+      mp_free(t);
+      if (mp_atomic_add(&s->live, (intptr_t)-1) == 1) mps_finish(s);
+      break;
+    }
+    case MPS_YIELD: {
+      if (!mps_runq_try_push(&w->runq, t)) mps_global_push(w->sched, t, t, 1);
+      break;
+    }
+    case MPS_PARK: {
+      // unless it was unparked in the meantime, the task can be resumed by anyone from now on
+      intptr_t expected = MPS_RUNNING;
+      if (!mp_atomic_cas(&t->park, &expected, (intptr_t)MPS_PARKED)) {
+        mp_assert_internal(expected == MPS_NOTIFIED);
+        mp_atomic_store(&t->park, (intptr_t)MPS_RUNNING);
+        if (!mps_runq_try_push(&w->runq, t)) mps_global_push(w->sched, t, t, 1);
+      }
+      break;
+    }
+    default: mp_unreachable("mps_task_run");
+  }
+}
+
+static void mps_worker_run(mps_worker_t* w) {
+  mps_worker_t* prev = _mps_worker;   // when `mps_run` is called from a task
+  _mps_worker = w;
+  mps_task_t* task;
+  while ((task = mps_find_task(w)) != NULL) {
+    mps_task_run(w, task);
+  }
+  mp_prompt_release(w->idle);
+  w->idle = NULL;
+  _mps_worker = prev;
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI mps_thread_start(LPVOID arg) {
+  mps_worker_run((mps_worker_t*)arg);
+  return 0;
+}
+#else
+static void* mps_thread_start(void* arg) {
+  mps_worker_run((mps_worker_t*)arg);
+  return NULL;
+}
+#endif
+
+
+//-----------------------------------------------------------------------
+// Interface
+//-----------------------------------------------------------------------
+
+mps_config_t mps_config_default(void) {
+  mps_config_t config;
+  config.workers = 0;
+  return config;
+}
+
+void mps_run(const mps_config_t* config, mps_fun_t* fun, void* arg, mps_stats_t* stats) {
+  mps_config_t cfg = (config != NULL ? *config : mps_config_default());
+  mps_sched_t s;
+  s.worker_count = (cfg.workers > 0 ? cfg.workers : mps_cpu_count());
+  s.workers = (mps_worker_t*)mp_zalloc_safe((size_t)s.worker_count * sizeof(mps_worker_t));
+  mp_atomic_store(&s.live, (intptr_t)1);
+  mp_atomic_store(&s.done, (intptr_t)0);
+  mp_atomic_store(&s.sleepers, (intptr_t)0);
+  mp_atomic_store(&s.global_count, (intptr_t)0);
+  mps_mutex_init(&s.lock);
+  mps_cond_init(&s.wakeup);
+  s.epoch = 0;
+  s.context = mp_task_context_get();
+  s.global_head = s.global_tail = NULL;
+  for (int i = 0; i < s.worker_count; i++) {
+    mps_worker_t* w = &s.workers[i];
+    w->sched = &s;
+    w->id = i;
+    w->random = 0x9E3779B97F4A7C15ULL * (uint64_t)(i + 1);
+  }
+
+  // the first task starts on the calling thread
+  mps_task_t* task = mps_task_create(&s, fun, arg);
+  mps_runq_try_push(&s.workers[0].runq, task);
+  int started = 1;
+  for (; started < s.worker_count; started++) {
+    if (!mps_thread_create(&s.workers[started].thread, &s.workers[started])) {
+      mp_error_message(EAGAIN, "unable to create a scheduler worker thread (running with %d workers)\n", started);
+      break;
+    }
+  }
+  mps_worker_run(&s.workers[0]);
+  for (int i = 1; i < started; i++) {
+    mps_thread_join(s.workers[i].thread);
+  }
+
+  if (stats != NULL) {
+    stats->spawns = stats->switches = stats->steals = stats->sleeps = 0;
+    for (int i = 0; i < s.worker_count; i++) {
+      const mps_stats_t* ws = &s.workers[i].stats;
+      stats->spawns += ws->spawns;
+      stats->switches += ws->switches;
+      stats->steals += ws->steals;
+      stats->sleeps += ws->sleeps;
+    }
+  }
+  mps_cond_done(&s.wakeup);
+  mps_mutex_done(&s.lock);
+  mp_free(s.workers);
+}
+
+static mps_worker_t* mps_worker_in_task(const char* fun) {
+  mps_worker_t* w = mps_worker();
+  if (w == NULL || w->current == NULL) {
+    mp_fatal_message(EINVAL, "%s can only be called from a scheduled task\n", fun);
+  }
+  return w;
+}
+
+void mps_spawn(mps_fun_t* fun, void* arg) {
+  mps_worker_t* w = mps_worker_in_task("mps_spawn");
+  mps_sched_t* s = w->sched;
+  w->stats.spawns++;
+  mp_atomic_add(&s->live, (intptr_t)1);
+  mps_enqueue(s, mps_task_create(s, fun, arg));
+}
+
+void mps_yield_now(void) {
+  mps_task_suspend(mps_worker_in_task("mps_yield_now")->current, MPS_YIELD);
+}
+
+void mps_park(void) {
+  mps_task_t* t = mps_worker_in_task("mps_park")->current;
+  intptr_t expected = MPS_NOTIFIED;
+  if (mp_atomic_cas(&t->park, &expected, (intptr_t)MPS_RUNNING)) return;  // consume an earlier unpark
+  mps_task_suspend(t, MPS_PARK);
+}
+
+void mps_unpark(mps_task_t* t) {
+  intptr_t state = mp_atomic_load(&t->park);
+  while (true) {
+    if (state == MPS_NOTIFIED) return;
+    if (state == MPS_RUNNING) {
+      // running (or in the middle of parking): let the next park return right away
+      if (mp_atomic_cas(&t->park, &state, (intptr_t)MPS_NOTIFIED)) return;
+    }
+    else {
+      mp_assert_internal(state == MPS_PARKED);
+      if (mp_atomic_cas(&t->park, &state, (intptr_t)MPS_RUNNING)) {
+        mps_enqueue_next(t->sched, t);
+        return;
+      }
+    }
+  }
+}
+
+mps_task_t* mps_current(void) {
+  mps_worker_t* w = mps_worker();
+  return (w == NULL ? NULL : w->current);
+}
+
+int mps_worker_id(void) {
+  mps_worker_t* w = mps_worker();
+  return (w == NULL ? -1 : w->id);
+}
+
+int mps_worker_count(void) {
+  mps_worker_t* w = mps_worker();
+  return (w == NULL ? 0 : w->sched->worker_count);
+}
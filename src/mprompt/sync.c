@@ -0,0 +1,310 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Mutex, semaphore, condition variable, and barrier for scheduled tasks.
+
+  Each primitive has a (short) internal lock that protects its state and
+  an intrusive queue of waiters that live on the stacks of parked tasks.
+  As with channels (`chan.c`), a waker sets the `granted` flag and unparks
+  the task with the internal lock held, and the woken task acquires the
+  internal lock once more before it returns, so its waiter (and the task
+  itself) stay alive until the waker is done with them.
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <errno.h>
+
+#include "mprompt.h"
+#include "mp_sched.h"
+#include "mp_sync.h"
+#include "internal/util.h"
+#include "internal/atomic.h"
+
+//-----------------------------------------------------------------------
+// Wait queues
+//-----------------------------------------------------------------------
+
+typedef struct mp_sync_waiter_s {
+  mps_task_t*              task;
+  _Atomic(intptr_t)        granted;
+  struct mp_sync_waiter_s* next;
+} mp_sync_waiter_t;
+
+typedef struct mp_sync_waitq_s {
+  mp_sync_order_t   order;
+  mp_sync_waiter_t* head;
+  mp_sync_waiter_t* tail;
+} mp_sync_waitq_t;
+
+static void mp_sync_waitq_init(mp_sync_waitq_t* q, mp_sync_order_t order) {
+  q->order = order;
+  q->head = q->tail = NULL;
+}
+
+static void mp_sync_waitq_push(mp_sync_waitq_t* q, mp_sync_waiter_t* w) {
+  if (q->order == MP_SYNC_LIFO) {
+    w->next = q->head;
+    q->head = w;
+    if (q->tail == NULL) q->tail = w;
+  }
+  else {
+    w->next = NULL;
+    if (q->tail == NULL) { q->head = w; }
+                    else { q->tail->next = w; }
+    q->tail = w;
+  }
+}
+
+static mp_sync_waiter_t* mp_sync_waitq_pop(mp_sync_waitq_t* q) {
+  mp_sync_waiter_t* w = q->head;
+  if (w != NULL) {
+    q->head = w->next;
+    if (q->head == NULL) q->tail = NULL;
+  }
+  return w;
+}
+
+// Wake up a dequeued waiter (with the internal lock held)
+static void mp_sync_grant(mp_sync_waiter_t* w) {
+  mps_task_t* task = w->task;
+  mp_atomic_store(&w->granted, (intptr_t)1);
+  mps_unpark(task);
+}
+
+// Enqueue a waiter for the current task (with the internal lock held)
+static void mp_sync_enqueue(mps_mutex_t* lock, mp_sync_waitq_t* q, mp_sync_waiter_t* w, const char* fun) {
+  w->task = mps_current();
+  if (w->task == NULL) {
+    mps_mutex_unlock(lock);
+    mp_fatal_message(EINVAL, "%s can only wait in a scheduled task\n", fun);
+    return;
+  }
+  mp_atomic_store(&w->granted, (intptr_t)0);
+  mp_sync_waitq_push(q, w);
+}
+
+// Park the current task until its waiter is granted (with the internal lock released)
+static void mp_sync_park(mps_mutex_t* lock, mp_sync_waiter_t* w) {
+  while (mp_atomic_load(&w->granted) == 0) {
+    mps_park();
+  }
+  mps_mutex_lock(lock);     // wait until the waker released the lock
+  mps_mutex_unlock(lock);
+}
+
+// Wait until granted; `lock` is held on entry and released on return.
+static void mp_sync_wait(mps_mutex_t* lock, mp_sync_waitq_t* q, const char* fun) {
+  mp_sync_waiter_t w;
+  mp_sync_enqueue(lock, q, &w, fun);
+  mps_mutex_unlock(lock);
+  mp_sync_park(lock, &w);
+}
+
+
+//-----------------------------------------------------------------------
+// Mutex
+//-----------------------------------------------------------------------
+
+struct mp_mutex_s {
+  mps_mutex_t      lock;
+  bool             locked;
+  mp_sync_waitq_t  waiters;
+};
+
+mp_mutex_t* mp_mutex_create(mp_sync_order_t order) {
+  mp_mutex_t* m = mp_zalloc_safe_tp(mp_mutex_t);
+  mps_mutex_init(&m->lock);
+  mp_sync_waitq_init(&m->waiters, order);
+  return m;
+}
+
+void mp_mutex_free(mp_mutex_t* m) {
+  if (m == NULL) return;
+  mp_assert(!m->locked && m->waiters.head == NULL);
+  mps_mutex_done(&m->lock);
+  mp_free(m);
+}
+
+void mp_mutex_lock(mp_mutex_t* m) {
+  mps_mutex_lock(&m->lock);
+  if (!m->locked) {
+    m->locked = true;
+    mps_mutex_unlock(&m->lock);
+    return;
+  }
+  mp_sync_wait(&m->lock, &m->waiters, "mp_mutex_lock");  // the mutex is handed over to us
+}
+
+bool mp_mutex_try_lock(mp_mutex_t* m) {
+  mps_mutex_lock(&m->lock);
+  const bool acquired = !m->locked;
+  m->locked = true;
+  mps_mutex_unlock(&m->lock);
+  return acquired;
+}
+
+void mp_mutex_unlock(mp_mutex_t* m) {
+  mps_mutex_lock(&m->lock);
+  mp_assert(m->locked);
+  mp_sync_waiter_t* w = mp_sync_waitq_pop(&m->waiters);
+  if (w != NULL) {
+    mp_sync_grant(w);   // stays locked
+  }
+  else {
+    m->locked = false;
+  }
+  mps_mutex_unlock(&m->lock);
+}
+
+
+//-----------------------------------------------------------------------
+// Semaphore
+//-----------------------------------------------------------------------
+
+struct mp_sema_s {
+  mps_mutex_t      lock;
+  size_t           count;
+  mp_sync_waitq_t  waiters;
+};
+
+mp_sema_t* mp_sema_create(size_t count, mp_sync_order_t order) {
+  mp_sema_t* s = mp_zalloc_safe_tp(mp_sema_t);
+  mps_mutex_init(&s->lock);
+  s->count = count;
+  mp_sync_waitq_init(&s->waiters, order);
+  return s;
+}
+
+void mp_sema_free(mp_sema_t* s) {
+  if (s == NULL) return;
+  mp_assert(s->waiters.head == NULL);
+  mps_mutex_done(&s->lock);
+  mp_free(s);
+}
+
+void mp_sema_acquire(mp_sema_t* s) {
+  mps_mutex_lock(&s->lock);
+  if (s->count > 0) {
+    s->count--;
+    mps_mutex_unlock(&s->lock);
+    return;
+  }
+  mp_sync_wait(&s->lock, &s->waiters, "mp_sema_acquire");  // a unit is handed over to us
+}
+
+bool mp_sema_try_acquire(mp_sema_t* s) {
+  mps_mutex_lock(&s->lock);
+  const bool acquired = (s->count > 0);
+  if (acquired) s->count--;
+  mps_mutex_unlock(&s->lock);
+  return acquired;
+}
+
+void mp_sema_release(mp_sema_t* s) {
+  mps_mutex_lock(&s->lock);
+  mp_sync_waiter_t* w = mp_sync_waitq_pop(&s->waiters);
+  if (w != NULL) {
+    mp_sync_grant(w);
+  }
+  else {
+    s->count++;
+  }
+  mps_mutex_unlock(&s->lock);
+}
+
+
+//-----------------------------------------------------------------------
+// Condition variable
+//-----------------------------------------------------------------------
+
+struct mp_cond_s {
+  mps_mutex_t      lock;
+  mp_sync_waitq_t  waiters;
+};
+
+mp_cond_t* mp_cond_create(mp_sync_order_t order) {
+  mp_cond_t* c = mp_zalloc_safe_tp(mp_cond_t);
+  mps_mutex_init(&c->lock);
+  mp_sync_waitq_init(&c->waiters, order);
+  return c;
+}
+
+void mp_cond_free(mp_cond_t* c) {
+  if (c == NULL) return;
+  mp_assert(c->waiters.head == NULL);
+  mps_mutex_done(&c->lock);
+  mp_free(c);
+}
+
+void mp_cond_wait(mp_cond_t* c, mp_mutex_t* m) {
+  // we are in the wait queue before we release the mutex, so no signal is missed
+  mp_sync_waiter_t w;
+  mps_mutex_lock(&c->lock);
+  mp_sync_enqueue(&c->lock, &c->waiters, &w, "mp_cond_wait");
+  mps_mutex_unlock(&c->lock);
+  mp_mutex_unlock(m);
+  mp_sync_park(&c->lock, &w);
+  mp_mutex_lock(m);
+}
+
+void mp_cond_signal(mp_cond_t* c) {
+  mps_mutex_lock(&c->lock);
+  mp_sync_waiter_t* w = mp_sync_waitq_pop(&c->waiters);
+  if (w != NULL) mp_sync_grant(w);
+  mps_mutex_unlock(&c->lock);
+}
+
+void mp_cond_broadcast(mp_cond_t* c) {
+  mps_mutex_lock(&c->lock);
+  mp_sync_waiter_t* w;
+  while ((w = mp_sync_waitq_pop(&c->waiters)) != NULL) {
+    mp_sync_grant(w);
+  }
+  mps_mutex_unlock(&c->lock);
+}
+
+
+//-----------------------------------------------------------------------
+// Barrier
+//-----------------------------------------------------------------------
+
+struct mp_barrier_s {
+  mps_mutex_t      lock;
+  size_t           count;
+  size_t           arrived;
+  mp_sync_waitq_t  waiters;
+};
+
+mp_barrier_t* mp_barrier_create(size_t count) {
+  mp_barrier_t* b = mp_zalloc_safe_tp(mp_barrier_t);
+  mps_mutex_init(&b->lock);
+  b->count = (count == 0 ? 1 : count);
+  mp_sync_waitq_init(&b->waiters, MP_SYNC_FIFO);
+  return b;
+}
+
+void mp_barrier_free(mp_barrier_t* b) {
+  if (b == NULL) return;
+  mp_assert(b->waiters.head == NULL);
+  mps_mutex_done(&b->lock);
+  mp_free(b);
+}
+
+bool mp_barrier_wait(mp_barrier_t* b) {
+  mps_mutex_lock(&b->lock);
+  b->arrived++;
+  if (b->arrived < b->count) {
+    mp_sync_wait(&b->lock, &b->waiters, "mp_barrier_wait");
+    return false;
+  }
+  // the last one releases everyone (and resets the barrier for the next round)
+  b->arrived = 0;
+  mp_sync_waiter_t* w;
+  while ((w = mp_sync_waitq_pop(&b->waiters)) != NULL) {
+    mp_sync_grant(w);
+  }
+  mps_mutex_unlock(&b->lock);
+  return true;
+}
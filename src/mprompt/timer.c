@@ -0,0 +1,145 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Hierarchical timer wheel (as in "Hashed and hierarchical timing wheels",
+  Varghese and Lauck, 1987).
+
+  There are `MP_WHEEL_LEVELS` levels of 64 slots where a slot at level `n`
+  covers 64^n ticks (of a millisecond). A timer is inserted at the level
+  that covers its remaining time, and when the lower level wraps around,
+  the timers in the current slot of the next level are re-inserted at lower
+  levels (cascading). Each slot is a circular doubly linked list of
+  intrusive timers so inserting and cancelling are O(1). Timers that are
+  further out than the wheel covers (about 4.6 hours) are put in the last
+  slot of the top level and re-inserted when they cascade.
+-----------------------------------------------------------------------------*/
+#if defined(MP_USE_IO) && defined(__linux__)
+#include "mp_io.h"
+
+#define MP_WHEEL_BITS    (6)
+#define MP_WHEEL_SLOTS   (1 << MP_WHEEL_BITS)
+#define MP_WHEEL_MASK    (MP_WHEEL_SLOTS - 1)
+#define MP_WHEEL_LEVELS  (4)
+
+typedef struct mp_wheel_s {
+  mp_msecs_t  next_tick;     // the next tick to expire (all earlier ticks are done)
+  long        count;         // number of pending timers
+  mp_timer_t  slots[MP_WHEEL_LEVELS][MP_WHEEL_SLOTS];   // sentinels of circular lists
+} mp_wheel_t;
+
+static void mp_wheel_init(mp_wheel_t* w, mp_msecs_t now) {
+  w->next_tick = now;
+  w->count = 0;
+  for (int level = 0; level < MP_WHEEL_LEVELS; level++) {
+    for (int i = 0; i < MP_WHEEL_SLOTS; i++) {
+      mp_timer_t* s = &w->slots[level][i];
+      s->next = s->prev = s;
+    }
+  }
+}
+
+static void mp_wheel_link(mp_wheel_t* w, mp_timer_t* t) {
+  const mp_msecs_t expire = t->expire;
+  const mp_msecs_t delta  = expire - w->next_tick;
+  mp_timer_t* slot;
+  if (delta < 0) {
+    // already expired: fire at the next tick
+    slot = &w->slots[0][w->next_tick & MP_WHEEL_MASK];
+  }
+  else {
+    int level = 0;
+    while (level < MP_WHEEL_LEVELS - 1 && delta >= ((mp_msecs_t)1 << (MP_WHEEL_BITS * (level + 1)))) {
+      level++;
+    }
+    mp_msecs_t at = expire;
+    const mp_msecs_t max_delta = ((mp_msecs_t)1 << (MP_WHEEL_BITS * MP_WHEEL_LEVELS)) - 1;
+    if (delta > max_delta) at = w->next_tick + max_delta;   // re-inserted when it cascades
+    slot = &w->slots[level][(at >> (MP_WHEEL_BITS * level)) & MP_WHEEL_MASK];
+  }
+  t->prev = slot->prev;
+  t->next = slot;
+  slot->prev->next = t;
+  slot->prev = t;
+}
+
+static void mp_wheel_unlink(mp_timer_t* t) {
+  t->prev->next = t->next;
+  t->next->prev = t->prev;
+  t->next = t->prev = NULL;
+}
+
+static void mp_wheel_insert(mp_wheel_t* w, mp_timer_t* t) {
+  mp_wheel_link(w, t);
+  w->count++;
+}
+
+static void mp_wheel_remove(mp_wheel_t* w, mp_timer_t* t) {
+  mp_wheel_unlink(t);
+  w->count--;
+}
+
+// Unlink all pending timers (when the reactor finishes)
+static void mp_wheel_clear(mp_wheel_t* w) {
+  for (int level = 0; level < MP_WHEEL_LEVELS; level++) {
+    for (int i = 0; i < MP_WHEEL_SLOTS; i++) {
+      mp_timer_t* s = &w->slots[level][i];
+      while (s->next != s) mp_wheel_unlink(s->next);
+    }
+  }
+  w->count = 0;
+}
+
+// Re-insert the timers of a slot at `level` (which now fall in lower levels);
+// returns the index of the slot so the caller can cascade the next level when it is 0.
+static int mp_wheel_cascade(mp_wheel_t* w, int level) {
+  const int index = (int)((w->next_tick >> (MP_WHEEL_BITS * level)) & MP_WHEEL_MASK);
+  mp_timer_t* s = &w->slots[level][index];
+  mp_timer_t* t = s->next;
+  s->next = s->prev = s;
+  while (t != s) {
+    mp_timer_t* next = t->next;
+    mp_wheel_link(w, t);
+    t = next;
+  }
+  return index;
+}
+
+// Expire all timers up to and including tick `now`; the timer functions are called after the
+// timer is removed (so they can restart it).
+static void mp_wheel_advance(mp_wheel_t* w, mp_msecs_t now) {
+  while (w->next_tick <= now) {
+    if (w->count == 0) {
+      w->next_tick = now + 1;
+      break;
+    }
+    const int index = (int)(w->next_tick & MP_WHEEL_MASK);
+    if (index == 0) {
+      for (int level = 1; level < MP_WHEEL_LEVELS && mp_wheel_cascade(w, level) == 0; level++) { }
+    }
+    mp_timer_t* s = &w->slots[0][index];
+    while (s->next != s) {
+      mp_timer_t* t = s->next;
+      mp_wheel_remove(w, t);
+      (t->fun)(t->arg);
+    }
+    w->next_tick++;
+  }
+}
+
+// The next tick at which the wheel needs to advance, or -1 if there are no timers.
+// This is exact for timers within the first level, and otherwise the next cascade.
+static mp_msecs_t mp_wheel_next(mp_wheel_t* w) {
+  if (w->count == 0) return -1;
+  const mp_msecs_t base = w->next_tick;
+  const int index = (int)(base & MP_WHEEL_MASK);
+  for (int i = index; i < MP_WHEEL_SLOTS; i++) {
+    const mp_timer_t* s = &w->slots[0][i];
+    if (s->next != s) return base + (i - index);
+  }
+  return (base | MP_WHEEL_MASK) + 1;
+}
+
+#endif
@@ -24,10 +24,11 @@ static void* handle_reader_ask(mpe_resume_t* r, void* local, void* arg) {
 }
  
 void* reader_handle(mpe_actionfun_t action, long init, void* arg) {
-  static const mpe_handlerdef_t reader_hdef = { MPE_EFFECT(reader), NULL, {
+  static const mpe_operation_t reader_ops[] = {
     { MPE_OP_TAIL_NOOP, MPE_OPTAG(reader,ask), &handle_reader_ask },
     { MPE_OP_NULL, mpe_op_null, NULL }
-  } };
+  };
+  static const mpe_handlerdef_t reader_hdef = { MPE_EFFECT(reader), NULL, reader_ops };
   return mpe_handle(&reader_hdef, mpe_voidp_long(init), action, arg);
 }
 
@@ -38,10 +39,10 @@ static void* handle_greader_ask(mpe_resume_t* r, void* local, void* arg) {
 }
  
 void* greader_handle(mpe_actionfun_t action, long init, void* arg) {
-  static const mpe_handlerdef_t greader_hdef = { MPE_EFFECT(reader), NULL, {
+  MPE_HANDLERDEF(greader_hdef, MPE_EFFECT(reader), NULL, {
     { MPE_OP_SCOPED_ONCE, MPE_OPTAG(reader,ask), &handle_greader_ask },
     { MPE_OP_NULL, mpe_op_null, NULL }
-  } };
+  });
   return mpe_handle(&greader_hdef, mpe_voidp_long(init), action, arg);
 }
 
@@ -59,10 +60,11 @@ static void* handle_exn_raise(mpe_resume_t* r, void* local, void* arg) {
 }
 
 void* exn_handle(mpe_actionfun_t action, void* arg) {
-  static const mpe_handlerdef_t exn_hdef = { MPE_EFFECT(exn), NULL, {
+  static const mpe_operation_t exn_ops[] = {
     { MPE_OP_NEVER, MPE_OPTAG(exn,raise), &handle_exn_raise },
     { MPE_OP_NULL, mpe_op_null, NULL }
-  } };
+  };
+  static const mpe_handlerdef_t exn_hdef = { MPE_EFFECT(exn), NULL, exn_ops };
   return mpe_handle(&exn_hdef, NULL, action, arg);
 }
 
@@ -84,11 +86,12 @@ static void* handle_state_set(mpe_resume_t* r, void* local, void* arg) {
   return mpe_resume_tail(r, arg, NULL);
 }
 
-static const mpe_handlerdef_t state_hdef = { MPE_EFFECT(state), NULL, {
+static const mpe_operation_t state_ops[] = {
   { MPE_OP_TAIL_NOOP, MPE_OPTAG(state,get), &handle_state_get },
   { MPE_OP_TAIL_NOOP, MPE_OPTAG(state,set), &handle_state_set },
   { MPE_OP_NULL, mpe_op_null, NULL }
-}};
+};
+static const mpe_handlerdef_t state_hdef = { MPE_EFFECT(state), NULL, state_ops };
 
 void* state_handle(mpe_actionfun_t action, long init, void* arg) {
   return mpe_handle(&state_hdef, mpe_voidp_long(init), action, arg);
@@ -97,31 +100,34 @@ void* state_handle(mpe_actionfun_t action, long init, void* arg) {
 
 // Variants
 
-static const mpe_handlerdef_t ustate_hdef = { MPE_EFFECT(state), NULL, {
+static const mpe_operation_t ustate_ops[] = {
   { MPE_OP_TAIL, MPE_OPTAG(state,get), &handle_state_get },
   { MPE_OP_TAIL, MPE_OPTAG(state,set), &handle_state_set },
   { MPE_OP_NULL, mpe_op_null, NULL }
-} };
+};
+static const mpe_handlerdef_t ustate_hdef = { MPE_EFFECT(state), NULL, ustate_ops };
 
 void* ustate_handle(mpe_actionfun_t action, long init, void* arg) {
   return mpe_handle(&ustate_hdef, mpe_voidp_long(init), action, arg);
 }
 
-static const mpe_handlerdef_t ostate_hdef = { MPE_EFFECT(state), NULL, {
+static const mpe_operation_t ostate_ops[] = {
   { MPE_OP_SCOPED_ONCE, MPE_OPTAG(state,get), &handle_state_get },
   { MPE_OP_SCOPED_ONCE, MPE_OPTAG(state,set), &handle_state_set },
   { MPE_OP_NULL, mpe_op_null, NULL }
-} };
+};
+static const mpe_handlerdef_t ostate_hdef = { MPE_EFFECT(state), NULL, ostate_ops };
 
 void* ostate_handle(mpe_actionfun_t action, long init, void* arg) {
   return mpe_handle(&ostate_hdef, mpe_voidp_long(init), action, arg);
 }
 
-static const mpe_handlerdef_t gstate_hdef = { MPE_EFFECT(state), NULL, {
+static const mpe_operation_t gstate_ops[] = {
   { MPE_OP_MULTI, MPE_OPTAG(state,get), &handle_state_get },
   { MPE_OP_MULTI, MPE_OPTAG(state,set), &handle_state_set },
   { MPE_OP_NULL, mpe_op_null, NULL }
-} };
+};
+static const mpe_handlerdef_t gstate_hdef = { MPE_EFFECT(state), NULL, gstate_ops };
 
 void* gstate_handle(mpe_actionfun_t action, long init, void* arg) {
   return mpe_handle(&gstate_hdef, mpe_voidp_long(init), action, arg);
@@ -152,10 +158,11 @@ static void* handle_amb_flip(mpe_resume_t* rc, void* local, void* arg) {
 }
   
 
-static const mpe_handlerdef_t amb_def = { MPE_EFFECT(amb), &handle_amb_result, {
+static const mpe_operation_t amb_ops[] = {
   { MPE_OP_SCOPED, MPE_OPTAG(amb,flip), &handle_amb_flip },
   { MPE_OP_NULL, mpe_op_null, NULL }
-}};
+};
+static const mpe_handlerdef_t amb_def = { MPE_EFFECT(amb), &handle_amb_result, amb_ops };
 
 blist amb_handle(mpe_actionfun_t* action, void* arg) {
   return mpe_blist_voidp( mpe_handle(&amb_def, NULL, action, arg) );
@@ -198,12 +205,13 @@ static void* handle_choice_choose(mpe_resume_t* rc, void* local, void* arg) {
 }
   
 
-static const mpe_handlerdef_t choice_def = { MPE_EFFECT(choice), &handle_choice_result, {
+static const mpe_operation_t choice_ops[] = {
   { MPE_OP_SCOPED, MPE_OPTAG(choice,choose), &handle_choice_choose },
   { MPE_OP_ABORT,  MPE_OPTAG(choice,fail), &handle_choice_fail },
   //{ MPE_OP_NEVER,  MPE_OPTAG(choice,fail), &handle_choice_fail },  // very slow in C++: nqueens(12) is about 15s vs. 0.6s with abort.
   { MPE_OP_NULL, mpe_op_null, NULL }
-}};
+};
+static const mpe_handlerdef_t choice_def = { MPE_EFFECT(choice), &handle_choice_result, choice_ops };
 
 blist choice_handle(mpe_actionfun_t* action, void* arg) {
   return mpe_blist_voidp( mpe_handle(&choice_def, mpe_voidp_null, action, arg) );
@@ -0,0 +1,131 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test task groups: joining all children, cancelling the remaining children
+  when one fails or cancels the group, and the cost of cancelling many
+  suspended children by unwinding each one or by a bulk drop.
+-----------------------------------------------------------------------------*/
+#include "test.h"
+
+static long finalized;
+static long completed;
+static long turns;
+
+static void finalize(void* local) {
+  UNUSED(local);
+  mpt_assert(reader_ask() == 7, "group: finalizer under the handlers of a child");
+  finalized++;
+}
+
+typedef struct child_s {
+  mpe_group_t* group;
+  long         yields;
+  long         fail_at;       // fail on this turn (or never if negative)
+  long         cancel_at;     // cancel the group on this turn (or never if negative)
+} child_t;
+
+static void* child_body(void* arg) {
+  child_t* c = (child_t*)arg;
+  for (long i = 0; i < c->yields; i++) {
+    turns++;
+    if (i == c->fail_at) mpe_group_fail(c);
+    if (i == c->cancel_at) mpe_group_cancel(c->group);
+    mpe_group_yield();
+    mpt_assert(reader_ask() == 42, "group: reader under a child");
+  }
+  completed++;
+  return NULL;
+}
+
+// a general reader handler (with its own prompt) between the yield and the group handler of the child
+static void* child_reader(void* arg) {
+  return greader_handle(&child_body, 42, arg);
+}
+
+static void* child_finally(void* arg) {
+  return mpe_finally(NULL, &finalize, &child_reader, arg);
+}
+
+// a tail reader handler around the finalizer of a child
+static void* child_action(void* arg) {
+  return reader_handle(&child_finally, 7, arg);
+}
+
+static void* run_group(mpe_group_cancel_t cancel, child_t* children, long n) {
+  finalized = completed = turns = 0;
+  mpe_group_t* g = mpe_group_create(cancel);
+  for (long i = 0; i < n; i++) {
+    children[i].group = g;
+    mpe_group_spawn(g, &child_action, &children[i]);
+  }
+  void* err = mpe_group_join(g);
+  mpe_group_free(g);
+  return err;
+}
+
+static void init_children(child_t* children, long n, long yields) {
+  for (long i = 0; i < n; i++) {
+    children[i].group = NULL;
+    children[i].yields = yields + (i % 3);
+    children[i].fail_at = -1;
+    children[i].cancel_at = -1;
+  }
+}
+
+
+/*-----------------------------------------------------------------
+  testing
+-----------------------------------------------------------------*/
+
+#define N  (100)
+
+static void test(mpe_group_cancel_t cancel, const char* name) {
+  child_t children[N];
+
+  // all children run to completion
+  init_children(children, N, 3);
+  void* err = run_group(cancel, children, N);
+  mpt_assert(err == NULL && completed == N && finalized == N, "group: join");
+
+  // a failing child cancels all others (which all started already)
+  init_children(children, N, 3);
+  children[N/2].fail_at = 1;
+  err = run_group(cancel, children, N);
+  mpt_assert(err == &children[N/2], "group: fail error");
+  mpt_assert(completed == 0 && finalized == N, "group: fail cancels");
+  mpt_assert(turns == N + N/2 + 1, "group: fail turns");
+
+  // the last child cancels the group on its first turn
+  init_children(children, N, 3);
+  children[N-1].cancel_at = 0;
+  err = run_group(cancel, children, N);
+  mpt_assert(err == NULL && completed == 0 && finalized == N, "group: cancel");
+  mpt_printf("group %-6s: %ld finalized\n", name, finalized);
+}
+
+static void bench(mpe_group_cancel_t cancel, const char* name, long n) {
+  child_t* children = (child_t*)malloc((size_t)n * sizeof(child_t));
+  if (children == NULL) return;
+  init_children(children, n, 2);
+  children[n-1].fail_at = 0;
+  void* err = NULL;
+  mpt_bench{ err = run_group(cancel, children, n); }
+  mpt_printf("group %-6s: cancelled %ld children\n", name, finalized);
+  mpt_assert(err == &children[n-1] && finalized == n, "group: bench");
+  free(children);
+}
+
+void group_run(void) {
+  test(MPE_GROUP_UNWIND, "unwind");
+  test(MPE_GROUP_DROP, "drop");
+  #ifdef NDEBUG
+  const long n = 10000L;
+  #else
+  const long n = 1000L;
+  #endif
+  bench(MPE_GROUP_UNWIND, "unwind", n);
+  bench(MPE_GROUP_DROP, "drop", n);
+}
@@ -0,0 +1,83 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test an effect with more than 8 operations of various kinds.
+-----------------------------------------------------------------------------*/
+#include "test.h"
+
+/*-----------------------------------------------------------------
+  Define operations
+-----------------------------------------------------------------*/
+MPE_DEFINE_EFFECT10(regs, r0, r1, r2, r3, r4, r5, r6, r7, r8, r9)
+MPE_DEFINE_OP1(regs, r0, long, long)
+MPE_DEFINE_OP1(regs, r1, long, long)
+MPE_DEFINE_OP1(regs, r2, long, long)
+MPE_DEFINE_OP1(regs, r3, long, long)
+MPE_DEFINE_OP1(regs, r4, long, long)
+MPE_DEFINE_OP1(regs, r5, long, long)
+MPE_DEFINE_OP1(regs, r6, long, long)
+MPE_DEFINE_OP1(regs, r7, long, long)
+MPE_DEFINE_OP1(regs, r8, long, long)
+MPE_DEFINE_OP1(regs, r9, long, long)
+
+// Each operation `ri(x)` returns `local*x + i`
+#define MPE_REGS_OP(i) \
+  static void* handle_regs_r##i(mpe_resume_t* r, void* local, void* arg) { \
+    return mpe_resume_tail(r, local, mpe_voidp_long(mpe_long_voidp(local)*mpe_long_voidp(arg) + i)); \
+  }
+
+MPE_REGS_OP(0) MPE_REGS_OP(1) MPE_REGS_OP(2) MPE_REGS_OP(3) MPE_REGS_OP(4)
+MPE_REGS_OP(5) MPE_REGS_OP(6) MPE_REGS_OP(7) MPE_REGS_OP(8) MPE_REGS_OP(9)
+
+static const mpe_operation_t regs_ops[] = {
+  { MPE_OP_TAIL_NOOP,   MPE_OPTAG(regs,r0), &handle_regs_r0 },
+  { MPE_OP_TAIL,        MPE_OPTAG(regs,r1), &handle_regs_r1 },
+  { MPE_OP_SCOPED_ONCE, MPE_OPTAG(regs,r2), &handle_regs_r2 },
+  { MPE_OP_ONCE,        MPE_OPTAG(regs,r3), &handle_regs_r3 },
+  { MPE_OP_MULTI,       MPE_OPTAG(regs,r4), &handle_regs_r4 },
+  { MPE_OP_TAIL_NOOP,   MPE_OPTAG(regs,r5), &handle_regs_r5 },
+  { MPE_OP_TAIL,        MPE_OPTAG(regs,r6), &handle_regs_r6 },
+  { MPE_OP_SCOPED_ONCE, MPE_OPTAG(regs,r7), &handle_regs_r7 },
+  { MPE_OP_TAIL_NOOP,   MPE_OPTAG(regs,r8), &handle_regs_r8 },
+  { MPE_OP_SCOPED,      MPE_OPTAG(regs,r9), &handle_regs_r9 },
+  { MPE_OP_NULL, mpe_op_null, NULL }
+};
+static const mpe_handlerdef_t regs_hdef = { MPE_EFFECT(regs), NULL, regs_ops };
+
+/*-----------------------------------------------------------------
+  Example programs
+-----------------------------------------------------------------*/
+
+static void* regs_action(void* arg) {
+  long n = mpe_long_voidp(arg);
+  long sum = 0;
+  for (long x = 0; x < n; x++) {
+    sum += regs_r0(x) + regs_r1(x) + regs_r2(x) + regs_r3(x) + regs_r4(x);
+    sum += regs_r5(x) + regs_r6(x) + regs_r7(x) + regs_r8(x) + regs_r9(x);
+  }
+  return mpe_voidp_long(sum);
+}
+
+/*-----------------------------------------------------------------
+  testing
+-----------------------------------------------------------------*/
+static void test(long n) {
+  const long k = 2;
+  long res = 0;
+  mpt_bench{ res = mpe_long_voidp(mpe_handle(&regs_hdef, mpe_voidp_long(k), &regs_action, mpe_voidp_long(n))); }
+  mpt_printf("manyops   : %ld\n", res);
+  long expect = 10*(k*(n*(n-1)/2)) + n*45;
+  mpt_assert(res == expect, "manyops");
+  mpt_assert(strcmp(mpe_optag_name(MPE_OPTAG(regs,r9)), "regs/r9") == 0, "manyops: name");
+}
+
+void manyops_run(void) {
+#ifdef NDEBUG
+  test(10000L);
+#else
+  test(1000L);
+#endif
+}
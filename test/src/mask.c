@@ -0,0 +1,120 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test handler lookup under deep nesting, masking, and `under` frames;
+  alternating between contexts in a loop ensures cached lookups stay valid.
+-----------------------------------------------------------------------------*/
+#include "test.h"
+
+#define DEPTH  (24)
+
+/*-----------------------------------------------------------------
+  Masking
+-----------------------------------------------------------------*/
+
+static void* ask_action(void* arg) {
+  UNUSED(arg);
+  return mpe_voidp_long(reader_ask());
+}
+
+static void* mask1_action(void* arg) {
+  return mpe_mask(MPE_EFFECT(reader), 0, &ask_action, arg);
+}
+
+static void* mask2_action(void* arg) {
+  return mpe_mask(MPE_EFFECT(reader), 0, &mask1_action, arg);
+}
+
+// a mask with `from == 1` only applies if an inner mask is already active
+static void* mask_from_action(void* arg) {
+  return mpe_mask(MPE_EFFECT(reader), 1, &ask_action, arg);
+}
+
+static void* mask_from_mask_action(void* arg) {
+  return mpe_mask(MPE_EFFECT(reader), 1, &mask1_action, arg);
+}
+
+static void* masked_loop(void* arg) {
+  long n = mpe_long_voidp(arg);
+  long sum = 0;
+  for (long i = 0; i < n; i++) {
+    long x = reader_ask();
+    long y = mpe_long_voidp(mask1_action(NULL));
+    long z = mpe_long_voidp(mask2_action(NULL));
+    long w = mpe_long_voidp(mask_from_action(NULL));
+    long v = mpe_long_voidp(mask_from_mask_action(NULL));
+    mpt_assert(x == 3 && y == 2 && z == 1 && w == 3 && v == 1, "mask: wrong handler");
+    sum += x + y + z;
+  }
+  return mpe_voidp_long(sum);
+}
+
+static void* reader2_action(void* arg) {
+  return reader_handle(&masked_loop, 3, arg);
+}
+
+static void* reader1_action(void* arg) {
+  return reader_handle(&reader2_action, 2, arg);
+}
+
+
+/*-----------------------------------------------------------------
+  Deep nesting of state handlers under other effects
+-----------------------------------------------------------------*/
+
+static void* deep_loop(void* arg) {
+  long n = mpe_long_voidp(arg);
+  long count = 0;
+  long i;
+  while ((i = state_get()) > 0) {
+    mpt_assert(reader_ask() == 1, "deep: wrong reader");
+    state_set(i - 1);
+    count++;
+  }
+  mpt_assert(count == n, "deep: wrong count");
+  return mpe_voidp_long(count);
+}
+
+typedef struct deep_env_s {
+  long depth;
+  long n;
+} deep_env_t;
+
+static void* deep_nest(void* arg) {
+  deep_env_t* env = (deep_env_t*)arg;
+  if (env->depth <= 0) {
+    // innermost: a `tail` state handler whose operations run under an `under` frame
+    return ustate_handle(&deep_loop, env->n, mpe_voidp_long(env->n));
+  }
+  env->depth--;
+  // alternate unrelated handlers to make the frame chain deep
+  return (env->depth % 2 == 0 ? state_handle(&deep_nest, 0, env) : exn_handle(&deep_nest, env));
+}
+
+
+/*-----------------------------------------------------------------
+  testing
+-----------------------------------------------------------------*/
+
+static void test(long n) {
+  long res = 0;
+  mpt_bench{ res = mpe_long_voidp(reader_handle(&reader1_action, 1, mpe_voidp_long(n))); }
+  mpt_printf("mask      : %ld\n", res);
+  mpt_assert(res == 6*n, "mask");
+
+  deep_env_t env = { DEPTH, n };
+  mpt_bench{ res = mpe_long_voidp(reader_handle(&deep_nest, 1, &env)); }
+  mpt_printf("deep      : %ld\n", res);
+  mpt_assert(res == n, "deep");
+}
+
+void mask_run(void) {
+#ifdef NDEBUG
+  test(1000000L);
+#else
+  test(10000L);
+#endif
+}
@@ -44,10 +44,11 @@ static void* handle_multi_unwind(mpe_resume_t* r, void* local, void* arg) {
 }
   
 
-static const mpe_handlerdef_t multi_hdef = { MPE_EFFECT(multi), NULL, {
+static const mpe_operation_t multi_ops[] = {
   { MPE_OP_MULTI, MPE_OPTAG(multi,unwind), &handle_multi_unwind },
   { MPE_OP_NULL, mpe_op_null, NULL }
-}};
+};
+static const mpe_handlerdef_t multi_hdef = { MPE_EFFECT(multi), NULL, multi_ops };
 
 void* multi_handle(mpe_actionfun_t* action, void* arg) {
   return mpe_handle(&multi_hdef, NULL, action, arg);
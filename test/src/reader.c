@@ -27,6 +27,23 @@ void* reader_action(void* arg) {
   return mpe_voidp_long( i + reader_ask());
 }
 
+/*-----------------------------------------------------------------
+  Forwarding reader 
+-----------------------------------------------------------------*/
+
+static void* freader_handle(mpe_actionfun_t action, void* arg) {
+  static const mpe_operation_t freader_ops[] = {
+    { MPE_OP_FORWARD, MPE_OPTAG(reader,ask), NULL },
+    { MPE_OP_NULL, mpe_op_null, NULL }
+  };
+  static const mpe_handlerdef_t freader_hdef = { MPE_EFFECT(reader), NULL, freader_ops };
+  return mpe_handle(&freader_hdef, NULL, action, arg);
+}
+
+static void* freader_action(void* arg) {
+  return freader_handle(&reader_action, arg);
+}
+
 /*-----------------------------------------------------------------
   testing
 -----------------------------------------------------------------*/
@@ -39,5 +56,8 @@ void reader_run(void) {
   mpt_bench{ res = mpe_long_voidp(greader_handle(reader_action, init, NULL)); }
   mpt_printf("greader   : %ld\n", res);
   mpt_assert(res == 2*init, "greader");
+  mpt_bench{ res = mpe_long_voidp(reader_handle(freader_action, init, NULL)); }
+  mpt_printf("freader   : %ld\n", res);
+  mpt_assert(res == 2*init, "freader");
 }
 
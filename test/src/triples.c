@@ -64,11 +64,12 @@ static void* _choice_choose(mpe_resume_t* rc, void* local, void* arg) {
   
 
 
-static const mpe_handlerdef_t choice_def = { MPE_EFFECT(choice), &_choice_result, {
+static const mpe_operation_t choice_ops[] = {
   { MPE_OP_SCOPED, MPE_OPTAG(choice,choose), &_choice_choose },
   { MPE_OP_ABORT,  MPE_OPTAG(choice,fail), &_choice_fail },
   { MPE_OP_NULL, mpe_op_null, NULL }
-} };
+};
+static const mpe_handlerdef_t choice_def = { MPE_EFFECT(choice), &_choice_result, choice_ops };
 
 static void* xchoice_handle(void*(*action)(void*), void* arg) {
   return mpe_handle(&choice_def, mpe_voidp_null, action, arg);
@@ -88,10 +89,11 @@ static void* _yield_yield(mpe_resume_t* rc, void* local, void* arg) {
   return mpe_resume_tail(rc, mpe_voidp_long( mpe_long_voidp(local)+1 ), local);
 }
 
-static const mpe_handlerdef_t yield_def = { MPE_EFFECT(yield),  &_yield_result, {
+static const mpe_operation_t yield_ops[] = {
   { MPE_OP_TAIL_NOOP, MPE_OPTAG(yield,yield), &_yield_yield },
   { MPE_OP_NULL, mpe_op_null, NULL }
-} };
+};
+static const mpe_handlerdef_t yield_def = { MPE_EFFECT(yield), &_yield_result, yield_ops };
 
 static void* yield_handle(void*(*action)(void*), long val, void* arg) {
   return mpe_handle(&yield_def, mpe_voidp_long(val), action, arg);
@@ -0,0 +1,132 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test unwinding without exceptions (`MPE_OP_NEVER_FINALLY` and `mpe_resume_drop`)
+  where only the `mpe_finally` finalizers are run.
+-----------------------------------------------------------------------------*/
+#include "test.h"
+
+/*-----------------------------------------------------------------
+  Define operations
+-----------------------------------------------------------------*/
+MPE_DEFINE_EFFECT2(fexn, raise, suspend)
+MPE_DEFINE_VOIDOP1(fexn, raise, long)
+MPE_DEFINE_OP0(fexn, suspend, long)
+
+static void* handle_fexn_raise(mpe_resume_t* r, void* local, void* arg) {
+  UNUSED(local); mpt_assert(r == NULL, "unwind: raise resumption");
+  return arg;
+}
+
+static void* handle_fexn_suspend(mpe_resume_t* r, void* local, void* arg) {
+  UNUSED(arg);
+  mpe_resume_drop(r);
+  return local;
+}
+
+static const mpe_operation_t fexn_ops[] = {
+  { MPE_OP_NEVER_FINALLY, MPE_OPTAG(fexn,raise), &handle_fexn_raise },
+  { MPE_OP_ONCE,          MPE_OPTAG(fexn,suspend), &handle_fexn_suspend },
+  { MPE_OP_NULL, mpe_op_null, NULL }
+};
+static const mpe_handlerdef_t fexn_hdef = { MPE_EFFECT(fexn), NULL, fexn_ops };
+
+// for comparison: unwind using `MPE_OP_NEVER` (which raises an exception in C++)
+static const mpe_operation_t fexn_never_ops[] = {
+  { MPE_OP_NEVER,         MPE_OPTAG(fexn,raise), &handle_fexn_raise },
+  { MPE_OP_ONCE,          MPE_OPTAG(fexn,suspend), &handle_fexn_suspend },
+  { MPE_OP_NULL, mpe_op_null, NULL }
+};
+static const mpe_handlerdef_t fexn_never_hdef = { MPE_EFFECT(fexn), NULL, fexn_never_ops };
+
+static void* fexn_handle(mpe_actionfun_t* action, long dropped, void* arg) {
+  return mpe_handle(&fexn_hdef, mpe_voidp_long(dropped), action, arg);
+}
+
+static void* fexn_never_handle(mpe_actionfun_t* action, void* arg) {
+  return mpe_handle(&fexn_never_hdef, NULL, action, arg);
+}
+
+
+/*-----------------------------------------------------------------
+  Example programs
+-----------------------------------------------------------------*/
+
+static long finalized;
+
+static void finalize(void* local) {
+  finalized += mpe_long_voidp(local);
+}
+
+static void* raise_action(void* arg) {
+  fexn_raise(mpe_long_voidp(arg));
+  return mpe_voidp_long(-1);  // never reached
+}
+
+static void* suspend_action(void* arg) {
+  UNUSED(arg);
+  return mpe_voidp_long(fexn_suspend());  // never resumed
+}
+
+// finally frames under a nested (unrelated) handler
+static void* nested_action(void* arg) {
+  return mpe_finally(mpe_voidp_long(1), &finalize, (mpe_actionfun_t*)arg, mpe_voidp_long(2));
+}
+
+static void* finally_action(void* arg) {
+  return mpe_finally(mpe_voidp_long(10), &finalize, &nested_action, arg);
+}
+
+static void* state_finally_action(void* arg) {
+  return state_handle(&finally_action, 0, arg);
+}
+
+static void* loop_action(void* arg) {
+  long n = mpe_long_voidp(arg);
+  long count = 0;
+  for (long i = 0; i < n; i++) {
+    count += mpe_long_voidp(fexn_handle(&raise_action, 0, mpe_voidp_long(1)));
+  }
+  return mpe_voidp_long(count);
+}
+
+static void* never_loop_action(void* arg) {
+  long n = mpe_long_voidp(arg);
+  long count = 0;
+  for (long i = 0; i < n; i++) {
+    count += mpe_long_voidp(fexn_never_handle(&raise_action, mpe_voidp_long(1)));
+  }
+  return mpe_voidp_long(count);
+}
+
+
+/*-----------------------------------------------------------------
+  testing
+-----------------------------------------------------------------*/
+
+static void test(long n) {
+  finalized = 0;
+  long res = mpe_long_voidp(fexn_handle(&state_finally_action, 0, (void*)&raise_action));
+  mpt_assert(res == 2 && finalized == 11, "unwind: raise");
+  res = mpe_long_voidp(fexn_handle(&state_finally_action, 3, (void*)&suspend_action));
+  mpt_assert(res == 3 && finalized == 22, "unwind: drop");
+  mpt_printf("unwind    : %ld\n", finalized);
+
+  mpt_bench{ res = mpe_long_voidp(loop_action(mpe_voidp_long(n))); }
+  mpt_printf("never-fin : %ld\n", res);
+  mpt_assert(res == n, "unwind: never-finally");
+  mpt_bench{ res = mpe_long_voidp(never_loop_action(mpe_voidp_long(n))); }
+  mpt_printf("never     : %ld\n", res);
+  mpt_assert(res == n, "unwind: never");
+}
+
+void unwind_run(void) {
+#ifdef NDEBUG
+  test(100000L);
+#else
+  test(1000L);
+#endif
+}
@@ -12,6 +12,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <mpeff.h>
 
 
@@ -23,6 +24,18 @@ void mpt_assert_at(bool condition, const char* msg, const char* fname, int line)
 
 #define mpt_printf(...)  fprintf(stderr, __VA_ARGS__)   // so it shows up in an azure pipeline
 
+// Check a condition without aborting the test; `mpt_errors()` returns the number of failed checks.
+#define check(cond, ...) \
+  do { if (!(cond)) { printf("error: " __VA_ARGS__); printf("\n"); mpt_error_count(1); } } while(0)
+
+#define mpt_errors()  mpt_error_count(0)
+
+static inline int mpt_error_count(int add) {
+  static int count = 0;
+  count += add;
+  return count;
+}
+
 /*-----------------------------------------------------------------
   Tests
 -----------------------------------------------------------------*/
@@ -37,6 +50,10 @@ void triples_run(void);
 void amb_run(void);
 void amb_state_run(void);
 void rehandle_run(void);
+void mask_run(void);
+void manyops_run(void);
+void unwind_run(void);
+void group_run(void);
 
 
 #ifdef __cplusplus
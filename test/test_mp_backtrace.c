@@ -0,0 +1,109 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test async-signal-safe backtraces across prompts: a timer signal
+  interrupts a busy loop running two prompts deep, and the backtrace
+  taken in the signal handler should reach back into the system stack.
+  (compiled with `-fno-omit-frame-pointer`)
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <mprompt.h>
+
+#if defined(_WIN32)
+int main() {
+  printf("mp_backtrace_signal is not supported on Windows\n");
+  return 0;
+}
+#else
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define __noinline  __attribute__((noinline))
+
+#define BT_MAX  (64)
+
+static void* expected;                 // return address into `main` on the system stack
+static void* bt[BT_MAX];
+static volatile sig_atomic_t bt_len = -1;
+
+static void on_alarm(int sig, siginfo_t* info, void* ucontext) {
+  (void)(sig); (void)(info);
+  bt_len = mp_backtrace_signal(ucontext, bt, BT_MAX);
+}
+
+static bool bt_contains(void* const* trace, int len, void* ip) {
+  for (int i = 0; i < len; i++) {
+    if (trace[i] == ip) return true;
+  }
+  return false;
+}
+
+static __noinline void* level2(mp_prompt_t* p, void* arg) {
+  (void)(p); (void)(arg);
+  // direct backtrace from the current frame
+  void* trace[BT_MAX];
+  int n = mp_backtrace_signal(NULL, trace, BT_MAX);
+  if (n > 0 && !bt_contains(trace, n, expected)) return (void*)"direct backtrace did not reach the system stack";
+  // and wait for the timer signal
+  struct itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  timer.it_value.tv_usec = 1000;
+  timer.it_interval.tv_usec = 1000;
+  setitimer(ITIMER_REAL, &timer, NULL);
+  for (volatile long i = 0; bt_len < 0 && i < 1000000000L; i++) { };
+  memset(&timer, 0, sizeof(timer));
+  setitimer(ITIMER_REAL, &timer, NULL);
+  return NULL;
+}
+
+static __noinline void* level1(mp_prompt_t* p, void* arg) {
+  (void)(p);
+  return mp_prompt(&level2, arg);
+}
+
+static __noinline void* system_level(void) {
+  expected = __builtin_return_address(0);
+  return mp_prompt(&level1, NULL);
+}
+
+int main() {
+  mp_init(NULL);
+  struct sigaction act;
+  memset(&act, 0, sizeof(act));
+  act.sa_sigaction = &on_alarm;
+  act.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;  // run on the alternate signal stack as gstacks commit on demand
+  sigemptyset(&act.sa_mask);
+  sigaction(SIGALRM, &act, NULL);
+
+  const char* err = (const char*)system_level();
+  if (err != NULL) {
+    printf("error: %s\n", err);
+    return 1;
+  }
+  if (bt_len < 0) {
+    printf("error: no timer signal received\n");
+    return 1;
+  }
+  if (bt_len == 0) {
+    printf("mp_backtrace_signal is not supported on this platform\n");
+    return 0;
+  }
+  printf("backtrace from the signal handler (%i frames):\n", (int)bt_len);
+  for (int i = 0; i < bt_len; i++) {
+    printf("  %p%s\n", bt[i], (bt[i] == expected ? "  <- main" : ""));
+  }
+  if (!bt_contains(bt, bt_len, expected)) {
+    printf("error: the backtrace did not reach the system stack\n");
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
+#endif
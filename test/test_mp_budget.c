@@ -0,0 +1,100 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test the process-wide stack budget: suspend prompts until a fresh
+  prompt fails with `EAGAIN`, then let the budget function shed load by
+  finishing a suspended prompt so the allocation can go ahead.
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <mprompt.h>
+
+#define BUDGET       (1024 * 1024)
+#define MAX_PENDING  (4096)
+
+static mp_resume_t* pending[MAX_PENDING];
+static long pending_count = 0;
+static long budget_calls = 0;
+static bool shed = false;
+
+static void* suspend(mp_resume_t* r, void* arg) {
+  (void)(arg);
+  return r;
+}
+
+static void* start(mp_prompt_t* p, void* arg) {
+  (void)(arg);
+  volatile char frame[8 * 1024];   // commit a bit more on demand
+  frame[0] = frame[sizeof(frame) - 1] = 1;
+  mp_yield(p, &suspend, NULL);
+  return (void*)(intptr_t)(frame[0] + frame[sizeof(frame) - 1]);
+}
+
+// Called when the budget is exhausted: finish a suspended prompt to release its stack
+static bool on_budget(ptrdiff_t committed, ptrdiff_t needed, void* arg) {
+  (void)(arg);
+  budget_calls++;
+  if (committed + needed <= BUDGET) {
+    printf("error: budget function called with %td + %td bytes within the budget\n", committed, needed);
+  }
+  if (!shed || pending_count == 0) return false;
+  mp_resume(pending[--pending_count], NULL);
+  return true;
+}
+
+int main() {
+  mp_config_t config = mp_config_default();
+  config.stack_budget = BUDGET;
+  config.stack_budget_fun = &on_budget;
+  config.stack_cache_count = 0;     // free gstacks right away so the budget is released
+  mp_init(&config);
+
+  // suspend prompts until the budget is exhausted
+  mp_prompt_t* p;
+  while (pending_count < MAX_PENDING && (p = mp_prompt_try_create()) != NULL) {
+    pending[pending_count++] = (mp_resume_t*)mp_prompt_enter(p, &start, NULL);
+  }
+  if (pending_count == 0 || pending_count >= MAX_PENDING) {
+    printf("error: the budget was not enforced (%ld prompts)\n", pending_count);
+    return 1;
+  }
+  if (errno != EAGAIN) {
+    printf("error: expecting EAGAIN when the budget is exhausted (errno: %d)\n", errno);
+    return 1;
+  }
+  printf("suspended %ld prompts with %td bytes committed (budget: %d)\n", pending_count, mp_stack_committed(), BUDGET);
+  if (mp_stack_committed() > BUDGET + 64 * 1024) {
+    printf("error: committed memory is too far over the budget\n");
+    return 1;
+  }
+
+  // now the budget function sheds load by finishing suspended prompts
+  shed = true;
+  const long calls = budget_calls;
+  const long count = pending_count;
+  for (int i = 0; i < 10; i++) {
+    p = mp_prompt_create();   // aborts if the allocation fails
+    pending[pending_count++] = (mp_resume_t*)mp_prompt_enter(p, &start, NULL);
+  }
+  if (budget_calls <= calls || pending_count > count + 10) {
+    printf("error: the budget function did not shed load\n");
+    return 1;
+  }
+
+  // finish all and release the budget
+  while (pending_count > 0) {
+    mp_resume(pending[--pending_count], NULL);
+  }
+  if (mp_stack_committed() != 0) {
+    printf("error: %td bytes are still committed\n", mp_stack_committed());
+    return 1;
+  }
+  printf("ok (%ld calls to the budget function)\n", budget_calls);
+  return 0;
+}
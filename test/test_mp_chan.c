@@ -0,0 +1,228 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test channels on the scheduler: ping-pong over unbuffered channels,
+  producers and consumers over bounded and unbounded channels (closed by
+  the last producer), and a select over several channels with send and
+  receive cases.
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <mprompt.h>
+#include "test.h"
+#include <mp_sched.h>
+#include <mp_chan.h>
+#include "internal/atomic.h"
+
+#define WORKERS     (4)
+#define ROUNDS      (10000)
+#define PRODUCERS   (8)
+#define CONSUMERS   (8)
+#define ITEMS       (5000)     // per producer
+#define SELECTS     (3)
+
+
+/*-----------------------------------------------------------------
+  Ping-pong over unbuffered channels
+-----------------------------------------------------------------*/
+
+static mp_chan_t* ping;
+static mp_chan_t* pong;
+
+static void ponger(void* arg) {
+  (void)(arg);
+  void* value;
+  while (mp_chan_recv(ping, &value)) {
+    mp_chan_send(pong, (void*)((intptr_t)value + 1));
+  }
+  mp_chan_close(pong);
+}
+
+static void test_pingpong(void* arg) {
+  (void)(arg);
+  ping = mp_chan_create(0);
+  pong = mp_chan_create(0);
+  mps_spawn(&ponger, NULL);
+  for (intptr_t i = 0; i < ROUNDS; i++) {
+    void* value = NULL;
+    check(mp_chan_send(ping, (void*)i), "ping send failed");
+    check(mp_chan_recv(pong, &value) && (intptr_t)value == i + 1, "wrong pong");
+  }
+  mp_chan_close(ping);
+  void* value = &value;
+  check(!mp_chan_recv(pong, &value) && value == NULL, "expecting a closed channel");
+  check(!mp_chan_send(ping, NULL), "sending on a closed channel should fail");
+  mp_chan_free(ping);
+  mp_chan_free(pong);
+}
+
+
+/*-----------------------------------------------------------------
+  Producers and consumers
+-----------------------------------------------------------------*/
+
+typedef struct pc_s {
+  mp_chan_t*        chan;
+  _Atomic(intptr_t) producers;   // still running
+  _Atomic(intptr_t) consumers;   // still running
+  _Atomic(intptr_t) sum;
+  _Atomic(intptr_t) count;
+} pc_t;
+
+static void producer(void* arg) {
+  pc_t* pc = (pc_t*)arg;
+  for (intptr_t i = 1; i <= ITEMS; i++) {
+    check(mp_chan_send(pc->chan, (void*)i), "producer send failed");
+    if (i % 100 == 0) mps_yield_now();
+  }
+  if (mp_atomic_add(&pc->producers, -1) == 1) mp_chan_close(pc->chan);
+}
+
+static void consumer(void* arg) {
+  pc_t* pc = (pc_t*)arg;
+  void* value;
+  intptr_t sum = 0;
+  intptr_t count = 0;
+  while (mp_chan_recv(pc->chan, &value)) {
+    sum += (intptr_t)value;
+    count++;
+  }
+  mp_atomic_add(&pc->sum, sum);
+  mp_atomic_add(&pc->count, count);
+  if (mp_atomic_add(&pc->consumers, -1) == 1) {
+    const intptr_t expected = (intptr_t)PRODUCERS * ITEMS * (ITEMS + 1) / 2;
+    check(mp_atomic_load(&pc->count) == (intptr_t)PRODUCERS * ITEMS, "received %ld items", (long)mp_atomic_load(&pc->count));
+    check(mp_atomic_load(&pc->sum) == expected, "wrong sum of items");
+    mp_chan_free(pc->chan);
+    free(pc);
+  }
+}
+
+static void producers_consumers(size_t capacity) {
+  pc_t* pc = (pc_t*)calloc(1, sizeof(pc_t));
+  pc->chan = mp_chan_create(capacity);
+  mp_atomic_store(&pc->producers, (intptr_t)PRODUCERS);
+  mp_atomic_store(&pc->consumers, (intptr_t)CONSUMERS);
+  for (int i = 0; i < CONSUMERS; i++) mps_spawn(&consumer, pc);
+  for (int i = 0; i < PRODUCERS; i++) mps_spawn(&producer, pc);
+}
+
+static void test_bounded(void* arg) {
+  (void)(arg);
+  producers_consumers(0);
+  producers_consumers(1);
+  producers_consumers(64);
+}
+
+static void test_unbounded(void* arg) {
+  (void)(arg);
+  mp_chan_t* c = mp_chan_create(MP_CHAN_UNBOUNDED);
+  for (intptr_t i = 0; i < ITEMS; i++) check(mp_chan_send(c, (void*)i), "unbounded send failed");
+  check(mp_chan_count(c) == ITEMS, "expecting %d buffered values", ITEMS);
+  for (intptr_t i = 0; i < ITEMS; i++) {
+    void* value;
+    check(mp_chan_try_recv(c, &value) && (intptr_t)value == i, "unbounded values out of order");
+  }
+  void* value;
+  check(!mp_chan_try_recv(c, &value), "expecting an empty channel");
+  mp_chan_free(c);
+  producers_consumers(MP_CHAN_UNBOUNDED);
+}
+
+
+/*-----------------------------------------------------------------
+  Select
+-----------------------------------------------------------------*/
+
+static mp_chan_t* sel_inputs[SELECTS];
+static mp_chan_t* sel_output;
+
+static void sel_producer(void* arg) {
+  mp_chan_t* c = (mp_chan_t*)arg;
+  for (intptr_t i = 1; i <= ITEMS; i++) mp_chan_send(c, (void*)i);
+  mp_chan_close(c);
+}
+
+// forward all inputs to the output, but only send when a value is pending
+static void sel_forwarder(void* arg) {
+  (void)(arg);
+  mp_chan_case_t cases[SELECTS + 1];
+  int open = SELECTS;
+  intptr_t pending = 0;   // values waiting to be sent
+  intptr_t pending_sum = 0;
+  for (int i = 0; i < SELECTS; i++) {
+    cases[i].chan = sel_inputs[i];
+    cases[i].dir = MP_CHAN_RECV;
+  }
+  cases[SELECTS].dir = MP_CHAN_SEND;
+  while (open > 0 || pending > 0) {
+    cases[SELECTS].chan = (pending > 0 ? sel_output : NULL);
+    cases[SELECTS].value = (void*)pending_sum;
+    const int k = mp_chan_select(cases, SELECTS + 1, true);
+    if (k == SELECTS) {
+      pending = 0;
+      pending_sum = 0;
+    }
+    else if (!cases[k].ok) {
+      cases[k].chan = NULL;   // closed
+      open--;
+    }
+    else {
+      pending++;
+      pending_sum += (intptr_t)cases[k].value;
+    }
+  }
+  mp_chan_close(sel_output);
+}
+
+static void test_select(void* arg) {
+  (void)(arg);
+  for (int i = 0; i < SELECTS; i++) {
+    sel_inputs[i] = mp_chan_create(i);   // unbuffered, 1, and 2
+    mps_spawn(&sel_producer, sel_inputs[i]);
+  }
+  sel_output = mp_chan_create(0);
+  mps_spawn(&sel_forwarder, NULL);
+  intptr_t sum = 0;
+  void* value;
+  while (mp_chan_recv(sel_output, &value)) sum += (intptr_t)value;
+  check(sum == (intptr_t)SELECTS * ITEMS * (ITEMS + 1) / 2, "wrong sum of selected values");
+  // a non-blocking select that is not ready
+  mp_chan_case_t kase = { sel_output, MP_CHAN_RECV, NULL, true };
+  check(mp_chan_select(&kase, 1, false) == 0 && !kase.ok, "expecting a closed channel");
+  mp_chan_t* empty = mp_chan_create(1);
+  kase.chan = empty;
+  check(mp_chan_select(&kase, 1, false) == -1, "expecting a select that is not ready");
+  check(mp_chan_try_send(empty, NULL) && !mp_chan_try_send(empty, NULL), "expecting a full channel");
+  mp_chan_free(empty);
+  for (int i = 0; i < SELECTS; i++) mp_chan_free(sel_inputs[i]);
+  mp_chan_free(sel_output);
+}
+
+
+/*-----------------------------------------------------------------
+  Main
+-----------------------------------------------------------------*/
+
+static void test_all(void* arg) {
+  (void)(arg);
+  mps_spawn(&test_pingpong, NULL);
+  mps_spawn(&test_bounded, NULL);
+  mps_spawn(&test_unbounded, NULL);
+  mps_spawn(&test_select, NULL);
+}
+
+int main() {
+  mp_init(NULL);
+  mps_config_t config = mps_config_default();
+  config.workers = WORKERS;
+  mps_run(&config, &test_all, NULL, NULL);
+  if (mpt_errors() > 0) return 1;
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,72 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test the commit-on-demand statistics: with per-page growth, touching
+  a known number of fresh stack pages should cause one fault per page,
+  and freeing the prompt should record a single gstack lifetime.
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <mprompt.h>
+#include "test.h"
+
+#define FRAME_SIZE  (128 * 1024)
+
+// Touch `FRAME_SIZE` bytes of fresh stack from the top down (so each access faults in the next page)
+static void* touch_pages(mp_prompt_t* p, void* arg) {
+  (void)(p); (void)(arg);
+  volatile char frame[FRAME_SIZE];
+  for (ptrdiff_t i = (ptrdiff_t)sizeof(frame) - 1; i >= 0; i -= 512) {
+    frame[i] = 1;
+  }
+  return (void*)(intptr_t)(frame[sizeof(frame) - 1]);
+}
+
+int main() {
+  mp_config_t config = mp_config_default();
+  config.stack_grow_fast = false;   // commit one page per fault
+  mp_init(&config);
+
+  mp_commit_stats_t stats;
+  mp_commit_stats_reset();
+  mp_commit_stats(&stats);
+  check(stats.faults == 0 && stats.committed == 0 && stats.gstacks == 0, "the statistics should be reset");
+
+  check(mp_prompt(&touch_pages, NULL) == (void*)1, "touch_pages");
+  mp_commit_stats(&stats);
+  printf("faults: %td, committed: %td, nsecs: %td, gstacks: %td\n", stats.faults, stats.committed, stats.nsecs, stats.gstacks);
+
+  // one fault per page (the frame may straddle one more page besides the initial commit)
+  const ptrdiff_t page_size = (stats.faults > 0 ? stats.committed / stats.faults : 0);
+  check(page_size >= 4096 && (page_size & (page_size - 1)) == 0, "expecting a page to be committed per fault");
+  check(stats.committed == stats.faults * page_size, "expecting a page to be committed per fault");
+  const ptrdiff_t pages = (page_size > 0 ? FRAME_SIZE / page_size : 0);
+  check(stats.faults >= pages - 1 && stats.faults <= pages + 1, "expecting about %td faults", pages);
+  check(stats.committed_hist[mp_commit_hist_bucket(page_size)] == stats.faults, "all commits should be in the page size bucket");
+  ptrdiff_t nsecs_total = 0;
+  for (int i = 0; i < MP_COMMIT_HIST_SIZE; i++) { nsecs_total += stats.nsecs_hist[i]; }
+  check(nsecs_total == stats.faults, "every fault should be in the latency histogram");
+
+  // the prompt is freed on return which ends the gstack lifetime
+  check(stats.gstacks == 1, "expecting one gstack lifetime");
+  check(stats.faults_hist[mp_commit_hist_bucket(stats.faults)] == 1, "the lifetime should be in the bucket of its faults");
+
+  // a second prompt (using the cached gstack) records its own lifetime
+  const ptrdiff_t faults = stats.faults;
+  check(mp_prompt(&touch_pages, NULL) == (void*)1, "touch_pages again");
+  mp_commit_stats(&stats);
+  check(stats.gstacks == 2, "expecting two gstack lifetimes");
+  check(stats.faults_hist[mp_commit_hist_bucket(stats.faults - faults)] >= 1, "the second lifetime should be in the bucket of its faults");
+
+  mp_commit_stats_reset();
+  mp_commit_stats(&stats);
+  check(stats.faults == 0 && stats.gstacks == 0 && stats.faults_hist[mp_commit_hist_bucket(faults)] == 0, "the statistics should be reset");
+
+  if (mpt_errors() == 0) printf("ok\n");
+  return (mpt_errors() == 0 ? 0 : 1);
+}
@@ -0,0 +1,251 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test batched generators: batches of various sizes (also when the
+  consumer changes the buffer between batches), empty batches, stopping
+  a producer early, and (in C++) range-for loops over `mp::generator`.
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <mprompt.h>
+#include "test.h"
+#include <mp_gen.h>
+
+#define COUNT  (1000)
+
+
+/*-----------------------------------------------------------------
+  C interface
+-----------------------------------------------------------------*/
+
+static bool producer_returned;
+
+// produce 0 .. n-1
+static void count_up(mp_gen_t* gen, void* arg) {
+  const long n = (long)(intptr_t)arg;
+  size_t capacity;
+  long*  buf = (long*)mp_gen_buffer(gen, &capacity);
+  size_t count = 0;
+  for (long i = 0; i < n; i++) {
+    buf[count++] = i;
+    if (count == capacity) {
+      if (!mp_gen_yield(gen, count)) break;
+      buf = (long*)mp_gen_buffer(gen, &capacity);
+      count = 0;
+    }
+  }
+  if (count > 0) mp_gen_yield(gen, count);
+  producer_returned = true;
+}
+
+// produce 0 .. n-1 with an empty batch before every element
+static void count_up_empty(mp_gen_t* gen, void* arg) {
+  const long n = (long)(intptr_t)arg;
+  for (long i = 0; i < n; i++) {
+    if (!mp_gen_yield(gen, 0)) return;
+    size_t capacity;
+    long* buf = (long*)mp_gen_buffer(gen, &capacity);
+    buf[0] = i;
+    if (!mp_gen_yield(gen, 1)) return;
+  }
+  mp_gen_yield(gen, 0);
+  producer_returned = true;
+}
+
+static void test_empty(void) {
+  long buf[4];
+  producer_returned = false;
+  mp_gen_t* gen = mp_gen_create(&count_up_empty, (void*)(intptr_t)COUNT);
+  long expect = 0;
+  size_t n;
+  while ((n = mp_gen_next(gen, buf, 4)) > 0) {
+    check(n == 1 && buf[0] == expect, "expecting %ld", expect);
+    expect++;
+  }
+  check(expect == COUNT, "empty batches should not end the generator (after %ld elements)", expect);
+  check(mp_gen_is_done(gen) && producer_returned, "the producer should be done");
+  mp_gen_free(gen);
+}
+
+static void test_batches(size_t capacity) {
+  long* buf = (long*)malloc(capacity * sizeof(long));
+  if (buf == NULL) return;
+  producer_returned = false;
+  mp_gen_t* gen = mp_gen_create(&count_up, (void*)(intptr_t)COUNT);
+  long   expect = 0;
+  size_t batches = 0;
+  size_t n;
+  while ((n = mp_gen_next(gen, buf, capacity)) > 0) {
+    batches++;
+    check(n == capacity || expect + (long)n == COUNT, "only the last batch can be partial");
+    for (size_t i = 0; i < n; i++) {
+      check(buf[i] == expect, "expecting %ld but got %ld", expect, buf[i]);
+      expect++;
+    }
+  }
+  check(expect == COUNT, "expecting %d elements but got %ld", COUNT, expect);
+  check(batches == (COUNT + capacity - 1) / capacity, "wrong number of batches (%zu)", batches);
+  check(mp_gen_is_done(gen) && producer_returned, "the producer should be done");
+  check(mp_gen_next(gen, buf, capacity) == 0, "a finished generator stays finished");
+  mp_gen_free(gen);
+  free(buf);
+}
+
+static void test_varying(void) {
+  long buf[100];
+  mp_gen_t* gen = mp_gen_create(&count_up, (void*)(intptr_t)COUNT);
+  long expect = 0;
+  for (size_t capacity = 1; ; capacity = (capacity % 100) + 1) {
+    const size_t n = mp_gen_next(gen, buf, capacity);
+    if (n == 0) break;
+    check(n <= capacity, "the batch is larger than the buffer");
+    for (size_t i = 0; i < n; i++, expect++) {
+      check(buf[i] == expect, "expecting %ld but got %ld", expect, buf[i]);
+    }
+  }
+  check(expect == COUNT, "expecting %d elements but got %ld", COUNT, expect);
+  mp_gen_free(gen);
+}
+
+static void test_stop(void) {
+  long buf[16];
+  // stopped after the first batch
+  producer_returned = false;
+  mp_gen_t* gen = mp_gen_create(&count_up, (void*)(intptr_t)COUNT);
+  check(mp_gen_next(gen, buf, 16) == 16, "expecting a full batch");
+  mp_gen_free(gen);
+  check(producer_returned, "the producer should return when it is stopped");
+  // never started
+  producer_returned = false;
+  gen = mp_gen_create(&count_up, (void*)(intptr_t)COUNT);
+  mp_gen_free(gen);
+  check(!producer_returned, "the producer should not start");
+}
+
+
+/*-----------------------------------------------------------------
+  C++ interface
+-----------------------------------------------------------------*/
+#ifdef __cplusplus
+#include <mp_gen.hpp>
+#include <string>
+#include <stdexcept>
+
+static int destructed = 0;
+
+struct guard_t {
+  ~guard_t() { destructed++; }
+};
+
+static void test_range_for(size_t batch) {
+  mp::generator<long> gen([](mp::gen_sink<long>& out) {
+    for (long i = 0; i < COUNT; i++) {
+      if (!out.emit(i)) return;
+    }
+  }, batch);
+  long expect = 0;
+  for (long x : gen) {
+    check(x == expect, "expecting %ld but got %ld", expect, x);
+    expect++;
+  }
+  check(expect == COUNT, "expecting %d elements but got %ld (batch %zu)", COUNT, expect, batch);
+}
+
+static void test_flush(void) {
+  // flushing without emitted values should not end the generator
+  mp::generator<long> gen([](mp::gen_sink<long>& out) {
+    for (long i = 0; i < COUNT; i++) {
+      if (!out.flush()) return;
+      if (!out.emit(i)) return;
+      if (i % 3 == 0 && !out.flush()) return;
+    }
+    out.flush();
+  }, 8);
+  long expect = 0;
+  for (long x : gen) {
+    check(x == expect, "expecting %ld but got %ld", expect, x);
+    expect++;
+  }
+  check(expect == COUNT, "expecting %d elements but got %ld", COUNT, expect);
+}
+
+static void test_strings(void) {
+  mp::generator<std::string> gen([](mp::gen_sink<std::string>& out) {
+    for (int i = 0; i < 100; i++) {
+      if (!out.emit(std::to_string(i))) return;
+    }
+  }, 16);
+  int i = 0;
+  for (const std::string& s : gen) {
+    check(s == std::to_string(i), "expecting %d but got %s", i, s.c_str());
+    i++;
+  }
+  check(i == 100, "expecting 100 strings");
+}
+
+static void test_break(void) {
+  destructed = 0;
+  {
+    mp::generator<long> gen([](mp::gen_sink<long>& out) {
+      guard_t guard;
+      for (long i = 0; ; i++) {
+        if (!out.emit(i)) return;
+      }
+    }, 8);
+    for (long x : gen) {
+      if (x == 20) break;
+    }
+  }
+  check(destructed == 1, "the producer should be stopped and unwound");
+}
+
+static void test_exception(void) {
+  bool caught = false;
+  long count = 0;
+  try {
+    mp::generator<long> gen([](mp::gen_sink<long>& out) {
+      for (long i = 0; i < 10; i++) out.emit(i);
+      throw std::runtime_error("producer failed");
+    }, 4);
+    for (long x : gen) { count += (x >= 0 ? 1 : 0); }
+  }
+  catch (const std::runtime_error&) {
+    caught = true;
+  }
+  check(caught && count == 8, "the producer exception should propagate to the consumer (after %ld elements)", count);
+}
+#endif
+
+
+/*-----------------------------------------------------------------
+  Main
+-----------------------------------------------------------------*/
+
+int main() {
+  mp_init(NULL);
+  test_batches(1);
+  test_batches(7);
+  test_batches(64);
+  test_batches(COUNT);
+  test_batches(2 * COUNT);
+  test_varying();
+  test_empty();
+  test_stop();
+  #ifdef __cplusplus
+  test_range_for(1);
+  test_range_for(64);
+  test_range_for(2 * COUNT);
+  test_flush();
+  test_strings();
+  test_break();
+  test_exception();
+  #endif
+  if (mpt_errors() > 0) return 1;
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,197 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test the stack growth policies: recurse to a known depth under each
+  policy and check the bytes committed per fault (using the commit
+  statistics), and that the peak policy commits the learned peak at once
+  when the same start function runs again (also after running on a
+  retained prompt).
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <mprompt.h>
+#include "test.h"
+
+#define DEPTH       (256)
+#define FRAME_SIZE  (1024)
+#define KIB         (1024)
+
+// Count the faults in the committed histogram from bucket `lo` up to (and including) `hi`
+static ptrdiff_t hist_count(const mp_commit_stats_t* stats, int lo, int hi) {
+  ptrdiff_t n = 0;
+  for (int i = lo; i <= hi && i < MP_COMMIT_HIST_SIZE; i++) { n += stats->committed_hist[i]; }
+  return n;
+}
+
+// Recurse through a volatile function pointer so the compiler cannot inline the recursion
+// into larger frames (that may touch the stack out of order)
+static int recurse(int depth);
+static int (*volatile recurse_fun)(int) = &recurse;
+
+static int recurse(int depth) {
+  volatile char frame[FRAME_SIZE];
+  frame[0] = (char)(depth & 1);
+  if (depth <= 0) return 0;
+  return recurse_fun(depth - 1) + frame[0];   // not a tail call
+}
+
+static void* run_recurse(mp_prompt_t* p, void* arg) {
+  (void)(p);
+  return (void*)(intptr_t)recurse((int)(intptr_t)arg);
+}
+
+// a separate start function to learn the peak of (with a different body so it is not folded with `run_recurse`)
+static int peak_depth = DEPTH;
+
+static void* run_recurse_peak(mp_prompt_t* p, void* arg) {
+  (void)(p); (void)(arg);
+  return (void*)(intptr_t)recurse(peak_depth);
+}
+
+// start functions for a retained prompt (again with different bodies)
+static int retained_deep_depth = DEPTH;
+static int retained_shallow_depth = DEPTH / 4;
+
+static void* run_retained_deep(mp_prompt_t* p, void* arg) {
+  (void)(p); (void)(arg);
+  return (void*)(intptr_t)recurse(retained_deep_depth);
+}
+
+static void* run_retained_shallow(mp_prompt_t* p, void* arg) {
+  (void)(p); (void)(arg);
+  return (void*)(intptr_t)(recurse(retained_shallow_depth) + DEPTH / 2 - retained_shallow_depth / 2);
+}
+
+// Run `fun` on a fresh prompt with `policy` and return the commit statistics of the run
+static mp_commit_stats_t run(mp_start_fun_t* fun, const mp_grow_policy_t* policy) {
+  mp_commit_stats_reset();
+  mp_prompt_t* p = mp_prompt_create();
+  mp_prompt_set_grow_policy(p, policy);
+  check(mp_prompt_enter(p, fun, (void*)(intptr_t)DEPTH) == (void*)(intptr_t)(DEPTH / 2), "wrong recursion result");
+  mp_commit_stats_t stats;
+  mp_commit_stats(&stats);
+  check(stats.gstacks == 1, "the prompt should be freed");
+  return stats;
+}
+
+static void print_stats(const char* name, const mp_commit_stats_t* stats) {
+  printf("%-10s: faults: %3td, committed: %7td\n", name, stats->faults, stats->committed);
+}
+
+
+/*-----------------------------------------------------------------
+  Policies
+-----------------------------------------------------------------*/
+
+static ptrdiff_t page_size;
+
+static void test_fixed(void) {
+  mp_grow_policy_t policy = { MP_GROW_FIXED, 16 * KIB, 0, 0, NULL, NULL };
+  mp_commit_stats_t stats = run(&run_recurse, &policy);
+  print_stats("fixed", &stats);
+  check(stats.faults > 0, "expecting faults");
+  check(stats.committed == stats.faults * 16 * KIB, "expecting 16 KiB per fault");
+  check(stats.committed_hist[mp_commit_hist_bucket(16 * KIB)] == stats.faults, "all commits should be 16 KiB");
+  check(stats.committed >= DEPTH * FRAME_SIZE && stats.committed <= 2 * DEPTH * FRAME_SIZE, "should commit about the recursion depth");
+}
+
+static void test_fixed_page(void) {
+  mp_grow_policy_t policy = { MP_GROW_FIXED, 0, 0, 0, NULL, NULL };  // defaults to the page size
+  mp_commit_stats_t stats = run(&run_recurse, &policy);
+  print_stats("page", &stats);
+  page_size = (stats.faults > 0 ? stats.committed / stats.faults : 0);
+  check(page_size >= 4 * KIB && stats.committed == stats.faults * page_size, "expecting a page per fault");
+  check(stats.committed_hist[mp_commit_hist_bucket(page_size)] == stats.faults, "all commits should be a page");
+}
+
+static void test_geometric(void) {
+  const ptrdiff_t max = 64 * KIB;
+  mp_grow_policy_t policy = { MP_GROW_GEOMETRIC, 0, 2, max, NULL, NULL };
+  mp_commit_stats_t stats = run(&run_recurse, &policy);
+  print_stats("geometric", &stats);
+  check(stats.faults > 1, "expecting faults");
+  // every fault commits at least twice the page (`2*used` extra) and at most `max` extra
+  check(hist_count(&stats, 0, mp_commit_hist_bucket(page_size)) == 0, "commits should be larger than a page");
+  check(hist_count(&stats, mp_commit_hist_bucket(max + page_size) + 1, MP_COMMIT_HIST_SIZE - 1) == 0, "commits should be at most %td extra", max);
+  check(stats.committed_hist[mp_commit_hist_bucket(max + page_size)] > 0, "the commits should reach the maximum");
+  check(stats.faults < (DEPTH * FRAME_SIZE) / (max / 2), "expecting few faults");
+}
+
+static ptrdiff_t custom_calls = 0;
+
+static ptrdiff_t grow_custom(ptrdiff_t used, ptrdiff_t available, void* arg) {
+  (void)(used); (void)(available);
+  custom_calls++;
+  return *((ptrdiff_t*)arg);
+}
+
+static void test_custom(void) {
+  ptrdiff_t extra = 7 * page_size;
+  mp_grow_policy_t policy = { MP_GROW_CUSTOM, 0, 0, 0, &grow_custom, &extra };
+  custom_calls = 0;
+  mp_commit_stats_t stats = run(&run_recurse, &policy);
+  print_stats("custom", &stats);
+  check(stats.faults > 0 && custom_calls == stats.faults, "the custom function should be called on every fault");
+  check(stats.committed == stats.faults * 8 * page_size, "expecting 8 pages per fault");
+}
+
+static void test_peak(void) {
+  mp_grow_policy_t policy = { MP_GROW_PEAK, 0, 2, 16 * KIB, NULL, NULL };
+  mp_commit_stats_t first = run(&run_recurse_peak, &policy);
+  print_stats("peak 1", &first);
+  mp_commit_stats_t second = run(&run_recurse_peak, &policy);
+  print_stats("peak 2", &second);
+  // the first run grows geometrically; the second run commits up to the learned peak at its first fault
+  check(first.faults > 2, "expecting the first run to fault repeatedly");
+  check(second.faults < first.faults && second.faults <= 2, "expecting the second run to commit up front");
+  check(hist_count(&second, mp_commit_hist_bucket(DEPTH * FRAME_SIZE / 2), MP_COMMIT_HIST_SIZE - 1) >= 1, "expecting one large commit up front");
+  check(second.committed >= first.committed - 16 * KIB - page_size, "the second run should commit about as much as the first");
+}
+
+
+// The peak of each run of a retained prompt is learned for its own start function
+static void test_peak_retained(void) {
+  mp_grow_policy_t policy = { MP_GROW_PEAK, 0, 2, 16 * KIB, NULL, NULL };
+  mp_prompt_t* p = mp_prompt_retain(mp_prompt_create());
+  mp_prompt_set_grow_policy(p, &policy);
+  mp_prompt_enter(p, &run_retained_deep, NULL);
+  mp_prompt_enter(p, &run_retained_shallow, NULL);   // uses the committed memory of the deep run
+  mp_prompt_release(p);
+  mp_commit_stats_t deep = run(&run_retained_deep, &policy);
+  print_stats("retained 1", &deep);
+  check(deep.faults <= 2, "expecting the peak of the deep run to be learned");
+  mp_commit_stats_t shallow = run(&run_retained_shallow, &policy);
+  print_stats("retained 2", &shallow);
+  check(shallow.faults > 2 && shallow.committed < deep.committed / 2, "the peak of the deep run should not be learned for the shallow run");
+}
+
+
+/*-----------------------------------------------------------------
+  Main
+-----------------------------------------------------------------*/
+
+int main() {
+  mp_config_t config = mp_config_default();
+  config.gpool_enable = false;      // fresh stacks for every run
+  config.stack_cache_count = 0;
+  mp_init(&config);
+
+  test_fixed_page();
+  if (page_size == 0) {
+    printf("skipped: commit-on-demand is not handled by the library on this platform\n");
+    return 0;
+  }
+  test_fixed();
+  test_geometric();
+  test_custom();
+  test_peak();
+  test_peak_retained();
+
+  if (mpt_errors() == 0) printf("ok\n");
+  return (mpt_errors() == 0 ? 0 : 1);
+}
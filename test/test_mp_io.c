@@ -0,0 +1,348 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test the I/O reactor with both the epoll and io_uring backends (if
+  available): a large transfer through a pipe (so the writer has to wait),
+  echo tasks over socket pairs, a server that accepts connections on a
+  local socket, reading back a local file (also with a count beyond 32
+  bits), and blocking calls offloaded to helper threads (while another
+  task keeps ticking).
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <mprompt.h>
+#include "test.h"
+
+#if !defined(__linux__) || !defined(MP_USE_IO)
+int main() {
+  printf("the I/O module is only available on Linux\n");
+  return 0;
+}
+#else
+#include <mp_io.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
+
+#define PIPE_BYTES    (1024 * 1024)
+#define PAIRS         (16)
+#define ROUNDS        (100)
+#define CONNECTIONS   (8)
+#define OFFLOADS      (8)
+
+static void set_nonblocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static bool read_full(int fd, uint8_t* buf, size_t count) {
+  size_t done = 0;
+  while (done < count) {
+    ssize_t n = mp_io_read(fd, buf + done, count - done);
+    if (n <= 0) return false;
+    done += (size_t)n;
+  }
+  return true;
+}
+
+static bool write_full(int fd, const uint8_t* buf, size_t count) {
+  size_t done = 0;
+  while (done < count) {
+    ssize_t n = mp_io_write(fd, buf + done, count - done);
+    if (n <= 0) return false;
+    done += (size_t)n;
+  }
+  return true;
+}
+
+
+/*-----------------------------------------------------------------
+  Pipe: the writer fills the pipe buffer and has to wait for the reader
+-----------------------------------------------------------------*/
+
+static int pipe_fds[2];
+
+static void pipe_writer(void* arg) {
+  (void)(arg);
+  uint8_t* buf = (uint8_t*)malloc(PIPE_BYTES);
+  for (size_t i = 0; i < PIPE_BYTES; i++) buf[i] = (uint8_t)(i % 251);
+  check(write_full(pipe_fds[1], buf, PIPE_BYTES), "pipe write failed");
+  mp_io_close(pipe_fds[1]);
+  free(buf);
+}
+
+static void pipe_reader(void* arg) {
+  (void)(arg);
+  uint8_t* buf = (uint8_t*)malloc(PIPE_BYTES);
+  check(read_full(pipe_fds[0], buf, PIPE_BYTES), "pipe read failed");
+  for (size_t i = 0; i < PIPE_BYTES; i++) {
+    if (buf[i] != (uint8_t)(i % 251)) { check(false, "pipe data differs at %zu", i); break; }
+  }
+  uint8_t eof;
+  check(mp_io_read(pipe_fds[0], &eof, 1) == 0, "expecting end of file on the pipe");
+  mp_io_close(pipe_fds[0]);
+  free(buf);
+}
+
+static void test_pipe(void* arg) {
+  (void)(arg);
+  if (pipe(pipe_fds) != 0) { check(false, "pipe: %s", strerror(errno)); return; }
+  set_nonblocking(pipe_fds[0]);
+  set_nonblocking(pipe_fds[1]);
+  mp_io_spawn(&pipe_reader, NULL);
+  mp_io_spawn(&pipe_writer, NULL);
+}
+
+
+/*-----------------------------------------------------------------
+  Echo over socket pairs
+-----------------------------------------------------------------*/
+
+static void echo_server(void* arg) {
+  const int fd = (int)(intptr_t)arg;
+  uint8_t buf[64];
+  ssize_t n;
+  while ((n = mp_io_read(fd, buf, sizeof(buf))) > 0) {
+    if (!write_full(fd, buf, (size_t)n)) break;
+  }
+  check(n == 0, "echo server read failed: %s", strerror(errno));
+  mp_io_close(fd);
+}
+
+static void echo_client(void* arg) {
+  const int fd = (int)(intptr_t)arg;
+  for (int i = 0; i < ROUNDS; i++) {
+    uint8_t msg[16];
+    uint8_t reply[16];
+    memset(msg, i, sizeof(msg));
+    if (!write_full(fd, msg, sizeof(msg)) || !read_full(fd, reply, sizeof(reply))) {
+      check(false, "echo client failed: %s", strerror(errno));
+      break;
+    }
+    check(memcmp(msg, reply, sizeof(msg)) == 0, "echo reply differs");
+  }
+  mp_io_close(fd);
+}
+
+static void test_echo(void* arg) {
+  (void)(arg);
+  for (int i = 0; i < PAIRS; i++) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) != 0) { check(false, "socketpair: %s", strerror(errno)); return; }
+    mp_io_spawn(&echo_server, (void*)(intptr_t)fds[0]);
+    mp_io_spawn(&echo_client, (void*)(intptr_t)fds[1]);
+  }
+}
+
+
+/*-----------------------------------------------------------------
+  Accept connections on a local socket
+-----------------------------------------------------------------*/
+
+static struct sockaddr_un listen_addr;
+
+static void accept_server(void* arg) {
+  const int lfd = (int)(intptr_t)arg;
+  for (int i = 0; i < CONNECTIONS; i++) {
+    int fd = mp_io_accept(lfd, NULL, NULL, SOCK_NONBLOCK);
+    if (fd < 0) { check(false, "accept: %s", strerror(errno)); break; }
+    mp_io_spawn(&echo_server, (void*)(intptr_t)fd);
+  }
+  mp_io_close(lfd);
+}
+
+static void accept_client(void* arg) {
+  (void)(arg);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr*)&listen_addr, sizeof(listen_addr)) != 0) {
+    check(false, "connect: %s", strerror(errno));
+    if (fd >= 0) close(fd);
+    return;
+  }
+  set_nonblocking(fd);
+  echo_client((void*)(intptr_t)fd);
+}
+
+static void test_accept(void* arg) {
+  (void)(arg);
+  int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  memset(&listen_addr, 0, sizeof(listen_addr));
+  listen_addr.sun_family = AF_UNIX;
+  snprintf(listen_addr.sun_path + 1, sizeof(listen_addr.sun_path) - 1, "mprompt-test-io-%d", (int)getpid());  // abstract name
+  if (lfd < 0 || bind(lfd, (struct sockaddr*)&listen_addr, sizeof(listen_addr)) != 0 || listen(lfd, CONNECTIONS) != 0) {
+    check(false, "listen: %s", strerror(errno));
+    if (lfd >= 0) close(lfd);
+    return;
+  }
+  mp_io_spawn(&accept_server, (void*)(intptr_t)lfd);
+  for (int i = 0; i < CONNECTIONS; i++) {
+    mp_io_spawn(&accept_client, NULL);
+  }
+}
+
+
+/*-----------------------------------------------------------------
+  Local file
+-----------------------------------------------------------------*/
+
+static void test_file(void* arg) {
+  (void)(arg);
+  char path[] = "/tmp/mprompt-test-io-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) { check(false, "mkstemp: %s", strerror(errno)); return; }
+  unlink(path);
+  const char msg[] = "hello from a prompt";
+  check(mp_io_write(fd, msg, sizeof(msg)) == (ssize_t)sizeof(msg), "file write failed");
+  lseek(fd, 0, SEEK_SET);
+  char buf[sizeof(msg)];
+  check(mp_io_read(fd, buf, sizeof(buf)) == (ssize_t)sizeof(buf) && memcmp(buf, msg, sizeof(msg)) == 0, "file read failed");
+  #if SIZE_MAX > UINT32_MAX
+  // a count beyond 32 bits is a short read (and not a zero length read at end of file)
+  lseek(fd, 0, SEEK_SET);
+  check(mp_io_read(fd, buf, (size_t)4 << 30) == (ssize_t)sizeof(buf), "file read with a large count failed");
+  #endif
+  mp_io_close(fd);
+}
+
+
+/*-----------------------------------------------------------------
+  Offloaded blocking calls
+-----------------------------------------------------------------*/
+
+static pthread_t     reactor_thread;
+static int           offloads_live;
+static long          ticks;
+static mp_io_task_t* offload_victim;
+
+static void* blocking_call(void* arg) {
+  check(!pthread_equal(pthread_self(), reactor_thread), "the call should run on a helper thread");
+  usleep(20 * 1000);
+  errno = EDOM;
+  return (void*)((intptr_t)arg + 1);
+}
+
+static void* direct_call(void* arg) {
+  check(pthread_equal(pthread_self(), reactor_thread), "outside a reactor task the call should run directly");
+  return (void*)((intptr_t)arg + 1);
+}
+
+static void offload_ticker(void* arg) {
+  (void)(arg);
+  while (offloads_live > 0) {
+    mp_sleep(1);
+    ticks++;
+  }
+  check(ticks >= 5, "the reactor should keep running during offloaded calls (only %ld ticks)", ticks);
+}
+
+static void offload_task(void* arg) {
+  errno = 0;
+  void* res = mp_offload(&blocking_call, arg);
+  check(res == (void*)((intptr_t)arg + 1) && errno == EDOM, "wrong offload result");
+  check(pthread_equal(pthread_self(), reactor_thread), "the task should resume on its reactor thread");
+  offloads_live--;
+}
+
+// cancelled while offloading: the call completes and the next wait is cancelled
+static void offload_cancelled(void* arg) {
+  (void)(arg);
+  offload_victim = mp_io_current();
+  check(mp_offload(&blocking_call, (void*)41) == (void*)42, "a cancelled offload should complete");
+  check(mp_sleep(1) == -1 && errno == ECANCELED, "the wait after a cancelled offload should be cancelled");
+  offloads_live--;
+}
+
+static void offload_canceller(void* arg) {
+  (void)(arg);
+  mp_sleep(5);
+  mp_io_cancel(offload_victim);
+}
+
+#ifdef __cplusplus
+#include <stdexcept>
+
+static void* throwing_call(void* arg) {
+  (void)(arg);
+  throw std::runtime_error("offload");
+}
+
+static void offload_exception(void* arg) {
+  (void)(arg);
+  bool caught = false;
+  try {
+    mp_offload(&throwing_call, NULL);
+  }
+  catch (const std::runtime_error&) {
+    caught = true;
+  }
+  check(caught, "the exception of an offloaded call should be rethrown in the task");
+}
+#endif
+
+static void test_offload(void* arg) {
+  (void)(arg);
+  reactor_thread = pthread_self();
+  offloads_live = OFFLOADS + 1;
+  ticks = 0;
+  mp_io_spawn(&offload_ticker, NULL);
+  for (intptr_t i = 0; i < OFFLOADS; i++) {
+    mp_io_spawn(&offload_task, (void*)i);
+  }
+  mp_io_spawn(&offload_cancelled, NULL);
+  mp_io_spawn(&offload_canceller, NULL);
+  #ifdef __cplusplus
+  mp_io_spawn(&offload_exception, NULL);
+  #endif
+}
+
+
+/*-----------------------------------------------------------------
+  Main
+-----------------------------------------------------------------*/
+
+static void test_all(void* arg) {
+  (void)(arg);
+  mp_io_spawn(&test_pipe, NULL);
+  mp_io_spawn(&test_echo, NULL);
+  mp_io_spawn(&test_accept, NULL);
+  mp_io_spawn(&test_file, NULL);
+  mp_io_spawn(&test_offload, NULL);
+}
+
+static void run_backend(mp_io_backend_t backend, const char* name) {
+  mp_io_config_t config = mp_io_config_default();
+  config.backend = backend;
+  config.queue_depth = 32;   // small so the submission queue fills up
+  const int before = mpt_errors();
+  const int err = mp_io_run(&config, &test_all, NULL);
+  if (err != 0) {
+    check(backend == MP_IO_URING, "unable to initialize %s: %s", name, strerror(err));
+    printf("%s: not available (%s)\n", name, strerror(err));
+    return;
+  }
+  printf("%s: %s\n", name, (mpt_errors() == before ? "ok" : "failed"));
+}
+
+int main() {
+  mp_init(NULL);
+  run_backend(MP_IO_EPOLL, "epoll");
+  run_backend(MP_IO_URING, "io_uring");
+  // outside a reactor the operations block
+  int fds[2];
+  char c = 0;
+  check(pipe(fds) == 0 && mp_io_write(fds[1], "x", 1) == 1 && mp_io_read(fds[0], &c, 1) == 1 && c == 'x', "blocking fallback failed");
+  reactor_thread = pthread_self();
+  check(mp_offload(&direct_call, (void*)1) == (void*)2, "offload fallback failed");
+  if (mpt_errors() > 0) return 1;
+  printf("ok\n");
+  return 0;
+}
+#endif
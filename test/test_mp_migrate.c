@@ -0,0 +1,183 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test migrating suspended prompts between threads: tasks suspend through
+  an effect handler and are resumed by whichever worker thread picks them
+  from a shared queue. Each task uses more stack at every step (so pages
+  are committed on demand on the worker threads), and checks that an inner
+  handler is still found after each migration.
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <mprompt.h>
+#include <mpeff.h>
+
+#if defined(_WIN32)
+int main() {
+  printf("this test uses pthreads and is not supported on Windows\n");
+  return 0;
+}
+#else
+#include <pthread.h>
+#include <sched.h>
+
+#define TASKS    (64)
+#define STEPS    (64)
+#define WORKERS  (4)
+
+#define __noinline  __attribute__((noinline))
+
+
+/*-----------------------------------------------------------------
+  Effects: `migrate/suspend` returns the resumption to whoever
+  resumed the task last, and `ident/get` returns the task id.
+-----------------------------------------------------------------*/
+
+MPE_DEFINE_EFFECT1(migrate, suspend)
+MPE_DEFINE_EFFECT1(ident, get)
+
+static void* handle_suspend(mpe_resume_t* r, void* local, void* arg) {
+  (void)(local); (void)(arg);
+  return r;
+}
+
+static void* handle_get(mpe_resume_t* r, void* local, void* arg) {
+  (void)(r); (void)(arg);
+  return local;
+}
+
+static const mpe_operation_t migrate_ops[] = {
+  { MPE_OP_ONCE, MPE_OPTAG(migrate,suspend), &handle_suspend },
+  { MPE_OP_NULL, mpe_op_null, NULL }
+};
+static const mpe_handlerdef_t migrate_hdef = { MPE_EFFECT(migrate), NULL, migrate_ops };
+
+static const mpe_operation_t ident_ops[] = {
+  { MPE_OP_TAIL_NOOP, MPE_OPTAG(ident,get), &handle_get },
+  { MPE_OP_NULL, mpe_op_null, NULL }
+};
+static const mpe_handlerdef_t ident_hdef = { MPE_EFFECT(ident), NULL, ident_ops };
+
+
+/*-----------------------------------------------------------------
+  Tasks
+-----------------------------------------------------------------*/
+
+static long task_errors[TASKS];
+static long task_migrations[TASKS];
+
+static __noinline long stack_use(long kb) {
+  volatile uint8_t frame[1024];
+  frame[0] = (uint8_t)kb;
+  if (kb <= 1) return frame[0];
+  return stack_use(kb - 1) + frame[0];
+}
+
+// Identify the current thread. This must not be inlined (and `pthread_self` is declared `const`) as 
+// the compiler would otherwise assume the thread stays the same across a yield.
+static __thread long thread_id;
+
+static __noinline long current_thread(void) {
+  return thread_id;
+}
+
+static void* task_steps(void* arg) {
+  const long id = (long)(intptr_t)arg;
+  for (long step = 1; step <= STEPS; step++) {
+    stack_use(step * 8);   // up to 512KiB
+    const long self = current_thread();
+    mpe_perform(MPE_OPTAG(migrate,suspend), NULL);
+    if (self != current_thread()) task_migrations[id]++;
+    if ((long)(intptr_t)mpe_perform(MPE_OPTAG(ident,get), NULL) != id) task_errors[id]++;
+  }
+  return NULL;
+}
+
+static void* task_start(void* arg) {
+  return mpe_handle(&ident_hdef, arg, &task_steps, arg);
+}
+
+// Start a task on this thread; returns its first resumption
+static mpe_resume_t* task_create(long id) {
+  return (mpe_resume_t*)mpe_handle(&migrate_hdef, NULL, &task_start, (void*)(intptr_t)id);
+}
+
+
+/*-----------------------------------------------------------------
+  Shared queue of resumptions
+-----------------------------------------------------------------*/
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static mpe_resume_t*   queue[TASKS];
+static long            queue_count = 0;
+static long            finished = 0;
+
+static void queue_push(mpe_resume_t* r) {
+  pthread_mutex_lock(&queue_lock);
+  if (r == NULL) { finished++; }
+            else { queue[queue_count++] = r; }
+  pthread_mutex_unlock(&queue_lock);
+}
+
+static mpe_resume_t* queue_pop(bool* done) {
+  mpe_resume_t* r = NULL;
+  pthread_mutex_lock(&queue_lock);
+  if (queue_count > 0) {
+    // take a random one so tasks are resumed on different threads
+    long i = rand() % queue_count;
+    r = queue[i];
+    queue[i] = queue[--queue_count];
+  }
+  *done = (finished == TASKS);
+  pthread_mutex_unlock(&queue_lock);
+  return r;
+}
+
+// Workers never create prompts themselves
+static void* worker(void* arg) {
+  thread_id = (long)(intptr_t)arg;
+  bool done = false;
+  while (!done) {
+    mpe_resume_t* r = queue_pop(&done);
+    if (r == NULL) { sched_yield(); continue; }
+    queue_push((mpe_resume_t*)mpe_resume_final(r, NULL, NULL));  // NULL when the task finished
+  }
+  return NULL;
+}
+
+int main() {
+  mp_init(NULL);
+  for (long i = 0; i < TASKS; i++) {
+    queue_push(task_create(i));
+  }
+  pthread_t threads[WORKERS];
+  for (int i = 0; i < WORKERS; i++) {
+    pthread_create(&threads[i], NULL, &worker, (void*)(intptr_t)(i + 1));
+  }
+  for (int i = 0; i < WORKERS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  long errors = 0;
+  long migrations = 0;
+  for (long i = 0; i < TASKS; i++) {
+    errors += task_errors[i];
+    migrations += task_migrations[i];
+  }
+  printf("%d tasks, %d steps each, %ld migrations between %d threads\n", TASKS, STEPS, migrations, WORKERS);
+  if (errors > 0) {
+    printf("error: %ld handler lookups failed after a migration\n", errors);
+    return 1;
+  }
+  if (migrations == 0) {
+    printf("error: no task migrated to another thread\n");
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
+#endif
@@ -0,0 +1,224 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test reusable (retained) prompts: re-entering a finished prompt with
+  different start functions (and recording each run in the commit
+  statistics), restarting a generator on the same prompt,
+  dropping a suspended chain, releasing a prompt while it is suspended,
+  and (in C++) propagating an exception out of a retained prompt.
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <mprompt.h>
+#include "test.h"
+
+#define RESTARTS  (1000)
+
+
+/*-----------------------------------------------------------------
+  Re-enter with different start functions
+-----------------------------------------------------------------*/
+
+static mp_prompt_t* entered;
+
+static void* add_one(mp_prompt_t* p, void* arg) {
+  entered = p;
+  return (void*)((intptr_t)arg + 1);
+}
+
+static void* times_two(mp_prompt_t* p, void* arg) {
+  entered = p;
+  volatile char frame[16*1024];    // use some stack so it gets committed
+  frame[0] = 1;
+  return (void*)((intptr_t)arg * 2 + frame[0] - 1);
+}
+
+static void test_reenter(void) {
+  mp_prompt_t* p = mp_prompt_retain(mp_prompt_create());
+  check(mp_prompt_is_idle(p), "a fresh prompt is idle");
+  check(mp_prompt_enter(p, &times_two, (void*)20) == (void*)40, "times_two");
+  check(entered == p && mp_prompt_is_idle(p), "the retained prompt should be idle after returning");
+  const ptrdiff_t committed = mp_stack_committed();
+  for (intptr_t i = 0; i < RESTARTS; i++) {
+    void* res = mp_prompt_enter(p, (i % 2 == 0 ? &add_one : &times_two), (void*)i);
+    check(res == (void*)(i % 2 == 0 ? i + 1 : i * 2), "wrong result at restart %zd", i);
+    check(entered == p, "not entered under the retained prompt");
+  }
+  check(mp_stack_committed() == committed, "restarts should not commit or allocate gstacks");
+  mp_prompt_release(p);
+}
+
+
+/*-----------------------------------------------------------------
+  Commit statistics of a retained prompt: every run is a lifetime
+-----------------------------------------------------------------*/
+
+// touch 128 KiB of stack from the top down so it is committed on demand
+static void* deep(mp_prompt_t* p, void* arg) {
+  entered = p;
+  volatile char frame[128*1024];
+  for (ptrdiff_t i = (ptrdiff_t)sizeof(frame) - 1; i >= 0; i -= 1024) {
+    frame[i] = 1;
+  }
+  return (void*)((intptr_t)arg + frame[sizeof(frame) - 1] - 1);
+}
+
+static void test_stats(void) {
+  mp_commit_stats_t stats;
+  mp_commit_stats_reset();
+  mp_prompt_t* p = mp_prompt_retain(mp_prompt_create());
+  check(mp_prompt_enter(p, &deep, (void*)1) == (void*)1, "deep");
+  mp_commit_stats(&stats);
+  const ptrdiff_t faults = stats.faults;
+  check(stats.gstacks == 1, "the first run should be recorded as a lifetime");
+  check(faults > 0 && stats.faults_hist[mp_commit_hist_bucket(faults)] == 1, "the first run should record its faults");
+  // the second run uses the memory committed already
+  check(mp_prompt_enter(p, &add_one, (void*)1) == (void*)2, "add_one");
+  mp_commit_stats(&stats);
+  check(stats.gstacks == 2, "the second run should be recorded as a lifetime");
+  check(stats.faults == faults && stats.faults_hist[0] == 1, "the faults of the first run should not be counted again");
+  mp_prompt_release(p);
+  mp_commit_stats(&stats);
+  check(stats.gstacks == 2, "releasing an idle prompt should not record another lifetime");
+}
+
+
+/*-----------------------------------------------------------------
+  Restart a generator
+-----------------------------------------------------------------*/
+
+static void* yield_resumption(mp_resume_t* r, void* arg) {
+  (void)(arg);
+  return r;
+}
+
+// yields `n` times (with the next value in `current`)
+typedef struct gen_env_s {
+  long         n;
+  long         current;
+  mp_prompt_t* target;    // yield to this prompt (or the own prompt if NULL)
+} gen_env_t;
+
+static void* count_up(mp_prompt_t* p, void* arg) {
+  gen_env_t* env = (gen_env_t*)arg;
+  for (long i = 0; i < env->n; i++) {
+    env->current = i;
+    mp_yield((env->target != NULL ? env->target : p), &yield_resumption, NULL);
+  }
+  return NULL;
+}
+
+static void test_generator(void) {
+  mp_prompt_t* p = mp_prompt_retain(mp_prompt_create());
+  for (long run = 0; run < RESTARTS; run++) {
+    gen_env_t env = { run % 10, -1, NULL };
+    long expect = 0;
+    mp_resume_t* r = (mp_resume_t*)mp_prompt_enter(p, &count_up, &env);
+    while (r != NULL) {
+      check(!mp_prompt_is_idle(p), "a suspended prompt is not idle");
+      check(env.current == expect, "expecting %ld but got %ld", expect, env.current);
+      expect++;
+      r = (mp_resume_t*)mp_resume(r, NULL);
+    }
+    check(expect == env.n, "expecting %ld elements but got %ld", env.n, expect);
+    check(mp_prompt_is_idle(p), "the generator should be idle after it finished");
+  }
+  mp_prompt_release(p);
+}
+
+
+/*-----------------------------------------------------------------
+  Drop and release while suspended
+-----------------------------------------------------------------*/
+
+static void* nested_count_up(mp_prompt_t* p, void* arg) {
+  gen_env_t* env = (gen_env_t*)arg;
+  env->target = p;
+  mp_prompt(&count_up, arg);   // yields to `p` with a chain of two prompts
+  return NULL;
+}
+
+static void* outer_yield(mp_prompt_t* p, void* arg) {
+  gen_env_t* env = (gen_env_t*)arg;
+  env->current = -1;
+  mp_yield(p, &yield_resumption, NULL);
+  return nested_count_up(p, arg);
+}
+
+static void test_drop(void) {
+  mp_prompt_t* p = mp_prompt_retain(mp_prompt_create());
+  for (int run = 0; run < 10; run++) {
+    gen_env_t env = { 10, -1, NULL };
+    // yields from a nested prompt: dropping the resumption also frees the nested prompt
+    mp_resume_t* r = (mp_resume_t*)mp_prompt_enter(p, &nested_count_up, &env);
+    check(r != NULL && env.current == 0, "expecting a suspended generator");
+    mp_resume_drop(r);
+    check(mp_prompt_is_idle(p), "a retained prompt is idle after dropping its resumption");
+  }
+  // release while suspended: freed once it finishes
+  gen_env_t env = { 3, -1, NULL };
+  mp_resume_t* r = (mp_resume_t*)mp_prompt_enter(p, &outer_yield, &env);
+  mp_prompt_release(p);
+  long count = 0;
+  while ((r = (mp_resume_t*)mp_resume(r, NULL)) != NULL) count++;
+  check(count == 3, "expecting 3 elements after a release (but got %ld)", count);
+  // release while suspended and drop
+  p = mp_prompt_retain(mp_prompt_create());
+  r = (mp_resume_t*)mp_prompt_enter(p, &outer_yield, &env);
+  mp_prompt_release(p);
+  mp_resume_drop(r);
+}
+
+
+/*-----------------------------------------------------------------
+  C++ exceptions
+-----------------------------------------------------------------*/
+#ifdef __cplusplus
+#include <stdexcept>
+
+static void* throw_fun(mp_prompt_t* p, void* arg) {
+  (void)(p); (void)(arg);
+  throw std::runtime_error("reuse");
+}
+
+static void test_exception(void) {
+  mp_prompt_t* p = mp_prompt_retain(mp_prompt_create());
+  for (int run = 0; run < 10; run++) {
+    bool caught = false;
+    try {
+      mp_prompt_enter(p, &throw_fun, NULL);
+    }
+    catch (const std::runtime_error&) {
+      caught = true;
+    }
+    check(caught, "the exception should propagate out of a retained prompt");
+    check(mp_prompt_is_idle(p), "a retained prompt is idle after an exception");
+    check(mp_prompt_enter(p, &add_one, (void*)41) == (void*)42, "re-enter after an exception");
+  }
+  mp_prompt_release(p);
+}
+#endif
+
+
+/*-----------------------------------------------------------------
+  Main
+-----------------------------------------------------------------*/
+
+int main() {
+  mp_init(NULL);
+  test_stats();     // first, so the gstack is fresh
+  test_reenter();
+  test_generator();
+  test_drop();
+  #ifdef __cplusplus
+  test_exception();
+  #endif
+  if (mpt_errors() > 0) return 1;
+  printf("ok\n");
+  return 0;
+}
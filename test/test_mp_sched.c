@@ -0,0 +1,179 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test the scheduler: many tasks that yield (and migrate between workers),
+  rings of tasks that pass a token with park/unpark, and a task that is
+  unparked from a thread outside the scheduler.
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <mprompt.h>
+#include <mp_sched.h>
+#include "internal/atomic.h"
+
+#if defined(_WIN32)
+int main() {
+  printf("this test uses pthreads and is not supported on Windows\n");
+  return 0;
+}
+#else
+#include <pthread.h>
+#include <sched.h>
+
+#define WORKERS  (4)
+#define TASKS    (1000)
+#define STEPS    (100)
+#define RINGS    (8)
+#define RING     (16)
+#define ROUNDS   (200)
+
+#define __noinline  __attribute__((noinline))
+
+static __noinline long stack_use(long kb) {
+  volatile uint8_t frame[1024];
+  frame[0] = (uint8_t)kb;
+  if (kb <= 1) return frame[0];
+  return stack_use(kb - 1) + frame[0];
+}
+
+
+/*-----------------------------------------------------------------
+  Yielding tasks
+-----------------------------------------------------------------*/
+
+static _Atomic(intptr_t) yield_done;
+static _Atomic(intptr_t) yield_migrations;
+
+static void yield_task(void* arg) {
+  long id = (long)(intptr_t)arg;
+  long migrations = 0;
+  for (long step = 0; step < STEPS; step++) {
+    stack_use(1 + (id + step) % 32);
+    const int worker = mps_worker_id();
+    mps_yield_now();
+    if (worker != mps_worker_id()) migrations++;
+  }
+  mp_atomic_add(&yield_migrations, (intptr_t)migrations);
+  mp_atomic_add(&yield_done, (intptr_t)1);
+}
+
+static void yield_main(void* arg) {
+  (void)(arg);
+  for (long i = 0; i < TASKS; i++) {
+    mps_spawn(&yield_task, (void*)(intptr_t)i);
+  }
+}
+
+
+/*-----------------------------------------------------------------
+  Rings of tasks passing a token with park/unpark
+-----------------------------------------------------------------*/
+
+typedef struct ring_s {
+  _Atomic(intptr_t) turn;
+  _Atomic(intptr_t) joined;
+  mps_task_t*       tasks[RING];
+  long              passes;
+} ring_t;
+
+static ring_t rings[RINGS];
+
+static void ring_task(void* arg) {
+  const long id = (long)(intptr_t)arg;
+  ring_t* ring = &rings[id / RING];
+  const long i = id % RING;
+  ring->tasks[i] = mps_current();
+  mp_atomic_add(&ring->joined, (intptr_t)1);
+  while (mp_atomic_load(&ring->joined) < RING) { mps_yield_now(); }
+  for (long round = 0; round < ROUNDS; round++) {
+    while (mp_atomic_load(&ring->turn) != i) { mps_park(); }
+    ring->passes++;
+    mp_atomic_store(&ring->turn, (intptr_t)((i + 1) % RING));
+    mps_unpark(ring->tasks[(i + 1) % RING]);
+  }
+}
+
+static void ring_main(void* arg) {
+  (void)(arg);
+  for (long i = 0; i < RINGS * RING; i++) {
+    mps_spawn(&ring_task, (void*)(intptr_t)i);
+  }
+}
+
+
+/*-----------------------------------------------------------------
+  Unpark from a thread outside of the scheduler
+-----------------------------------------------------------------*/
+
+static _Atomic(intptr_t) outside_task;   // `mps_task_t*`
+static _Atomic(intptr_t) outside_ready;
+static bool outside_woken;
+
+static void* outside_thread(void* arg) {
+  (void)(arg);
+  intptr_t t;
+  while ((t = mp_atomic_load(&outside_task)) == 0) { sched_yield(); }
+  mp_atomic_store(&outside_ready, (intptr_t)1);
+  mps_unpark((mps_task_t*)t);
+  return NULL;
+}
+
+static void outside_main(void* arg) {
+  (void)(arg);
+  mp_atomic_store(&outside_task, (intptr_t)mps_current());
+  while (mp_atomic_load(&outside_ready) == 0) { mps_park(); }
+  outside_woken = true;
+}
+
+
+int main() {
+  mp_init(NULL);
+  mps_config_t config = mps_config_default();
+  config.workers = WORKERS;
+  mps_stats_t stats;
+  int errors = 0;
+
+  mps_run(&config, &yield_main, NULL, &stats);
+  printf("yield: %ld tasks, %ld migrations, %lld switches, %lld steals\n", (long)mp_atomic_load(&yield_done),
+         (long)mp_atomic_load(&yield_migrations), (long long)stats.switches, (long long)stats.steals);
+  if (mp_atomic_load(&yield_done) != TASKS || stats.spawns != TASKS) {
+    printf("error: not all tasks finished\n");
+    errors++;
+  }
+  if (stats.switches < (int64_t)TASKS * (STEPS + 1)) {
+    printf("error: expecting at least %ld switches\n", (long)TASKS * (STEPS + 1));
+    errors++;
+  }
+  if (mp_atomic_load(&yield_migrations) == 0) {
+    printf("error: no task migrated to another worker\n");
+    errors++;
+  }
+
+  mps_run(&config, &ring_main, NULL, &stats);
+  for (long r = 0; r < RINGS; r++) {
+    if (rings[r].passes != RING * ROUNDS) {
+      printf("error: ring %ld passed the token %ld times\n", r, rings[r].passes);
+      errors++;
+    }
+  }
+  printf("rings: %lld switches, %lld steals, %lld sleeps\n", (long long)stats.switches, (long long)stats.steals, (long long)stats.sleeps);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, &outside_thread, NULL);
+  mps_run(&config, &outside_main, NULL, NULL);
+  pthread_join(thread, NULL);
+  if (!outside_woken) {
+    printf("error: the task was not unparked from outside the scheduler\n");
+    errors++;
+  }
+
+  if (errors > 0) return 1;
+  printf("ok\n");
+  return 0;
+}
+#endif
@@ -0,0 +1,235 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test the synchronization primitives on the scheduler: a mutex that is
+  held across a suspension, the FIFO and LIFO wake up order, a semaphore
+  that bounds concurrency, a bounded queue with condition variables, and
+  rounds of a barrier.
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <mprompt.h>
+#include "test.h"
+#include <mp_sched.h>
+#include <mp_sync.h>
+#include "internal/atomic.h"
+
+#define WORKERS     (4)
+#define TASKS       (64)
+#define INCREMENTS  (200)
+#define LIMIT       (3)
+#define ITEMS       (10000)
+#define QUEUE       (8)
+#define ROUNDS      (20)
+
+static void run(int workers, mps_fun_t* fun) {
+  mps_config_t config = mps_config_default();
+  config.workers = workers;
+  mps_run(&config, fun, NULL, NULL);
+}
+
+
+/*-----------------------------------------------------------------
+  Mutex held across a suspension
+-----------------------------------------------------------------*/
+
+static mp_mutex_t*       mutex;
+static _Atomic(intptr_t) inside;
+static long              counter;      // protected by `mutex`
+
+static void mutex_task(void* arg) {
+  (void)(arg);
+  for (int i = 0; i < INCREMENTS; i++) {
+    mp_mutex_lock(mutex);
+    check(mp_atomic_add(&inside, 1) == 0, "two tasks in the critical section");
+    const long c = counter;
+    mps_yield_now();          // would deadlock with an OS mutex on a single worker
+    counter = c + 1;
+    mp_atomic_add(&inside, -1);
+    mp_mutex_unlock(mutex);
+  }
+}
+
+static void test_mutex(void* arg) {
+  (void)(arg);
+  for (int i = 0; i < TASKS; i++) mps_spawn(&mutex_task, NULL);
+}
+
+
+/*-----------------------------------------------------------------
+  Wake up order
+-----------------------------------------------------------------*/
+
+static int order[3];
+static int order_count;
+
+static void order_task(void* arg) {
+  mp_mutex_lock(mutex);
+  order[order_count++] = (int)(intptr_t)arg;
+  mp_mutex_unlock(mutex);
+}
+
+static void test_order(void* arg) {
+  (void)(arg);
+  order_count = 0;
+  mp_mutex_lock(mutex);
+  for (intptr_t i = 0; i < 3; i++) {
+    mps_spawn(&order_task, (void*)i);
+    mps_yield_now();   // let it wait on the mutex (on a single worker)
+  }
+  mp_mutex_unlock(mutex);
+}
+
+static void check_order(mp_sync_order_t ord) {
+  mutex = mp_mutex_create(ord);
+  run(1, &test_order);
+  mp_mutex_free(mutex);
+  check(order_count == 3, "not all tasks acquired the mutex");
+  for (int i = 0; i < 3; i++) {
+    check(order[i] == (ord == MP_SYNC_FIFO ? i : 2 - i), "wrong %s order", (ord == MP_SYNC_FIFO ? "FIFO" : "LIFO"));
+  }
+}
+
+
+/*-----------------------------------------------------------------
+  Semaphore
+-----------------------------------------------------------------*/
+
+static mp_sema_t*        sema;
+static _Atomic(intptr_t) sema_active;
+static _Atomic(intptr_t) sema_max;
+
+static void sema_task(void* arg) {
+  (void)(arg);
+  for (int i = 0; i < 10; i++) {
+    mp_sema_acquire(sema);
+    const intptr_t active = mp_atomic_add(&sema_active, 1) + 1;
+    check(active <= LIMIT, "too many tasks acquired the semaphore");
+    intptr_t max = mp_atomic_load(&sema_max);
+    while (active > max && !mp_atomic_cas(&sema_max, &max, active)) { }
+    mps_yield_now();
+    mp_atomic_add(&sema_active, -1);
+    mp_sema_release(sema);
+  }
+}
+
+static void test_sema(void* arg) {
+  (void)(arg);
+  for (int i = 0; i < TASKS; i++) mps_spawn(&sema_task, NULL);
+}
+
+
+/*-----------------------------------------------------------------
+  Bounded queue with condition variables
+-----------------------------------------------------------------*/
+
+static mp_cond_t* not_empty;
+static mp_cond_t* not_full;
+static long       queue[QUEUE];
+static long       queue_head;
+static long       queue_count;
+static long       consumed_sum;
+
+static void queue_producer(void* arg) {
+  (void)(arg);
+  for (long i = 1; i <= ITEMS; i++) {
+    mp_mutex_lock(mutex);
+    while (queue_count == QUEUE) mp_cond_wait(not_full, mutex);
+    queue[(queue_head + queue_count) % QUEUE] = i;
+    queue_count++;
+    mp_cond_signal(not_empty);
+    mp_mutex_unlock(mutex);
+  }
+}
+
+static void queue_consumer(void* arg) {
+  (void)(arg);
+  for (long i = 1; i <= ITEMS; i++) {
+    mp_mutex_lock(mutex);
+    while (queue_count == 0) mp_cond_wait(not_empty, mutex);
+    const long item = queue[queue_head];
+    queue_head = (queue_head + 1) % QUEUE;
+    queue_count--;
+    consumed_sum += item;
+    mp_cond_signal(not_full);
+    mp_mutex_unlock(mutex);
+  }
+}
+
+static void test_cond(void* arg) {
+  (void)(arg);
+  mps_spawn(&queue_consumer, NULL);
+  mps_spawn(&queue_producer, NULL);
+}
+
+
+/*-----------------------------------------------------------------
+  Barrier
+-----------------------------------------------------------------*/
+
+static mp_barrier_t*     barrier;
+static _Atomic(intptr_t) arrivals;
+static _Atomic(intptr_t) leaders;
+
+static void barrier_task(void* arg) {
+  (void)(arg);
+  for (intptr_t round = 0; round < ROUNDS; round++) {
+    mp_atomic_add(&arrivals, 1);
+    if (mp_barrier_wait(barrier)) mp_atomic_add(&leaders, 1);
+    check(mp_atomic_load(&arrivals) >= (round + 1) * TASKS, "passed the barrier too early");
+    mp_barrier_wait(barrier);   // so no task arrives for the next round before all checked
+  }
+}
+
+static void test_barrier(void* arg) {
+  (void)(arg);
+  for (int i = 0; i < TASKS; i++) mps_spawn(&barrier_task, NULL);
+}
+
+
+/*-----------------------------------------------------------------
+  Main
+-----------------------------------------------------------------*/
+
+int main() {
+  mp_init(NULL);
+
+  mutex = mp_mutex_create(MP_SYNC_FIFO);
+  run(1, &test_mutex);
+  check(counter == TASKS * INCREMENTS, "mutex counter is %ld", counter);
+  counter = 0;
+  run(WORKERS, &test_mutex);
+  check(counter == TASKS * INCREMENTS, "mutex counter is %ld", counter);
+  mp_mutex_free(mutex);
+
+  check_order(MP_SYNC_FIFO);
+  check_order(MP_SYNC_LIFO);
+
+  sema = mp_sema_create(LIMIT, MP_SYNC_FIFO);
+  run(WORKERS, &test_sema);
+  check(mp_atomic_load(&sema_max) == LIMIT, "the semaphore was never fully used");
+  mp_sema_free(sema);
+
+  mutex = mp_mutex_create(MP_SYNC_LIFO);
+  not_empty = mp_cond_create(MP_SYNC_FIFO);
+  not_full = mp_cond_create(MP_SYNC_LIFO);
+  run(WORKERS, &test_cond);
+  check(consumed_sum == (long)ITEMS * (ITEMS + 1) / 2, "wrong sum of consumed items");
+  mp_cond_free(not_empty);
+  mp_cond_free(not_full);
+  mp_mutex_free(mutex);
+
+  barrier = mp_barrier_create(TASKS);
+  run(WORKERS, &test_barrier);
+  check(mp_atomic_load(&leaders) == ROUNDS, "expecting one leader per barrier round");
+  mp_barrier_free(barrier);
+
+  if (mpt_errors() > 0) return 1;
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,287 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Test the timers of the I/O reactor with both backends: many sleeping
+  tasks that must wake up in order (and not before their deadline), a
+  sleep long enough to cascade through the wheel levels, cancelling a
+  sleeping task, and `mpe_with_timeout` unwinding a blocked read (running
+  its finalizers and destructors), also when nested or when it cancels
+  the children of a task group.
+-----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <mprompt.h>
+#include "test.h"
+#include <mpeff.h>
+
+#if !defined(__linux__) || !defined(MP_USE_IO)
+int main() {
+  printf("the I/O module is only available on Linux\n");
+  return 0;
+}
+#else
+#include <mp_io.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define SLEEPERS   (64)
+
+
+/*-----------------------------------------------------------------
+  Sleeping tasks wake up in order of their deadline
+-----------------------------------------------------------------*/
+
+static mp_msecs_t last_deadline;
+static int        woken;
+
+static void sleeper(void* arg) {
+  const mp_msecs_t deadline = (mp_msecs_t)(intptr_t)arg;
+  check(mp_sleep_until(deadline) == 0, "sleep was cancelled");
+  check(mp_io_now() >= deadline, "woke up %lld ms early", (long long)(deadline - mp_io_now()));
+  check(deadline >= last_deadline, "woke up out of order");
+  last_deadline = deadline;
+  woken++;
+}
+
+static void test_sleepers(void* arg) {
+  (void)(arg);
+  last_deadline = 0;
+  woken = 0;
+  const mp_msecs_t now = mp_io_now();
+  for (int i = 0; i < SLEEPERS; i++) {
+    mp_io_spawn(&sleeper, (void*)(intptr_t)(now + 1 + ((i * 37) % 150)));
+  }
+}
+
+static void test_long_sleep(void* arg) {
+  (void)(arg);
+  const mp_msecs_t start = mp_io_now();
+  check(mp_sleep(300) == 0, "long sleep was cancelled");
+  const mp_msecs_t elapsed = mp_io_now() - start;
+  check(elapsed >= 300 && elapsed < 2000, "long sleep took %lld ms", (long long)elapsed);
+}
+
+
+/*-----------------------------------------------------------------
+  Cancel a sleeping task
+-----------------------------------------------------------------*/
+
+static mp_io_task_t* cancel_target;
+
+static void cancel_sleeper(void* arg) {
+  (void)(arg);
+  cancel_target = mp_io_current();
+  const mp_msecs_t start = mp_io_now();
+  check(mp_sleep(10000) == -1 && errno == ECANCELED, "expecting a cancelled sleep");
+  check(mp_io_now() - start < 5000, "the cancelled sleep took too long");
+  check(mp_sleep(1) == 0, "the cancellation should only apply once");
+}
+
+static void cancel_canceller(void* arg) {
+  (void)(arg);
+  mp_sleep(10);
+  mp_io_cancel(cancel_target);
+}
+
+static void test_cancel(void* arg) {
+  (void)(arg);
+  mp_io_spawn(&cancel_sleeper, NULL);
+  mp_io_spawn(&cancel_canceller, NULL);
+}
+
+
+/*-----------------------------------------------------------------
+  Timeouts
+-----------------------------------------------------------------*/
+
+static int finalized;
+static int destructed;
+
+#ifdef __cplusplus
+struct guard_t {
+  ~guard_t() { destructed++; }
+};
+#endif
+
+static void count_final(void* local) {
+  (void)(local);
+  finalized++;
+}
+
+// read from a pipe that is never written
+static void* blocked_read(void* arg) {
+  #ifdef __cplusplus
+  guard_t guard;
+  #endif
+  const int fd = (int)(intptr_t)arg;
+  char c;
+  mp_io_read(fd, &c, 1);
+  check(false, "the read should not return");
+  return NULL;
+}
+
+static void* guarded_read(void* arg) {
+  return mpe_finally(NULL, &count_final, &blocked_read, arg);
+}
+
+static void* quick_action(void* arg) {
+  check(mp_sleep(5) == 0, "sleep within the timeout was cancelled");
+  return arg;
+}
+
+typedef struct nested_s {
+  int      fd;
+  int64_t  inner_timeout;
+  bool     inner_timed_out;
+} nested_t;
+
+static void* nested_inner(void* arg) {
+  nested_t* n = (nested_t*)arg;
+  mpe_with_timeout(n->inner_timeout, &guarded_read, (void*)(intptr_t)n->fd, &n->inner_timed_out);
+  return arg;
+}
+
+// a group where one child blocks on a read while the others are suspended
+#define GROUP_CHILDREN  (8)
+
+typedef struct group_env_s {
+  int                fd;
+  mpe_group_cancel_t cancel;
+} group_env_t;
+
+static void* group_yielder(void* arg) {
+  (void)(arg);
+  #ifdef __cplusplus
+  guard_t guard;
+  #endif
+  for (;;) mpe_group_yield();
+  return NULL;
+}
+
+static void* group_child(void* arg) {
+  group_env_t* env = (group_env_t*)arg;
+  mpe_group_yield();
+  return mpe_finally(NULL, &count_final, &blocked_read, (void*)(intptr_t)env->fd);
+}
+
+static void* group_join_all(void* arg) {
+  mpe_group_join((mpe_group_t*)arg);
+  check(false, "the join should not return");
+  return NULL;
+}
+
+static void group_free(void* local) {
+  finalized++;
+  mpe_group_free((mpe_group_t*)local);
+}
+
+static void* group_join(void* arg) {
+  group_env_t* env = (group_env_t*)arg;
+  mpe_group_t* g = mpe_group_create(env->cancel);
+  for (int i = 1; i < GROUP_CHILDREN; i++) {
+    mpe_group_spawn(g, &group_yielder, NULL);
+  }
+  mpe_group_spawn(g, &group_child, env);
+  return mpe_finally(g, &group_free, &group_join_all, g);
+}
+
+static void test_timeouts(void* arg) {
+  (void)(arg);
+  int fds[2];
+  if (pipe(fds) != 0) { check(false, "pipe: %s", strerror(errno)); return; }
+  fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+  finalized = destructed = 0;
+
+  // a blocked read times out
+  bool timed_out = false;
+  mp_msecs_t start = mp_io_now();
+  void* res = mpe_with_timeout(50, &guarded_read, (void*)(intptr_t)fds[0], &timed_out);
+  check(timed_out && res == NULL, "expecting a timeout");
+  check(mp_io_now() - start >= 50, "timed out too early");
+  check(finalized == 1, "the finalizer did not run");
+  #ifdef __cplusplus
+  check(destructed == 1, "the destructor did not run");
+  #endif
+
+  // no timeout
+  res = mpe_with_timeout(1000, &quick_action, &timed_out, &timed_out);
+  check(!timed_out && res == &timed_out, "unexpected timeout");
+  check(mp_sleep(1) == 0, "sleep after a timeout scope was cancelled");
+
+  // the outer timeout expires first
+  nested_t n = { fds[0], 1000, false };
+  res = mpe_with_timeout(30, &nested_inner, &n, &timed_out);
+  check(timed_out && res == NULL && !n.inner_timed_out, "expecting the outer timeout");
+  check(finalized == 2, "the finalizer did not run in a nested timeout");
+
+  // the inner timeout expires first
+  n.inner_timeout = 30;
+  res = mpe_with_timeout(1000, &nested_inner, &n, &timed_out);
+  check(!timed_out && res == &n && n.inner_timed_out, "expecting the inner timeout");
+  check(finalized == 3, "the finalizer did not run in an inner timeout");
+  #ifdef __cplusplus
+  check(destructed == 3, "the destructors did not run");
+  #endif
+
+  // a timeout cancels the children of a group (and the blocked one)
+  for (int i = 0; i < 2; i++) {
+    group_env_t env = { fds[0], (i == 0 ? MPE_GROUP_UNWIND : MPE_GROUP_DROP) };
+    finalized = destructed = 0;
+    res = mpe_with_timeout(30, &group_join, &env, &timed_out);
+    check(timed_out && res == NULL, "expecting a group timeout");
+    check(finalized == 2, "the finalizers did not run in a group timeout");
+    #ifdef __cplusplus
+    check(destructed == (env.cancel == MPE_GROUP_UNWIND ? GROUP_CHILDREN : 1), "the destructors did not run in a group timeout");
+    #endif
+  }
+
+  mp_io_close(fds[0]);
+  mp_io_close(fds[1]);
+}
+
+
+/*-----------------------------------------------------------------
+  Main
+-----------------------------------------------------------------*/
+
+static void test_all(void* arg) {
+  (void)(arg);
+  mp_io_spawn(&test_sleepers, NULL);
+  mp_io_spawn(&test_long_sleep, NULL);
+  mp_io_spawn(&test_cancel, NULL);
+  mp_io_spawn(&test_timeouts, NULL);
+}
+
+static void run_backend(mp_io_backend_t backend, const char* name) {
+  mp_io_config_t config = mp_io_config_default();
+  config.backend = backend;
+  const int before = mpt_errors();
+  const int err = mp_io_run(&config, &test_all, NULL);
+  if (err != 0) {
+    check(backend == MP_IO_URING, "unable to initialize %s: %s", name, strerror(err));
+    printf("%s: not available (%s)\n", name, strerror(err));
+    return;
+  }
+  check(woken == SLEEPERS, "only %d sleepers woke up", woken);
+  printf("%s: %s\n", name, (mpt_errors() == before ? "ok" : "failed"));
+}
+
+int main() {
+  mp_init(NULL);
+  run_backend(MP_IO_EPOLL, "epoll");
+  run_backend(MP_IO_URING, "io_uring");
+  // outside a reactor the sleep blocks
+  const mp_msecs_t start = mp_io_now();
+  check(mp_sleep(5) == 0 && mp_io_now() - start >= 5, "blocking sleep failed");
+  if (mpt_errors() > 0) return 1;
+  printf("ok\n");
+  return 0;
+}
+#endif
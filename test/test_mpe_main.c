@@ -47,6 +47,10 @@ static void test_c(void) {
   countern_run();
   mstate_run();
   rehandle_run();
+  mask_run();
+  manyops_run();
+  unwind_run();
+  group_run();
 
   // multi-shot tests
   amb_run();
@@ -0,0 +1,238 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Microsoft Research, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Tests the typed C++17 interface in `mpeff.hpp`
+-----------------------------------------------------------------------------*/
+#include <string>
+#include <vector>
+#include <mprompt.h>
+#include <mpeff.hpp>
+#include "test.h"
+
+/*-----------------------------------------------------------------
+  State (tail_noop)
+-----------------------------------------------------------------*/
+
+struct tstate {
+  static constexpr const char* names[] = { "tstate", "tstate/get", "tstate/set", nullptr };
+  using get = mpe::operation<tstate, 0, long()>;
+  using set = mpe::operation<tstate, 1, void(long)>;
+};
+
+struct tstate_handler {
+  long value;
+  long get()       { return value; }
+  void set(long x) { value = x; }
+};
+
+using tstate_def = mpe::handler_def<tstate,
+                     mpe::tail_noop<tstate::get, &tstate_handler::get>,
+                     mpe::tail_noop<tstate::set, &tstate_handler::set>>;
+
+static long counter() {
+  long i;
+  long sum = 0;
+  while ((i = tstate::get::perform()) > 0) {
+    tstate::set::perform(i - 1);
+    sum += i;
+  }
+  return sum;
+}
+
+static void test_state(long n) {
+  tstate_handler h{ n };
+  long res = 0;
+  mpt_bench{ res = mpe::handle<tstate_def>(h, &counter); }
+  mpt_printf("typed state   : %ld\n", res);
+  mpt_assert(res == n*(n+1)/2 && h.value == 0, "typed state");
+}
+
+
+/*-----------------------------------------------------------------
+  Reader with a non-trivial type (tail, and scoped_once)
+-----------------------------------------------------------------*/
+
+struct treader {
+  static constexpr const char* names[] = { "treader", "treader/ask", "treader/append", nullptr };
+  using ask    = mpe::operation<treader, 0, std::string()>;
+  using append = mpe::operation<treader, 1, std::size_t(const std::string&)>;
+};
+
+struct treader_handler {
+  std::string value;
+  std::string ask() { return value; }
+  std::size_t append(const std::string& s) { value += s; return value.size(); }
+  std::string gask(mpe::resumption<treader::ask, std::string>& r) {
+    return r.resume_tail(value);
+  }
+  std::string gappend(mpe::resumption<treader::append, std::string>& r, const std::string& s) {
+    value += s;
+    std::string res = r.resume_final(value.size());
+    return res + "!";
+  }
+};
+
+using treader_def = mpe::handler_def<treader,
+                      mpe::tail<treader::ask, &treader_handler::ask>,
+                      mpe::tail<treader::append, &treader_handler::append>>;
+
+using tgreader_def = mpe::handler_def<treader,
+                       mpe::scoped_once<treader::ask, &treader_handler::gask>,
+                       mpe::scoped_once<treader::append, &treader_handler::gappend>>;
+
+static std::string reader_body() {
+  std::string s = "world";
+  std::size_t n = treader::append::perform(s);
+  mpt_assert(n == 11, "typed reader: append");
+  return treader::ask::perform();
+}
+
+static void test_reader() {
+  treader_handler h{ "hello " };
+  std::string res = mpe::handle<treader_def>(h, &reader_body);
+  mpt_printf("typed reader  : %s\n", res.c_str());
+  mpt_assert(res == "hello world", "typed reader");
+
+  treader_handler g{ "hello " };
+  res = mpe::handle<tgreader_def>(g, &reader_body);
+  mpt_printf("typed greader : %s\n", res.c_str());
+  mpt_assert(res == "hello world!", "typed greader");
+}
+
+
+/*-----------------------------------------------------------------
+  Exceptions (never resume; destructors must run)
+-----------------------------------------------------------------*/
+
+struct texn {
+  static constexpr const char* names[] = { "texn", "texn/raise", nullptr };
+  using raise = mpe::operation<texn, 0, void(const std::string&)>;
+};
+
+struct texn_handler {
+  std::string raise(std::string msg) { return "error: " + msg; }
+};
+
+using texn_def = mpe::handler_def<texn, mpe::never<texn::raise, &texn_handler::raise>>;
+
+static void test_exn() {
+  bool destructed = false;
+  texn_handler h;
+  std::string res = mpe::handle<texn_def>(h, [&]() -> std::string {
+    test_raii_t raii("typed exn", &destructed);
+    std::string msg = "oops";
+    texn::raise::perform(msg);
+    return "not raised";
+  });
+  mpt_printf("typed exn     : %s\n", res.c_str());
+  mpt_assert(res == "error: oops" && destructed, "typed exn");
+}
+
+
+/*-----------------------------------------------------------------
+  Ambiguity (multi)
+-----------------------------------------------------------------*/
+
+struct tamb {
+  static constexpr const char* names[] = { "tamb", "tamb/flip", nullptr };
+  using flip = mpe::operation<tamb, 0, bool()>;
+};
+
+using results = std::vector<bool>;
+
+struct tamb_handler {
+  results flip(mpe::resumption<tamb::flip, results>& r) {
+    results xs = r.resume(false);
+    results ys = r.resume_final(true);
+    xs.insert(xs.end(), ys.begin(), ys.end());
+    return xs;
+  }
+};
+
+using tamb_def = mpe::handler_def<tamb, mpe::multi<tamb::flip, &tamb_handler::flip>>;
+
+static bool xors(long n) {
+  bool x = false;
+  for (long i = 0; i < n; i++) {
+    x = (x != tamb::flip::perform());
+  }
+  return x;
+}
+
+static void test_amb(long n) {
+  tamb_handler h;
+  results res;
+  mpt_bench{ res = mpe::handle<tamb_def>(h, [n]() { return results{ xors(n) }; }); }
+  std::size_t trues = 0;
+  for (bool b : res) { if (b) trues++; }
+  mpt_printf("typed amb     : %zu results, %zu true\n", res.size(), trues);
+  mpt_assert(res.size() == (std::size_t(1) << n) && trues == res.size()/2, "typed amb");
+}
+
+
+/*-----------------------------------------------------------------
+  Release (resumptions that are not resumed for the last time are 
+  released when the operation function returns)
+-----------------------------------------------------------------*/
+
+struct tpoint {
+  long x;
+  explicit tpoint(long x) : x(x) { }   // not default constructible
+};
+
+struct tchoose {
+  static constexpr const char* names[] = { "tchoose", "tchoose/choose", nullptr };
+  using choose = mpe::operation<tchoose, 0, tpoint()>;
+};
+
+struct tchoose_handler {
+  bool resume;
+  tpoint choose(mpe::resumption<tchoose::choose, tpoint>& r) {
+    if (!resume) return tpoint(-1);
+    return tpoint(r.resume(tpoint(20)).x + 1);   // not final for `multi`
+  }
+};
+
+using tchoose_multi_def  = mpe::handler_def<tchoose, mpe::multi<tchoose::choose, &tchoose_handler::choose>>;
+using tchoose_scoped_def = mpe::handler_def<tchoose, mpe::scoped_once<tchoose::choose, &tchoose_handler::choose>>;
+
+template<class Def>
+static void test_release(const char* name, bool resume) {
+  bool destructed = false;
+  tchoose_handler h{ resume };
+  tpoint res = mpe::handle<Def>(h, [&]() {
+    test_raii_t raii(name, &destructed);
+    return tpoint(tchoose::choose::perform().x + 1);
+  });
+  mpt_printf("typed %-7s : %ld\n", name, res.x);
+  mpt_assert(res.x == (resume ? 22 : -1) && destructed, name);
+}
+
+
+/*-----------------------------------------------------------------
+  testing
+-----------------------------------------------------------------*/
+
+int main() {
+  mp_config_t config = mp_config_default();
+  mp_init(&config);
+  mpt_printf("testing typed effects..\n");
+#ifdef NDEBUG
+  test_state(100000000L);
+  test_amb(16);
+#else
+  test_state(1000000L);
+  test_amb(10);
+#endif
+  test_reader();
+  test_exn();
+  test_release<tchoose_multi_def>("multi", true);
+  test_release<tchoose_multi_def>("multi", false);
+  test_release<tchoose_scoped_def>("scoped", true);
+  test_release<tchoose_scoped_def>("scoped", false);
+  mpt_printf("done.\n");
+  return 0;
+}